@@ -0,0 +1,627 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * headless benchmark of the processing core: runs images through the export pixelpipe with a few fixed
+ * history stacks, and every module of that pipe on its own, for a list of openmp thread counts.
+ * the results are printed as tab separated lines, one per measurement:
+ *
+ *   pipe    <image> <preset> <threads> <seconds> <MP/s>
+ *   module  <op> <process|process_sse2|process_avx2|process_avx512> <threads> <seconds> <MP/s> <max deviation>
+ *   kernel  <name> <stage> <threads> <seconds> <MP/s>
+ *
+ * kernels are micro-benchmarks of single building blocks of the modules, on a synthetic buffer of --size.
+ * the time is the best of all runs, to keep the numbers reproducible. the deviation is the largest absolute
+ * difference of a vectorized variant's output from the plain process() one, for float outputs.
+ */
+
+#include "common/bilateral.h"
+#include "common/darktable.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/imageio.h"
+#include "common/interpolation.h"
+#include "common/mipmap_cache.h"
+#include "control/conf.h"
+#include "develop/develop.h"
+#include "develop/format.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <float.h>
+#include <glib/gstdio.h>
+#include <libintl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_BENCH_MAX_THREADS 16
+
+typedef struct dt_bench_preset_t
+{
+  const char *name;
+  const char *ops[8]; // modules switched on in addition to the defaults
+} dt_bench_preset_t;
+
+static const dt_bench_preset_t dt_bench_presets[] = {
+  // the default pipe: for raws that's mostly rawprepare and demosaic
+  { "demosaic", { NULL } },
+  { "typical", { "exposure", "shadhi", "tonecurve", "vibrance", "sharpen", NULL } },
+  { "heavy", { "denoiseprofile", "nlmeans", "bilat", "exposure", "sharpen", NULL } },
+  // a run of point-wise modules, fused into one pass unless pixelpipe/fuse_pointwise is off
+  { "pointwise", { "exposure", "tonecurve", "colorcontrast", "vibrance", "velvia", "levels", NULL } },
+};
+
+typedef struct dt_bench_t
+{
+  int threads[DT_BENCH_MAX_THREADS];
+  int num_threads;
+  int runs;
+  float scale;
+  gboolean pipe, modules;
+} dt_bench_t;
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [--image <file>]... [--size <width>x<height>] [--scale <0..1>] [--runs <N>]\n"
+                  "  [--threads <N,N,..>] [--preset <demosaic|typical|heavy|pointwise>] [--no-pipe] [--no-modules]\n"
+                  "  [--kernel <bilateral|resample>]... [--core <darktable options>]\n"
+                  "\n"
+                  "without --image a synthetic image of the given size (default 3000x2000) is used.\n"
+                  "with --kernel only the given kernels are run, on a buffer of that size.\n",
+          progname);
+}
+
+static void _set_threads(const int threads)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+}
+
+// deterministic noise on top of smooth gradients, stored as pfm so it can be imported like any other image
+static char *_write_synthetic_image(const int width, const int height)
+{
+  char *filename = g_build_filename(darktable.tmpdir, "darktable-bench.pfm", NULL);
+  FILE *f = g_fopen(filename, "wb");
+  if(!f)
+  {
+    g_free(filename);
+    return NULL;
+  }
+  fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+  float *row = (float *)malloc(sizeof(float) * 3 * width);
+  uint32_t seed = 0x12345678u;
+  for(int j = 0; j < height; j++)
+  {
+    for(int i = 0; i < width; i++)
+      for(int c = 0; c < 3; c++)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        const float noise = ((seed >> 8) / (float)(1 << 24) - 0.5f) * 0.05f;
+        const float base = c == 0 ? i / (float)width : c == 1 ? j / (float)height
+                                                              : 0.5f + 0.4f * sinf(0.01f * (i + j));
+        row[3 * i + c] = CLAMPS(base + noise, 0.0f, 1.0f);
+      }
+    fwrite(row, sizeof(float), 3 * width, f);
+  }
+  free(row);
+  fclose(f);
+  return filename;
+}
+
+static int _import(const char *filename)
+{
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(filename);
+  const int filmid = dt_film_new(&film, directory);
+  g_free(directory);
+  return dt_image_import(filmid, filename, TRUE);
+}
+
+static void _enable_preset(dt_dev_pixelpipe_t *pipe, const dt_bench_preset_t *preset)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    for(int k = 0; preset->ops[k]; k++)
+      if(!strcmp(piece->module->op, preset->ops[k])) piece->enabled = 1;
+  }
+}
+
+// fill a module input with something that isn't just zeros
+static void _fill_buffer(void *buf, const dt_iop_buffer_dsc_t *dsc, const size_t pixels)
+{
+  const size_t values = pixels * dsc->channels;
+  uint32_t seed = 0x87654321u;
+  if(dsc->datatype == TYPE_UINT16)
+  {
+    uint16_t *out = (uint16_t *)buf;
+    for(size_t k = 0; k < values; k++) out[k] = (seed = seed * 1664525u + 1013904223u) >> 18;
+  }
+  else
+  {
+    float *out = (float *)buf;
+    for(size_t k = 0; k < values; k++) out[k] = ((seed = seed * 1664525u + 1013904223u) >> 8) / (float)(1 << 24);
+  }
+}
+
+static void _bench_modules(const dt_bench_t *bench, dt_dev_pixelpipe_t *pipe, const int width, const int height)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    if(!piece->enabled) continue;
+
+    dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f }, roi_out;
+    module->modify_roi_out(module, piece, &roi_out, &roi_in);
+    if(roi_out.width <= 0 || roi_out.height <= 0) continue;
+
+    const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(&piece->dsc_in);
+    const size_t out_bpp = MAX(dt_iop_buffer_dsc_to_bpp(&piece->dsc_out), 4 * sizeof(float));
+    // the pixelpipe only guarantees 16-byte aligned buffers (cache lines, fused strips of odd width), so
+    // hand the kernels buffers that are exactly that and no better
+    void *input_alloc = dt_alloc_align(64, in_bpp * roi_in.width * roi_in.height + 16);
+    void *output_alloc = dt_alloc_align(64, out_bpp * roi_out.width * roi_out.height + 16);
+    if(!input_alloc || !output_alloc)
+    {
+      fprintf(stderr, "[bench] could not allocate buffers for `%s'\n", module->op);
+      dt_free_align(input_alloc);
+      dt_free_align(output_alloc);
+      continue;
+    }
+    void *input = (char *)input_alloc + 16;
+    void *output = (char *)output_alloc + 16;
+    _fill_buffer(input, &piece->dsc_in, (size_t)roi_in.width * roi_in.height);
+
+    typedef void (*process_t)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                              const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                              const struct dt_iop_roi_t *const roi_out);
+    const struct
+    {
+      const char *name;
+      process_t process;
+      int available;
+    } paths[] = {
+      { "process", module->process_plain, 1 },
+      { "process_sse2", module->process_sse2, darktable.codepath.SSE2 },
+      { "process_avx2", module->process_avx2, darktable.codepath.AVX2 },
+      { "process_avx512", module->process_avx512, darktable.codepath.AVX512 },
+    };
+
+    // the plain output is the reference the vectorized variants are checked against
+    const size_t out_values
+        = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out) / sizeof(float) * roi_out.width * roi_out.height;
+    const int compare = piece->dsc_out.datatype == TYPE_FLOAT;
+    float *reference = compare ? dt_alloc_align(64, sizeof(float) * out_values) : NULL;
+
+    for(int path = 0; path < (int)(sizeof(paths) / sizeof(paths[0])); path++)
+    {
+      if(!paths[path].process || !paths[path].available) continue;
+      double deviation = 0.0;
+      for(int t = 0; t < bench->num_threads; t++)
+      {
+        _set_threads(bench->threads[t]);
+        double best = DBL_MAX;
+        for(int r = 0; r < bench->runs; r++)
+        {
+          const double start = dt_get_wtime();
+          paths[path].process(module, piece, input, output, &roi_in, &roi_out);
+          best = MIN(best, dt_get_wtime() - start);
+        }
+        if(t == 0 && reference)
+        {
+          if(path == 0)
+            memcpy(reference, output, sizeof(float) * out_values);
+          else
+            for(size_t k = 0; k < out_values; k++)
+              deviation = MAX(deviation, fabsf(((float *)output)[k] - reference[k]));
+        }
+        printf("module\t%s\t%s\t%d\t%.4f\t%.2f\t%g\n", module->op, paths[path].name, bench->threads[t], best,
+               roi_out.width * roi_out.height / 1e6 / MAX(best, 1e-9), deviation);
+        fflush(stdout);
+      }
+    }
+    dt_free_align(reference);
+    dt_free_align(input_alloc);
+    dt_free_align(output_alloc);
+  }
+}
+
+typedef double (*dt_bench_stage_t)(void *data);
+
+// best of all runs of one stage of a kernel, printed for every thread count
+static void _bench_stage(const dt_bench_t *bench, const char *kernel, const char *stage, const size_t pixels,
+                         dt_bench_stage_t run, void *data)
+{
+  for(int t = 0; t < bench->num_threads; t++)
+  {
+    _set_threads(bench->threads[t]);
+    double best = DBL_MAX;
+    for(int r = 0; r < bench->runs; r++) best = MIN(best, run(data));
+    printf("kernel\t%s\t%s\t%d\t%.4f\t%.2f\n", kernel, stage, bench->threads[t], best,
+           pixels / 1e6 / MAX(best, 1e-9));
+    fflush(stdout);
+  }
+}
+
+typedef struct dt_bench_bilateral_t
+{
+  int width, height;
+  float *in, *out;
+  dt_bilateral_t *b;
+} dt_bench_bilateral_t;
+
+static double _bilateral_splat(void *data)
+{
+  dt_bench_bilateral_t *d = (dt_bench_bilateral_t *)data;
+  // local contrast defaults
+  dt_bilateral_free(d->b);
+  d->b = dt_bilateral_init(d->width, d->height, 50.0f, 20.0f);
+  const double start = dt_get_wtime();
+  dt_bilateral_splat(d->b, d->in);
+  return dt_get_wtime() - start;
+}
+
+static double _bilateral_blur(void *data)
+{
+  dt_bench_bilateral_t *d = (dt_bench_bilateral_t *)data;
+  const double start = dt_get_wtime();
+  dt_bilateral_blur(d->b);
+  return dt_get_wtime() - start;
+}
+
+static double _bilateral_slice(void *data)
+{
+  dt_bench_bilateral_t *d = (dt_bench_bilateral_t *)data;
+  const double start = dt_get_wtime();
+  dt_bilateral_slice(d->b, d->in, d->out, -1.0f);
+  return dt_get_wtime() - start;
+}
+
+static int _bench_bilateral(const dt_bench_t *bench, const int width, const int height)
+{
+  const size_t pixels = (size_t)width * height;
+  dt_bench_bilateral_t d = { width, height, dt_alloc_align(64, sizeof(float) * 4 * pixels),
+                             dt_alloc_align(64, sizeof(float) * 4 * pixels), NULL };
+  if(!d.in || !d.out)
+  {
+    fprintf(stderr, "[bench] could not allocate buffers for the bilateral grid\n");
+    dt_free_align(d.in);
+    dt_free_align(d.out);
+    return 1;
+  }
+  const dt_iop_buffer_dsc_t dsc = { .channels = 4, .datatype = TYPE_FLOAT };
+  _fill_buffer(d.in, &dsc, pixels);
+  // the grid expects Lab
+  for(size_t k = 0; k < pixels; k++) d.in[4 * k] *= 100.0f;
+
+  _bench_stage(bench, "bilateral", "splat", pixels, _bilateral_splat, &d);
+  _bench_stage(bench, "bilateral", "blur", pixels, _bilateral_blur, &d);
+  _bench_stage(bench, "bilateral", "slice", pixels, _bilateral_slice, &d);
+
+  _set_threads(darktable.num_openmp_threads);
+  dt_bilateral_free(d.b);
+  dt_free_align(d.in);
+  dt_free_align(d.out);
+  return 0;
+}
+
+typedef struct dt_bench_resample_t
+{
+  const struct dt_interpolation *itor;
+  dt_iop_roi_t roi_in, roi_out;
+  float *in, *out;
+  gboolean cold;
+} dt_bench_resample_t;
+
+static double _resample(void *data)
+{
+  dt_bench_resample_t *d = (dt_bench_resample_t *)data;
+  // a cold run has to build its resampling plans, as every call used to
+  if(d->cold) dt_interpolation_plan_cache_flush();
+  const double start = dt_get_wtime();
+  dt_interpolation_resample(d->itor, d->out, &d->roi_out, d->roi_out.width * 4 * sizeof(float), d->in, &d->roi_in,
+                            d->roi_in.width * 4 * sizeof(float));
+  return dt_get_wtime() - start;
+}
+
+// down- and upscaling with every interpolator, throughput counted in output pixels
+static int _bench_resample(const dt_bench_t *bench, const int width, const int height)
+{
+  const float scales[] = { 0.5f, 1.5f };
+  const size_t pixels = (size_t)width * height;
+  dt_bench_resample_t d = { .roi_in = { 0, 0, width, height, 1.0f } };
+  d.in = dt_alloc_align(64, sizeof(float) * 4 * pixels);
+  d.out = dt_alloc_align(64, sizeof(float) * 4 * (size_t)(pixels * scales[1] * scales[1] + 1));
+  if(!d.in || !d.out)
+  {
+    fprintf(stderr, "[bench] could not allocate buffers for resampling\n");
+    dt_free_align(d.in);
+    dt_free_align(d.out);
+    return 1;
+  }
+  const dt_iop_buffer_dsc_t dsc = { .channels = 4, .datatype = TYPE_FLOAT };
+  _fill_buffer(d.in, &dsc, pixels);
+
+  for(int i = DT_INTERPOLATION_FIRST; i < DT_INTERPOLATION_LAST; i++)
+  {
+    d.itor = dt_interpolation_new(i);
+    for(int s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+    {
+      d.roi_out = (dt_iop_roi_t){ 0, 0, width * scales[s], height * scales[s], scales[s] };
+      const size_t out_pixels = (size_t)d.roi_out.width * d.roi_out.height;
+      for(int cold = 1; cold >= 0; cold--)
+      {
+        d.cold = cold;
+        char *stage = g_strdup_printf("%s-%s%s", d.itor->name, scales[s] < 1.0f ? "down" : "up",
+                                      cold ? "-cold" : "");
+        _bench_stage(bench, "resample", stage, out_pixels, _resample, &d);
+        g_free(stage);
+      }
+    }
+  }
+
+  _set_threads(darktable.num_openmp_threads);
+  dt_free_align(d.in);
+  dt_free_align(d.out);
+  return 0;
+}
+
+static const struct
+{
+  const char *name;
+  int (*run)(const dt_bench_t *bench, const int width, const int height);
+} dt_bench_kernels[] = {
+  { "bilateral", _bench_bilateral },
+  { "resample", _bench_resample },
+};
+
+static int _bench_image(const dt_bench_t *bench, const int imgid, const char *image_name,
+                        const dt_bench_preset_t *preset)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+  // only the preset counts, not whatever came with the image
+  dev.history_end = 0;
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  if(!buf.buf || !buf.width || !buf.height)
+  {
+    fprintf(stderr, "[bench] could not load `%s'\n", image_name);
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+
+  dt_dev_pixelpipe_t pipe;
+  if(!dt_dev_pixelpipe_init_export(&pipe, dev.image_storage.width, dev.image_storage.height,
+                                   IMAGEIO_RGB | IMAGEIO_FLOAT))
+  {
+    fprintf(stderr, "[bench] could not allocate the pixelpipe\n");
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  _enable_preset(&pipe, preset);
+  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
+                                  &pipe.processed_height);
+
+  const int width = bench->scale * pipe.processed_width + .5f;
+  const int height = bench->scale * pipe.processed_height + .5f;
+
+  // always run the pipe once, the modules need their input formats from it
+  for(int t = 0; t < bench->num_threads; t++)
+  {
+    _set_threads(bench->threads[t]);
+    double best = DBL_MAX;
+    for(int r = 0; r < (bench->pipe ? bench->runs : 1); r++)
+    {
+      dt_dev_pixelpipe_flush_caches(&pipe);
+      const double start = dt_get_wtime();
+      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, width, height, bench->scale);
+      best = MIN(best, dt_get_wtime() - start);
+    }
+    if(bench->pipe)
+    {
+      printf("pipe\t%s\t%s\t%d\t%.4f\t%.2f\n", image_name, preset->name, bench->threads[t], best,
+             width * height / 1e6 / MAX(best, 1e-9));
+      fflush(stdout);
+    }
+    if(!bench->pipe) break;
+  }
+
+  if(bench->modules) _bench_modules(bench, &pipe, width, height);
+
+  _set_threads(darktable.num_openmp_threads);
+  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  dt_dev_cleanup(&dev);
+  return 0;
+}
+
+int main(int argc, char *arg[])
+{
+  bindtextdomain(GETTEXT_PACKAGE, DARKTABLE_LOCALEDIR);
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+  textdomain(GETTEXT_PACKAGE);
+
+  if(!gtk_parse_args(&argc, &arg)) exit(1);
+
+  GList *images = NULL, *kernels = NULL;
+  int width = 3000, height = 2000;
+  const char *preset_name = NULL;
+  char *thread_list = NULL;
+  dt_bench_t bench = { { 0 }, 0, 3, 1.0f, TRUE, TRUE };
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "-h") || !strcmp(arg[k], "--help"))
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+    else if(!strcmp(arg[k], "--image") && argc > k + 1)
+      images = g_list_append(images, arg[++k]);
+    else if(!strcmp(arg[k], "--size") && argc > k + 1)
+    {
+      if(sscanf(arg[++k], "%dx%d", &width, &height) != 2 || width < 16 || height < 16)
+      {
+        usage(arg[0]);
+        exit(1);
+      }
+    }
+    else if(!strcmp(arg[k], "--scale") && argc > k + 1)
+      bench.scale = CLAMPS(atof(arg[++k]), 0.01f, 1.0f);
+    else if(!strcmp(arg[k], "--runs") && argc > k + 1)
+      bench.runs = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+      thread_list = arg[++k];
+    else if(!strcmp(arg[k], "--preset") && argc > k + 1)
+      preset_name = arg[++k];
+    else if(!strcmp(arg[k], "--no-pipe"))
+      bench.pipe = FALSE;
+    else if(!strcmp(arg[k], "--no-modules"))
+      bench.modules = FALSE;
+    else if(!strcmp(arg[k], "--kernel") && argc > k + 1)
+      kernels = g_list_append(kernels, arg[++k]);
+    else if(!strcmp(arg[k], "--core"))
+    {
+      // everything from here on should be passed to the core
+      k++;
+      break;
+    }
+    else
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+  }
+
+  // headless, cpu only and nothing written back:
+  int m_argc = 0;
+  char **m_arg = malloc((7 + argc - k + 1) * sizeof(char *));
+  m_arg[m_argc++] = "darktable-bench";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--disable-opencl";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  if(dt_init(m_argc, m_arg, FALSE, FALSE, NULL))
+  {
+    free(m_arg);
+    exit(1);
+  }
+
+  if(thread_list)
+  {
+    gchar **list = g_strsplit(thread_list, ",", DT_BENCH_MAX_THREADS);
+    for(int i = 0; list[i] && bench.num_threads < DT_BENCH_MAX_THREADS; i++)
+      if(atoi(list[i]) > 0) bench.threads[bench.num_threads++] = atoi(list[i]);
+    g_strfreev(list);
+  }
+  if(!bench.num_threads)
+  {
+    bench.threads[bench.num_threads++] = 1;
+    if(darktable.num_openmp_threads > 1) bench.threads[bench.num_threads++] = darktable.num_openmp_threads;
+  }
+
+  if(kernels)
+  {
+    int res = 0;
+    for(GList *iter = kernels; iter; iter = g_list_next(iter))
+    {
+      const char *name = (const char *)iter->data;
+      int found = 0;
+      for(int i = 0; i < sizeof(dt_bench_kernels) / sizeof(dt_bench_kernels[0]); i++)
+        if(!strcmp(name, dt_bench_kernels[i].name))
+        {
+          res |= dt_bench_kernels[i].run(&bench, width, height);
+          found = 1;
+        }
+      if(!found)
+      {
+        fprintf(stderr, "[bench] unknown kernel `%s'\n", name);
+        res = 1;
+      }
+    }
+    dt_cleanup();
+    g_list_free(kernels);
+    g_list_free(images);
+    free(m_arg);
+    return res;
+  }
+
+  char *synthetic = NULL;
+  if(!images)
+  {
+    synthetic = _write_synthetic_image(width, height);
+    if(!synthetic)
+    {
+      fprintf(stderr, "[bench] could not write the synthetic image to `%s'\n", darktable.tmpdir);
+      dt_cleanup();
+      free(m_arg);
+      exit(1);
+    }
+    images = g_list_append(images, synthetic);
+  }
+
+  int res = 0;
+  for(GList *iter = images; iter; iter = g_list_next(iter))
+  {
+    const char *filename = (const char *)iter->data;
+    const int imgid = _import(filename);
+    if(!imgid)
+    {
+      fprintf(stderr, "[bench] could not import `%s'\n", filename);
+      res = 1;
+      continue;
+    }
+    gchar *image_name = synthetic ? g_strdup_printf("synthetic-%dx%d", width, height)
+                                  : g_path_get_basename(filename);
+    for(int p = 0; p < sizeof(dt_bench_presets) / sizeof(dt_bench_presets[0]); p++)
+    {
+      if(preset_name && strcmp(preset_name, dt_bench_presets[p].name)) continue;
+      res |= _bench_image(&bench, imgid, image_name, &dt_bench_presets[p]);
+    }
+    g_free(image_name);
+  }
+
+  dt_cleanup();
+
+  if(synthetic) g_unlink(synthetic);
+  g_free(synthetic);
+  g_list_free(images);
+  free(m_arg);
+  return res;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -27,7 +27,9 @@
 
 #include "common/collection.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/debug.h"
+#include "common/dtpthread.h"
 #include "common/exif.h"
 #include "common/film.h"
 #include "common/history.h"
@@ -40,167 +42,126 @@
 #include "control/conf.h"
 #include "develop/imageop.h"
 
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <libintl.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+// one <input file> [<xmp file>] <output file> with its settings
+typedef struct dt_cli_job_t
+{
+  char *input_filename;
+  char *xmp_filename;
+  char *output_filename;
+  int width, height, bpp;
+  gboolean high_quality, upscale;
+  int line; // in the batch file, for error messages
+} dt_cli_job_t;
+
+// state shared by the threads working on a batch file
+typedef struct dt_cli_batch_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GList *jobs;         // the ones still to do
+  GHashTable *running; // input files of the jobs being worked on
+  gboolean verbose;
+  gboolean remove_images; // clean up the private in-memory library after each job
+
+  // stats
+  int done, failed, images;
+  double import_time, export_time;
+} dt_cli_batch_t;
+
 static void usage(const char *progname)
 {
   fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [--width <max width>,--height <max "
                   "height>,--bpp <bpp>,--hq <0|1|true|false>,--upscale <0|1|true|false>,--verbose] [--core <darktable options>]\n",
           progname);
+  fprintf(stderr, "       %s --batch <job file|-> [--jobs <N>] [--width <max width>,--height <max "
+                  "height>,--bpp <bpp>,--hq <0|1|true|false>,--upscale <0|1|true|false>,--verbose] [--core <darktable options>]\n"
+                  "\n"
+                  "in batch mode every line of the job file (or stdin for -) is one job in the form\n"
+                  "  <input file> [<xmp file>] <output file> [--width ..,--height ..,--bpp ..,--hq ..,--upscale ..]\n"
+                  "the options given on the command line are the defaults for all jobs. up to N jobs are processed\n"
+                  "at the same time, empty lines and lines starting with # are skipped.\n",
+          progname);
 }
 
-int main(int argc, char *arg[])
+// parse one of the per job options at arg[*k]. returns -1 if it's none of them, 1 on error and 0 otherwise.
+static int _parse_job_option(int argc, char *arg[], int *k, dt_cli_job_t *job)
 {
-  bindtextdomain(GETTEXT_PACKAGE, DARKTABLE_LOCALEDIR);
-  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
-  textdomain(GETTEXT_PACKAGE);
-
-  if(!gtk_parse_args(&argc, &arg)) exit(1);
-
-  // parse command line arguments
-  char *input_filename = NULL;
-  char *xmp_filename = NULL;
-  char *output_filename = NULL;
-  int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
-  gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE;
-
-  int k;
-  for(k = 1; k < argc; k++)
+  if(!strcmp(arg[*k], "--width") && argc > *k + 1)
   {
-    if(arg[k][0] == '-')
-    {
-      if(!strcmp(arg[k], "--help"))
-      {
-        usage(arg[0]);
-        exit(1);
-      }
-      else if(!strcmp(arg[k], "--version"))
-      {
-        printf("this is darktable-cli %s\ncopyright (c) 2012-2016 johannes hanika, tobias ellinghaus\n",
-               darktable_package_version);
-        exit(1);
-      }
-      else if(!strcmp(arg[k], "--width") && argc > k + 1)
-      {
-        k++;
-        width = MAX(atoi(arg[k]), 0);
-      }
-      else if(!strcmp(arg[k], "--height") && argc > k + 1)
-      {
-        k++;
-        height = MAX(atoi(arg[k]), 0);
-      }
-      else if(!strcmp(arg[k], "--bpp") && argc > k + 1)
-      {
-        k++;
-        bpp = MAX(atoi(arg[k]), 0);
-        fprintf(stderr, "%s %d\n",
-                _("TODO: sorry, due to API restrictions we currently cannot set the BPP to"), bpp);
-      }
-      else if(!strcmp(arg[k], "--hq") && argc > k + 1)
-      {
-        k++;
-        gchar *str = g_ascii_strup(arg[k], -1);
-        if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
-          high_quality = FALSE;
-        else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
-          high_quality = TRUE;
-        else
-        {
-          fprintf(stderr, "%s: %s\n", _("unknown option for --hq"), arg[k]);
-          usage(arg[0]);
-          exit(1);
-        }
-        g_free(str);
-      }
-      else if(!strcmp(arg[k], "--upscale") && argc > k + 1)
-      {
-        k++;
-        gchar *str = g_ascii_strup(arg[k], -1);
-        if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
-          upscale = FALSE;
-        else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
-          upscale= TRUE;
-        else
-        {
-          fprintf(stderr, "%s: %s\n", _("unknown option for --upscale"), arg[k]);
-          usage(arg[0]);
-          exit(1);
-        }
-        g_free(str);
-      }
-      else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
-      {
-        verbose = TRUE;
-      }
-      else if(!strcmp(arg[k], "--core"))
-      {
-        // everything from here on should be passed to the core
-        k++;
-        break;
-      }
-    }
-    else
-    {
-      if(file_counter == 0)
-        input_filename = arg[k];
-      else if(file_counter == 1)
-        xmp_filename = arg[k];
-      else if(file_counter == 2)
-        output_filename = arg[k];
-      file_counter++;
-    }
+    (*k)++;
+    job->width = MAX(atoi(arg[*k]), 0);
   }
-
-  int m_argc = 0;
-  char **m_arg = malloc((5 + argc - k + 1) * sizeof(char *));
-  m_arg[m_argc++] = "darktable-cli";
-  m_arg[m_argc++] = "--library";
-  m_arg[m_argc++] = ":memory:";
-  m_arg[m_argc++] = "--conf";
-  m_arg[m_argc++] = "write_sidecar_files=FALSE";
-  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
-  m_arg[m_argc] = NULL;
-
-  if(file_counter < 2 || file_counter > 3)
+  else if(!strcmp(arg[*k], "--height") && argc > *k + 1)
   {
-    usage(arg[0]);
-    free(m_arg);
-    exit(1);
+    (*k)++;
+    job->height = MAX(atoi(arg[*k]), 0);
   }
-  else if(file_counter == 2)
+  else if(!strcmp(arg[*k], "--bpp") && argc > *k + 1)
   {
-    // no xmp file given
-    output_filename = xmp_filename;
-    xmp_filename = NULL;
+    (*k)++;
+    job->bpp = MAX(atoi(arg[*k]), 0);
+    fprintf(stderr, "%s %d\n",
+            _("TODO: sorry, due to API restrictions we currently cannot set the BPP to"), job->bpp);
   }
-
-  if(g_file_test(output_filename, G_FILE_TEST_IS_DIR))
+  else if((!strcmp(arg[*k], "--hq") || !strcmp(arg[*k], "--upscale")) && argc > *k + 1)
   {
-    fprintf(stderr, _("error: output file is a directory. please specify file name"));
-    fprintf(stderr, "\n");
-    free(m_arg);
-    exit(1);
+    gboolean *value = !strcmp(arg[*k], "--hq") ? &job->high_quality : &job->upscale;
+    (*k)++;
+    gchar *str = g_ascii_strup(arg[*k], -1);
+    if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
+      *value = FALSE;
+    else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
+      *value = TRUE;
+    else
+    {
+      fprintf(stderr, "%s: %s\n", value == &job->high_quality ? _("unknown option for --hq")
+                                                              : _("unknown option for --upscale"), arg[*k]);
+      g_free(str);
+      return 1;
+    }
+    g_free(str);
   }
+  else
+    return -1;
+  return 0;
+}
 
-  // the output file already exists, so there will be a sequence number added
-  if(g_file_test(output_filename, G_FILE_TEST_EXISTS))
+// put the positional arguments in place, returns 1 if there are too few or too many
+static int _set_job_files(dt_cli_job_t *job, char **files, const int file_counter)
+{
+  if(file_counter < 2 || file_counter > 3) return 1;
+  job->input_filename = g_strdup(files[0]);
+  if(file_counter == 2)
   {
-    fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
+    // no xmp file given
+    job->output_filename = g_strdup(files[1]);
   }
-
-  // init dt without gui and without data.db:
-  if(dt_init(m_argc, m_arg, FALSE, FALSE, NULL))
+  else
   {
-    free(m_arg);
-    exit(1);
+    job->xmp_filename = g_strdup(files[1]);
+    job->output_filename = g_strdup(files[2]);
   }
+  return 0;
+}
 
-  GList *id_list = NULL;
+static void _free_job(dt_cli_job_t *job)
+{
+  g_free(job->input_filename);
+  g_free(job->xmp_filename);
+  g_free(job->output_filename);
+  g_free(job);
+}
+
+// read the images of a job into the library and attach the xmp
+static int _import_job(dt_cli_job_t *job, GList **id_list, const gboolean verbose)
+{
+  const char *input_filename = job->input_filename;
 
   if(g_file_test(input_filename, G_FILE_TEST_IS_DIR))
   {
@@ -209,10 +170,9 @@ int main(int argc, char *arg[])
     {
       fprintf(stderr, _("error: can't open folder %s"), input_filename);
       fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
+      return 1;
     }
-    id_list = dt_film_get_image_ids(filmid);
+    *id_list = dt_film_get_image_ids(filmid);
   }
   else
   {
@@ -223,35 +183,31 @@ int main(int argc, char *arg[])
     gchar *directory = g_path_get_dirname(input_filename);
     filmid = dt_film_new(&film, directory);
     id = dt_image_import(filmid, input_filename, TRUE);
+    g_free(directory);
     if(!id)
     {
       fprintf(stderr, _("error: can't open file %s"), input_filename);
       fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
+      return 1;
     }
-    g_free(directory);
 
-    id_list = g_list_append(id_list, GINT_TO_POINTER(id));
+    *id_list = g_list_append(*id_list, GINT_TO_POINTER(id));
   }
 
-  int total = g_list_length(id_list);
-
-  if(total == 0)
+  if(*id_list == NULL)
   {
     fprintf(stderr, _("no images to export, aborting\n"));
-    free(m_arg);
-    exit(1);
+    return 1;
   }
 
   // attach xmp, if requested:
-  if(xmp_filename)
+  if(job->xmp_filename)
   {
-    for(GList *iter = id_list; iter; iter = g_list_next(iter))
+    for(GList *iter = *id_list; iter; iter = g_list_next(iter))
     {
       int id = GPOINTER_TO_INT(iter->data);
       dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
-      dt_exif_xmp_read(image, xmp_filename, 1);
+      dt_exif_xmp_read(image, job->xmp_filename, 1);
       // don't write new xmp:
       dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
     }
@@ -260,14 +216,23 @@ int main(int argc, char *arg[])
   // print the history stack. only look at the first image and assume all got the same processing applied
   if(verbose)
   {
-    int id = GPOINTER_TO_INT(id_list->data);
+    int id = GPOINTER_TO_INT((*id_list)->data);
     gchar *history = dt_history_get_items_as_string(id);
     if(history)
       printf("%s\n", history);
     else
       printf("[%s]\n", _("empty history stack"));
+    g_free(history);
   }
 
+  return 0;
+}
+
+static int _export_job(dt_cli_job_t *job, GList *id_list)
+{
+  char *output_filename = job->output_filename;
+  const int total = g_list_length(id_list);
+
   // try to find out the export format from the output_filename
   char *ext = output_filename + strlen(output_filename);
   while(ext > output_filename && *ext != '.') ext--;
@@ -289,16 +254,14 @@ int main(int argc, char *arg[])
     fprintf(
         stderr, "%s\n",
         _("cannot find disk storage module. please check your installation, something seems to be broken."));
-    free(m_arg);
-    exit(1);
+    return 1;
   }
 
   sdata = storage->get_params(storage);
   if(sdata == NULL)
   {
     fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
-    free(m_arg);
-    exit(1);
+    return 1;
   }
 
   // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
@@ -311,16 +274,16 @@ int main(int argc, char *arg[])
   {
     fprintf(stderr, _("unknown extension '.%s'"), ext);
     fprintf(stderr, "\n");
-    free(m_arg);
-    exit(1);
+    storage->free_params(storage, sdata);
+    return 1;
   }
 
   fdata = format->get_params(format);
   if(fdata == NULL)
   {
     fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
-    free(m_arg);
-    exit(1);
+    storage->free_params(storage, sdata);
+    return 1;
   }
 
   uint32_t w, h, fw, fh, sw, sh;
@@ -338,8 +301,8 @@ int main(int argc, char *arg[])
   else
     h = sh < fh ? sh : fh;
 
-  fdata->max_width = width;
-  fdata->max_height = height;
+  fdata->max_width = job->width;
+  fdata->max_height = job->height;
   fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
   fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
   fdata->style[0] = '\0';
@@ -347,7 +310,7 @@ int main(int argc, char *arg[])
 
   if(storage->initialize_store)
   {
-    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, high_quality, upscale);
+    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, job->high_quality, job->upscale);
 
     format->set_params(format, fdata, format->params_size(format));
     storage->set_params(storage, sdata, storage->params_size(storage));
@@ -359,17 +322,349 @@ int main(int argc, char *arg[])
   for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
   {
     int id = GPOINTER_TO_INT(iter->data);
-    storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale);
+    storage->store(storage, sdata, id, format, fdata, num, total, job->high_quality, job->upscale);
   }
 
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
   storage->free_params(storage, sdata);
   format->free_params(format, fdata);
+
+  return 0;
+}
+
+// check the output file of a job before doing any work
+static int _check_output(const dt_cli_job_t *job)
+{
+  if(g_file_test(job->output_filename, G_FILE_TEST_IS_DIR))
+  {
+    fprintf(stderr, _("error: output file is a directory. please specify file name"));
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  // the output file already exists, so there will be a sequence number added
+  if(g_file_test(job->output_filename, G_FILE_TEST_EXISTS))
+  {
+    fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
+  }
+  return 0;
+}
+
+// read the jobs from a batch file, one per line. jobs get the settings of defaults unless they override them.
+static GList *_read_batch_file(const char *filename, const dt_cli_job_t *defaults, int *errors)
+{
+  GList *jobs = NULL;
+  FILE *f = strcmp(filename, "-") ? g_fopen(filename, "rb") : stdin;
+  if(!f)
+  {
+    fprintf(stderr, _("error: can't open batch file %s"), filename);
+    fprintf(stderr, "\n");
+    (*errors)++;
+    return NULL;
+  }
+
+  char line[4 * PATH_MAX];
+  int lineno = 0;
+  while(fgets(line, sizeof(line), f))
+  {
+    lineno++;
+    g_strstrip(line);
+    if(line[0] == '\0' || line[0] == '#') continue;
+
+    gint argc = 0;
+    gchar **argv = NULL;
+    GError *error = NULL;
+    if(!g_shell_parse_argv(line, &argc, &argv, &error))
+    {
+      fprintf(stderr, _("error: can't parse line %d of the batch file: %s"), lineno, error->message);
+      fprintf(stderr, "\n");
+      g_clear_error(&error);
+      (*errors)++;
+      continue;
+    }
+
+    dt_cli_job_t *job = (dt_cli_job_t *)g_malloc0(sizeof(dt_cli_job_t));
+    job->width = defaults->width;
+    job->height = defaults->height;
+    job->bpp = defaults->bpp;
+    job->high_quality = defaults->high_quality;
+    job->upscale = defaults->upscale;
+    job->line = lineno;
+
+    char *files[3];
+    int file_counter = 0;
+    int res = 0;
+    for(int k = 0; k < argc && !res; k++)
+    {
+      if(argv[k][0] == '-')
+      {
+        res = _parse_job_option(argc, argv, &k, job);
+        if(res < 0) fprintf(stderr, _("error: unknown option %s"), argv[k]);
+      }
+      else if(file_counter < 3)
+        files[file_counter++] = argv[k];
+      else
+        file_counter++;
+    }
+    if(!res && _set_job_files(job, files, file_counter))
+    {
+      fprintf(stderr, _("error: expected <input file> [<xmp file>] <output file>"));
+      res = 1;
+    }
+    if(res)
+    {
+      fprintf(stderr, " (line %d)\n", lineno);
+      _free_job(job);
+      (*errors)++;
+    }
+    else
+      jobs = g_list_prepend(jobs, job);
+    g_strfreev(argv);
+  }
+
+  if(f != stdin) fclose(f);
+  return g_list_reverse(jobs);
+}
+
+static void *_batch_worker(void *data)
+{
+  dt_cli_batch_t *batch = (dt_cli_batch_t *)data;
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+
+  dt_pthread_mutex_lock(&batch->mutex);
+  while(batch->jobs)
+  {
+    // jobs on the same input share the image in the library, so they can't run at the same time
+    GList *iter = batch->jobs;
+    while(iter && g_hash_table_contains(batch->running, ((dt_cli_job_t *)iter->data)->input_filename))
+      iter = g_list_next(iter);
+    if(!iter)
+    {
+      dt_pthread_cond_wait(&batch->cond, &batch->mutex);
+      continue;
+    }
+    dt_cli_job_t *job = (dt_cli_job_t *)iter->data;
+    batch->jobs = g_list_delete_link(batch->jobs, iter);
+    g_hash_table_add(batch->running, job->input_filename);
+
+    // importing writes to the library, do one at a time
+    GList *id_list = NULL;
+    const double start = dt_get_wtime();
+    int res = _check_output(job) || _import_job(job, &id_list, batch->verbose);
+    const double imported = dt_get_wtime();
+    const int images = g_list_length(id_list);
+    dt_pthread_mutex_unlock(&batch->mutex);
+
+    if(!res) res = _export_job(job, id_list);
+    const double exported = dt_get_wtime();
+
+    dt_pthread_mutex_lock(&batch->mutex);
+    // so the next job on the same input starts from scratch
+    if(batch->remove_images)
+      for(GList *i = id_list; i; i = g_list_next(i)) dt_image_remove(GPOINTER_TO_INT(i->data));
+    g_list_free(id_list);
+
+    if(res)
+    {
+      fprintf(stderr, _("error: job on line %d failed"), job->line);
+      fprintf(stderr, "\n");
+      batch->failed++;
+    }
+    else
+    {
+      batch->done++;
+      batch->images += images;
+    }
+    batch->import_time += imported - start;
+    batch->export_time += exported - imported;
+    dt_print(DT_DEBUG_PERF, "[batch] line %d: %d images, import %.3f secs, export %.3f secs\n", job->line, images,
+             imported - start, exported - imported);
+
+    g_hash_table_remove(batch->running, job->input_filename);
+    _free_job(job);
+    pthread_cond_broadcast(&batch->cond);
+  }
+  dt_pthread_mutex_unlock(&batch->mutex);
+  return NULL;
+}
+
+static int _run_batch(const char *filename, const dt_cli_job_t *defaults, const int threads,
+                      const gboolean verbose, const double init_time)
+{
+  dt_cli_batch_t batch = { 0 };
+  int errors = 0;
+  batch.jobs = _read_batch_file(filename, defaults, &errors);
+  batch.running = g_hash_table_new(g_str_hash, g_str_equal);
+  batch.verbose = verbose;
+  // only clean up the library if it's our own
+  batch.remove_images = !strcmp(dt_database_get_path(darktable.db), ":memory:");
+  dt_pthread_mutex_init(&batch.mutex, NULL);
+  pthread_cond_init(&batch.cond, NULL);
+
+  const double start = dt_get_wtime();
+  const int workers = CLAMP(threads, 1, MAX(1, g_list_length(batch.jobs)));
+  darktable.num_openmp_threads = MAX(1, darktable.num_openmp_threads / workers);
+
+  // the main thread is the first worker
+  pthread_t *thread = (pthread_t *)calloc(workers, sizeof(pthread_t));
+  int started = 0;
+  for(int k = 1; k < workers; k++)
+    if(!dt_pthread_create(&thread[started], _batch_worker, &batch)) started++;
+  _batch_worker(&batch);
+  for(int k = 0; k < started; k++) pthread_join(thread[k], NULL);
+  free(thread);
+
+  const double total = dt_get_wtime() - start;
+  fprintf(stderr, "[batch] %d jobs done, %d failed, %d invalid lines, %d images in %.3f secs using %d threads"
+                  " (%.2f images/s)\n",
+          batch.done, batch.failed, errors, batch.images, total, started + 1, batch.images / MAX(total, 1e-3));
+  fprintf(stderr, "[batch] init %.3f secs, import %.3f secs, export %.3f secs (summed over all threads,"
+                  " %.3f secs per image)\n",
+          init_time, batch.import_time, batch.export_time,
+          (batch.import_time + batch.export_time) / MAX(batch.images, 1));
+
+  pthread_cond_destroy(&batch.cond);
+  dt_pthread_mutex_destroy(&batch.mutex);
+  g_hash_table_destroy(batch.running);
+  return batch.failed || errors;
+}
+
+int main(int argc, char *arg[])
+{
+  bindtextdomain(GETTEXT_PACKAGE, DARKTABLE_LOCALEDIR);
+  bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
+  textdomain(GETTEXT_PACKAGE);
+
+  if(!gtk_parse_args(&argc, &arg)) exit(1);
+
+  // parse command line arguments
+  dt_cli_job_t job = { 0 };
+  job.high_quality = TRUE;
+  char *files[3] = { NULL };
+  int file_counter = 0;
+  gboolean verbose = FALSE;
+  char *batch_filename = NULL;
+  int threads = 1;
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(arg[k][0] == '-')
+    {
+      if(!strcmp(arg[k], "--help"))
+      {
+        usage(arg[0]);
+        exit(1);
+      }
+      else if(!strcmp(arg[k], "--version"))
+      {
+        printf("this is darktable-cli %s\ncopyright (c) 2012-2016 johannes hanika, tobias ellinghaus\n",
+               darktable_package_version);
+        exit(1);
+      }
+      else if(!strcmp(arg[k], "--batch") && argc > k + 1)
+      {
+        k++;
+        batch_filename = arg[k];
+      }
+      else if(!strcmp(arg[k], "--jobs") && argc > k + 1)
+      {
+        k++;
+        threads = CLAMP(atoi(arg[k]), 1, 64);
+      }
+      else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
+      {
+        verbose = TRUE;
+      }
+      else if(!strcmp(arg[k], "--core"))
+      {
+        // everything from here on should be passed to the core
+        k++;
+        break;
+      }
+      else if(_parse_job_option(argc, arg, &k, &job) > 0)
+      {
+        usage(arg[0]);
+        exit(1);
+      }
+    }
+    else
+    {
+      if(file_counter < 3) files[file_counter] = arg[k];
+      file_counter++;
+    }
+  }
+
+  int m_argc = 0;
+  char **m_arg = malloc((5 + argc - k + 1) * sizeof(char *));
+  m_arg[m_argc++] = "darktable-cli";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  if(batch_filename)
+  {
+    if(file_counter)
+    {
+      usage(arg[0]);
+      free(m_arg);
+      exit(1);
+    }
+
+    // one initialization for all the jobs
+    const double start = dt_get_wtime();
+    if(dt_init(m_argc, m_arg, FALSE, FALSE, NULL))
+    {
+      free(m_arg);
+      exit(1);
+    }
+    const int res = _run_batch(batch_filename, &job, threads, verbose, dt_get_wtime() - start);
+
+    dt_cleanup();
+
+    free(m_arg);
+    return res;
+  }
+
+  if(_set_job_files(&job, files, file_counter))
+  {
+    usage(arg[0]);
+    free(m_arg);
+    exit(1);
+  }
+
+  if(_check_output(&job))
+  {
+    free(m_arg);
+    exit(1);
+  }
+
+  // init dt without gui and without data.db:
+  if(dt_init(m_argc, m_arg, FALSE, FALSE, NULL))
+  {
+    free(m_arg);
+    exit(1);
+  }
+
+  GList *id_list = NULL;
+  if(_import_job(&job, &id_list, verbose) || _export_job(&job, id_list))
+  {
+    free(m_arg);
+    exit(1);
+  }
   g_list_free(id_list);
 
   dt_cleanup();
 
+  g_free(job.input_filename);
+  g_free(job.xmp_filename);
+  g_free(job.output_filename);
   free(m_arg);
 }
 
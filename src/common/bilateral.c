@@ -22,6 +22,9 @@
 #include <math.h>             // for roundf
 #include <stdlib.h>           // for size_t, free, malloc, NULL
 #include <string.h>           // for memset
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // these clamp away insane memory requirements.
 // they should reasonably faithfully represent the
@@ -120,48 +123,138 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   return b;
 }
 
-void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
+// grid cell and weight of each image column (or row), these only depend on the position
+static void grid_coords(const int n, const float sigma, const size_t size, int *idx, float *frac)
+{
+  for(int i = 0; i < n; i++)
+  {
+    const float x = CLAMPS(i / sigma, 0, size - 1);
+    idx[i] = MIN((int)x, size - 2);
+    frac[i] = x - idx[i];
+  }
+}
+
+// splat the pixels [i0, i1) of row j into buf. no atomics, the caller makes sure nobody else writes
+// to the same grid cells at the same time.
+static inline void splat_row(const dt_bilateral_t *const b, const float *const in, float *const buf,
+                             const int *const xi, const float *const xf, const int yi, const float yf, const int j,
+                             const int i0, const int i1)
 {
   const int ox = 1;
   const int oy = b->size_x;
   const int oz = b->size_y * b->size_x;
-// splat into downsampled grid
+  const float norm = 100.0f / (b->sigma_s * b->sigma_s);
+  const float *const row = in + (size_t)4 * j * b->width;
+  for(int i = i0; i < i1; i++)
+  {
+    const float L = row[4 * i];
+    const float z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
+    const int zi = MIN((int)z, b->size_z - 2);
+    const float zf = z - zi;
+    // nearest neighbour splatting:
+    const size_t gi = xi[i] + b->size_x * (yi + b->size_y * zi);
+    // sum up payload here, doesn't have to be same as edge stopping data
+    // for cross bilateral applications.
+    // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
+    // should not cause clipping here.
+    const float wx[2] = { 1.0f - xf[i], xf[i] };
+    const float wy[2] = { (1.0f - yf) * norm, yf * norm };
+    const float wz[2] = { 1.0f - zf, zf };
+    for(int k = 0; k < 8; k++)
+      buf[gi + ((k & 1) ? ox : 0) + ((k & 2) ? oy : 0) + ((k & 4) ? oz : 0)]
+          += wx[k & 1] * wy[(k >> 1) & 1] * wz[k >> 2];
+  }
+}
+
+// image rows and columns that fall into grid cell c are [start[c], start[c+1])
+static void cell_starts(const int n, const int *const idx, const int cells, int *start)
+{
+  int i = 0;
+  for(int c = 0; c <= cells; c++)
+  {
+    while(i < n && idx[i] < c) i++;
+    start[c] = i;
+  }
+}
+
+void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
+{
+  int *const xi = (int *)malloc(sizeof(int) * b->width);
+  float *const xf = (float *)malloc(sizeof(float) * b->width);
+  int *const yi = (int *)malloc(sizeof(int) * b->height);
+  float *const yf = (float *)malloc(sizeof(float) * b->height);
+  grid_coords(b->width, b->sigma_s, b->size_x, xi, xf);
+  grid_coords(b->height, b->sigma_s, b->size_y, yi, yf);
+
+  // a pixel in grid cell (x, y) only touches the grid at x..x+1 and y..y+1. so all cells with the same
+  // parity in x and y can be splatted concurrently without atomics, in four passes.
+  const int cells_x = b->size_x - 1;
+  const int cells_y = b->size_y - 1;
+  const int tiles = ((cells_x + 1) / 2) * ((cells_y + 1) / 2);
+  const int nthreads = omp_get_max_threads();
+
+  if(tiles >= 4 * nthreads)
+  {
+    int *const x_start = (int *)malloc(sizeof(int) * (cells_x + 1));
+    int *const y_start = (int *)malloc(sizeof(int) * (cells_y + 1));
+    cell_starts(b->width, xi, cells_x, x_start);
+    cell_starts(b->height, yi, cells_y, y_start);
+
+    for(int pass = 0; pass < 4; pass++)
+    {
+      const int px = pass & 1, py = pass >> 1;
+      const int tiles_x = (cells_x - px + 1) / 2;
+      const int tiles_y = (cells_y - py + 1) / 2;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) shared(b)
+#pragma omp parallel for default(none) shared(b, x_start, y_start) schedule(dynamic, 1)
 #endif
-  for(int j = 0; j < b->height; j++)
+      for(int t = 0; t < tiles_x * tiles_y; t++)
+      {
+        const int cx = px + 2 * (t % tiles_x);
+        const int cy = py + 2 * (t / tiles_x);
+        for(int j = y_start[cy]; j < y_start[cy + 1]; j++)
+          splat_row(b, in, b->buf, xi, xf, yi[j], yf[j], j, x_start[cx], x_start[cx + 1]);
+      }
+    }
+    free(x_start);
+    free(y_start);
+  }
+  else
   {
-    size_t index = 4 * j * b->width;
-    for(int i = 0; i < b->width; i++)
+    // coarse grid, so too few cells to keep all threads busy: but then it's small enough to give each
+    // thread a private copy, which are summed up afterwards.
+    const size_t size = b->size_x * b->size_y * b->size_z;
+    float *const grids = dt_alloc_align(64, sizeof(float) * size * nthreads);
+    if(!grids)
     {
-      float x, y, z;
-      const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      const int xi = MIN((int)x, b->size_x - 2);
-      const int yi = MIN((int)y, b->size_y - 2);
-      const int zi = MIN((int)z, b->size_z - 2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      // nearest neighbour splatting:
-      const size_t grid_index = xi + b->size_x * (yi + b->size_y * zi);
-      // sum up payload here, doesn't have to be same as edge stopping data
-      // for cross bilateral applications.
-      // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
-      // should not cause clipping here.
-      for(int k = 0; k < 8; k++)
-      {
-        const size_t ii = grid_index + ((k & 1) ? ox : 0) + ((k & 2) ? oy : 0) + ((k & 4) ? oz : 0);
-        const float contrib = ((k & 1) ? xf : (1.0f - xf)) * ((k & 2) ? yf : (1.0f - yf))
-                              * ((k & 4) ? zf : (1.0f - zf)) * 100.0f / (b->sigma_s * b->sigma_s);
+      // with many threads the copies add up, so without the memory for them splat them one after the other
+      for(int j = 0; j < b->height; j++) splat_row(b, in, b->buf, xi, xf, yi[j], yf[j], j, 0, b->width);
+      goto done;
+    }
+    memset(grids, 0, sizeof(float) * size * nthreads);
 #ifdef _OPENMP
-#pragma omp atomic
+#pragma omp parallel for default(none) shared(b) schedule(static)
 #endif
-        b->buf[ii] += contrib;
-      }
-      index += 4;
+    for(int j = 0; j < b->height; j++)
+      splat_row(b, in, grids + size * dt_get_thread_num(), xi, xf, yi[j], yf[j], j, 0, b->width);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(b) schedule(static)
+#endif
+    for(size_t k = 0; k < size; k++)
+    {
+      float sum = 0.0f;
+      for(int t = 0; t < nthreads; t++) sum += grids[size * t + k];
+      b->buf[k] += sum;
     }
+    dt_free_align(grids);
   }
+
+done:
+  free(xi);
+  free(xf);
+  free(yi);
+  free(yf);
 }
 
 static void blur_line_z(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
@@ -252,90 +345,193 @@ void dt_bilateral_blur(dt_bilateral_t *b)
 }
 
 
-void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, float *out, const float detail)
+// to_output == 0: out = in with L replaced by the detail adjusted one.
+// to_output == 1: only add the detail to L of what's already in out.
+static void slice_plain(const dt_bilateral_t *const b, const float *const in, float *out, const float norm,
+                        const int to_output)
 {
-  // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
-  const float norm = -detail * b->sigma_r * 0.04f;
   const int ox = 1;
   const int oy = b->size_x;
   const int oz = b->size_y * b->size_x;
+  int *const xi = (int *)malloc(sizeof(int) * b->width);
+  float *const xf = (float *)malloc(sizeof(float) * b->width);
+  grid_coords(b->width, b->sigma_s, b->size_x, xi, xf);
 #ifdef _OPENMP
-#pragma omp parallel for default(none) shared(out)
+#pragma omp parallel for default(none) shared(out) schedule(static)
 #endif
   for(int j = 0; j < b->height; j++)
   {
-    size_t index = 4 * j * b->width;
-    for(int i = 0; i < b->width; i++)
+    float y;
+    {
+      float x, z;
+      image_to_grid(b, 0, j, 0.0f, &x, &y, &z);
+    }
+    const int yi = MIN((int)y, b->size_y - 2);
+    const float yf = y - yi;
+    size_t index = (size_t)4 * j * b->width;
+    for(int i = 0; i < b->width; i++, index += 4)
     {
-      float x, y, z;
       const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
+      const float z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
       // trilinear lookup:
-      const int xi = MIN((int)x, b->size_x - 2);
-      const int yi = MIN((int)y, b->size_y - 2);
       const int zi = MIN((int)z, b->size_z - 2);
-      const float xf = x - xi;
-      const float yf = y - yi;
       const float zf = z - zi;
-      const size_t gi = xi + b->size_x * (yi + b->size_y * zi);
-      const float Lout = L
-                         + norm * (b->buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                   + b->buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                   + b->buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                   + b->buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                   + b->buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                   + b->buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                   + b->buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                   + b->buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
-      out[index] = Lout;
-      // and copy color and mask
-      out[index + 1] = in[index + 1];
-      out[index + 2] = in[index + 2];
-      out[index + 3] = in[index + 3];
-      index += 4;
+      const size_t gi = xi[i] + b->size_x * (yi + b->size_y * zi);
+      const float xw = xf[i];
+      const float Lout = norm * (b->buf[gi] * (1.0f - xw) * (1.0f - yf) * (1.0f - zf)
+                                 + b->buf[gi + ox] * (xw) * (1.0f - yf) * (1.0f - zf)
+                                 + b->buf[gi + oy] * (1.0f - xw) * (yf) * (1.0f - zf)
+                                 + b->buf[gi + ox + oy] * (xw) * (yf) * (1.0f - zf)
+                                 + b->buf[gi + oz] * (1.0f - xw) * (1.0f - yf) * (zf)
+                                 + b->buf[gi + ox + oz] * (xw) * (1.0f - yf) * (zf)
+                                 + b->buf[gi + oy + oz] * (1.0f - xw) * (yf) * (zf)
+                                 + b->buf[gi + ox + oy + oz] * (xw) * (yf) * (zf));
+      if(to_output)
+        out[index] = MAX(0.0f, out[index] + Lout);
+      else
+      {
+        out[index] = L + Lout;
+        // and copy color and mask
+        out[index + 1] = in[index + 1];
+        out[index + 2] = in[index + 2];
+        out[index + 3] = in[index + 3];
+      }
     }
   }
+  free(xi);
+  free(xf);
 }
 
-void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *const in, float *out,
-                                  const float detail)
+#if defined(__SSE2__)
+// trilinear lookup for four consecutive pixels of a row: the grid reads stay scalar, the coordinates and
+// the interpolation are done four at a time.
+static inline __m128 slice_4_sse2(const dt_bilateral_t *const b, const __m128 L, const int *const xi,
+                                  const __m128 xf, const int yi, const __m128 yf)
 {
-  // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
-  const float norm = -detail * b->sigma_r * 0.04f;
   const int ox = 1;
   const int oy = b->size_x;
   const int oz = b->size_y * b->size_x;
+  const __m128 z = _mm_min_ps(_mm_max_ps(_mm_div_ps(L, _mm_set1_ps(b->sigma_r)), _mm_setzero_ps()),
+                              _mm_set1_ps(b->size_z - 1.0f));
+  const __m128 zi = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(z)), _mm_set1_ps(b->size_z - 2.0f));
+  const __m128 zf = _mm_sub_ps(z, zi);
+  int zis[4];
+  _mm_storeu_si128((__m128i *)zis, _mm_cvttps_epi32(zi));
+
+  float c[8][4];
+  for(int p = 0; p < 4; p++)
+  {
+    const float *const g = b->buf + xi[p] + b->size_x * (yi + b->size_y * zis[p]);
+    c[0][p] = g[0];
+    c[1][p] = g[ox];
+    c[2][p] = g[oy];
+    c[3][p] = g[ox + oy];
+    c[4][p] = g[oz];
+    c[5][p] = g[ox + oz];
+    c[6][p] = g[oy + oz];
+    c[7][p] = g[ox + oy + oz];
+  }
+#define LERP(A, B, T) _mm_add_ps((A), _mm_mul_ps((T), _mm_sub_ps((B), (A))))
+  const __m128 c00 = LERP(_mm_loadu_ps(c[0]), _mm_loadu_ps(c[1]), xf);
+  const __m128 c10 = LERP(_mm_loadu_ps(c[2]), _mm_loadu_ps(c[3]), xf);
+  const __m128 c01 = LERP(_mm_loadu_ps(c[4]), _mm_loadu_ps(c[5]), xf);
+  const __m128 c11 = LERP(_mm_loadu_ps(c[6]), _mm_loadu_ps(c[7]), xf);
+  const __m128 res = LERP(LERP(c00, c10, yf), LERP(c01, c11, yf), zf);
+#undef LERP
+  return res;
+}
+
+static void slice_sse2(const dt_bilateral_t *const b, const float *const in, float *out, const float norm,
+                       const int to_output)
+{
+  int *const xi = (int *)malloc(sizeof(int) * b->width);
+  float *const xf = (float *)malloc(sizeof(float) * b->width);
+  grid_coords(b->width, b->sigma_s, b->size_x, xi, xf);
 #ifdef _OPENMP
-#pragma omp parallel for default(none) shared(out)
+#pragma omp parallel for default(none) shared(out) schedule(static)
 #endif
   for(int j = 0; j < b->height; j++)
   {
-    size_t index = 4 * j * b->width;
-    for(int i = 0; i < b->width; i++)
+    float y;
     {
-      float x, y, z;
-      const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
-      // trilinear lookup:
-      const int xi = MIN((int)x, b->size_x - 2);
-      const int yi = MIN((int)y, b->size_y - 2);
-      const int zi = MIN((int)z, b->size_z - 2);
-      const float xf = x - xi;
-      const float yf = y - yi;
-      const float zf = z - zi;
-      const size_t gi = xi + b->size_x * (yi + b->size_y * zi);
-      const float Lout = norm * (b->buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
-                                 + b->buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
-                                 + b->buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
-                                 + b->buf[gi + ox + oy] * (xf) * (yf) * (1.0f - zf)
-                                 + b->buf[gi + oz] * (1.0f - xf) * (1.0f - yf) * (zf)
-                                 + b->buf[gi + ox + oz] * (xf) * (1.0f - yf) * (zf)
-                                 + b->buf[gi + oy + oz] * (1.0f - xf) * (yf) * (zf)
-                                 + b->buf[gi + ox + oy + oz] * (xf) * (yf) * (zf));
-      out[index] = MAX(0.0f, out[index] + Lout);
-      index += 4;
+      float x, z;
+      image_to_grid(b, 0, j, 0.0f, &x, &y, &z);
+    }
+    const int yi = MIN((int)y, b->size_y - 2);
+    const __m128 yf = _mm_set1_ps(y - yi);
+    const __m128 vnorm = _mm_set1_ps(norm);
+    const float *const row_in = in + (size_t)4 * j * b->width;
+    float *const row_out = out + (size_t)4 * j * b->width;
+    int i = 0;
+    for(; i + 4 <= b->width; i += 4)
+    {
+      const float *const px = row_in + 4 * i;
+      float *const po = row_out + 4 * i;
+      const __m128 L = _mm_set_ps(px[12], px[8], px[4], px[0]);
+      const __m128 detail = _mm_mul_ps(vnorm, slice_4_sse2(b, L, xi + i, _mm_loadu_ps(xf + i), yi, yf));
+      float Lout[4];
+      if(to_output)
+      {
+        const __m128 Lo = _mm_set_ps(po[12], po[8], po[4], po[0]);
+        _mm_storeu_ps(Lout, _mm_max_ps(_mm_add_ps(Lo, detail), _mm_setzero_ps()));
+        for(int p = 0; p < 4; p++) po[4 * p] = Lout[p];
+      }
+      else
+      {
+        _mm_storeu_ps(Lout, _mm_add_ps(L, detail));
+        // copy color and mask along with the new L
+        for(int p = 0; p < 4; p++)
+          _mm_store_ps(po + 4 * p, _mm_move_ss(_mm_load_ps(px + 4 * p), _mm_set_ss(Lout[p])));
+      }
+    }
+    // the few remaining pixels of the row
+    for(; i < b->width; i++)
+    {
+      const float *const px = row_in + 4 * i;
+      float *const po = row_out + 4 * i;
+      const int xi4[4] = { xi[i], xi[i], xi[i], xi[i] };
+      float Lout[4];
+      _mm_storeu_ps(Lout, _mm_mul_ps(vnorm, slice_4_sse2(b, _mm_set1_ps(px[0]), xi4, _mm_set1_ps(xf[i]), yi, yf)));
+      if(to_output)
+        po[0] = MAX(0.0f, po[0] + Lout[0]);
+      else
+      {
+        po[0] = px[0] + Lout[0];
+        po[1] = px[1];
+        po[2] = px[2];
+        po[3] = px[3];
+      }
     }
   }
+  free(xi);
+  free(xf);
+}
+#endif
+
+static void slice(const dt_bilateral_t *const b, const float *const in, float *out, const float detail,
+                  const int to_output)
+{
+  // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
+  const float norm = -detail * b->sigma_r * 0.04f;
+  if(darktable.codepath.OPENMP_SIMD)
+    slice_plain(b, in, out, norm, to_output);
+#if defined(__SSE2__)
+  else if(darktable.codepath.SSE2)
+    slice_sse2(b, in, out, norm, to_output);
+#endif
+  else
+    dt_unreachable_codepath();
+}
+
+void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, float *out, const float detail)
+{
+  slice(b, in, out, detail, 0);
+}
+
+void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *const in, float *out,
+                                  const float detail)
+{
+  slice(b, in, out, detail, 1);
 }
 
 void dt_bilateral_free(dt_bilateral_t *b)
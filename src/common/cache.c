@@ -26,56 +26,133 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache. the keys are spread over a number of
+// independently locked segments, each of which is a plain hashtable + lru list.
 
-void dt_cache_init(
+static inline dt_cache_segment_t *_cache_segment(const dt_cache_t *cache, const uint32_t key)
+{
+  // keys are image ids (plus mip level in the high bits), so they are dense. mix them up a bit
+  // (fibonacci hashing) so consecutive images end up in different segments.
+  const uint32_t h = key * 2654435761u;
+  return cache->segments + ((h >> 16) & (cache->num_segments - 1));
+}
+
+static inline void _cache_segment_lock(dt_cache_segment_t *segment)
+{
+  if(dt_pthread_mutex_trylock(&segment->lock))
+  {
+    dt_pthread_mutex_lock(&segment->lock);
+    segment->contended++;
+  }
+  segment->lookups++;
+}
+
+void dt_cache_init_segmented(
     dt_cache_t *cache,
     size_t entry_size,
-    size_t cost_quota)
+    size_t cost_quota,
+    uint32_t segments)
 {
-  cache->cost = 0;
-  cache->lru = 0;
+  uint32_t num = 1;
+  while(num < segments) num <<= 1;
+
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
+  cache->num_segments = num;
+  cache->segments = (dt_cache_segment_t *)calloc(num, sizeof(dt_cache_segment_t));
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+  for(uint32_t k = 0; k < num; k++)
+  {
+    dt_cache_segment_t *segment = cache->segments + k;
+    dt_pthread_mutex_init(&segment->lock, 0);
+    segment->cost = 0;
+    // spread the quota, the first segments get the remainder:
+    segment->cost_quota = cost_quota / num + (k < cost_quota % num ? 1 : 0);
+    segment->hashtable = g_hash_table_new(0, 0);
+    segment->lru = 0;
+    segment->lookups = 0;
+    segment->contended = 0;
+  }
+}
+
+void dt_cache_init(
+    dt_cache_t *cache,
+    size_t entry_size,
+    size_t cost_quota)
+{
+  dt_cache_init_segmented(cache, entry_size, cost_quota, 1);
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  GList *l = cache->lru;
-  while(l)
+  for(uint32_t k = 0; k < cache->num_segments; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-
-    if(cache->cleanup)
+    dt_cache_segment_t *segment = cache->segments + k;
+    g_hash_table_destroy(segment->hashtable);
+    GList *l = segment->lru;
+    while(l)
     {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
 
-      cache->cleanup(cache->cleanup_data, entry);
+      if(cache->cleanup)
+      {
+        assert(entry->data_size);
+        ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+        cache->cleanup(cache->cleanup_data, entry);
+      }
+      else
+        dt_free_align(entry->data);
+
+      dt_pthread_rwlock_destroy(&entry->lock);
+      g_slice_free1(sizeof(*entry), entry);
+      l = g_list_next(l);
     }
-    else
-      dt_free_align(entry->data);
+    g_list_free(segment->lru);
+    dt_pthread_mutex_destroy(&segment->lock);
+  }
+  free(cache->segments);
+  cache->segments = NULL;
+  cache->num_segments = 0;
+}
 
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
-    l = g_list_next(l);
+size_t dt_cache_get_cost(dt_cache_t *cache)
+{
+  size_t cost = 0;
+  for(uint32_t k = 0; k < cache->num_segments; k++)
+  {
+    dt_cache_segment_t *segment = cache->segments + k;
+    dt_pthread_mutex_lock(&segment->lock);
+    cost += segment->cost;
+    dt_pthread_mutex_unlock(&segment->lock);
+  }
+  return cost;
+}
+
+void dt_cache_print_contention(dt_cache_t *cache, const char *name)
+{
+  uint64_t lookups = 0, contended = 0;
+  for(uint32_t k = 0; k < cache->num_segments; k++)
+  {
+    dt_cache_segment_t *segment = cache->segments + k;
+    dt_pthread_mutex_lock(&segment->lock);
+    lookups += segment->lookups;
+    contended += segment->contended;
+    dt_pthread_mutex_unlock(&segment->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
+  printf("[%s] %u segments, %" PRIu64 " lookups, %" PRIu64 " contended (%.2f%%)\n", name, cache->num_segments,
+         lookups, contended, lookups ? 100.0 * contended / lookups : 0.0);
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_segment_t *segment = _cache_segment(cache, key);
+  _cache_segment_lock(segment);
+  int32_t result = g_hash_table_contains(segment->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&segment->lock);
   return result;
 }
 
@@ -84,22 +161,26 @@ int dt_cache_for_all(
     int (*process)(const uint32_t key, const void *data, void *user_data),
     void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for(uint32_t k = 0; k < cache->num_segments; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_segment_t *segment = cache->segments + k;
+    dt_pthread_mutex_lock(&segment->lock);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, segment->hashtable);
+    while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&segment->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&segment->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
@@ -111,9 +192,10 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
   gboolean res;
   int result;
   double start = dt_get_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_cache_segment_t *segment = _cache_segment(cache, key);
+  _cache_segment_lock(segment);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      segment->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -123,13 +205,13 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&segment->lock);
       return 0;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    segment->lru = g_list_remove_link(segment->lru, entry->link);
+    segment->lru = g_list_concat(segment->lru, entry->link);
+    dt_pthread_mutex_unlock(&segment->lock);
     double end = dt_get_wtime();
     if(end - start > 0.1)
       fprintf(stderr, "try+ wait time %.06fs mode %c \n", end - start, mode);
@@ -144,13 +226,15 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&segment->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "try- wait time %.06fs\n", end - start);
   return 0;
 }
 
+static void _cache_segment_gc(dt_cache_t *cache, dt_cache_segment_t *segment, const float fill_ratio);
+
 // if found, the data void* is returned. if not, it is set to be
 // the given *data and a new hash table entry is created, which can be
 // found using the given key later on.
@@ -160,10 +244,11 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key
   gboolean res;
   int result;
   double start = dt_get_wtime();
+  dt_cache_segment_t *segment = _cache_segment(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  _cache_segment_lock(segment);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      segment->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   { // yay, found. read lock and pass on.
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -172,14 +257,14 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&segment->lock);
       g_usleep(5);
       goto restart;
     }
     // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    segment->lru = g_list_remove_link(segment->lru, entry->link);
+    segment->lru = g_list_concat(segment->lru, entry->link);
+    dt_pthread_mutex_unlock(&segment->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -208,10 +293,10 @@ restart:
 
   // first try to clean up.
   // also wait if we can't free more than the requested fill ratio.
-  if(cache->cost > 0.8f * cache->cost_quota)
+  if(segment->cost > 0.8f * segment->cost_quota)
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _cache_segment_gc(cache, segment, 0.8f);
   }
 
   // here dies your 32-bit system:
@@ -225,7 +310,7 @@ restart:
   entry->key = key;
   entry->_lock_demoting = 0;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(segment->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -244,12 +329,12 @@ restart:
   if(write) dt_pthread_rwlock_wrlock_with_caller(&entry->lock, file, line);
   else      dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  segment->cost += entry->cost;
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  segment->lru = g_list_concat(segment->lru, entry->link);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&segment->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "wait time %.06fs\n", end - start);
@@ -265,22 +350,23 @@ int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
   gboolean res;
   int result;
   dt_cache_entry_t *entry;
+  dt_cache_segment_t *segment = _cache_segment(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  _cache_segment_lock(segment);
 
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      segment->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&segment->lock);
     return 1;
   }
   // need write lock to be able to delete:
   result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&segment->lock);
     g_usleep(5);
     goto restart;
   }
@@ -289,15 +375,15 @@ restart:
   {
     // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&segment->lock);
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  gboolean removed = g_hash_table_remove(segment->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  segment->lru = g_list_delete_link(segment->lru, entry->link);
 
   if(cache->cleanup)
   {
@@ -311,17 +397,18 @@ restart:
 
   dt_pthread_rwlock_unlock(&entry->lock);
   dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
+  segment->cost -= entry->cost;
   g_slice_free1(sizeof(*entry), entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&segment->lock);
   return 0;
 }
 
 // best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
-void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+// expects the segment lock to be held.
+static void _cache_segment_gc(dt_cache_t *cache, dt_cache_segment_t *segment, const float fill_ratio)
 {
-  GList *l = cache->lru;
+  GList *l = segment->lru;
   int cnt = 0;
   while(l)
   {
@@ -329,7 +416,7 @@ void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
     dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
     assert(entry->link->data == entry);
     l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio) break;
+    if(segment->cost < segment->cost_quota * fill_ratio) break;
 
     // if still locked by anyone else give up:
     if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
@@ -342,9 +429,9 @@ void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
     }
 
     // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
+    g_hash_table_remove(segment->hashtable, GINT_TO_POINTER(entry->key));
+    segment->lru = g_list_delete_link(segment->lru, entry->link);
+    segment->cost -= entry->cost;
 
     if(cache->cleanup)
     {
@@ -362,6 +449,17 @@ void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
   }
 }
 
+void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+{
+  for(uint32_t k = 0; k < cache->num_segments; k++)
+  {
+    dt_cache_segment_t *segment = cache->segments + k;
+    dt_pthread_mutex_lock(&segment->lock);
+    _cache_segment_gc(cache, segment, fill_ratio);
+    dt_pthread_mutex_unlock(&segment->lock);
+  }
+}
+
 void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, const char *file, int line)
 {
 #if((__has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)) && 1)
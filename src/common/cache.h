@@ -38,17 +38,32 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
-typedef struct dt_cache_t
+// one independently locked part of the cache. keys are distributed over the segments by hash,
+// so threads working on different images rarely wait for each other.
+typedef struct dt_cache_segment_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_pthread_mutex_t lock; // guards hashtable, lru and cost of this segment only
 
-  size_t entry_size; // cache line allocation
   size_t cost;       // user supplied cost per cache line (bytes?)
-  size_t cost_quota; // quota to try and meet. but don't use as hard limit.
+  size_t cost_quota; // this segment's share of the quota of the whole cache
 
   GHashTable *hashtable; // stores (key, entry) pairs
   GList *lru;            // last element is most recently used, first is about to be kicked from cache.
 
+  // statistics, only ever written while holding the lock:
+  uint64_t lookups;   // number of times the lock was taken for a lookup
+  uint64_t contended; // number of times the lock was already held by someone else
+}
+dt_cache_segment_t;
+
+typedef struct dt_cache_t
+{
+  size_t entry_size; // cache line allocation
+  size_t cost_quota; // quota to try and meet. but don't use as hard limit.
+
+  uint32_t num_segments;         // power of two
+  dt_cache_segment_t *segments;
+
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
   dt_cache_allocate_t cleanup;
@@ -59,8 +74,17 @@ dt_cache_t;
 
 // entry size is only used if alloc callback is 0
 void dt_cache_init(dt_cache_t *cache, size_t entry_size, size_t cost_quota);
+// same, but split the cache into (rounded up to a power of two) independently locked segments, each with its
+// own lru list and an equal share of the quota. only use this if the quota is large compared to the cost of
+// a single entry.
+void dt_cache_init_segmented(dt_cache_t *cache, size_t entry_size, size_t cost_quota, uint32_t segments);
 void dt_cache_cleanup(dt_cache_t *cache);
 
+// sum of the cost of all entries currently in the cache. takes all segment locks.
+size_t dt_cache_get_cost(dt_cache_t *cache);
+// print lock statistics of all segments (debug).
+void dt_cache_print_contention(dt_cache_t *cache, const char *name);
+
 static inline void dt_cache_set_allocate_callback(dt_cache_t *cache, dt_cache_allocate_t allocate_cb,
                                                   void *allocate_data)
 {
@@ -87,10 +111,10 @@ void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, co
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 // returns 0 on success, 1 if the key was not found.
 int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
-// removes from the tip of the lru list, until the fill ratio of the hashtable
+// removes from the tip of the lru lists, until the fill ratio of every segment
 // goes below the given parameter, in terms of the user defined cost measure.
-// will never lock and never fail, but sometimes not free memory (in case all
-// is locked)
+// will never block on an entry and never fail, but sometimes not free memory
+// (in case all is locked)
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio);
 
 // iterate over all currently contained data blocks.
@@ -106,11 +106,10 @@ const dt_collection_params_t *dt_collection_params(const dt_collection_t *collec
   return &collection->params;
 }
 
-int dt_collection_update(const dt_collection_t *collection)
+/* builds the where part of the collection query, it decides whether a single image is part of the collection */
+static gchar *_dt_collection_where(const dt_collection_t *collection)
 {
-  uint32_t result;
-  gchar *wq, *sq, *selq, *query;
-  wq = sq = selq = query = NULL;
+  gchar *wq = NULL;
 
   /* build where part */
   if(!(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
@@ -161,6 +160,17 @@ int dt_collection_update(const dt_collection_t *collection)
     wq = dt_util_dstrcat(wq, " AND (group_id = id OR group_id = %d)", darktable.gui->expanded_group_id);
   }
 
+  return wq;
+}
+
+int dt_collection_update(const dt_collection_t *collection)
+{
+  uint32_t result;
+  gchar *wq, *sq, *selq, *query;
+  sq = selq = query = NULL;
+
+  wq = _dt_collection_where(collection);
+
   /* build select part includes where */
   if(collection->params.sort == DT_COLLECTION_SORT_COLOR
      && (collection->params.query_flags & COLLECTION_QUERY_USE_SORT))
@@ -451,6 +461,93 @@ uint32_t dt_collection_get_count(const dt_collection_t *collection)
   return collection->count;
 }
 
+void dt_collection_update_images(const dt_collection_t *collection, const GList *imgids,
+                                 const dt_collection_sort_t changed)
+{
+  if(!imgids) return;
+
+  // memory.collected_images only mirrors the main collection, and a bare extended where can't be tested
+  // image by image. count those the old way.
+  if(collection != darktable.collection
+     || (collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  {
+    _dt_collection_recount_callback_1(NULL, (gpointer)collection);
+    return;
+  }
+
+  // does the change reorder the collection?
+  const gboolean moved = changed != DT_COLLECTION_SORT_NONE && changed == collection->params.sort
+                         && (collection->params.query_flags & COLLECTION_QUERY_USE_SORT);
+
+  gchar *wq = _dt_collection_where(collection);
+  gchar *query = dt_util_dstrcat(NULL, "SELECT COUNT(*) FROM main.images WHERE id = ?1 AND (%s)", wq);
+  sqlite3_stmt *match, *collected, *uncollect, *unselect;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &match, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT COUNT(*) FROM memory.collected_images WHERE imgid = ?1",
+                                  &collected);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "DELETE FROM memory.collected_images WHERE imgid = ?1",
+                                  &uncollect);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "DELETE FROM main.selected_images WHERE imgid = ?1", &unselect);
+
+  int delta = 0;
+  gboolean rebuild = FALSE;
+  for(const GList *l = imgids; l; l = g_list_next(l))
+  {
+    const int imgid = GPOINTER_TO_INT(l->data);
+
+    DT_DEBUG_SQLITE3_BIND_INT(match, 1, imgid);
+    const int now = sqlite3_step(match) == SQLITE_ROW && sqlite3_column_int(match, 0) > 0;
+    DT_DEBUG_SQLITE3_RESET(match);
+
+    DT_DEBUG_SQLITE3_BIND_INT(collected, 1, imgid);
+    const int before = sqlite3_step(collected) == SQLITE_ROW && sqlite3_column_int(collected, 0) > 0;
+    DT_DEBUG_SQLITE3_RESET(collected);
+
+    if(before && !now)
+    {
+      // the others keep their order, so dropping the row is all it takes
+      DT_DEBUG_SQLITE3_BIND_INT(uncollect, 1, imgid);
+      sqlite3_step(uncollect);
+      DT_DEBUG_SQLITE3_RESET(uncollect);
+      DT_DEBUG_SQLITE3_BIND_INT(unselect, 1, imgid);
+      sqlite3_step(unselect);
+      DT_DEBUG_SQLITE3_RESET(unselect);
+    }
+    else if(now && (!before || moved))
+    {
+      // the image has to go somewhere in between, only the sorted query knows where
+      rebuild = TRUE;
+    }
+    delta += now - before;
+  }
+
+  sqlite3_finalize(match);
+  dt_database_release_statement(darktable.db, collected);
+  dt_database_release_statement(darktable.db, uncollect);
+  dt_database_release_statement(darktable.db, unselect);
+  g_free(query);
+  g_free(wq);
+
+  ((dt_collection_t *)collection)->count += delta;
+
+  if(rebuild)
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+  else
+  {
+    // the counts next to tags, ratings and labels in the collect module are stale even if the collection isn't
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_IMAGES_CHANGED);
+    if(delta) dt_control_queue_redraw();
+  }
+}
+
+void dt_collection_update_image(const dt_collection_t *collection, const int imgid,
+                                const dt_collection_sort_t changed)
+{
+  GList *imgids = g_list_prepend(NULL, GINT_TO_POINTER(imgid));
+  dt_collection_update_images(collection, imgids, changed);
+  g_list_free(imgids);
+}
+
 uint32_t dt_collection_get_selected_count(const dt_collection_t *collection)
 {
   sqlite3_stmt *stmt = NULL;
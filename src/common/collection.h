@@ -197,6 +197,14 @@ uint32_t dt_collection_get_selected_count(const dt_collection_t *collection);
 
 /** update query by conf vars */
 void dt_collection_update_query(const dt_collection_t *collection);
+/** the rating, color labels or tags of imgids changed. updates their membership in memory.collected_images
+ * and the count without running the collection query again. changed is the sort order the change can affect,
+ * images entering the collection or moving in it make it rebuild and raise DT_SIGNAL_COLLECTION_CHANGED. */
+void dt_collection_update_images(const dt_collection_t *collection, const GList *imgids,
+                                 const dt_collection_sort_t changed);
+/** the same for a single image */
+void dt_collection_update_image(const dt_collection_t *collection, const int imgid,
+                                const dt_collection_sort_t changed);
 
 /** updates the hint message for collection */
 void dt_collection_hint_message(const dt_collection_t *collection);
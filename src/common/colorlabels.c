@@ -104,6 +104,10 @@ void dt_colorlabels_toggle_label_selection(const int color)
   }
   sqlite3_finalize(stmt);
 
+  GList *imgids = dt_collection_get_selected(darktable.collection, -1);
+  dt_collection_update_images(darktable.collection, imgids, DT_COLLECTION_SORT_COLOR);
+  g_list_free(imgids);
+
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -136,6 +140,7 @@ void dt_colorlabels_toggle_label(const int imgid, const int color)
   }
   sqlite3_finalize(stmt);
 
+  dt_collection_update_image(darktable.collection, imgid, DT_COLLECTION_SORT_COLOR);
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -143,21 +148,13 @@ int dt_colorlabels_check_label(const int imgid, const int color)
 {
   if(imgid <= 0) return 0;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT * FROM main.color_labels WHERE imgid=?1 AND color=?2 LIMIT 1",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "SELECT * FROM main.color_labels WHERE imgid=?1 AND color=?2 LIMIT 1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    sqlite3_finalize(stmt);
-    return 1;
-  }
-  else
-  {
-    sqlite3_finalize(stmt);
-    return 0;
-  }
+  const int found = sqlite3_step(stmt) == SQLITE_ROW;
+  dt_database_release_statement(darktable.db, stmt);
+  return found;
 }
 
 gboolean dt_colorlabels_key_accel_callback(GtkAccelGroup *accel_group, GObject *acceleratable, guint keyval,
@@ -46,6 +46,7 @@
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
+#include "common/interpolation.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
@@ -58,6 +59,7 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/pixelpipe_profile.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
 #include "gui/presets.h"
@@ -132,6 +134,8 @@ static int usage(const char *argv0)
 #endif
   printf(" [--conf <key>=<value>]");
   printf(" [--noiseprofiles <noiseprofiles json file>]");
+  printf(" [--pipe-profile <json file>]");
+  printf(" [--pipe-trace <chrome trace file>]");
   printf("\n");
   return 1;
 }
@@ -319,9 +323,23 @@ static void dt_codepaths_init()
 #endif
   }
 
+  // the wider sets are only there if we could compile for them. cpuid also checks that the os saves the
+  // registers, which not all versions of __builtin_cpu_supports() do.
+  {
+#if defined(HAVE_AVX2_TARGET)
+    const dt_cpu_flags_t flags = dt_detect_cpu_features();
+    darktable.codepath.AVX2 = darktable.codepath.SSE2 && (flags & CPU_FLAG_AVX2) && (flags & CPU_FLAG_FMA);
+#if defined(HAVE_AVX512_TARGET)
+    darktable.codepath.AVX512 = darktable.codepath.AVX2 && (flags & CPU_FLAG_AVX512F);
+#endif
+#endif
+  }
+
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2") || !darktable.codepath.SSE2) darktable.codepath.AVX2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx512") || !darktable.codepath.AVX2) darktable.codepath.AVX512 = 0;
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -498,6 +516,13 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #else
                "  SSE2 optimized codepath disabled\n"
 #endif
+#if defined(HAVE_AVX512_TARGET)
+               "  AVX2 and AVX-512 optimized codepaths enabled\n"
+#elif defined(HAVE_AVX2_TARGET)
+               "  AVX2 optimized codepath enabled\n"
+#else
+               "  AVX2 optimized codepath disabled\n"
+#endif
 #ifdef _OPENMP
                "  OpenMP support enabled\n"
 #else
@@ -666,6 +691,16 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
         argv[k-1] = NULL;
         argv[k] = NULL;
       }
+      else if((!strcmp(argv[k], "--pipe-profile") || !strcmp(argv[k], "--pipe-trace")) && argc > k + 1)
+      {
+        const dt_dev_pixelpipe_profile_format_t format = !strcmp(argv[k], "--pipe-trace")
+                                                             ? DT_DEV_PIXELPIPE_PROFILE_TRACE
+                                                             : DT_DEV_PIXELPIPE_PROFILE_JSON;
+        dt_dev_pixelpipe_profile_cleanup(darktable.pipe_profile);
+        darktable.pipe_profile = dt_dev_pixelpipe_profile_init(argv[++k], format);
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
       else if(!strcmp(argv[k], "--luacmd") && argc > k + 1)
       {
 #ifdef USE_LUA
@@ -1037,6 +1072,9 @@ void dt_cleanup()
     free(darktable.imageio);
     free(darktable.gui);
   }
+  // all pipes are gone by now
+  dt_dev_pixelpipe_profile_cleanup(darktable.pipe_profile);
+  darktable.pipe_profile = NULL;
   dt_image_cache_cleanup(darktable.image_cache);
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
@@ -1067,6 +1105,9 @@ void dt_cleanup()
 
   dt_guides_cleanup(darktable.guides);
 
+  dt_interpolation_plan_cache_flush();
+  dt_develop_blend_mask_cache_flush();
+
   dt_database_destroy(darktable.db);
 
   if(init_gui)
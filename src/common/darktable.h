@@ -132,6 +132,15 @@ static inline int dt_version()
 #define INVPHI 0.61803398874989479F
 #endif
 
+// functions using AVX2 or AVX-512 intrinsics are compiled for that instruction set only, the rest of the
+// binary stays baseline. they must only be called if darktable.codepath.AVX2 or .AVX512 is set.
+#if defined(HAVE_AVX2_TARGET)
+#define DT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#if defined(HAVE_AVX512_TARGET)
+#define DT_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
 // NaN-safe clamping (NaN compares false, and will thus result in H)
 #define CLAMPS(A, L, H) ((A) > (L) ? ((A) < (H) ? (A) : (H)) : (L))
 
@@ -176,6 +185,8 @@ typedef enum dt_debug_thread_t
 typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
+  unsigned int AVX2 : 1;   // includes FMA
+  unsigned int AVX512 : 1; // AVX-512F
   unsigned int _no_intrinsics : 1;
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
@@ -212,6 +223,7 @@ typedef struct darktable_t
   struct dt_dbus_t *dbus;
   struct dt_undo_t *undo;
   struct dt_colorspaces_t *color_profiles;
+  struct dt_dev_pixelpipe_profile_t *pipe_profile; // only set when recording pipe timings
   dt_pthread_mutex_t db_insert;
   dt_pthread_mutex_t plugin_threadsafe;
   dt_pthread_mutex_t capabilities_threadsafe;
@@ -37,7 +37,7 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 15
+#define CURRENT_DATABASE_VERSION_LIBRARY 16
 #define CURRENT_DATABASE_VERSION_DATA 1
 
 typedef struct dt_database_t
@@ -52,8 +52,28 @@ typedef struct dt_database_t
 
   /* ondisk DB */
   sqlite3 *handle;
+
+  /* idle prepared statements, keyed by their sql text. see dt_database_get_statement() */
+  dt_pthread_mutex_t statements_lock;
+  GHashTable *statements;
+
+  /* accumulated run time per statement for -d sql and -d perf */
+  dt_pthread_mutex_t timings_lock;
+  GHashTable *timings;
 } dt_database_t;
 
+/* the number of idle copies of one statement the cache holds on to */
+#define DT_DATABASE_STATEMENT_COPIES 4
+/* the number of statements listed in the timing report */
+#define DT_DATABASE_TIMING_REPORT 20
+
+typedef struct dt_database_timing_t
+{
+  const char *query;
+  uint64_t count;
+  uint64_t total_ns, max_ns;
+} dt_database_timing_t;
+
 
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
@@ -1010,6 +1030,37 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
 
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 15;
+  }
+  else if(version == 15)
+  {
+    // 15 -> 16 indexes for the lookups done per image. the (film_id, filename) one also serves plain
+    // film_id lookups, history is always read in num order and the tag and color label ones cover the
+    // imgid sub-selects of the collection queries
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    TRY_EXEC("DROP INDEX IF EXISTS main.images_film_id_index",
+             "[init] can't drop index `images_film_id_index' from database\n");
+    TRY_EXEC("CREATE INDEX main.images_film_id_filename_index ON images (film_id, filename)",
+             "[init] can't create index `images_film_id_filename_index' in database\n");
+
+    TRY_EXEC("DROP INDEX IF EXISTS main.history_imgid_index",
+             "[init] can't drop index `history_imgid_index' from database\n");
+    TRY_EXEC("CREATE INDEX main.history_imgid_index ON history (imgid, num)",
+             "[init] can't create index `history_imgid_index' in database\n");
+
+    TRY_EXEC("CREATE INDEX main.mask_imgid_index ON mask (imgid)",
+             "[init] can't create index `mask_imgid_index' in database\n");
+
+    TRY_EXEC("DROP INDEX IF EXISTS main.tagged_images_tagid_index",
+             "[init] can't drop index `tagged_images_tagid_index' from database\n");
+    TRY_EXEC("CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)",
+             "[init] can't create index `tagged_images_tagid_index' in database\n");
+
+    TRY_EXEC("CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)",
+             "[init] can't create index `color_labels_color_index' in database\n");
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 16;
   } // maybe in the future, see commented out code elsewhere
     //   else if(version == XXX)
     //   {
@@ -1131,7 +1182,8 @@ static void _create_library_schema(dt_database_t *db)
       "average_brightness REAL, timelapse_keyframe INTEGER, exposure_correction REAL)", /* timelapse stuff */
       NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.images_group_id_index ON images (group_id)", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.images_film_id_index ON images (film_id)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.images_film_id_filename_index ON images (film_id, filename)", NULL,
+               NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.images_filename_index ON images (filename)", NULL, NULL, NULL);
   ////////////////////////////// selected_images
   sqlite3_exec(db->handle, "CREATE TABLE main.selected_images (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
@@ -1142,16 +1194,18 @@ static void _create_library_schema(dt_database_t *db)
       "operation VARCHAR(256), op_params BLOB, enabled INTEGER, "
       "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))",
       NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.history_imgid_index ON history (imgid)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.history_imgid_index ON history (imgid, num)", NULL, NULL, NULL);
   ////////////////////////////// mask
   sqlite3_exec(db->handle,
                "CREATE TABLE main.mask (imgid INTEGER, formid INTEGER, form INTEGER, name VARCHAR(256), "
                "version INTEGER, points BLOB, points_count INTEGER, source BLOB)",
                NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.mask_imgid_index ON mask (imgid)", NULL, NULL, NULL);
   ////////////////////////////// tagged_images
   sqlite3_exec(db->handle, "CREATE TABLE main.tagged_images (imgid INTEGER, tagid INTEGER, "
                            "PRIMARY KEY (imgid, tagid))", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)", NULL,
+               NULL, NULL);
   ////////////////////////////// used_tags
   sqlite3_exec(db->handle, "CREATE TABLE main.used_tags (id INTEGER, name VARCHAR NOT NULL)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.used_tags_idx ON used_tags (id, name)", NULL, NULL, NULL);
@@ -1159,6 +1213,8 @@ static void _create_library_schema(dt_database_t *db)
   sqlite3_exec(db->handle, "CREATE TABLE main.color_labels (imgid INTEGER, color INTEGER)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.color_labels_idx ON color_labels (imgid, color)", NULL, NULL,
                NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)", NULL, NULL,
+               NULL);
   ////////////////////////////// meta_data
   sqlite3_exec(db->handle, "CREATE TABLE main.meta_data (id INTEGER, key INTEGER, value VARCHAR)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.metadata_index ON meta_data (id, key)", NULL, NULL, NULL);
@@ -1214,6 +1270,8 @@ static void _create_memory_schema(dt_database_t *db)
       db->handle,
       "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)", NULL,
       NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX memory.collected_images_imgid_index ON collected_images (imgid)", NULL,
+               NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.tmp_selection (imgid INTEGER)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.tagq (tmpid INTEGER PRIMARY KEY, id INTEGER)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.taglist "
@@ -1469,6 +1527,64 @@ static gboolean _lock_databases(dt_database_t *db)
   return TRUE;
 }
 
+static void _database_timing_free(gpointer data)
+{
+  dt_database_timing_t *t = (dt_database_timing_t *)data;
+  g_free((gchar *)t->query);
+  g_free(t);
+}
+
+/* sqlite3 calls this after each statement finished running, on the thread that ran it */
+static void _database_profile(void *data, const char *query, sqlite3_uint64 ns)
+{
+  dt_database_t *db = (dt_database_t *)data;
+  dt_pthread_mutex_lock(&db->timings_lock);
+  dt_database_timing_t *t = g_hash_table_lookup(db->timings, query);
+  if(!t)
+  {
+    t = (dt_database_timing_t *)g_malloc0(sizeof(dt_database_timing_t));
+    t->query = g_strdup(query);
+    g_hash_table_insert(db->timings, (gpointer)t->query, t);
+  }
+  t->count++;
+  t->total_ns += ns;
+  t->max_ns = MAX(t->max_ns, ns);
+  dt_pthread_mutex_unlock(&db->timings_lock);
+}
+
+static gint _database_timing_sort(gconstpointer a, gconstpointer b)
+{
+  const dt_database_timing_t *ta = (const dt_database_timing_t *)a;
+  const dt_database_timing_t *tb = (const dt_database_timing_t *)b;
+  return ta->total_ns < tb->total_ns ? 1 : ta->total_ns > tb->total_ns ? -1 : 0;
+}
+
+/* prints the statements which took the most time in total over the whole session */
+static void _database_timing_report(const dt_database_t *db)
+{
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&db->timings_lock);
+  GList *timings = g_list_sort(g_hash_table_get_values(db->timings), _database_timing_sort);
+  uint64_t count = 0, total_ns = 0;
+  for(const GList *l = timings; l; l = g_list_next(l))
+  {
+    const dt_database_timing_t *t = (const dt_database_timing_t *)l->data;
+    count += t->count;
+    total_ns += t->total_ns;
+  }
+  dt_print(DT_DEBUG_SQL | DT_DEBUG_PERF, "[sql] %" G_GUINT64_FORMAT " statement runs of %u queries took %.3f secs\n",
+           count, g_hash_table_size(db->timings), total_ns * 1e-9);
+  int k = 0;
+  for(const GList *l = timings; l && k < DT_DATABASE_TIMING_REPORT; l = g_list_next(l), k++)
+  {
+    const dt_database_timing_t *t = (const dt_database_timing_t *)l->data;
+    dt_print(DT_DEBUG_SQL | DT_DEBUG_PERF,
+             "[sql] %9.3f ms total, %8" G_GUINT64_FORMAT " runs, %8.3f ms avg, %8.3f ms max: %s\n",
+             t->total_ns * 1e-6, t->count, t->total_ns * 1e-6 / t->count, t->max_ns * 1e-6, t->query);
+  }
+  g_list_free(timings);
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&db->timings_lock);
+}
+
 dt_database_t *dt_database_init(const char *alternative, const gboolean load_data)
 {
 start:
@@ -1517,6 +1633,8 @@ start:
   dt_database_t *db = (dt_database_t *)g_malloc0(sizeof(dt_database_t));
   db->dbfilename_data = g_strdup(dbfilename_data);
   db->dbfilename_library = g_strdup(dbfilename_library);
+  dt_pthread_mutex_init(&db->statements_lock, NULL);
+  dt_pthread_mutex_init(&db->timings_lock, NULL);
 
   /* having more than one instance of darktable using the same database is a bad idea */
   /* try to get locks for the databases */
@@ -1546,6 +1664,8 @@ start:
     g_free(db->dbfilename_data);
     g_free(db->lockfile_library);
     g_free(db->dbfilename_library);
+    dt_pthread_mutex_destroy(&db->statements_lock);
+    dt_pthread_mutex_destroy(&db->timings_lock);
     g_free(db);
     return NULL;
   }
@@ -1570,10 +1690,35 @@ start:
   }
   sqlite3_finalize(stmt);
 
-  // some sqlite3 config
-  sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  db->statements = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  if(darktable.unmuted & (DT_DEBUG_SQL | DT_DEBUG_PERF))
+  {
+    db->timings = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _database_timing_free);
+    sqlite3_profile(db->handle, _database_profile, db);
+  }
+
+  // some sqlite3 config. the page size has to be set before switching to wal, it only has an effect on new
+  // databases anyway
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
+  // journal_mode goes for all attached databases, synchronous has to be set for data on its own
+  if(dt_conf_get_bool("database/write_ahead_log"))
+  {
+    // readers don't block the writer and a commit is an append to the log. synchronous = NORMAL can't
+    // corrupt the database in wal mode, at worst the last transactions are lost on power failure.
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA data.synchronous = NORMAL", NULL, NULL, NULL);
+  }
+  else
+  {
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA data.synchronous = OFF", NULL, NULL, NULL);
+  }
+  // 64MB page cache instead of the default 2MB, temporary tables and indexes (ORDER BY, DISTINCT) in memory
+  sqlite3_exec(db->handle, "PRAGMA cache_size = -65536", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "PRAGMA temp_store = MEMORY", NULL, NULL, NULL);
 
   /* now that we got functional databases that are locked for us we can make sure that the schema is set up */
 
@@ -1799,7 +1944,22 @@ error:
 
 void dt_database_destroy(const dt_database_t *db)
 {
+  if(db->timings) _database_timing_report(db);
+
+  if(db->statements)
+  {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, db->statements);
+    while(g_hash_table_iter_next(&iter, NULL, &value))
+      g_slist_free_full((GSList *)value, (GDestroyNotify)sqlite3_finalize);
+    g_hash_table_destroy(db->statements);
+  }
+
   sqlite3_close(db->handle);
+  if(db->timings) g_hash_table_destroy(db->timings);
+  dt_pthread_mutex_destroy((dt_pthread_mutex_t *)&db->statements_lock);
+  dt_pthread_mutex_destroy((dt_pthread_mutex_t *)&db->timings_lock);
   if (db->lockfile_data)
   {
     unlink(db->lockfile_data);
@@ -1820,6 +1980,51 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+sqlite3_stmt *dt_database_get_statement(const dt_database_t *db, const char *query)
+{
+  sqlite3_stmt *stmt = NULL;
+  if(!db || !db->handle) return NULL;
+
+  // hand out an idle copy if there is one. a statement is only ever used by one caller at a time, so
+  // several threads asking for the same query each get their own
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&db->statements_lock);
+  GSList *idle = g_hash_table_lookup(db->statements, query);
+  if(idle)
+  {
+    stmt = (sqlite3_stmt *)idle->data;
+    g_hash_table_insert(db->statements, g_strdup(query), g_slist_delete_link(idle, idle));
+  }
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&db->statements_lock);
+
+  if(!stmt && sqlite3_prepare_v2(db->handle, query, -1, &stmt, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "[sql] can't prepare `%s': %s\n", query, sqlite3_errmsg(db->handle));
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+  }
+  return stmt;
+}
+
+void dt_database_release_statement(const dt_database_t *db, sqlite3_stmt *stmt)
+{
+  if(!stmt) return;
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  // sqlite3_sql() is the exact text the statement was prepared from, so it is the cache key
+  const char *query = sqlite3_sql(stmt);
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&db->statements_lock);
+  GSList *idle = g_hash_table_lookup(db->statements, query);
+  if(g_slist_length(idle) < DT_DATABASE_STATEMENT_COPIES)
+  {
+    g_hash_table_insert(db->statements, g_strdup(query), g_slist_prepend(idle, stmt));
+    stmt = NULL;
+  }
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&db->statements_lock);
+
+  if(stmt) sqlite3_finalize(stmt);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
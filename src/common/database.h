@@ -28,6 +28,11 @@ struct dt_database_t *dt_database_init(const char *alternative, const gboolean l
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** get a prepared statement for query out of the statement cache, preparing it if there is no idle one.
+ *  every statement has to be handed back with dt_database_release_statement() instead of being finalized. */
+struct sqlite3_stmt *dt_database_get_statement(const struct dt_database_t *db, const char *query);
+/** reset the statement, clear its bindings and put it back into the cache */
+void dt_database_release_statement(const struct dt_database_t *db, struct sqlite3_stmt *stmt);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
@@ -78,6 +78,17 @@
     __DT_DEBUG_SQL_QUERY__(b)                                                                                     \
   } while(0)
 
+// like DT_DEBUG_SQLITE3_PREPARE_V2 but a is the dt_database_t and the statement comes from its cache.
+// hand it back with dt_database_release_statement() instead of finalizing it.
+#define DT_DEBUG_SQLITE3_PREPARE_CACHED(a, b, c)                                                                  \
+  do                                                                                                              \
+  {                                                                                                               \
+    dt_print(DT_DEBUG_SQL, "[sql] %s:%d, function %s(): prepare cached \"%s\"\n", __FILE__, __LINE__,             \
+             __FUNCTION__, (b));                                                                                  \
+    *(c) = dt_database_get_statement(a, b);                                                                       \
+    __DT_DEBUG_SQL_QUERY__(b)                                                                                     \
+  } while(0)
+
 #define DT_DEBUG_SQLITE3_BIND_INT(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_int(a, b, c))
 #define DT_DEBUG_SQLITE3_BIND_DOUBLE(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_double(a, b, c))
 #define DT_DEBUG_SQLITE3_BIND_TEXT(a, b, c, d, e) __DT_DEBUG_ASSERT__(sqlite3_bind_text(a, b, c, d, e))
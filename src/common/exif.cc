@@ -1030,58 +1030,122 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
   }
 }
 
+struct dt_exif_file_t
+{
+  std::string path;
+  bool has_stat;
+  struct stat statbuf;
+  std::unique_ptr<Exiv2::Image> image; // NULL if the file could not be read
+  std::string error;                   // why it could not be read
+};
+
+// at least set datetime taken to something useful in case there is no exif data in this file (pfm, png, ...)
+static void _exif_datetime_from_stat(dt_image_t *img, const struct stat *statbuf)
+{
+  struct tm result;
+  strftime(img->exif_datetime_taken, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&statbuf->st_mtime, &result));
+}
+
+// everything dt_exif_read() does once the metadata of the file is in memory. throws exiv2 exceptions.
+static int _exif_read_metadata(dt_image_t *img, Exiv2::Image *image)
+{
+  bool res = true;
+
+  // EXIF metadata
+  Exiv2::ExifData &exifData = image->exifData();
+  if(!exifData.empty())
+    res = dt_exif_read_exif_data(img, exifData);
+  else
+    img->exif_inited = 1;
+
+  // these get overwritten by IPTC and XMP. is that how it should work?
+  dt_exif_apply_global_overwrites(img);
+
+  // IPTC metadata.
+  Exiv2::IptcData &iptcData = image->iptcData();
+  if(!iptcData.empty()) res = dt_exif_read_iptc_data(img, iptcData) && res;
+
+  // XMP metadata
+  Exiv2::XmpData &xmpData = image->xmpData();
+  if(!xmpData.empty()) res = dt_exif_read_xmp_data(img, xmpData, -1, true) && res;
+
+  // Initialize size - don't wait for full raw to be loaded to get this
+  // information. If use_embedded_thumbnail is set, it will take a
+  // change in development history to have this information
+  img->height = image->pixelHeight();
+  img->width = image->pixelWidth();
+
+  return res ? 0 : 1;
+}
+
 /** read the metadata of an image.
  * XMP data trumps IPTC data trumps EXIF data
  */
 int dt_exif_read(dt_image_t *img, const char *path)
 {
-  // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
-  // ...)
   struct stat statbuf;
 
-  if(!stat(path, &statbuf))
-  {
-    struct tm result;
-    strftime(img->exif_datetime_taken, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
-  }
+  if(!stat(path, &statbuf)) _exif_datetime_from_stat(img, &statbuf);
 
   try
   {
     std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(path));
     assert(image.get() != 0);
     image->readMetadata();
-    bool res = true;
+    return _exif_read_metadata(img, image.get());
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+    return 1;
+  }
+}
 
-    // EXIF metadata
-    Exiv2::ExifData &exifData = image->exifData();
-    if(!exifData.empty())
-      res = dt_exif_read_exif_data(img, exifData);
-    else
-      img->exif_inited = 1;
+dt_exif_file_t *dt_exif_file_open(const char *path)
+{
+  dt_exif_file_t *file = new(std::nothrow) dt_exif_file_t;
+  if(!file) return NULL;
 
-    // these get overwritten by IPTC and XMP. is that how it should work?
-    dt_exif_apply_global_overwrites(img);
+  file->path = path;
+  file->has_stat = !stat(path, &file->statbuf);
+  try
+  {
+    file->image = std::unique_ptr<Exiv2::Image>(Exiv2::ImageFactory::open(path));
+    assert(file->image.get() != 0);
+    file->image->readMetadata();
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    file->image.reset();
+    file->error = e.what();
+  }
+  return file;
+}
 
-    // IPTC metadata.
-    Exiv2::IptcData &iptcData = image->iptcData();
-    if(!iptcData.empty()) res = dt_exif_read_iptc_data(img, iptcData) && res;
+void dt_exif_file_close(dt_exif_file_t *file)
+{
+  delete file;
+}
 
-    // XMP metadata
-    Exiv2::XmpData &xmpData = image->xmpData();
-    if(!xmpData.empty()) res = dt_exif_read_xmp_data(img, xmpData, -1, true) && res;
+int dt_exif_read_file(dt_image_t *img, dt_exif_file_t *file)
+{
+  if(file->has_stat) _exif_datetime_from_stat(img, &file->statbuf);
 
-    // Initialize size - don't wait for full raw to be loaded to get this
-    // information. If use_embedded_thumbnail is set, it will take a
-    // change in development history to have this information
-    img->height = image->pixelHeight();
-    img->width = image->pixelWidth();
+  if(!file->image)
+  {
+    std::cerr << "[exiv2] " << file->path << ": " << file->error << std::endl;
+    return 1;
+  }
 
-    return res ? 0 : 1;
+  try
+  {
+    return _exif_read_metadata(img, file->image.get());
   }
   catch(Exiv2::AnyError &e)
   {
     std::string s(e.what());
-    std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+    std::cerr << "[exiv2] " << file->path << ": " << s << std::endl;
     return 1;
   }
 }
@@ -1972,269 +2036,278 @@ skip:
 }
 
 // need a write lock on *img (non-const) to write stars (and soon color labels).
-int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_only)
+// everything dt_exif_xmp_read() does once the sidecar is in memory. throws exiv2 exceptions.
+static int _exif_xmp_read_metadata(dt_image_t *img, const char *filename, Exiv2::Image *image,
+                                   const int history_only)
 {
-  // exclude pfm to avoid stupid errors on the console
-  const char *c = filename + strlen(filename) - 4;
-  if(c >= filename && !strcmp(c, ".pfm")) return 1;
-  try
-  {
-    // read xmp sidecar
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(filename));
-    assert(image.get() != 0);
-    image->readMetadata();
-    Exiv2::XmpData &xmpData = image->xmpData();
+  Exiv2::XmpData &xmpData = image->xmpData();
 
-    sqlite3_stmt *stmt;
+  sqlite3_stmt *stmt;
 
-    Exiv2::XmpData::iterator pos;
+  Exiv2::XmpData::iterator pos;
 
-    int version = 0;
-    if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.xmp_version"))) != xmpData.end())
-      version = pos->toLong();
+  int version = 0;
+  if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.xmp_version"))) != xmpData.end())
+    version = pos->toLong();
 
-    if(!history_only)
-    {
-      // otherwise we ignore title, description, ... from non-dt xmp files :(
-      size_t ns_pos = image->xmpPacket().find("xmlns:darktable=\"http://darktable.sf.net/\"");
-      bool is_a_dt_xmp = (ns_pos != std::string::npos);
-      dt_exif_read_xmp_data(img, xmpData, is_a_dt_xmp ? version : -1, false);
-    }
+  if(!history_only)
+  {
+    // otherwise we ignore title, description, ... from non-dt xmp files :(
+    size_t ns_pos = image->xmpPacket().find("xmlns:darktable=\"http://darktable.sf.net/\"");
+    bool is_a_dt_xmp = (ns_pos != std::string::npos);
+    dt_exif_read_xmp_data(img, xmpData, is_a_dt_xmp ? version : -1, false);
+  }
 
 
-    // convert legacy flip bits (will not be written anymore, convert to flip history item here):
-    if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.raw_params"))) != xmpData.end())
-    {
-      int32_t i = pos->toLong();
-      dt_image_raw_parameters_t raw_params = *(dt_image_raw_parameters_t *)&i;
-      int32_t user_flip = raw_params.user_flip;
-      img->legacy_flip.user_flip = user_flip;
-      img->legacy_flip.legacy = 0;
-    }
+  // convert legacy flip bits (will not be written anymore, convert to flip history item here):
+  if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.raw_params"))) != xmpData.end())
+  {
+    int32_t i = pos->toLong();
+    dt_image_raw_parameters_t raw_params = *(dt_image_raw_parameters_t *)&i;
+    int32_t user_flip = raw_params.user_flip;
+    img->legacy_flip.user_flip = user_flip;
+    img->legacy_flip.legacy = 0;
+  }
 
-    if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.auto_presets_applied"))) != xmpData.end())
-    {
-      int32_t i = pos->toLong();
-      // set or clear bit in image struct
-      if(i == 1) img->flags |= DT_IMAGE_AUTO_PRESETS_APPLIED;
-      if(i == 0) img->flags &= ~DT_IMAGE_AUTO_PRESETS_APPLIED;
-      // in any case, this is no legacy image.
-      img->flags |= DT_IMAGE_NO_LEGACY_PRESETS;
-    }
-    else
-    {
-      // not found means 0 (old xmp)
-      img->flags &= ~DT_IMAGE_AUTO_PRESETS_APPLIED;
-      // so we are legacy (thus have to clear the no-legacy flag)
-      img->flags &= ~DT_IMAGE_NO_LEGACY_PRESETS;
-    }
-    // when we are reading the xmp data it doesn't make sense to flag the image as removed
-    img->flags &= ~DT_IMAGE_REMOVE;
-
-    // forms
-    // TODO: turn that into something like Xmp.darktable.history!
-    Exiv2::XmpData::iterator mask;
-    Exiv2::XmpData::iterator mask_name;
-    Exiv2::XmpData::iterator mask_type;
-    Exiv2::XmpData::iterator mask_version;
-    Exiv2::XmpData::iterator mask_id;
-    Exiv2::XmpData::iterator mask_nb;
-    Exiv2::XmpData::iterator mask_src;
-    if((mask = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask"))) != xmpData.end()
-       && (mask_src = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_src"))) != xmpData.end()
-       && (mask_name = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_name"))) != xmpData.end()
-       && (mask_type = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_type"))) != xmpData.end()
-       && (mask_version = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_version"))) != xmpData.end()
-       && (mask_id = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_id"))) != xmpData.end()
-       && (mask_nb = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_nb"))) != xmpData.end())
-    {
-      const int cnt = mask->count();
-      if(cnt == mask_src->count() && cnt == mask_name->count() && cnt == mask_type->count()
-         && cnt == mask_version->count() && cnt == mask_id->count() && cnt == mask_nb->count())
+  if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.auto_presets_applied"))) != xmpData.end())
+  {
+    int32_t i = pos->toLong();
+    // set or clear bit in image struct
+    if(i == 1) img->flags |= DT_IMAGE_AUTO_PRESETS_APPLIED;
+    if(i == 0) img->flags &= ~DT_IMAGE_AUTO_PRESETS_APPLIED;
+    // in any case, this is no legacy image.
+    img->flags |= DT_IMAGE_NO_LEGACY_PRESETS;
+  }
+  else
+  {
+    // not found means 0 (old xmp)
+    img->flags &= ~DT_IMAGE_AUTO_PRESETS_APPLIED;
+    // so we are legacy (thus have to clear the no-legacy flag)
+    img->flags &= ~DT_IMAGE_NO_LEGACY_PRESETS;
+  }
+  // when we are reading the xmp data it doesn't make sense to flag the image as removed
+  img->flags &= ~DT_IMAGE_REMOVE;
+
+  // forms
+  // TODO: turn that into something like Xmp.darktable.history!
+  Exiv2::XmpData::iterator mask;
+  Exiv2::XmpData::iterator mask_name;
+  Exiv2::XmpData::iterator mask_type;
+  Exiv2::XmpData::iterator mask_version;
+  Exiv2::XmpData::iterator mask_id;
+  Exiv2::XmpData::iterator mask_nb;
+  Exiv2::XmpData::iterator mask_src;
+  if((mask = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask"))) != xmpData.end()
+     && (mask_src = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_src"))) != xmpData.end()
+     && (mask_name = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_name"))) != xmpData.end()
+     && (mask_type = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_type"))) != xmpData.end()
+     && (mask_version = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_version"))) != xmpData.end()
+     && (mask_id = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_id"))) != xmpData.end()
+     && (mask_nb = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.mask_nb"))) != xmpData.end())
+  {
+    const int cnt = mask->count();
+    if(cnt == mask_src->count() && cnt == mask_name->count() && cnt == mask_type->count()
+       && cnt == mask_version->count() && cnt == mask_id->count() && cnt == mask_nb->count())
+    {
+      // clean all registered form for this image
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.mask WHERE imgid = ?1", -1,
+                                  &stmt, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
+      sqlite3_step(stmt);
+      sqlite3_finalize(stmt);
+
+      // register all forms
+      for(int i = 0; i < cnt; i++)
       {
-        // clean all registered form for this image
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.mask WHERE imgid = ?1", -1,
-                                    &stmt, NULL);
+        DT_DEBUG_SQLITE3_PREPARE_V2(
+            dt_database_get(darktable.db),
+            "INSERT INTO main.mask (imgid, formid, form, name, version, points, points_count, source) "
+            "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)",
+            -1, &stmt, NULL);
         DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-
-        // register all forms
-        for(int i = 0; i < cnt; i++)
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, mask_id->toLong(i));
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, mask_type->toLong(i));
+        std::string mask_name_str = mask_name->toString(i);
+        if(mask_name_str.c_str() != NULL)
         {
-          DT_DEBUG_SQLITE3_PREPARE_V2(
-              dt_database_get(darktable.db),
-              "INSERT INTO main.mask (imgid, formid, form, name, version, points, points_count, source) "
-              "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8)",
-              -1, &stmt, NULL);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, mask_id->toLong(i));
-          DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, mask_type->toLong(i));
-          std::string mask_name_str = mask_name->toString(i);
-          if(mask_name_str.c_str() != NULL)
-          {
-            const char *mname = mask_name_str.c_str();
-            DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, mname, -1, SQLITE_TRANSIENT);
-          }
-          else
-          {
-            const char *mname = "form";
-            DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, mname, -1, SQLITE_TRANSIENT);
-          }
-          DT_DEBUG_SQLITE3_BIND_INT(stmt, 5, mask_version->toLong(i));
-          std::string mask_str = mask->toString(i);
-          const char *mask_c = mask_str.c_str();
-          const size_t mask_c_len = strlen(mask_c);
-          int mask_len = 0;
-          const unsigned char *mask_blob = dt_exif_xmp_decode(mask_c, mask_c_len, &mask_len);
-          DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 6, mask_blob, mask_len, SQLITE_TRANSIENT);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, mask_nb->toLong(i));
-
-          std::string mask_src_str = mask_src->toString(i);
-          const char *mask_src_c = mask_src_str.c_str();
-          const size_t mask_src_c_len = strlen(mask_src_c);
-          int mask_src_len = 0;
-          unsigned char *mask_src_blob = dt_exif_xmp_decode(mask_src_c, mask_src_c_len, &mask_src_len);
-          DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 8, mask_src_blob, mask_src_len, SQLITE_TRANSIENT);
-
-          sqlite3_step(stmt);
-          sqlite3_finalize(stmt);
+          const char *mname = mask_name_str.c_str();
+          DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, mname, -1, SQLITE_TRANSIENT);
         }
+        else
+        {
+          const char *mname = "form";
+          DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, mname, -1, SQLITE_TRANSIENT);
+        }
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 5, mask_version->toLong(i));
+        std::string mask_str = mask->toString(i);
+        const char *mask_c = mask_str.c_str();
+        const size_t mask_c_len = strlen(mask_c);
+        int mask_len = 0;
+        const unsigned char *mask_blob = dt_exif_xmp_decode(mask_c, mask_c_len, &mask_len);
+        DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 6, mask_blob, mask_len, SQLITE_TRANSIENT);
+        DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, mask_nb->toLong(i));
+
+        std::string mask_src_str = mask_src->toString(i);
+        const char *mask_src_c = mask_src_str.c_str();
+        const size_t mask_src_c_len = strlen(mask_src_c);
+        int mask_src_len = 0;
+        unsigned char *mask_src_blob = dt_exif_xmp_decode(mask_src_c, mask_src_c_len, &mask_src_len);
+        DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 8, mask_src_blob, mask_src_len, SQLITE_TRANSIENT);
+
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
       }
     }
+  }
+
+  // history
+  int num = 0;
+  gboolean all_ok = TRUE;
+  GList *history_entries = NULL;
+
+  if(version < 2)
+  {
+    history_entries = read_history_v1(filename, 0);
+    if(!history_entries) // didn't work? try super old version with rdf:Bag
+      history_entries = read_history_v1(filename, 1);
+  }
+  else if(version == 2)
+    history_entries = read_history_v2(xmpData, filename);
+  else
+  {
+    std::cerr << "error: Xmp schema version " << version << " in " << filename << " not supported" << std::endl;
+    return 1;
+  }
+
+  sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT xmp_history", NULL, NULL, NULL);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
+                              &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
+  if(sqlite3_step(stmt) != SQLITE_DONE)
+  {
+    fprintf(stderr, "[exif] error deleting history for image %d\n", img->id);
+    fprintf(stderr, "[exif]   %s\n", sqlite3_errmsg(dt_database_get(darktable.db)));
+    all_ok = FALSE;
+    goto end;
+  }
+
+  sqlite3_finalize(stmt);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO main.history (imgid, num, module, operation, op_params, enabled, "
+                              "blendop_params, blendop_version, multi_priority, multi_name) "
+                              "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10)", -1, &stmt, NULL);
 
-    // history
-    int num = 0;
-    gboolean all_ok = TRUE;
-    GList *history_entries = NULL;
+  for(GList *iter = history_entries; iter; iter = g_list_next(iter))
+  {
+    history_entry_t *entry = (history_entry_t *)iter->data;
+//       print_entry(entry);
 
-    if(version < 2)
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, num);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, entry->modversion);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, entry->operation, -1, SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 5, entry->params, entry->params_len, SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 6, entry->enabled);
+    if(entry->blendop_params)
     {
-      history_entries = read_history_v1(filename, 0);
-      if(!history_entries) // didn't work? try super old version with rdf:Bag
-        history_entries = read_history_v1(filename, 1);
+      DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 7, entry->blendop_params, entry->blendop_params_len, SQLITE_TRANSIENT);
     }
-    else if(version == 2)
-      history_entries = read_history_v2(xmpData, filename);
     else
     {
-      std::cerr << "error: Xmp schema version " << version << " in " << filename << " not supported" << std::endl;
-      return 1;
+      sqlite3_bind_null(stmt, 7);
+    }
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 8, entry->blendop_version);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 9, entry->multi_priority);
+    if(entry->multi_name)
+    {
+      DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 10, entry->multi_name, -1, SQLITE_TRANSIENT);
+    }
+    else
+    {
+      DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 10, "", -1, SQLITE_TRANSIENT); // "" instead of " " should be fine now
     }
 
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
-
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
-                                &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
     if(sqlite3_step(stmt) != SQLITE_DONE)
     {
-      fprintf(stderr, "[exif] error deleting history for image %d\n", img->id);
+      fprintf(stderr, "[exif] error adding history entry for image %d\n", img->id);
       fprintf(stderr, "[exif]   %s\n", sqlite3_errmsg(dt_database_get(darktable.db)));
       all_ok = FALSE;
       goto end;
     }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
 
-    sqlite3_finalize(stmt);
+    num++;
+  }
+  sqlite3_finalize(stmt);
 
+  // we shouldn't change history_end when no history was read!
+  if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.history_end"))) != xmpData.end() && num > 0)
+  {
+    int history_end = MIN(pos->toLong(), num);
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT INTO main.history (imgid, num, module, operation, op_params, enabled, "
-                                "blendop_params, blendop_version, multi_priority, multi_name) "
-                                "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10)", -1, &stmt, NULL);
-
-    for(GList *iter = history_entries; iter; iter = g_list_next(iter))
-    {
-      history_entry_t *entry = (history_entry_t *)iter->data;
-//       print_entry(entry);
-
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, num);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, entry->modversion);
-      DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, entry->operation, -1, SQLITE_TRANSIENT);
-      DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 5, entry->params, entry->params_len, SQLITE_TRANSIENT);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 6, entry->enabled);
-      if(entry->blendop_params)
-      {
-        DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 7, entry->blendop_params, entry->blendop_params_len, SQLITE_TRANSIENT);
-      }
-      else
-      {
-        sqlite3_bind_null(stmt, 7);
-      }
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 8, entry->blendop_version);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 9, entry->multi_priority);
-      if(entry->multi_name)
-      {
-        DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 10, entry->multi_name, -1, SQLITE_TRANSIENT);
-      }
-      else
-      {
-        DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 10, "", -1, SQLITE_TRANSIENT); // "" instead of " " should be fine now
-      }
-
-      if(sqlite3_step(stmt) != SQLITE_DONE)
-      {
-        fprintf(stderr, "[exif] error adding history entry for image %d\n", img->id);
-        fprintf(stderr, "[exif]   %s\n", sqlite3_errmsg(dt_database_get(darktable.db)));
-        all_ok = FALSE;
-        goto end;
-      }
-      sqlite3_reset(stmt);
-      sqlite3_clear_bindings(stmt);
-
-      num++;
-    }
-    sqlite3_finalize(stmt);
-
-    // we shouldn't change history_end when no history was read!
-    if((pos = xmpData.findKey(Exiv2::XmpKey("Xmp.darktable.history_end"))) != xmpData.end() && num > 0)
+                                "UPDATE main.images SET history_end = ?1 WHERE id = ?2", -1,
+                                &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, history_end);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->id);
+    if(sqlite3_step(stmt) != SQLITE_DONE)
     {
-      int history_end = MIN(pos->toLong(), num);
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                  "UPDATE main.images SET history_end = ?1 WHERE id = ?2", -1,
-                                  &stmt, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, history_end);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->id);
-      if(sqlite3_step(stmt) != SQLITE_DONE)
-      {
-        fprintf(stderr, "[exif] error writing history_end for image %d\n", img->id);
-        fprintf(stderr, "[exif]   %s\n", sqlite3_errmsg(dt_database_get(darktable.db)));
-        all_ok = FALSE;
-        goto end;
-      }
+      fprintf(stderr, "[exif] error writing history_end for image %d\n", img->id);
+      fprintf(stderr, "[exif]   %s\n", sqlite3_errmsg(dt_database_get(darktable.db)));
+      all_ok = FALSE;
+      goto end;
     }
-    else
+  }
+  else
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "UPDATE main.images SET history_end = (SELECT IFNULL(MAX(num) + 1, 0) "
+                                "FROM main.history WHERE imgid = ?1) WHERE id = ?1", -1,
+                                &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
+    if(sqlite3_step(stmt) != SQLITE_DONE)
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                  "UPDATE main.images SET history_end = (SELECT IFNULL(MAX(num) + 1, 0) "
-                                  "FROM main.history WHERE imgid = ?1) WHERE id = ?1", -1,
-                                  &stmt, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->id);
-      if(sqlite3_step(stmt) != SQLITE_DONE)
-      {
-        fprintf(stderr, "[exif] error writing history_end for image %d\n", img->id);
-        fprintf(stderr, "[exif]   %s\n", sqlite3_errmsg(dt_database_get(darktable.db)));
-        all_ok = FALSE;
-        goto end;
-      }
+      fprintf(stderr, "[exif] error writing history_end for image %d\n", img->id);
+      fprintf(stderr, "[exif]   %s\n", sqlite3_errmsg(dt_database_get(darktable.db)));
+      all_ok = FALSE;
+      goto end;
     }
+  }
 
 end:
-    sqlite3_finalize(stmt);
+  sqlite3_finalize(stmt);
 
-    g_list_free_full(history_entries, free_entry);
+  g_list_free_full(history_entries, free_entry);
 
-    if(all_ok)
-    {
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
-    }
-    else
-    {
-      std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
-      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
-      return 1;
-    }
+  if(all_ok)
+  {
+    sqlite3_exec(dt_database_get(darktable.db), "RELEASE xmp_history", NULL, NULL, NULL);
+  }
+  else
+  {
+    std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
+    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TO xmp_history", NULL, NULL, NULL);
+    sqlite3_exec(dt_database_get(darktable.db), "RELEASE xmp_history", NULL, NULL, NULL);
+    return 1;
+  }
+
+  return 0;
+}
 
+int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_only)
+{
+  // exclude pfm to avoid stupid errors on the console
+  const char *c = filename + strlen(filename) - 4;
+  if(c >= filename && !strcmp(c, ".pfm")) return 1;
+  try
+  {
+    // read xmp sidecar
+    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(filename));
+    assert(image.get() != 0);
+    image->readMetadata();
+    return _exif_xmp_read_metadata(img, filename, image.get(), history_only);
   }
   catch(Exiv2::AnyError &e)
   {
@@ -2243,7 +2316,19 @@ end:
     // std::cerr << "[exiv2] " << filename << ": " << s << std::endl;
     return 1;
   }
-  return 0;
+}
+
+int dt_exif_xmp_read_file(dt_image_t *img, dt_exif_file_t *file, const int history_only)
+{
+  if(!file->image) return 1;
+  try
+  {
+    return _exif_xmp_read_metadata(img, file->path.c_str(), file->image.get(), history_only);
+  }
+  catch(Exiv2::AnyError &)
+  {
+    return 1;
+  }
 }
 
 // helper to create an xmp data thing. throws exiv2 exceptions if stuff goes wrong.
@@ -2788,12 +2873,23 @@ static void dt_exif_log_handler(int log_level, const char *message)
   }
 }
 
+// the xmp toolkit is not thread safe by itself, and files are parsed by several threads during imports
+static GRecMutex _exif_xmp_mutex;
+
+static void _exif_xmp_lock(void *data, bool lock)
+{
+  if(lock)
+    g_rec_mutex_lock(&_exif_xmp_mutex);
+  else
+    g_rec_mutex_unlock(&_exif_xmp_mutex);
+}
+
 void dt_exif_init()
 {
   // preface the exiv2 messages with "[exiv2] "
   Exiv2::LogMsg::setHandler(&dt_exif_log_handler);
 
-  Exiv2::XmpParser::initialize();
+  Exiv2::XmpParser::initialize(&_exif_xmp_lock, NULL);
   // this has te stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   Exiv2::XmpProperties::registerNs("http://ns.adobe.com/lightroom/1.0/", "lr");
@@ -53,6 +53,19 @@ char *dt_exif_xmp_read_string(const int imgid);
 /** read xmp sidecar file. */
 int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_only);
 
+/** metadata of a file (image or sidecar), parsed into memory. opening one does not touch the database or
+ * any image, so several files can be opened in parallel, to be applied to their images later on. */
+typedef struct dt_exif_file_t dt_exif_file_t;
+
+/** parse the metadata of path. returns NULL only when out of memory, a file that can't be read is reported
+ * when it is applied. */
+dt_exif_file_t *dt_exif_file_open(const char *path);
+void dt_exif_file_close(dt_exif_file_t *file);
+
+/** dt_exif_read() and dt_exif_xmp_read() from a file opened with dt_exif_file_open(). */
+int dt_exif_read_file(dt_image_t *img, dt_exif_file_t *file);
+int dt_exif_xmp_read_file(dt_image_t *img, dt_exif_file_t *file, const int history_only);
+
 /** fetch largest exif thumbnail jpg bytestream into buffer*/
 int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type);
 
@@ -33,6 +33,11 @@
 
 #define BLOCKSIZE 32
 
+// the vertical pass runs on strips of this many columns at once. a row of a strip then is a few whole cache
+// lines, where a single column would use one pixel of each line it pulls in and thrash the cache and tlb with
+// the large row stride. the filter state of a strip still fits into L1.
+#define STRIPSIZE 32
+
 static void compute_gauss_params(const float sigma, dt_gaussian_order_t order, float *a0, float *a1,
                                  float *a2, float *a3, float *b1, float *b2, float *coefp, float *coefn)
 {
@@ -171,75 +176,77 @@ void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
   float *Labmax = g->max;
   float *Labmin = g->min;
 
-// vertical blur column by column
+// vertical blur on strips of columns
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp,           \
                                               coefn) schedule(static)
 #endif
-  for(int i = 0; i < width; i++)
+  for(int i0 = 0; i0 < width; i0 += STRIPSIZE)
   {
-    float xp[4] = {0.0f};
-    float yb[4] = {0.0f};
-    float yp[4] = {0.0f};
-    float xc[4] = {0.0f};
-    float yc[4] = {0.0f};
-    float xn[4] = {0.0f};
-    float xa[4] = {0.0f};
-    float yn[4] = {0.0f};
-    float ya[4] = {0.0f};
+    const int strip = MIN(STRIPSIZE, width - i0);
+    float xp[STRIPSIZE][4];
+    float yb[STRIPSIZE][4];
+    float yp[STRIPSIZE][4];
+    float xn[STRIPSIZE][4];
+    float xa[STRIPSIZE][4];
+    float yn[STRIPSIZE][4];
+    float ya[STRIPSIZE][4];
 
     // forward filter
-    for(int k = 0; k < ch; k++)
-    {
-      xp[k] = CLAMPF(in[(size_t)i * ch + k], Labmin[k], Labmax[k]);
-      yb[k] = xp[k] * coefp;
-      yp[k] = yb[k];
-      xc[k] = yc[k] = xn[k] = xa[k] = yn[k] = ya[k] = 0.0f;
-    }
+    for(int i = 0; i < strip; i++)
+      for(int k = 0; k < ch; k++)
+      {
+        xp[i][k] = CLAMPF(in[(size_t)(i0 + i) * ch + k], Labmin[k], Labmax[k]);
+        yb[i][k] = xp[i][k] * coefp;
+        yp[i][k] = yb[i][k];
+      }
 
     for(int j = 0; j < height; j++)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
+      size_t offset = ((size_t)j * width + i0) * ch;
 
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
+      for(int i = 0; i < strip; i++, offset += ch)
+        for(int k = 0; k < ch; k++)
+        {
+          const float xc = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
+          const float yc = (a0 * xc) + (a1 * xp[i][k]) - (b1 * yp[i][k]) - (b2 * yb[i][k]);
 
-        temp[offset + k] = yc[k];
+          temp[offset + k] = yc;
 
-        xp[k] = xc[k];
-        yb[k] = yp[k];
-        yp[k] = yc[k];
-      }
+          xp[i][k] = xc;
+          yb[i][k] = yp[i][k];
+          yp[i][k] = yc;
+        }
     }
 
     // backward filter
-    for(int k = 0; k < ch; k++)
-    {
-      xn[k] = CLAMPF(in[((size_t)(height - 1) * width + i) * ch + k], Labmin[k], Labmax[k]);
-      xa[k] = xn[k];
-      yn[k] = xn[k] * coefn;
-      ya[k] = yn[k];
-    }
+    for(int i = 0; i < strip; i++)
+      for(int k = 0; k < ch; k++)
+      {
+        xn[i][k] = CLAMPF(in[((size_t)(height - 1) * width + i0 + i) * ch + k], Labmin[k], Labmax[k]);
+        xa[i][k] = xn[i][k];
+        yn[i][k] = xn[i][k] * coefn;
+        ya[i][k] = yn[i][k];
+      }
 
     for(int j = height - 1; j > -1; j--)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
+      size_t offset = ((size_t)j * width + i0) * ch;
 
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
+      for(int i = 0; i < strip; i++, offset += ch)
+        for(int k = 0; k < ch; k++)
+        {
+          const float xc = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
 
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
+          const float yc = (a2 * xn[i][k]) + (a3 * xa[i][k]) - (b1 * yn[i][k]) - (b2 * ya[i][k]);
 
-        xa[k] = xn[k];
-        xn[k] = xc[k];
-        ya[k] = yn[k];
-        yn[k] = yc[k];
+          xa[i][k] = xn[i][k];
+          xn[i][k] = xc;
+          ya[i][k] = yn[i][k];
+          yn[i][k] = yc;
 
-        temp[offset + k] += yc[k];
-      }
+          temp[offset + k] += yc;
+        }
     }
   }
 
@@ -338,71 +345,77 @@ static void dt_gaussian_blur_4c_sse(dt_gaussian_t *g, const float *const in, flo
   float *temp = g->buf;
 
 
-// vertical blur column by column
+// vertical blur on strips of columns
 #ifdef _OPENMP
 #pragma omp parallel for default(none) shared(temp, a0, a1, a2, a3, b1, b2, coefp, coefn) schedule(static)
 #endif
-  for(int i = 0; i < width; i++)
+  for(int i0 = 0; i0 < width; i0 += STRIPSIZE)
   {
-    __m128 xp = _mm_setzero_ps();
-    __m128 yb = _mm_setzero_ps();
-    __m128 yp = _mm_setzero_ps();
-    __m128 xc = _mm_setzero_ps();
-    __m128 yc = _mm_setzero_ps();
-    __m128 xn = _mm_setzero_ps();
-    __m128 xa = _mm_setzero_ps();
-    __m128 yn = _mm_setzero_ps();
-    __m128 ya = _mm_setzero_ps();
+    const int strip = MIN(STRIPSIZE, width - i0);
+    __m128 xp[STRIPSIZE];
+    __m128 yb[STRIPSIZE];
+    __m128 yp[STRIPSIZE];
 
     // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(in + i * ch), Labmin, Labmax);
-    yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
-    yp = yb;
-
+    for(int i = 0; i < strip; i++)
+    {
+      xp[i] = MMCLAMPPS(_mm_load_ps(in + (size_t)(i0 + i) * ch), Labmin, Labmax);
+      yb[i] = _mm_mul_ps(_mm_set_ps1(coefp), xp[i]);
+      yp[i] = yb[i];
+    }
 
     for(int j = 0; j < height; j++)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
+      size_t offset = ((size_t)j * width + i0) * ch;
 
+      for(int i = 0; i < strip; i++, offset += ch)
+      {
+        const __m128 xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
 
-      yc = _mm_add_ps(
-          _mm_mul_ps(xc, _mm_set_ps1(a0)),
-          _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
-                     _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
+        const __m128 yc = _mm_add_ps(
+            _mm_mul_ps(xc, _mm_set_ps1(a0)),
+            _mm_sub_ps(_mm_mul_ps(xp[i], _mm_set_ps1(a1)),
+                       _mm_add_ps(_mm_mul_ps(yp[i], _mm_set_ps1(b1)), _mm_mul_ps(yb[i], _mm_set_ps1(b2)))));
 
-      _mm_store_ps(temp + offset, yc);
+        _mm_store_ps(temp + offset, yc);
 
-      xp = xc;
-      yb = yp;
-      yp = yc;
+        xp[i] = xc;
+        yb[i] = yp[i];
+        yp[i] = yc;
+      }
     }
 
-    // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(in + ((size_t)(height - 1) * width + i) * ch), Labmin, Labmax);
-    xa = xn;
-    yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
-    ya = yn;
+    // backward filter, reusing the state arrays: xn in xp, xa in yb, yn in yp and ya in a fourth one
+    __m128 ya[STRIPSIZE];
+    __m128 *const xn = xp, *const xa = yb, *const yn = yp;
+    for(int i = 0; i < strip; i++)
+    {
+      xn[i] = MMCLAMPPS(_mm_load_ps(in + ((size_t)(height - 1) * width + i0 + i) * ch), Labmin, Labmax);
+      xa[i] = xn[i];
+      yn[i] = _mm_mul_ps(_mm_set_ps1(coefn), xn[i]);
+      ya[i] = yn[i];
+    }
 
     for(int j = height - 1; j > -1; j--)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
+      size_t offset = ((size_t)j * width + i0) * ch;
 
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
+      for(int i = 0; i < strip; i++, offset += ch)
+      {
+        const __m128 xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
 
-      yc = _mm_add_ps(
-          _mm_mul_ps(xn, _mm_set_ps1(a2)),
-          _mm_sub_ps(_mm_mul_ps(xa, _mm_set_ps1(a3)),
-                     _mm_add_ps(_mm_mul_ps(yn, _mm_set_ps1(b1)), _mm_mul_ps(ya, _mm_set_ps1(b2)))));
+        const __m128 yc = _mm_add_ps(
+            _mm_mul_ps(xn[i], _mm_set_ps1(a2)),
+            _mm_sub_ps(_mm_mul_ps(xa[i], _mm_set_ps1(a3)),
+                       _mm_add_ps(_mm_mul_ps(yn[i], _mm_set_ps1(b1)), _mm_mul_ps(ya[i], _mm_set_ps1(b2)))));
 
+        xa[i] = xn[i];
+        xn[i] = xc;
+        ya[i] = yn[i];
+        yn[i] = yc;
 
-      xa = xn;
-      xn = xc;
-      ya = yn;
-      yn = yc;
-
-      _mm_store_ps(temp + offset, _mm_add_ps(_mm_load_ps(temp + offset), yc));
+        _mm_store_ps(temp + offset, _mm_add_ps(_mm_load_ps(temp + offset), yc));
+      }
     }
   }
 
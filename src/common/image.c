@@ -741,21 +741,23 @@ void dt_image_read_duplicates(const uint32_t id, const char *filename)
 }
 
 
-uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
+// the checks done before importing filename. returns its lower case extension if it is to be imported,
+// NULL otherwise.
+static char *_image_import_check(const char *filename, gboolean override_ignore_jpegs)
 {
-  if(!g_file_test(filename, G_FILE_TEST_IS_REGULAR) || dt_util_get_file_size(filename) == 0) return 0;
+  if(!g_file_test(filename, G_FILE_TEST_IS_REGULAR) || dt_util_get_file_size(filename) == 0) return NULL;
   const char *cc = filename + strlen(filename);
   for(; *cc != '.' && cc > filename; cc--)
     ;
-  if(!strcmp(cc, ".dt")) return 0;
-  if(!strcmp(cc, ".dttags")) return 0;
-  if(!strcmp(cc, ".xmp")) return 0;
+  if(!strcmp(cc, ".dt")) return NULL;
+  if(!strcmp(cc, ".dttags")) return NULL;
+  if(!strcmp(cc, ".xmp")) return NULL;
   char *ext = g_ascii_strdown(cc + 1, -1);
   if(override_ignore_jpegs == FALSE && (!strcmp(ext, "jpg") || !strcmp(ext, "jpeg"))
      && dt_conf_get_bool("ui_last/import_ignore_jpegs"))
   {
     g_free(ext);
-    return 0;
+    return NULL;
   }
   int supported = 0;
   char **extensions = g_strsplit(dt_supported_extensions, ",", 100);
@@ -769,24 +771,96 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   if(!supported)
   {
     g_free(ext);
-    return 0;
+    return NULL;
+  }
+  return ext;
+}
+
+// the bits in flags that indicate if any of the extra files (.txt, .wav) are present
+static uint32_t _image_import_extra_flags(const char *filename)
+{
+  uint32_t flags = 0;
+  char *extra_file = dt_image_get_audio_path_from_path(filename);
+  if(extra_file)
+  {
+    flags |= DT_IMAGE_HAS_WAV;
+    g_free(extra_file);
+  }
+  extra_file = dt_image_get_text_path_from_path(filename);
+  if(extra_file)
+  {
+    flags |= DT_IMAGE_HAS_TXT;
+    g_free(extra_file);
   }
+  return flags;
+}
+
+struct dt_image_import_batch_t
+{
+  sqlite3_stmt *find;      // id of a file in a film roll
+  sqlite3_stmt *insert;    // dummy entry of a new image
+  sqlite3_stmt *group;     // group of another file with the same base name, for non-jpegs
+  sqlite3_stmt *group_jpg; // same for jpegs
+  sqlite3_stmt *set_group;
+  gboolean transaction;
+  GArray *added;           // ids inserted by the open transaction, dropped from the cache if it fails
+};
+
+static void _image_import_statements_prepare(dt_image_import_batch_t *b)
+{
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", -1, &b->find,
+                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(
+      dt_database_get(darktable.db),
+      "INSERT INTO main.images (id, film_id, filename, caption, description, license, sha1sum, flags, version, "
+      "max_version, history_end) VALUES (NULL, ?1, ?2, '', '', '', '', ?3, 0, 0, 0)",
+      -1, &b->insert, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(
+      dt_database_get(darktable.db),
+      "SELECT group_id FROM main.images WHERE film_id = ?1 AND filename LIKE ?2 AND id = group_id", -1,
+      &b->group, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(
+      dt_database_get(darktable.db),
+      "SELECT group_id FROM main.images WHERE film_id = ?1 AND filename LIKE ?2 AND id != ?3", -1,
+      &b->group_jpg, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "UPDATE main.images SET group_id = ?1 WHERE id = ?2",
+                              -1, &b->set_group, NULL);
+}
+
+static void _image_import_statements_finalize(dt_image_import_batch_t *b)
+{
+  sqlite3_finalize(b->find);
+  sqlite3_finalize(b->insert);
+  sqlite3_finalize(b->group);
+  sqlite3_finalize(b->group_jpg);
+  sqlite3_finalize(b->set_group);
+}
+
+static void _image_import_statement_done(sqlite3_stmt *stmt)
+{
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+}
+
+// adds filename to the database and the image cache. exif and xmp are the already parsed metadata of the
+// file and of its sidecar, if NULL they are read from disk here.
+static uint32_t _image_import_internal(dt_image_import_batch_t *b, const int32_t film_id, const char *filename,
+                                       const char *ext, const uint32_t extra_flags, dt_exif_file_t *exif,
+                                       dt_exif_file_t *xmp)
+{
   int rc;
   uint32_t id = 0;
   // select from images; if found => return
   gchar *imgfname;
   imgfname = g_path_get_basename((const gchar *)filename);
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_STATIC);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  DT_DEBUG_SQLITE3_BIND_INT(b->find, 1, film_id);
+  DT_DEBUG_SQLITE3_BIND_TEXT(b->find, 2, imgfname, -1, SQLITE_STATIC);
+  if(sqlite3_step(b->find) == SQLITE_ROW)
   {
-    id = sqlite3_column_int(stmt, 0);
+    id = sqlite3_column_int(b->find, 0);
+    _image_import_statement_done(b->find);
     g_free(imgfname);
-    sqlite3_finalize(stmt);
-    g_free(ext);
     dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'w');
     img->flags &= ~DT_IMAGE_REMOVE;
     dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
@@ -794,7 +868,7 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
     dt_image_synch_all_xmp(filename);
     return id;
   }
-  sqlite3_finalize(stmt);
+  _image_import_statement_done(b->find);
 
   // also need to set the no-legacy bit, to make sure we get the right presets (new ones)
   uint32_t flags = dt_conf_get_int("ui_last/import_initial_rating");
@@ -804,38 +878,20 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
     dt_conf_set_int("ui_last/import_initial_rating", 1);
   }
   flags |= DT_IMAGE_NO_LEGACY_PRESETS;
-  // set the bits in flags that indicate if any of the extra files (.txt, .wav) are present
-  char *extra_file = dt_image_get_audio_path_from_path(filename);
-  if(extra_file)
-  {
-    flags |= DT_IMAGE_HAS_WAV;
-    g_free(extra_file);
-  }
-  extra_file = dt_image_get_text_path_from_path(filename);
-  if(extra_file)
-  {
-    flags |= DT_IMAGE_HAS_TXT;
-    g_free(extra_file);
-  }
+  flags |= extra_flags;
   // insert dummy image entry in database
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "INSERT INTO main.images (id, film_id, filename, caption, description, license, sha1sum, flags, version, "
-      "max_version, history_end) VALUES (NULL, ?1, ?2, '', '', '', '', ?3, 0, 0, 0)",
-      -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, flags);
-  rc = sqlite3_step(stmt);
+  DT_DEBUG_SQLITE3_BIND_INT(b->insert, 1, film_id);
+  DT_DEBUG_SQLITE3_BIND_TEXT(b->insert, 2, imgfname, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_INT(b->insert, 3, flags);
+  rc = sqlite3_step(b->insert);
   if(rc != SQLITE_DONE) fprintf(stderr, "sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  _image_import_statement_done(b->insert);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE film_id = ?1 AND filename = ?2", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, imgfname, -1, SQLITE_STATIC);
-  if(sqlite3_step(stmt) == SQLITE_ROW) id = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_BIND_INT(b->find, 1, film_id);
+  DT_DEBUG_SQLITE3_BIND_TEXT(b->find, 2, imgfname, -1, SQLITE_STATIC);
+  if(sqlite3_step(b->find) == SQLITE_ROW) id = sqlite3_column_int(b->find, 0);
+  _image_import_statement_done(b->find);
+  if(b->added && id) g_array_append_val(b->added, id);
 
   // Try to find out if this should be grouped already.
   gchar *basename = g_strdup(imgfname);
@@ -848,11 +904,7 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   // in case we are not a jpg check if we need to change group representative
   if(strcmp(ext, "jpg") != 0 && strcmp(ext, "jpeg") != 0)
   {
-    sqlite3_stmt *stmt2;
-    DT_DEBUG_SQLITE3_PREPARE_V2(
-        dt_database_get(darktable.db),
-        "SELECT group_id FROM main.images WHERE film_id = ?1 AND filename LIKE ?2 AND id = group_id", -1, &stmt2,
-        NULL);
+    sqlite3_stmt *stmt2 = b->group;
     DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, film_id);
     DT_DEBUG_SQLITE3_BIND_TEXT(stmt2, 2, sql_pattern, -1, SQLITE_TRANSIENT);
     // if we have a group already
@@ -898,14 +950,11 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
     {
       group_id = id;
     }
-    sqlite3_finalize(stmt2);
+    _image_import_statement_done(stmt2);
   }
   else
   {
-    sqlite3_stmt *stmt2;
-    DT_DEBUG_SQLITE3_PREPARE_V2(
-        dt_database_get(darktable.db),
-        "SELECT group_id FROM main.images WHERE film_id = ?1 AND filename LIKE ?2 AND id != ?3", -1, &stmt2, NULL);
+    sqlite3_stmt *stmt2 = b->group_jpg;
     DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, film_id);
     DT_DEBUG_SQLITE3_BIND_TEXT(stmt2, 2, sql_pattern, -1, SQLITE_TRANSIENT);
     DT_DEBUG_SQLITE3_BIND_INT(stmt2, 3, id);
@@ -913,14 +962,12 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
       group_id = sqlite3_column_int(stmt2, 0);
     else
       group_id = id;
-    sqlite3_finalize(stmt2);
+    _image_import_statement_done(stmt2);
   }
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "UPDATE main.images SET group_id = ?1 WHERE id = ?2",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, group_id);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, id);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_BIND_INT(b->set_group, 1, group_id);
+  DT_DEBUG_SQLITE3_BIND_INT(b->set_group, 2, id);
+  sqlite3_step(b->set_group);
+  _image_import_statement_done(b->set_group);
 
   // printf("[image_import] importing `%s' to img id %d\n", imgfname, id);
 
@@ -929,13 +976,13 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   img->group_id = group_id;
 
   // read dttags and exif for database queries!
-  (void)dt_exif_read(img, filename);
+  (void)(exif ? dt_exif_read_file(img, exif) : dt_exif_read(img, filename));
   char dtfilename[PATH_MAX] = { 0 };
   g_strlcpy(dtfilename, filename, sizeof(dtfilename));
   // dt_image_path_append_version(id, dtfilename, sizeof(dtfilename));
   g_strlcat(dtfilename, ".xmp", sizeof(dtfilename));
 
-  int res = dt_exif_xmp_read(img, dtfilename, 0);
+  int res = xmp ? dt_exif_xmp_read_file(img, xmp, 0) : dt_exif_xmp_read(img, dtfilename, 0);
 
   // write through to db, but not to xmp.
   dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
@@ -950,7 +997,6 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   guint tagid = 0;
   char tagname[512];
   snprintf(tagname, sizeof(tagname), "darktable|format|%s", ext);
-  g_free(ext);
   dt_tag_new(tagname, &tagid);
   dt_tag_attach(tagid, id);
 
@@ -973,6 +1019,142 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   return id;
 }
 
+uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
+{
+  char *ext = _image_import_check(filename, override_ignore_jpegs);
+  if(!ext) return 0;
+
+  dt_image_import_batch_t b = { 0 };
+  _image_import_statements_prepare(&b);
+  const uint32_t id = _image_import_internal(&b, film_id, filename, ext, _image_import_extra_flags(filename),
+                                             NULL, NULL);
+  _image_import_statements_finalize(&b);
+  g_free(ext);
+  return id;
+}
+
+void dt_image_import_prepare(dt_image_import_file_t *file, const char *filename, gboolean override_ignore_jpegs)
+{
+  memset(file, 0, sizeof(dt_image_import_file_t));
+  file->filename = g_strdup(filename);
+  file->ext = _image_import_check(filename, override_ignore_jpegs);
+  if(!file->ext) return;
+
+  file->extra_flags = _image_import_extra_flags(filename);
+  file->exif = dt_exif_file_open(filename);
+  gchar *xmpfilename = g_strconcat(filename, ".xmp", NULL);
+  file->xmp = dt_exif_file_open(xmpfilename);
+  g_free(xmpfilename);
+}
+
+void dt_image_import_file_cleanup(dt_image_import_file_t *file)
+{
+  if(file->exif) dt_exif_file_close(file->exif);
+  if(file->xmp) dt_exif_file_close(file->xmp);
+  g_free(file->filename);
+  g_free(file->ext);
+  memset(file, 0, sizeof(dt_image_import_file_t));
+}
+
+dt_image_import_batch_t *dt_image_import_batch_begin(void)
+{
+  dt_image_import_batch_t *b = (dt_image_import_batch_t *)calloc(1, sizeof(dt_image_import_batch_t));
+  if(!b) return NULL;
+  _image_import_statements_prepare(b);
+  b->added = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+  b->transaction
+      = (sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT import_batch", NULL, NULL, NULL) == SQLITE_OK);
+  return b;
+}
+
+uint32_t dt_image_import_prepared(dt_image_import_batch_t *batch, const int32_t film_id,
+                                  dt_image_import_file_t *file)
+{
+  if(!file->ext) return 0;
+  if(batch)
+    return _image_import_internal(batch, film_id, file->filename, file->ext, file->extra_flags, file->exif,
+                                  file->xmp);
+
+  // no batch, no transaction either
+  dt_image_import_batch_t b = { 0 };
+  _image_import_statements_prepare(&b);
+  const uint32_t id = _image_import_internal(&b, film_id, file->filename, file->ext, file->extra_flags,
+                                             file->exif, file->xmp);
+  _image_import_statements_finalize(&b);
+  return id;
+}
+
+// a reader elsewhere can hold the library for a moment, wait up to 50 * 20ms for it before giving up
+#define DT_IMAGE_IMPORT_COMMIT_TRIES 50
+#define DT_IMAGE_IMPORT_COMMIT_WAIT 20000
+
+/* the batch writes within a savepoint on the connection all threads share, so whatever else writes in the
+ * meantime (like the presets auto applied while the first thumbnails are made) nests its own savepoints in
+ * it. returns FALSE if what got imported since the last commit is still pending. */
+static gboolean _image_import_batch_release(dt_image_import_batch_t *b, const gboolean last)
+{
+  const guint added = b->added->len;
+  if(!b->transaction) goto done;
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  int rc;
+  for(int tries = 0; (rc = sqlite3_exec(db, "RELEASE import_batch", NULL, NULL, NULL)) == SQLITE_BUSY
+                     && tries < DT_IMAGE_IMPORT_COMMIT_TRIES;
+      tries++)
+    g_usleep(DT_IMAGE_IMPORT_COMMIT_WAIT);
+
+  if(rc == SQLITE_ERROR || sqlite3_get_autocommit(db))
+  {
+    // no transaction, or not ours: a COMMIT from elsewhere already took the images with it
+    if(rc != SQLITE_OK)
+      dt_print(DT_DEBUG_SQL, "[image_import] %u images got committed from elsewhere\n", added);
+    rc = SQLITE_OK;
+  }
+  if(rc == SQLITE_OK)
+  {
+    b->transaction = FALSE;
+    goto done;
+  }
+
+  if(!last)
+  {
+    // keep the savepoint, the next commit tries again together with the images added until then
+    fprintf(stderr, "[image_import] can't commit %u imported images yet: %s\n", added, sqlite3_errmsg(db));
+    return FALSE;
+  }
+
+  // don't leave the transaction open for good, everything written after it would be lost with it
+  fprintf(stderr, "[image_import] can't commit %u imported images: %s\n", added, sqlite3_errmsg(db));
+  sqlite3_exec(db, "ROLLBACK TO import_batch", NULL, NULL, NULL);
+  sqlite3_exec(db, "RELEASE import_batch", NULL, NULL, NULL);
+  b->transaction = FALSE;
+  for(guint k = 0; k < added; k++)
+    dt_image_cache_remove(darktable.image_cache, g_array_index(b->added, uint32_t, k));
+  dt_control_log(ngettext("%u image could not be added to the library",
+                          "%u images could not be added to the library", added),
+                 added);
+done:
+  g_array_set_size(b->added, 0);
+  return TRUE;
+}
+
+void dt_image_import_batch_commit(dt_image_import_batch_t *batch)
+{
+  if(!batch) return;
+  if(_image_import_batch_release(batch, FALSE))
+    batch->transaction
+        = (sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT import_batch", NULL, NULL, NULL) == SQLITE_OK);
+}
+
+void dt_image_import_batch_end(dt_image_import_batch_t *batch)
+{
+  if(!batch) return;
+  _image_import_batch_release(batch, TRUE);
+  _image_import_statements_finalize(batch);
+  g_array_free(batch->added, TRUE);
+  free(batch);
+}
+
 void dt_image_init(dt_image_t *img)
 {
   img->width = img->height = 0;
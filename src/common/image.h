@@ -220,6 +220,31 @@ void dt_image_print_exif(const dt_image_t *img, char *line, size_t line_len);
 void dt_image_read_duplicates(uint32_t id, const char *filename);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. */
 uint32_t dt_image_import(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
+
+/** a file prepared for import by dt_image_import_prepare(). */
+typedef struct dt_image_import_file_t
+{
+  char *filename;
+  char *ext;                    // lower case extension, NULL if the file is not to be imported
+  uint32_t extra_flags;         // DT_IMAGE_HAS_WAV and DT_IMAGE_HAS_TXT
+  struct dt_exif_file_t *exif;  // metadata of the image
+  struct dt_exif_file_t *xmp;   // and of its sidecar
+} dt_image_import_file_t;
+
+/** bulk imports are split in two: dt_image_import_prepare() does all the file system work of importing a
+ * file, checking it and parsing its metadata and sidecar. it does not touch the database or the image cache,
+ * so many files can be prepared in parallel. dt_image_import_prepared() then does what dt_image_import()
+ * does with the prepared file, reusing the statements of the batch and writing within its transaction. */
+typedef struct dt_image_import_batch_t dt_image_import_batch_t;
+void dt_image_import_prepare(dt_image_import_file_t *file, const char *filename, gboolean override_ignore_jpegs);
+void dt_image_import_file_cleanup(dt_image_import_file_t *file);
+/** starts a batch and its first transaction. */
+dt_image_import_batch_t *dt_image_import_batch_begin(void);
+uint32_t dt_image_import_prepared(dt_image_import_batch_t *batch, int32_t film_id, dt_image_import_file_t *file);
+/** commits what has been imported so far and starts the next transaction. */
+void dt_image_import_batch_commit(dt_image_import_batch_t *batch);
+/** commits and frees the batch. */
+void dt_image_import_batch_end(dt_image_import_batch_t *batch);
 /** removes the given image from the database. */
 void dt_image_remove(const int32_t imgid);
 /** duplicates the given image in the database with the duplicate getting the supplied version number. if that
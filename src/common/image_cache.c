@@ -36,13 +36,13 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   // load stuff from db and store in cache:
   char *str;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(
+      darktable.db,
       "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "
       "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "
       "raw_parameters, longitude, latitude, altitude, color_matrix, colorspace, version, raw_black, "
       "raw_maximum, average_brightness, timelapse_keyframe, exposure_correction FROM main.images WHERE id = ?1", /* added timelapse stuff */
-      -1, &stmt, NULL);
+      &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, entry->key);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -137,7 +137,7 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
     fprintf(stderr, "[image_cache_allocate] failed to open image %d from database: %s\n", entry->key,
             sqlite3_errmsg(dt_database_get(darktable.db)));
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
   img->cache_entry = entry; // init backref
   // could downgrade lock write->read on entry->lock if we were using concurrencykit..
   dt_image_refresh_makermodel(img);
@@ -160,7 +160,8 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
-  dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
+  // lots of threads (lighttable, thumbnail and import jobs) hit this one, spread the lock:
+  dt_cache_init_segmented(&cache->cache, sizeof(dt_image_t), max_mem, 16);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
@@ -174,9 +175,11 @@ void dt_image_cache_cleanup(dt_image_cache_t *cache)
 
 void dt_image_cache_print(dt_image_cache_t *cache)
 {
-  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", cache->cache.cost / (1024.0 * 1024.0),
+  const size_t cost = dt_cache_get_cost(&cache->cache);
+  printf("[image cache] fill %.2f/%.2f MB (%.2f%%)\n", cost / (1024.0 * 1024.0),
          cache->cache.cost_quota / (1024.0 * 1024.0),
-         (float)cache->cache.cost / (float)cache->cache.cost_quota);
+         (float)cost / (float)cache->cache.cost_quota);
+  dt_cache_print_contention(&cache->cache, "image cache");
 }
 
 dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const uint32_t imgid, char mode)
@@ -215,15 +218,15 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
 {
   if(img->id <= 0) return;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(
+      darktable.db,
       "UPDATE main.images SET width = ?1, height = ?2, maker = ?3, model = ?4, "
       "lens = ?5, exposure = ?6, aperture = ?7, iso = ?8, focal_length = ?9, "
       "focus_distance = ?10, film_id = ?11, datetime_taken = ?12, flags = ?13, "
       "crop = ?14, orientation = ?15, raw_parameters = ?16, group_id = ?17, longitude = ?18, "
       "latitude = ?19, altitude = ?20, color_matrix = ?21, colorspace = ?22, raw_black = ?23, "
       "raw_maximum = ?24, average_brightness = ?25, timelapse_keyframe = ?26, exposure_correction = ?27 WHERE id = ?28", /* added timelapse stuff */
-      -1, &stmt, NULL);
+      &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->exif_maker, -1, SQLITE_STATIC);
@@ -254,7 +257,7 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 28, img->id);
   int rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  dt_database_release_statement(darktable.db, stmt);
 
   // TODO: make this work in relaxed mode, too.
   if(mode == DT_IMAGE_CACHE_SAFE)
@@ -48,6 +48,8 @@
 #include "develop/blend.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/tiling.h"
 
 #ifdef HAVE_GRAPHICSMAGICK
 #include <magick/api.h>
@@ -537,6 +539,357 @@ int dt_imageio_export(const uint32_t imgid, const char *filename, dt_imageio_mod
                                         0, NULL, copy_metadata, storage, storage_params, num, total);
 }
 
+// run the export pipe for rows y..y+height of the output, leaving the result in pipe->backbuf
+static int _export_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const int y, const int width,
+                           const int height, const double scale, const gboolean high_quality_processing,
+                           const int bpp)
+{
+  int res = 0;
+  if(high_quality_processing)
+  {
+    /*
+     * if high quality processing was requested, downsampling will be done
+     * at the very end of the pipe (just before border and watermark)
+     */
+    res = dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y, width, height, scale);
+  }
+  else
+  {
+    // else, downsampling will be right after demosaic
+
+    // so we need to turn temporarily disable in-pipe late downsampling iop.
+
+    // find the finalscale module
+    dt_dev_pixelpipe_iop_t *finalscale = NULL;
+    {
+      GList *nodes = g_list_last(pipe->nodes);
+      while(nodes)
+      {
+        dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
+        if(!strcmp(node->module->op, "finalscale"))
+        {
+          finalscale = node;
+          break;
+        }
+        nodes = g_list_previous(nodes);
+      }
+    }
+
+    if(finalscale) finalscale->enabled = 0;
+
+    // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
+    if(bpp == 8)
+      res = dt_dev_pixelpipe_process(pipe, dev, 0, y, width, height, scale);
+    else
+      res = dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y, width, height, scale);
+
+    if(finalscale) finalscale->enabled = 1;
+  }
+  return res;
+}
+
+// downconversion of the pipe output to low-precision formats, in place
+static void _export_convert(uint8_t *const outbuf, const int processed_width, const int processed_height,
+                            const int bpp, const int32_t display_byteorder, const gboolean high_quality_processing)
+{
+  if(bpp == 8)
+  {
+    if(display_byteorder)
+    {
+      if(high_quality_processing)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      // else processing output was 8-bit already, and no need to swap order
+    }
+    else // need to flip
+    {
+      // ldr output: char
+      if(high_quality_processing)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      else
+      { // !display_byteorder, need to swap:
+        uint8_t *const buf8 = outbuf;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+        // just flip byte order
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          uint8_t tmp = buf8[4 * k + 0];
+          buf8[4 * k + 0] = buf8[4 * k + 2];
+          buf8[4 * k + 2] = tmp;
+        }
+      }
+    }
+  }
+  else if(bpp == 16)
+  {
+    // uint16_t per color channel
+    float *buff = (float *)outbuf;
+    uint16_t *buf16 = (uint16_t *)outbuf;
+    for(int y = 0; y < processed_height; y++)
+      for(int x = 0; x < processed_width; x++)
+      {
+        // convert in place
+        const size_t k = (size_t)processed_width * y + x;
+        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
+      }
+  }
+  // else output float, no further harm done to the pixels :)
+}
+
+// can the export pipe run on horizontal bands of the output? returns the number of rows each band needs
+// on top and bottom for the neighbourhoods of all modules, or -1 if some module can't be run on parts of
+// the image. *factor is set to the largest memory requirement of a module, in band buffers.
+static int _export_band_margin(dt_dev_pixelpipe_t *pipe, const int width, const int height, const double scale,
+                               float *factor)
+{
+  const dt_iop_roi_t roi = (dt_iop_roi_t){ 0, 0, width, height, scale };
+  int margin = 0;
+  *factor = 2.0f;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    if(!piece->enabled) continue;
+
+    // the same modules can be tiled, gamma just converts to 8 bits
+    if(!(module->flags() & IOP_FLAGS_ALLOW_TILING) && strcmp(module->op, "gamma")) return -1;
+
+    dt_develop_tiling_t tiling = { 0 };
+    module->tiling_callback(module, piece, &roi, &roi, &tiling);
+    margin += tiling.overlap;
+    *factor = fmaxf(*factor, tiling.factor);
+
+    // blurred blend masks reach out further
+    const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+    if(bp && (bp->mask_mode & DEVELOP_MASK_ENABLED)) margin += ceilf(3.0f * fabsf(bp->radius));
+  }
+  return margin;
+}
+
+// process and write the export in horizontal bands of the output, so the pipe never holds more than a band
+// with its margins in any buffer.
+static int _export_stream(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_imageio_module_format_t *format,
+                          dt_imageio_module_data_t *format_params, const char *filename, void *exif,
+                          const int exif_len, const int imgid, const int num, const int total, const int width,
+                          const int height, const double scale, const gboolean high_quality_processing,
+                          const int bpp, const int32_t display_byteorder, const int band_height, const int margin)
+{
+  if(format->write_image_begin(format_params, filename, exif, exif_len, imgid, num, total)) return 1;
+
+  // the pipe hands out floats, unless it already went through gamma
+  const size_t pixel_size = (bpp == 8 && !high_quality_processing) ? 4 * sizeof(uint8_t) : 4 * sizeof(float);
+
+  int res = 0;
+  for(int y = 0; y < height && !res; y += band_height)
+  {
+    const int rows = MIN(band_height, height - y);
+    const int top = MIN(margin, y);
+    const int bottom = MIN(margin, height - y - rows);
+
+    dt_times_t start;
+    dt_get_times(&start);
+    res = _export_process(pipe, dev, y - top, width, top + rows + bottom, scale, high_quality_processing, bpp);
+    if(res || !pipe->backbuf) break;
+    dt_show_times(&start, "[dev_process_export] pixel pipeline processing", "rows %d to %d of %d", y, y + rows,
+                  height);
+
+    uint8_t *band = (uint8_t *)pipe->backbuf + pixel_size * width * top;
+    _export_convert(band, width, rows, bpp, display_byteorder, high_quality_processing);
+    res = format->write_image_band(format_params, band, y, rows);
+  }
+  if(!res && !pipe->backbuf) res = 1;
+
+  return format->write_image_end(format_params, filename, exif, exif_len, res) || res;
+}
+
+// the pipe output shared by all variants of one image, see dt_imageio_export_variants()
+typedef struct dt_imageio_export_source_t
+{
+  uint32_t imgid;
+  const dt_imageio_export_variant_t *variants;
+  int count;
+  char style[128];
+  gboolean style_append;
+  gboolean rendered; // buf holds the pipe output, up to finalscale
+  gboolean unshared; // the pipe can't be shared, every variant runs its own
+  float *buf;
+  int width, height;                     // size of buf
+  double scale;                          // scale buf was rendered at
+  int processed_width, processed_height; // size of the pipe output at scale 1
+  int sRGB;
+} dt_imageio_export_source_t;
+
+// set while the storage of a variant exports on this thread
+static __thread dt_imageio_export_source_t *_export_source = NULL;
+
+// scale of the pipe output that fits into the size the format asks for
+static double _export_scale(const dt_imageio_module_data_t *format_params, const int processed_width,
+                            const int processed_height, const gboolean upscale)
+{
+  const float max_scale = upscale ? 100.0 : 1.0;
+  const double scalex = format_params->max_width > 0
+                            ? fminf(format_params->max_width / (double)processed_width, max_scale)
+                            : 1.0;
+  const double scaley = format_params->max_height > 0
+                            ? fminf(format_params->max_height / (double)processed_height, max_scale)
+                            : 1.0;
+  return fminf(scalex, scaley);
+}
+
+static int _export_read_exif(const uint32_t imgid, const int sRGB, const int width, const int height,
+                             uint8_t **exif_profile)
+{
+  char pathname[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+  // last param is dng mode, it's false here
+  return dt_exif_read_blob(exif_profile, pathname, imgid, sRGB, width, height, 0);
+}
+
+// run the pipe once for all variants, at the largest size any of them needs. the modules after finalscale
+// (borders, watermark, ...) depend on the size of the output, if any of them is on every variant has to run
+// its own pipe. returns non-zero if the pipe failed.
+static int _export_source_render(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_imageio_export_source_t *source,
+                                 const gboolean high_quality, const gboolean upscale, const int sRGB)
+{
+  GList *nodes = g_list_last(pipe->nodes);
+  for(; nodes; nodes = g_list_previous(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!strcmp(piece->module->op, "finalscale")) break;
+    // gamma only converts to 8 bits, which every variant does for itself
+    if(piece->enabled && strcmp(piece->module->op, "gamma")) break;
+  }
+  if(!nodes || strcmp(((dt_dev_pixelpipe_iop_t *)nodes->data)->module->op, "finalscale"))
+  {
+    source->unshared = TRUE;
+    return 0;
+  }
+
+  double scale = 0.0;
+  for(int k = 0; k < source->count; k++)
+    scale = fmax(scale, _export_scale(source->variants[k].format_params, pipe->processed_width,
+                                      pipe->processed_height, upscale));
+  const int width = scale * pipe->processed_width + .5f;
+  const int height = scale * pipe->processed_height + .5f;
+
+  // the largest variant comes out as if it had been exported on its own, in floating point
+  const int res = _export_process(pipe, dev, 0, width, height, scale, scale < 1.0 && high_quality, 32);
+  if(res || !pipe->backbuf) return 1;
+
+  source->buf = dt_alloc_align(64, sizeof(float) * 4 * width * height);
+  if(!source->buf) return 1;
+  memcpy(source->buf, pipe->backbuf, sizeof(float) * 4 * width * height);
+  source->width = width;
+  source->height = height;
+  source->scale = scale;
+  source->processed_width = pipe->processed_width;
+  source->processed_height = pipe->processed_height;
+  source->sRGB = sRGB;
+  source->rendered = TRUE;
+  dt_print(DT_DEBUG_DEV, "[export] rendered %dx%d once for %d variants\n", width, height, source->count);
+  return 0;
+}
+
+// scale the shared pipe output down to the size of one variant and hand it to the format
+static int _export_source_write(const dt_imageio_export_source_t *source, dt_imageio_module_format_t *format,
+                                dt_imageio_module_data_t *format_params, const char *filename, void *exif,
+                                const int exif_len, const int imgid, const int num, const int total,
+                                const int width, const int height, const double scale, const int bpp,
+                                const int32_t display_byteorder)
+{
+  float *outbuf = dt_alloc_align(64, sizeof(float) * 4 * width * height);
+  if(!outbuf) return 1;
+
+  if(width == source->width && height == source->height)
+    memcpy(outbuf, source->buf, sizeof(float) * 4 * width * height);
+  else
+  {
+    // the same resampling finalscale does at the end of the pipe
+    const dt_iop_roi_t roi_in = { 0, 0, source->width, source->height, 1.0f };
+    const dt_iop_roi_t roi_out = { 0, 0, width, height, scale / source->scale };
+    dt_iop_clip_and_zoom_roi(outbuf, source->buf, &roi_out, &roi_in, width, source->width);
+  }
+
+  _export_convert((uint8_t *)outbuf, width, height, bpp, display_byteorder, TRUE);
+  const int res = format->write_image(format_params, filename, outbuf, exif, exif_len, imgid, num, total);
+  dt_free_align(outbuf);
+  return res;
+}
+
+// export a variant from the pipe output the first one left behind
+static int _export_source_variant(const dt_imageio_export_source_t *source, const uint32_t imgid,
+                                  const char *filename, dt_imageio_module_format_t *format,
+                                  dt_imageio_module_data_t *format_params, const int32_t ignore_exif,
+                                  const int32_t display_byteorder, const gboolean upscale, const int num,
+                                  const int total)
+{
+  const double scale = _export_scale(format_params, source->processed_width, source->processed_height, upscale);
+  const int width = scale * source->processed_width + .5f;
+  const int height = scale * source->processed_height + .5f;
+  format_params->width = width;
+  format_params->height = height;
+
+  int length = 0;
+  uint8_t *exif_profile = NULL;
+  if(!ignore_exif) length = _export_read_exif(imgid, source->sRGB, width, height, &exif_profile);
+
+  dt_times_t start;
+  dt_get_times(&start);
+  const int res = _export_source_write(source, format, format_params, filename, exif_profile, length, imgid, num,
+                                       total, width, height, scale, format->bpp(format_params), display_byteorder);
+  dt_show_times(&start, "[dev_process_export] scaling shared pipe output", "%dx%d", width, height);
+
+  free(exif_profile);
+  return res;
+}
+
+// what is left to do once the file is written
+static void _export_finish(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                           dt_imageio_module_data_t *format_params, const int32_t thumbnail_export,
+                           const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
+                           dt_imageio_module_data_t *storage_params)
+{
+  /* now write xmp into that container, if possible */
+  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+  {
+    dt_exif_xmp_attach(imgid, filename);
+    // no need to cancel the export if this fail
+  }
+
+  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
+    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  {
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
+                            format_params, storage, storage_params);
+  }
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
 int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
@@ -546,6 +899,21 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_storage_t *storage,
                                  dt_imageio_module_data_t *storage_params, int num, int total)
 {
+  // variants of the same image share the output of one pipe run, see dt_imageio_export_variants()
+  dt_imageio_export_source_t *source = _export_source;
+  if(source
+     && (source->imgid != imgid || source->unshared || thumbnail_export || filter
+         || strcmp(source->style, format_params->style) || source->style_append != format_params->style_append))
+    source = NULL;
+  if(source && source->rendered)
+  {
+    const int res = _export_source_variant(source, imgid, filename, format, format_params, ignore_exif,
+                                           display_byteorder, upscale, num, total);
+    _export_finish(imgid, filename, format, format_params, thumbnail_export, copy_metadata, storage,
+                   storage_params);
+    return res;
+  }
+
   dt_develop_t dev;
   dt_dev_init(&dev, 0);
   dt_dev_load_image(&dev, imgid);
@@ -570,15 +938,20 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   const int wd = img->width;
   const int ht = img->height;
-  const float max_scale = upscale ? 100.0 : 1.0;
 
   int res = 0;
 
   dt_times_t start;
   dt_get_times(&start);
+  // for huge images don't allocate full sized buffers upfront, the export might go in bands
+  const int stream_threshold = dt_conf_get_int("plugins/lighttable/export/stream_threshold");
+  const gboolean stream_export
+      = !thumbnail_export && stream_threshold > 0 && (size_t)wd * ht > (size_t)stream_threshold * 1000000;
+
   dt_dev_pixelpipe_t pipe;
   res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-                         : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params));
+                         : dt_dev_pixelpipe_init_export(&pipe, stream_export ? 0 : wd, stream_export ? 0 : ht,
+                                                        format->levels(format_params));
   if(!res)
   {
     dt_control_log(
@@ -721,174 +1094,87 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
             ? FALSE
             : high_quality;
 
-  const int width = format_params->max_width;
-  const int height = format_params->max_height;
-  const double scalex = width > 0 ? fminf(width / (double)pipe.processed_width, max_scale) : 1.0;
-  const double scaley = height > 0 ? fminf(height / (double)pipe.processed_height, max_scale) : 1.0;
-  const double scale = fminf(scalex, scaley);
+  const double scale = _export_scale(format_params, pipe.processed_width, pipe.processed_height, upscale);
 
   const int processed_width = scale * pipe.processed_width + .5f;
   const int processed_height = scale * pipe.processed_height + .5f;
 
   const int bpp = format->bpp(format_params);
 
-  dt_get_times(&start);
-  if(high_quality_processing)
+  // huge exports are processed and written in bands, if all modules and the format can do that
+  int band_height = 0, margin = -1;
+  float factor = 2.0f;
+  if(stream_export && format->write_image_begin
+     && (size_t)processed_width * processed_height > (size_t)stream_threshold * 1000000)
+    margin = _export_band_margin(&pipe, processed_width, processed_height, scale, &factor);
+  if(margin >= 0)
   {
-    /*
-     * if high quality processing was requested, downsampling will be done
-     * at the very end of the pipe (just before border and watermark)
-     */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    // bands with their margins and the modules' temporary buffers take up to half of the host memory limit
+    const int host_memory_limit = dt_conf_get_int("host_memory_limit");
+    const size_t available = (size_t)(host_memory_limit > 0 ? host_memory_limit : 1024) * 1024 * 1024 / 2;
+    const size_t row_size = (size_t)4 * sizeof(float) * processed_width;
+    const int rows = available / ((factor + 2.0f) * row_size);
+    band_height = MAX(rows - 2 * margin, MAX(64, 2 * margin));
+    if(band_height >= processed_height) band_height = 0;
   }
-  else
-  {
-    // else, downsampling will be right after demosaic
-
-    // so we need to turn temporarily disable in-pipe late downsampling iop.
 
-    // find the finalscale module
-    dt_dev_pixelpipe_iop_t *finalscale = NULL;
-    {
-      GList *nodes = g_list_last(pipe.nodes);
-      while(nodes)
-      {
-        dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
-        if(!strcmp(node->module->op, "finalscale"))
-        {
-          finalscale = node;
-          break;
-        }
-        nodes = g_list_previous(nodes);
-      }
-    }
-
-    if(finalscale) finalscale->enabled = 0;
-
-    // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-    else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-
-    if(finalscale) finalscale->enabled = 1;
+  // the first variant renders for all of them. huge images would have to keep their full output around,
+  // they rather run the pipe per variant, in bands.
+  if(source && stream_export) source->unshared = TRUE;
+  if(source && !source->unshared && _export_source_render(&pipe, &dev, source, high_quality, upscale, sRGB))
+  {
+    dt_control_log(_("image `%s' could not be processed for export"), img->filename);
+    goto error;
   }
-  dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
-                                         : "[dev_process_export] pixel pipeline processing",
-                NULL);
 
-  uint8_t *outbuf = pipe.backbuf;
+  format_params->width = processed_width;
+  format_params->height = processed_height;
 
-  // downconversion to low-precision formats:
-  if(bpp == 8)
+  int length = 0;
+  uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
+                                // adding new tags could make it go over that... so let it be and see what
+                                // happens when we write the image
+  if(!ignore_exif) length = _export_read_exif(imgid, sRGB, processed_width, processed_height, &exif_profile);
+
+  dt_get_times(&start);
+  if(source && source->rendered)
   {
-    if(display_byteorder)
-    {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
-    }
-    else // need to flip
-    {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static)
-#endif
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
-      }
-    }
+    res = _export_source_write(source, format, format_params, filename, exif_profile, length, imgid, num, total,
+                               processed_width, processed_height, scale, bpp, display_byteorder);
+    dt_show_times(&start, "[dev_process_export] scaling shared pipe output", "%dx%d", processed_width,
+                  processed_height);
   }
-  else if(bpp == 16)
+  else if(band_height)
   {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
-      }
+    dt_print(DT_DEBUG_DEV, "[export] streaming %dx%d in bands of %d rows with %d rows margin\n",
+             processed_width, processed_height, band_height, margin);
+    res = _export_stream(&pipe, &dev, format, format_params, filename, exif_profile, length, imgid, num, total,
+                         processed_width, processed_height, scale, high_quality_processing, bpp,
+                         display_byteorder, band_height, margin);
+    dt_show_times(&start, "[dev_process_export] streamed export", NULL);
   }
-  // else output float, no further harm done to the pixels :)
+  else
+  {
+    _export_process(&pipe, &dev, 0, processed_width, processed_height, scale, high_quality_processing, bpp);
+    dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
+                                           : "[dev_process_export] pixel pipeline processing",
+                  NULL);
 
-  format_params->width = processed_width;
-  format_params->height = processed_height;
+    uint8_t *outbuf = pipe.backbuf;
 
-  if(!ignore_exif)
-  {
-    int length;
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
-                                  // adding new tags could make it go over that... so let it be and see what
-                                  // happens when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-    // last param is dng mode, it's false here
-    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+    _export_convert(outbuf, processed_width, processed_height, bpp, display_byteorder, high_quality_processing);
 
     res = format->write_image(format_params, filename, outbuf, exif_profile, length, imgid, num, total);
-
-    free(exif_profile);
-  }
-  else
-  {
-    res = format->write_image(format_params, filename, outbuf, NULL, 0, imgid, num, total);
   }
 
+  free(exif_profile);
+
   dt_dev_pixelpipe_cleanup(&pipe);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
-  /* now write xmp into that container, if possible */
-  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
-  {
-    dt_exif_xmp_attach(imgid, filename);
-    // no need to cancel the export if this fail
-  }
-
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
-  {
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                            format_params, storage, storage_params);
-  }
+  _export_finish(imgid, filename, format, format_params, thumbnail_export, copy_metadata, storage,
+                 storage_params);
 
   return res;
 
@@ -900,6 +1186,46 @@ error_early:
   return 1;
 }
 
+int dt_imageio_export_variants(const uint32_t imgid, const dt_imageio_export_variant_t *variants, const int count,
+                               const gboolean high_quality, const gboolean upscale, const int num, const int total)
+{
+  if(count <= 0) return 0;
+
+  dt_imageio_export_source_t source = { 0 };
+  source.imgid = imgid;
+  source.variants = variants;
+  source.count = count;
+  g_strlcpy(source.style, variants[0].format_params->style, sizeof(source.style));
+  source.style_append = variants[0].format_params->style_append;
+
+  // the first one runs the pipe for everybody on its way
+  _export_source = &source;
+  int failed = variants[0].storage->store(variants[0].storage, variants[0].storage_params, imgid,
+                                          variants[0].format, variants[0].format_params, num, total,
+                                          high_quality, upscale) != 0;
+  _export_source = NULL;
+
+  // the others only scale and encode, side by side if their storages can take it
+  gboolean parallel = source.rendered;
+  for(int k = 1; k < count; k++)
+    parallel = parallel && variants[k].storage->concurrent_store(variants[k].storage, variants[k].storage_params);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(variants, source) schedule(dynamic, 1) reduction(+ : failed) \
+    if(parallel)
+#endif
+  for(int k = 1; k < count; k++)
+  {
+    _export_source = &source;
+    failed += variants[k].storage->store(variants[k].storage, variants[k].storage_params, imgid,
+                                         variants[k].format, variants[k].format_params, num, total,
+                                         high_quality, upscale) != 0;
+    _export_source = NULL;
+  }
+
+  dt_free_align(source.buf);
+  return failed;
+}
 
 // fallback read method in case file could not be opened yet.
 // use GraphicsMagick (if supported) to read exotic LDRs
@@ -78,6 +78,20 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
                                  dt_imageio_module_data_t *storage_params, int num, int total);
 
+/** one output of dt_imageio_export_variants(), with a size, format and storage of its own */
+typedef struct dt_imageio_export_variant_t
+{
+  struct dt_imageio_module_format_t *format;
+  struct dt_imageio_module_data_t *format_params; // max_width and max_height select the size
+  struct dt_imageio_module_storage_t *storage;
+  struct dt_imageio_module_data_t *storage_params;
+} dt_imageio_export_variant_t;
+
+/** hand one image to the storages of all variants. the pixelpipe runs only once, at the largest size any of
+ *  them needs, and the smaller ones are scaled down from its output. returns the number of failed variants. */
+int dt_imageio_export_variants(const uint32_t imgid, const dt_imageio_export_variant_t *variants, const int count,
+                               const gboolean high_quality, const gboolean upscale, const int num, const int total);
+
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
 
@@ -109,6 +109,14 @@ static int dt_imageio_load_module_format(dt_imageio_module_format_t *module, con
   if(!g_module_symbol(module->module, "free_params", (gpointer) & (module->free_params))) goto error;
   if(!g_module_symbol(module->module, "set_params", (gpointer) & (module->set_params))) goto error;
   if(!g_module_symbol(module->module, "write_image", (gpointer) & (module->write_image))) goto error;
+  if(!g_module_symbol(module->module, "write_image_begin", (gpointer) & (module->write_image_begin))
+     || !g_module_symbol(module->module, "write_image_band", (gpointer) & (module->write_image_band))
+     || !g_module_symbol(module->module, "write_image_end", (gpointer) & (module->write_image_end)))
+  {
+    module->write_image_begin = NULL;
+    module->write_image_band = NULL;
+    module->write_image_end = NULL;
+  }
   if(!g_module_symbol(module->module, "bpp", (gpointer) & (module->bpp))) goto error;
   if(!g_module_symbol(module->module, "flags", (gpointer) & (module->flags)))
     module->flags = _default_format_flags;
@@ -194,6 +202,11 @@ static int _default_storage_dimension(struct dt_imageio_module_storage_t *self,
 {
   return 0;
 }
+/** Default implementation of concurrent_store, storage modules have to opt in to parallel exports */
+static int _default_concurrent_store(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
+{
+  return 0;
+}
 /** a NOP for when a default should do nothing */
 static void _default_storage_nop(struct dt_imageio_module_storage_t *self)
 {
@@ -243,6 +256,10 @@ static int dt_imageio_load_module_storage(dt_imageio_module_storage_t *module, c
     module->initialize_store = NULL;
   if(!g_module_symbol(module->module, "finalize_store", (gpointer) & (module->finalize_store)))
     module->finalize_store = NULL;
+  if(!g_module_symbol(module->module, "concurrent_store", (gpointer) & (module->concurrent_store)))
+    module->concurrent_store = _default_concurrent_store;
+  if(!g_module_symbol(module->module, "variant_suffix", (gpointer) & (module->variant_suffix)))
+    module->variant_suffix = NULL;
   if(!g_module_symbol(module->module, "set_params", (gpointer) & (module->set_params))) goto error;
 
   if(!g_module_symbol(module->module, "supported", (gpointer) & (module->supported)))
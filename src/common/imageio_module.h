@@ -116,6 +116,14 @@ typedef struct dt_imageio_module_format_t
   /* write to file, with exif if not NULL, and icc profile if supported. */
   int (*write_image)(dt_imageio_module_data_t *data, const char *filename, const void *in, void *exif,
                      int exif_len, int imgid, int num, int total);
+  /* optional: write the image in bands of rows, top to bottom, for exports too large to be kept in memory.
+     begin is called with data->width and height set, band with rows in the layout write_image() gets,
+     end after a successful begin, with failed set if anything went wrong. return != 0 on fail. */
+  int (*write_image_begin)(dt_imageio_module_data_t *data, const char *filename, void *exif, int exif_len,
+                           int imgid, int num, int total);
+  int (*write_image_band)(dt_imageio_module_data_t *data, const void *in, int y, int height);
+  int (*write_image_end)(dt_imageio_module_data_t *data, const char *filename, void *exif, int exif_len,
+                         int failed);
   /* flag that describes the available precision/levels of output format. mainly used for dithering. */
   int (*levels)(dt_imageio_module_data_t *data);
 
@@ -175,6 +183,12 @@ typedef struct dt_imageio_module_storage_t
                const int num, const int total, const gboolean high_quality, const gboolean upscale);
   /* called once at the end (after exporting all images), if implemented. */
   void (*finalize_store)(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data);
+  /* return non-zero if store() may be called from several threads at once for the same data. */
+  int (*concurrent_store)(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data);
+  /* append suffix to the names of the files stored with data, if implemented. keeps export variants of the
+   * same format apart. */
+  void (*variant_suffix)(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data,
+                         const char *suffix);
 
   void *(*legacy_params)(struct dt_imageio_module_storage_t *self, const void *const old_params,
                          const size_t old_params_size, const int old_version, const int new_version,
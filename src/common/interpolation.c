@@ -23,9 +23,13 @@
 #include <assert.h>
 #include <glib.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
+#if defined(HAVE_AVX2_TARGET)
+#include <immintrin.h>
+#endif
 
 /** Border extrapolation modes */
 enum border_mode
@@ -1350,311 +1354,327 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
-static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
-                                            const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                            const float *const in, const dt_iop_roi_t *const roi_in,
-                                            const int32_t in_stride)
+/* ------------------------------------------------------------------------
+ * Resampling plan cache
+ * ----------------------------------------------------------------------*/
+
+/* A plan only depends on the interpolator and on the geometry, and the same
+ * geometries come back over and over again: darkroom zoom levels, thumbnail
+ * sizes, the final scale of an export. Keep the most recently used ones
+ * around. Plans are shared between threads and refcounted, the cache holds
+ * one reference and every user another one. */
+#define RESAMPLING_PLAN_CACHE_SIZE 16
+
+typedef struct dt_resampling_plan_t
 {
-  int *hindex = NULL;
-  int *hlength = NULL;
-  float *hkernel = NULL;
-  int *vindex = NULL;
-  int *vlength = NULL;
-  float *vkernel = NULL;
-  int *vmeta = NULL;
+  // key
+  enum dt_interpolation_type itor;
+  int in;
+  int in_x0;
+  int out;
+  int out_x0;
+  float scale;
+
+  // the plan itself, see prepare_resampling_plan(). length is the start of the allocation.
+  int *length;
+  float *kernel;
+  int *index;
+  int *meta;
+  int maxtaps;
+
+  int refs;
+  uint64_t used;
+} dt_resampling_plan_t;
+
+static struct
+{
+  GMutex lock;
+  dt_resampling_plan_t *plan[RESAMPLING_PLAN_CACHE_SIZE];
+  uint64_t clock;
+} plan_cache;
 
-  int r;
+// needs plan_cache.lock
+static void plan_unref(dt_resampling_plan_t *plan)
+{
+  if(--plan->refs) return;
+  dt_free_align(plan->length);
+  free(plan);
+}
 
-  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
-             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
-             roi_out->x, roi_out->y, roi_out->scale);
+static void plan_release(dt_resampling_plan_t *plan)
+{
+  if(!plan) return;
+  g_mutex_lock(&plan_cache.lock);
+  plan_unref(plan);
+  g_mutex_unlock(&plan_cache.lock);
+}
 
-  // Fast code path for 1:1 copy, only cropping area can change
-  if(roi_out->scale == 1.f)
+/* Returns the plan for the given geometry, from the cache if possible, or NULL
+ * if it could not be allocated. Release it with plan_release(). Two threads
+ * missing on the same plan at once both compute it, the spare copy just ages
+ * out of the cache. */
+static dt_resampling_plan_t *plan_acquire(const struct dt_interpolation *itor, const int in, const int in_x0,
+                                          const int out, const int out_x0, const float scale)
+{
+  g_mutex_lock(&plan_cache.lock);
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
   {
-    const int x0 = roi_out->x * 4 * sizeof(float);
-    const int l = roi_out->width * 4 * sizeof(float);
-#if DEBUG_RESAMPLING_TIMING
-    int64_t ts_resampling = getts();
-#endif
-#ifdef _OPENMP
-#pragma omp parallel for default(none) shared(out)
-#endif
-    for(int y = 0; y < roi_out->height; y++)
+    dt_resampling_plan_t *plan = plan_cache.plan[k];
+    if(plan && plan->itor == itor->id && plan->in == in && plan->in_x0 == in_x0 && plan->out == out
+       && plan->out_x0 == out_x0 && plan->scale == scale)
     {
-      float *i = (float *)((char *)in + (size_t)in_stride * (y + roi_out->y) + x0);
-      float *o = (float *)((char *)out + (size_t)out_stride * y);
-      memcpy(o, i, l);
+      plan->refs++;
+      plan->used = ++plan_cache.clock;
+      g_mutex_unlock(&plan_cache.lock);
+      return plan;
     }
-#if DEBUG_RESAMPLING_TIMING
-    ts_resampling = getts() - ts_resampling;
-    fprintf(stderr, "resampling %p plan:0us resampling:%" PRId64 "us\n", in, ts_resampling);
-#endif
-    // All done, so easy case
-    return;
   }
-
-// Generic non 1:1 case... much more complicated :D
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_plan = getts();
-#endif
-
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
-  if(r)
+  g_mutex_unlock(&plan_cache.lock);
+
+  dt_resampling_plan_t *plan = (dt_resampling_plan_t *)calloc(1, sizeof(dt_resampling_plan_t));
+  if(!plan) return NULL;
+
+  plan->itor = itor->id;
+  plan->in = in;
+  plan->in_x0 = in_x0;
+  plan->out = out;
+  plan->out_x0 = out_x0;
+  plan->scale = scale;
+  if(prepare_resampling_plan(itor, in, in_x0, out, out_x0, scale, &plan->length, &plan->kernel, &plan->index,
+                             &plan->meta)
+     || !plan->length)
   {
-    goto exit;
+    free(plan);
+    return NULL;
   }
+  for(int k = 0; k < out; k++) plan->maxtaps = MAX(plan->maxtaps, plan->length[k]);
+  plan->refs = 2;
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
-  if(r)
+  // take an empty slot, or replace the least recently used plan
+  g_mutex_lock(&plan_cache.lock);
+  int slot = 0;
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
   {
-    goto exit;
+    if(!plan_cache.plan[k])
+    {
+      slot = k;
+      break;
+    }
+    if(plan_cache.plan[k]->used < plan_cache.plan[slot]->used) slot = k;
   }
+  if(plan_cache.plan[slot]) plan_unref(plan_cache.plan[slot]);
+  plan_cache.plan[slot] = plan;
+  plan->used = ++plan_cache.clock;
+  g_mutex_unlock(&plan_cache.lock);
 
-#if DEBUG_RESAMPLING_TIMING
-  ts_plan = getts() - ts_plan;
-#endif
-
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_resampling = getts();
-#endif
+  return plan;
+}
 
-// Process each output line
-#ifdef _OPENMP
-#pragma omp parallel for default(none) shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
-#endif
-  for(int oy = 0; oy < roi_out->height; oy++)
+void dt_interpolation_plan_cache_flush(void)
+{
+  g_mutex_lock(&plan_cache.lock);
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE_SIZE; k++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
-
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
-
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
-    {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      float vs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        float vhs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          size_t baseidx = (size_t)hindex[hiidx++] * 4;
-          const float htap = hkernel[hkidx++];
-          for(int c = 0; c < 3; c++) vhs[c] += i[baseidx + c] * htap;
-        }
+    if(plan_cache.plan[k]) plan_unref(plan_cache.plan[k]);
+    plan_cache.plan[k] = NULL;
+  }
+  g_mutex_unlock(&plan_cache.lock);
+}
 
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        for(int c = 0; c < 3; c++) vs[c] += vhs[c] * vtap;
+/* ------------------------------------------------------------------------
+ * Separable resampling
+ * ----------------------------------------------------------------------*/
 
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
+/* Output lines are processed in blocks. Each block first resamples the input
+ * lines it needs horizontally into a per thread buffer of about this size,
+ * which then stays in cache for the vertical pass. Input lines shared by two
+ * blocks are resampled twice, so blocks should not get much smaller. */
+#define RESAMPLING_BLOCK_BYTES (512 * 1024)
 
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * 4 * sizeof(float));
-      for(int c = 0; c < 3; c++) o[c] = vs[c];
+// floats of an output line added up at once by the vertical pass, small enough to stay in L1
+#define RESAMPLING_COLUMN_BLOCK 1024
 
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
+/** resamples one 4 channel line horizontally according to plan */
+typedef void (*resample_hpass_t)(float *out, const float *const in, const dt_resampling_plan_t *const plan);
 
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
+static void resample_hpass_plain(float *out, const float *const in, const dt_resampling_plan_t *const plan)
+{
+  // kernel taps and sample indexes are stored in lockstep
+  int kidx = 0;
+  for(int ox = 0; ox < plan->out; ox++)
+  {
+    const int hl = plan->length[ox];
+    float vhs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for(int ix = 0; ix < hl; ix++)
+    {
+      const float *i = in + (size_t)plan->index[kidx + ix] * 4;
+      const float htap = plan->kernel[kidx + ix];
+      for(int c = 0; c < 4; c++) vhs[c] += i[c] * htap;
     }
-
-    // Progress in vertical context
-    viidx += vl;
-    vkidx += vl;
+    for(int c = 0; c < 4; c++) out[4 * ox + c] = vhs[c];
+    kidx += hl;
   }
-
-#if DEBUG_RESAMPLING_TIMING
-  ts_resampling = getts() - ts_resampling;
-  fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
-#endif
-
-exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
 }
 
 #if defined(__SSE2__)
-static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, float *out,
-                                          const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                          const float *const in, const dt_iop_roi_t *const roi_in,
-                                          const int32_t in_stride)
+static void resample_hpass_sse(float *out, const float *const in, const dt_resampling_plan_t *const plan)
 {
-  int *hindex = NULL;
-  int *hlength = NULL;
-  float *hkernel = NULL;
-  int *vindex = NULL;
-  int *vlength = NULL;
-  float *vkernel = NULL;
-  int *vmeta = NULL;
+  int kidx = 0;
+  for(int ox = 0; ox < plan->out; ox++)
+  {
+    const int hl = plan->length[ox];
+    __m128 vhs = _mm_setzero_ps();
+    for(int ix = 0; ix < hl; ix++)
+    {
+      const __m128 htap = _mm_set1_ps(plan->kernel[kidx + ix]);
+      vhs = _mm_add_ps(vhs, _mm_mul_ps(_mm_load_ps(in + (size_t)plan->index[kidx + ix] * 4), htap));
+    }
+    _mm_store_ps(out + 4 * ox, vhs);
+    kidx += hl;
+  }
+}
+#endif
 
-  int r;
+#if defined(HAVE_AVX2_TARGET)
+/* Two taps at once, one per 128-bit lane, with fused multiply-adds. */
+static void DT_TARGET_AVX2 resample_hpass_avx2(float *out, const float *const in,
+                                               const dt_resampling_plan_t *const plan)
+{
+  int kidx = 0;
+  for(int ox = 0; ox < plan->out; ox++)
+  {
+    const int hl = plan->length[ox];
+    const int *const index = plan->index + kidx;
+    const float *const kernel = plan->kernel + kidx;
+
+    // even taps accumulate in the lower lane, odd ones in the upper lane
+    __m256 vhs2 = _mm256_setzero_ps();
+    int ix = 0;
+    for(; ix + 1 < hl; ix += 2)
+    {
+      const __m256 px = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(in + (size_t)index[ix] * 4)),
+                                             _mm_load_ps(in + (size_t)index[ix + 1] * 4), 1);
+      const __m256 htap
+          = _mm256_insertf128_ps(_mm256_set1_ps(kernel[ix]), _mm_set1_ps(kernel[ix + 1]), 1);
+      vhs2 = _mm256_fmadd_ps(px, htap, vhs2);
+    }
+    __m128 vhs = _mm_add_ps(_mm256_castps256_ps128(vhs2), _mm256_extractf128_ps(vhs2, 1));
+    if(ix < hl) vhs = _mm_fmadd_ps(_mm_load_ps(in + (size_t)index[ix] * 4), _mm_set1_ps(kernel[ix]), vhs);
 
-  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
-             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
-             roi_out->x, roi_out->y, roi_out->scale);
+    _mm_store_ps(out + 4 * ox, vhs);
+    kidx += hl;
+  }
+}
+#endif
 
-  // Fast code path for 1:1 copy, only cropping area can change
-  if(roi_out->scale == 1.f)
+// first and last input line needed by output lines [oy0, oy1)
+static inline void resample_block_lines(const dt_resampling_plan_t *const vplan, const int oy0, const int oy1,
+                                        int *first, int *last)
+{
+  *first = INT_MAX;
+  *last = -1;
+  for(int oy = oy0; oy < oy1; oy++)
   {
-    const int x0 = roi_out->x * 4 * sizeof(float);
-    const int l = roi_out->width * 4 * sizeof(float);
-#if DEBUG_RESAMPLING_TIMING
-    int64_t ts_resampling = getts();
-#endif
-#ifdef _OPENMP
-#pragma omp parallel for default(none) shared(out)
-#endif
-    for(int y = 0; y < roi_out->height; y++)
+    const int *const vindex = vplan->index + vplan->meta[3 * oy + 2];
+    for(int iy = 0; iy < vplan->length[oy]; iy++)
     {
-      float *i = (float *)((char *)in + (size_t)in_stride * (y + roi_out->y) + x0);
-      float *o = (float *)((char *)out + (size_t)out_stride * y);
-      memcpy(o, i, l);
+      *first = MIN(*first, vindex[iy]);
+      *last = MAX(*last, vindex[iy]);
     }
-#if DEBUG_RESAMPLING_TIMING
-    ts_resampling = getts() - ts_resampling;
-    fprintf(stderr, "resampling %p plan:0us resampling:%" PRId64 "us\n", in, ts_resampling);
-#endif
-    // All done, so easy case
-    return;
   }
+}
+
+static void resample_separable(const struct dt_interpolation *itor, float *out,
+                               const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                               const float *const in, const dt_iop_roi_t *const roi_in, const int32_t in_stride,
+                               const resample_hpass_t hpass)
+{
+  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
+             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
+             roi_out->x, roi_out->y, roi_out->scale);
 
-// Generic non 1:1 case... much more complicated :D
 #if DEBUG_RESAMPLING_TIMING
   int64_t ts_plan = getts();
 #endif
 
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
-  if(r)
-  {
-    goto exit;
-  }
-
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
-  if(r)
+  dt_resampling_plan_t *const hplan
+      = plan_acquire(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale);
+  dt_resampling_plan_t *const vplan
+      = plan_acquire(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale);
+  if(!hplan || !vplan)
   {
-    goto exit;
+    plan_release(hplan);
+    plan_release(vplan);
+    return;
   }
 
 #if DEBUG_RESAMPLING_TIMING
   ts_plan = getts() - ts_plan;
-#endif
-
-#if DEBUG_RESAMPLING_TIMING
   int64_t ts_resampling = getts();
 #endif
 
-// Process each output line
-#ifdef _OPENMP
-#pragma omp parallel for default(none) shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
-#endif
-  for(int oy = 0; oy < roi_out->height; oy++)
+  const int height = roi_out->height;
+  const size_t row = (size_t)4 * roi_out->width;
+  const int nthreads = dt_get_num_threads();
+
+  /* as many output lines per block as fit the budget, but enough blocks to keep all threads busy. a block
+   * needs about block / scale + maxtaps input lines, keep it large enough that at most a third of them are
+   * resampled twice, even for wide images. */
+  const int budget = MAX(1, RESAMPLING_BLOCK_BYTES / (int)(row * sizeof(float)));
+  const int fit = MAX((int)ceilf(2 * vplan->maxtaps * roi_out->scale),
+                      (int)((budget - vplan->maxtaps) * roi_out->scale) + 1);
+  const int block = MAX(1, MIN(fit, (height + nthreads - 1) / nthreads));
+  const int nblocks = (height + block - 1) / block;
+
+  int span = 1;
+  for(int b = 0; b < nblocks; b++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
+    int first, last;
+    resample_block_lines(vplan, b * block, MIN(height, (b + 1) * block), &first, &last);
+    span = MAX(span, last - first + 1);
+  }
 
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
+  float *const lines = dt_alloc_align(64, sizeof(float) * row * span * nthreads);
+  if(!lines) goto exit;
 
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(out, span) schedule(static)
+#endif
+  for(int b = 0; b < nblocks; b++)
+  {
+    const int oy0 = b * block;
+    const int oy1 = MIN(height, oy0 + block);
+    int first, last;
+    resample_block_lines(vplan, oy0, oy1, &first, &last);
+
+    // horizontal pass over all input lines of the block
+    float *const buf = lines + row * span * dt_get_thread_num();
+    for(int iy = first; iy <= last; iy++)
+      hpass(buf + row * (iy - first), (const float *)((const char *)in + (size_t)in_stride * iy), hplan);
+
+    // vertical pass, the taps of a line are applied to a block of columns at a time
+    for(int oy = oy0; oy < oy1; oy++)
     {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      __m128 vs = _mm_setzero_ps();
-
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
+      const int vl = vplan->length[oy];
+      const float *const vkernel = vplan->kernel + vplan->meta[3 * oy + 1];
+      const int *const vindex = vplan->index + vplan->meta[3 * oy + 2];
+      float *const o = (float *)((char *)out + (size_t)out_stride * oy);
 
-      for(int iy = 0; iy < vl; iy++)
+      for(size_t x0 = 0; x0 < row; x0 += RESAMPLING_COLUMN_BLOCK)
       {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        __m128 vhs = _mm_setzero_ps();
-
-        for(int ix = 0; ix < hl; ix++)
+        const size_t x1 = MIN(row, x0 + RESAMPLING_COLUMN_BLOCK);
+        for(size_t x = x0; x < x1; x++) o[x] = 0.0f;
+        for(int iy = 0; iy < vl; iy++)
         {
-          // Apply the precomputed filter kernel
-          size_t baseidx = (size_t)hindex[hiidx++] * 4;
-          float htap = hkernel[hkidx++];
-          __m128 vhtap = _mm_set_ps1(htap);
-          vhs = _mm_add_ps(vhs, _mm_mul_ps(*(__m128 *)&i[baseidx], vhtap));
+          const float *const l = buf + row * (vindex[iy] - first);
+          const float vtap = vkernel[iy];
+          for(size_t x = x0; x < x1; x++) o[x] += l[x] * vtap;
         }
-
-        // Accumulate contribution from this line
-        float vtap = vkernel[vkidx++];
-        __m128 vvtap = _mm_set_ps1(vtap);
-        vs = _mm_add_ps(vs, _mm_mul_ps(vhs, vvtap));
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
       }
-
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * 4 * sizeof(float));
-      _mm_stream_ps(o, vs);
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
     }
-
-    // Progress in vertical context
-//     viidx += vl;
-//     vkidx += vl;
   }
 
-  _mm_sfence();
+  dt_free_align(lines);
 
 #if DEBUG_RESAMPLING_TIMING
   ts_resampling = getts() - ts_resampling;
@@ -1662,13 +1682,33 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
 #endif
 
 exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  plan_release(hplan);
+  plan_release(vplan);
 }
+
+// 1:1 copy, only the cropping area can change
+static void resample_copy(float *out, const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                          const float *const in, const int32_t in_stride)
+{
+  const int x0 = roi_out->x * 4 * sizeof(float);
+  const int l = roi_out->width * 4 * sizeof(float);
+#if DEBUG_RESAMPLING_TIMING
+  int64_t ts_resampling = getts();
+#endif
+#ifdef _OPENMP
+#pragma omp parallel for default(none) shared(out)
+#endif
+  for(int y = 0; y < roi_out->height; y++)
+  {
+    float *i = (float *)((char *)in + (size_t)in_stride * (y + roi_out->y) + x0);
+    float *o = (float *)((char *)out + (size_t)out_stride * y);
+    memcpy(o, i, l);
+  }
+#if DEBUG_RESAMPLING_TIMING
+  ts_resampling = getts() - ts_resampling;
+  fprintf(stderr, "resampling %p plan:0us resampling:%" PRId64 "us\n", in, ts_resampling);
 #endif
+}
 
 /** Applies resampling (re-scaling) on *full* input and output buffers.
  *  roi_in and roi_out define the part of the buffers that is affected.
@@ -1678,14 +1718,23 @@ void dt_interpolation_resample(const struct dt_interpolation *itor, float *out,
                                const float *const in, const dt_iop_roi_t *const roi_in,
                                const int32_t in_stride)
 {
+  if(roi_out->scale == 1.f) return resample_copy(out, roi_out, out_stride, in, in_stride);
+
+  resample_hpass_t hpass = NULL;
   if(darktable.codepath.OPENMP_SIMD)
-    return dt_interpolation_resample_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+    hpass = resample_hpass_plain;
+#if defined(HAVE_AVX2_TARGET)
+  else if(darktable.codepath.AVX2)
+    hpass = resample_hpass_avx2;
+#endif
 #if defined(__SSE2__)
   else if(darktable.codepath.SSE2)
-    return dt_interpolation_resample_sse(itor, out, roi_out, out_stride, in, roi_in, in_stride);
+    hpass = resample_hpass_sse;
 #endif
   else
     dt_unreachable_codepath();
+
+  resample_separable(itor, out, roi_out, out_stride, in, roi_in, in_stride, hpass);
 }
 
 /** Applies resampling (re-scaling) on a specific region-of-interest of an image. The input
@@ -1752,8 +1801,9 @@ int dt_interpolation_resample_cl(const struct dt_interpolation *itor, int devid,
   int *vlength = NULL;
   float *vkernel = NULL;
   int *vmeta = NULL;
+  dt_resampling_plan_t *hplan = NULL;
+  dt_resampling_plan_t *vplan = NULL;
 
-  int r;
   cl_int err = -999;
 
   cl_mem dev_hindex = NULL;
@@ -1796,24 +1846,25 @@ int dt_interpolation_resample_cl(const struct dt_interpolation *itor, int devid,
   int64_t ts_plan = getts();
 #endif
 
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, &hmeta);
-  if(r)
+  // Fetch the resampling plans
+  hplan = plan_acquire(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale);
+  vplan = plan_acquire(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale);
+  if(!hplan || !vplan)
   {
     goto error;
   }
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
-  if(r)
-  {
-    goto error;
-  }
+  hlength = hplan->length;
+  hkernel = hplan->kernel;
+  hindex = hplan->index;
+  hmeta = hplan->meta;
+  vlength = vplan->length;
+  vkernel = vplan->kernel;
+  vindex = vplan->index;
+  vmeta = vplan->meta;
 
-  int hmaxtaps = -1, vmaxtaps = -1;
-  for(int k = 0; k < roi_out->width; k++) hmaxtaps = MAX(hmaxtaps, hlength[k]);
-  for(int k = 0; k < roi_out->height; k++) vmaxtaps = MAX(vmaxtaps, vlength[k]);
+  const int hmaxtaps = hplan->maxtaps;
+  const int vmaxtaps = vplan->maxtaps;
 
 #if DEBUG_RESAMPLING_TIMING
   ts_plan = getts() - ts_plan;
@@ -1939,8 +1990,8 @@ int dt_interpolation_resample_cl(const struct dt_interpolation *itor, int devid,
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  plan_release(hplan);
+  plan_release(vplan);
   return CL_SUCCESS;
 
 error:
@@ -1952,8 +2003,8 @@ error:
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  plan_release(hplan);
+  plan_release(vplan);
   dt_print(DT_DEBUG_OPENCL, "[opencl_resampling] couldn't enqueue kernel! %d\n", err);
   return err;
 }
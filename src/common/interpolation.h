@@ -34,8 +34,8 @@ enum dt_interpolation_type
   DT_INTERPOLATION_LANCZOS2,                          /**< Lanczos interpolation (with 2 lobes) */
   DT_INTERPOLATION_LANCZOS3,                          /**< Lanczos interpolation (with 3 lobes) */
   DT_INTERPOLATION_LAST,                              /**< Helper for easy iteration on interpolators */
-  DT_INTERPOLATION_DEFAULT = DT_INTERPOLATION_BILINEAR,
-  DT_INTERPOLATION_USERPREF /**< can be specified so that user setting is chosen */
+  DT_INTERPOLATION_USERPREF,                          /**< can be specified so that user setting is chosen */
+  DT_INTERPOLATION_DEFAULT = DT_INTERPOLATION_BILINEAR
 };
 
 /** Interpolation function */
@@ -142,6 +142,10 @@ void dt_interpolation_resample_roi(const struct dt_interpolation *itor, float *o
                                    const float *const in, const dt_iop_roi_t *const roi_in,
                                    const int32_t in_stride);
 
+/** Frees the cached resampling plans. The resamplers keep the plans of the
+ * most recently used geometries, they are rebuilt on demand afterwards. */
+void dt_interpolation_plan_cache_flush(void);
+
 #ifdef HAVE_OPENCL
 typedef struct dt_interpolation_cl_global_t
 {
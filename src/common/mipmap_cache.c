@@ -25,6 +25,7 @@
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
+#include "common/mipmap_pack.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
@@ -353,7 +354,22 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   int loaded_from_disk = 0;
   if(mip < DT_MIPMAP_F)
   {
-    if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
+    if(cache->pack[mip])
+    {
+      uint32_t width, height;
+      int32_t color_space;
+      if(!dt_mipmap_pack_read(cache->pack[mip], get_imgid(entry->key), entry->data + sizeof(*dsc),
+                              cache->max_width[mip], cache->max_height[mip], &width, &height, &color_space))
+      {
+        dsc->width = width;
+        dsc->height = height;
+        dsc->iscale = 1.0f;
+        dsc->color_space = color_space;
+        loaded_from_disk = 1;
+      }
+    }
+    // the jpg files are still used when there is no pack, or to fill it from an older cache
+    if(!loaded_from_disk && cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
@@ -420,6 +436,7 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
     snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
     g_unlink(filename);
   }
+  if(cache->pack[mip]) dt_mipmap_pack_remove(cache->pack[mip], imgid);
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -436,6 +453,14 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
+      else if(cache->pack[mip])
+      {
+        // uncompressed, so unlike the jpg there is no quality loss in replacing an existing one. but there is
+        // no need to either.
+        if(!dt_mipmap_pack_contains(cache->pack[mip], get_imgid(entry->key)))
+          dt_mipmap_pack_write(cache->pack[mip], get_imgid(entry->key), entry->data + sizeof(*dsc), dsc->width,
+                               dsc->height, dsc->color_space);
+      }
       else if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
       {
         // serialize to disk
@@ -556,7 +581,10 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->mip_full.stats_fetches = 0;
   cache->mip_full.stats_standin = 0;
 
-  dt_cache_init(&cache->mip_thumbs.cache, 0, max_mem);
+  // split the thumbnail cache into independently locked segments, so lighttable worker threads don't all
+  // queue up on one lock. keep room for a handful of mid-sized thumbnails in each, or their lru would thrash.
+  const uint32_t segments = CLAMP(max_mem / (8 * cache->buffer_size[DT_MIPMAP_3]), 1, 16);
+  dt_cache_init_segmented(&cache->mip_thumbs.cache, 0, max_mem, segments);
   dt_cache_set_allocate_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_thumbs.cache, dt_mipmap_cache_deallocate_dynamic, cache);
 
@@ -577,6 +605,26 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
                                         + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
                                           * cache->max_height[DT_MIPMAP_F];
+
+  dt_pthread_mutex_init(&cache->prefetch_lock, NULL);
+  cache->prefetch_wanted = g_hash_table_new(NULL, NULL);
+  cache->prefetch_stale = g_hash_table_new(NULL, NULL);
+
+  // one memory mapped pack per thumbnail level, if requested:
+  for(int k = 0; k < DT_MIPMAP_F; k++) cache->pack[k] = NULL;
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend") && dt_conf_get_bool("cache_disk_backend_pack"))
+  {
+    char filename[PATH_MAX] = { 0 };
+    snprintf(filename, sizeof(filename), "%s.d", cache->cachedir);
+    if(!g_mkdir_with_parents(filename, 0750))
+    {
+      for(int k = 0; k < DT_MIPMAP_F; k++)
+      {
+        snprintf(filename, sizeof(filename), "%s.d/%d", cache->cachedir, k);
+        cache->pack[k] = dt_mipmap_pack_open(filename);
+      }
+    }
+  }
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
@@ -584,20 +632,33 @@ void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  // after the caches, these write their thumbnails to the packs on cleanup
+  for(int k = 0; k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_pack_close(cache->pack[k]);
+    cache->pack[k] = NULL;
+  }
+  g_hash_table_destroy(cache->prefetch_wanted);
+  g_hash_table_destroy(cache->prefetch_stale);
+  dt_pthread_mutex_destroy(&cache->prefetch_lock);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
 {
+  const size_t thumbs_cost = dt_cache_get_cost(&cache->mip_thumbs.cache);
+  const size_t f_cost = dt_cache_get_cost(&cache->mip_f.cache);
+  const size_t full_cost = dt_cache_get_cost(&cache->mip_full.cache);
   printf("[mipmap_cache] thumbs fill %.2f/%.2f MB (%.2f%%)\n",
-         cache->mip_thumbs.cache.cost / (1024.0 * 1024.0),
+         thumbs_cost / (1024.0 * 1024.0),
          cache->mip_thumbs.cache.cost_quota / (1024.0 * 1024.0),
-         100.0f * (float)cache->mip_thumbs.cache.cost / (float)cache->mip_thumbs.cache.cost_quota);
+         100.0f * (float)thumbs_cost / (float)cache->mip_thumbs.cache.cost_quota);
   printf("[mipmap_cache] float fill %d/%d slots (%.2f%%)\n",
-         (uint32_t)cache->mip_f.cache.cost, (uint32_t)cache->mip_f.cache.cost_quota,
-         100.0f * (float)cache->mip_f.cache.cost / (float)cache->mip_f.cache.cost_quota);
+         (uint32_t)f_cost, (uint32_t)cache->mip_f.cache.cost_quota,
+         100.0f * (float)f_cost / (float)cache->mip_f.cache.cost_quota);
   printf("[mipmap_cache] full  fill %d/%d slots (%.2f%%)\n",
-         (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
-         100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+         (uint32_t)full_cost, (uint32_t)cache->mip_full.cache.cost_quota,
+         100.0f * (float)full_cost / (float)cache->mip_full.cache.cost_quota);
+  dt_cache_print_contention(&cache->mip_thumbs.cache, "mipmap_cache");
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -652,6 +713,14 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipm
   }
 }
 
+// somebody explicitly asked for this one again, so its load job has to run
+static inline void _prefetch_unstale(dt_mipmap_cache_t *cache, const uint32_t key)
+{
+  dt_pthread_mutex_lock(&cache->prefetch_lock);
+  g_hash_table_remove(cache->prefetch_stale, GUINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&cache->prefetch_lock);
+}
+
 void dt_mipmap_cache_get_with_caller(
     dt_mipmap_cache_t *cache,
     dt_mipmap_buffer_t *buf,
@@ -700,6 +769,7 @@ void dt_mipmap_cache_get_with_caller(
     // and opposite: prefetch without locking
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
+    _prefetch_unstale(cache, key);
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_PREFETCH_DISK)
@@ -708,10 +778,9 @@ void dt_mipmap_cache_get_with_caller(
     if(!cache->cachedir[0]) return;
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_cache_has_ondisk_thumbnail(cache, imgid, mip)) return;
+    _prefetch_unstale(cache, key);
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -891,13 +960,8 @@ void dt_mipmap_cache_get_with_caller(
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(cache->cachedir[0] && dt_mipmap_cache_has_ondisk_thumbnail(cache, imgid, mip))
+      dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = 0;
@@ -950,6 +1014,59 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(const dt_mipmap_cache_t *cach
   return best;
 }
 
+void dt_mipmap_cache_prefetch(dt_mipmap_cache_t *cache, const int32_t *imgids, const int num,
+                              const dt_mipmap_size_t mip)
+{
+  if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
+    return; // remove the (int) once we no longer have to support gcc < 4.8 :/
+
+  GHashTable *wanted = g_hash_table_new(NULL, NULL);
+  for(int k = 0; k < num; k++)
+    if(imgids[k] > 0) g_hash_table_add(wanted, GUINT_TO_POINTER(get_key(imgids[k], mip)));
+
+  dt_pthread_mutex_lock(&cache->prefetch_lock);
+  // whatever the view moved away from goes stale, whatever it came back to is fresh again
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init(&iter, cache->prefetch_wanted);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+    if(!g_hash_table_contains(wanted, key)) g_hash_table_add(cache->prefetch_stale, key);
+  g_hash_table_iter_init(&iter, wanted);
+  while(g_hash_table_iter_next(&iter, &key, NULL)) g_hash_table_remove(cache->prefetch_stale, key);
+  // jobs dropped off the end of the job queue never come back to collect their key
+  if(g_hash_table_size(cache->prefetch_stale) > 8192) g_hash_table_remove_all(cache->prefetch_stale);
+  g_hash_table_destroy(cache->prefetch_wanted);
+  cache->prefetch_wanted = wanted;
+  dt_pthread_mutex_unlock(&cache->prefetch_lock);
+
+  // the foreground job queue is a stack of limited size: push the least important ones first,
+  // so the visible thumbnails end up on top and the far away ones are the first to be discarded.
+  dt_cache_t *c = &_get_cache(cache, mip)->cache;
+  for(int k = num - 1; k >= 0; k--)
+  {
+    if(imgids[k] <= 0) continue;
+    // don't waste a slot in the queue on what is already there
+    dt_cache_entry_t *entry = dt_cache_testget(c, get_key(imgids[k], mip), 'r');
+    if(entry)
+    {
+      dt_cache_release(c, entry);
+      continue;
+    }
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgids[k], mip));
+  }
+}
+
+gboolean dt_mipmap_cache_prefetch_wanted(dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                         const dt_mipmap_size_t mip)
+{
+  const gpointer key = GUINT_TO_POINTER(get_key(imgid, mip));
+  dt_pthread_mutex_lock(&cache->prefetch_lock);
+  // a job only gets skipped once, a later request for the same thumbnail will queue a new one anyways
+  const gboolean stale = g_hash_table_remove(cache->prefetch_stale, key);
+  dt_pthread_mutex_unlock(&cache->prefetch_lock);
+  return !stale;
+}
+
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
 {
   // get rid of all ldr thumbnails:
@@ -1250,12 +1367,37 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace()
   return DT_COLORSPACE_DISPLAY;
 }
 
+gboolean dt_mipmap_cache_has_ondisk_thumbnail(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                              const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F) return FALSE;
+  if(cache->pack[mip] && dt_mipmap_pack_contains(cache->pack[mip], imgid)) return TRUE;
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", cache->cachedir, mip, imgid);
+  return g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
 {
   if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      if(cache->pack[mip])
+      {
+        uint8_t *buf = (uint8_t *)dt_alloc_align(16, (size_t)cache->max_width[mip] * cache->max_height[mip] * 4);
+        uint32_t width, height;
+        int32_t color_space;
+        if(buf && !dt_mipmap_pack_read(cache->pack[mip], src_imgid, buf, cache->max_width[mip],
+                                       cache->max_height[mip], &width, &height, &color_space))
+        {
+          dt_mipmap_pack_write(cache->pack[mip], dst_imgid, buf, width, height, color_space);
+          dt_free_align(buf);
+          continue;
+        }
+        dt_free_align(buf);
+      }
+
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
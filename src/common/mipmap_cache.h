@@ -99,6 +99,12 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // optional single-file disk backend per thumbnail level, instead of one jpg per image
+  struct dt_mipmap_pack_t *pack[DT_MIPMAP_F];
+  // speculative loads asked for by the views, see dt_mipmap_cache_prefetch()
+  dt_pthread_mutex_t prefetch_lock;
+  GHashTable *prefetch_wanted; // keys of the last request
+  GHashTable *prefetch_stale;  // keys earlier requests dropped, their queued load jobs are skipped
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -139,6 +145,16 @@ void dt_mipmap_cache_write_get_with_caller(
 void dt_mipmap_cache_release_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const char *file,
                                          int line);
 
+// speculatively load the thumbnails of a view in the background. imgids are sorted by importance,
+// the first ones will be loaded first. this replaces the previous request: anything asked for
+// before which is not in imgids any more and still waiting in the job queue will not be loaded.
+void dt_mipmap_cache_prefetch(dt_mipmap_cache_t *cache, const int32_t *imgids, const int num,
+                              const dt_mipmap_size_t mip);
+
+// whether a queued load job for this thumbnail is still of any use, or its request has been dropped.
+gboolean dt_mipmap_cache_prefetch_wanted(dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                         const dt_mipmap_size_t mip);
+
 // remove thumbnails, so they will be regenerated:
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid);
 
@@ -159,6 +175,10 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
 // returns the colorspace to use for created thumbnails, takes config into account
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
+// whether the disk backend has a thumbnail of this size for the image
+gboolean dt_mipmap_cache_has_ondisk_thumbnail(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                              const dt_mipmap_size_t mip);
+
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
 // only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
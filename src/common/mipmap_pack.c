@@ -0,0 +1,489 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef __WIN32__
+#include <sys/mman.h>
+#endif
+
+// first bytes of every pack, also makes sure offset 0 never points to a thumbnail
+static const char dt_mipmap_pack_header[8] = { 'd', 't', 'm', 'p', 'a', 'c', 'k', '1' };
+#define DT_MIPMAP_PACK_RECORD_MAGIC 0x6d627474u
+// the index grows in steps of this many image ids
+#define DT_MIPMAP_PACK_INDEX_STEP 4096
+// compact the pack on open when more than this fraction of it, and at least DT_MIPMAP_PACK_COMPACT_MIN bytes,
+// isn't used by any thumbnail
+#define DT_MIPMAP_PACK_COMPACT_RATIO 0.3
+#define DT_MIPMAP_PACK_COMPACT_MIN (16 << 20)
+
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t magic;
+  uint32_t imgid;
+  uint32_t width, height;
+  int32_t color_space;
+  uint32_t size; // bytes of pixel data following this header
+} dt_mipmap_pack_record_t;
+
+// a range of the pack, either unused or holding the record of imgid
+typedef struct dt_mipmap_pack_extent_t
+{
+  uint64_t offset, size;
+  uint32_t imgid;
+} dt_mipmap_pack_extent_t;
+
+struct dt_mipmap_pack_t
+{
+  dt_pthread_mutex_t mutex;
+  int data_fd, index_fd;
+  const uint8_t *data; // read only mapping of the pack
+  size_t data_mapped;  // length of that mapping
+  size_t data_end;     // end of the last record, new thumbnails which don't fit a hole are appended here
+  uint64_t *index;     // offset of the record for every image id, 0 if there is none
+  size_t slots;
+  GArray *holes;       // dt_mipmap_pack_extent_t left by replaced or removed thumbnails, sorted by offset
+  size_t dead_bytes;   // total size of the holes
+};
+
+#ifndef __WIN32__
+
+static int _pack_map_data(dt_mipmap_pack_t *pack)
+{
+  if(pack->data) munmap((void *)pack->data, pack->data_mapped);
+  pack->data = NULL;
+  pack->data_mapped = 0;
+  void *data = mmap(NULL, pack->data_end, PROT_READ, MAP_SHARED, pack->data_fd, 0);
+  if(data == MAP_FAILED) return 1;
+  pack->data = data;
+  pack->data_mapped = pack->data_end;
+  return 0;
+}
+
+static int _pack_map_index(dt_mipmap_pack_t *pack, const size_t slots)
+{
+  if(pack->index) munmap(pack->index, pack->slots * sizeof(uint64_t));
+  pack->index = NULL;
+  pack->slots = 0;
+  if(!slots) return 0;
+  void *index = mmap(NULL, slots * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, pack->index_fd, 0);
+  if(index == MAP_FAILED) return 1;
+  pack->index = index;
+  pack->slots = slots;
+  return 0;
+}
+
+// make sure imgid has a slot in the index. new slots are zero, as the file is extended by ftruncate().
+static int _pack_grow_index(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  if(imgid < pack->slots) return 0;
+  const size_t slots = ((size_t)imgid / DT_MIPMAP_PACK_INDEX_STEP + 1) * DT_MIPMAP_PACK_INDEX_STEP;
+  if(ftruncate(pack->index_fd, slots * sizeof(uint64_t))) return 1;
+  return _pack_map_index(pack, slots);
+}
+
+static int _pack_pwrite(const int fd, const void *buf, size_t len, off_t offset)
+{
+  const uint8_t *p = (const uint8_t *)buf;
+  while(len > 0)
+  {
+    const ssize_t written = pwrite(fd, p, len, offset);
+    if(written < 0 && errno == EINTR) continue;
+    if(written <= 0) return 1;
+    p += written;
+    len -= written;
+    offset += written;
+  }
+  return 0;
+}
+
+// size of the record at offset, including its header. 0 if it's not a valid record of imgid.
+static size_t _pack_record_size(dt_mipmap_pack_t *pack, const uint64_t offset, const uint32_t imgid)
+{
+  if(offset + sizeof(dt_mipmap_pack_record_t) > pack->data_end) return 0;
+  if(offset + sizeof(dt_mipmap_pack_record_t) > pack->data_mapped && _pack_map_data(pack)) return 0;
+  dt_mipmap_pack_record_t rec;
+  memcpy(&rec, pack->data + offset, sizeof(rec));
+  if(rec.magic != DT_MIPMAP_PACK_RECORD_MAGIC || rec.imgid != imgid
+     || rec.size != (size_t)rec.width * rec.height * 4 || offset + sizeof(rec) + rec.size > pack->data_end)
+    return 0;
+  return sizeof(rec) + rec.size;
+}
+
+// first fit from the holes, or the end of the pack. the caller moves data_end if it used that.
+static uint64_t _pack_alloc(dt_mipmap_pack_t *pack, const size_t size)
+{
+  for(guint k = 0; k < pack->holes->len; k++)
+  {
+    dt_mipmap_pack_extent_t *hole = &g_array_index(pack->holes, dt_mipmap_pack_extent_t, k);
+    if(hole->size < size) continue;
+    const uint64_t offset = hole->offset;
+    hole->offset += size;
+    hole->size -= size;
+    if(!hole->size) g_array_remove_index(pack->holes, k);
+    pack->dead_bytes -= size;
+    return offset;
+  }
+  return pack->data_end;
+}
+
+// give a range back, merging it with the neighbouring holes. a hole at the end just shrinks the pack.
+static void _pack_free(dt_mipmap_pack_t *pack, uint64_t offset, uint64_t size)
+{
+  guint k = 0;
+  while(k < pack->holes->len && g_array_index(pack->holes, dt_mipmap_pack_extent_t, k).offset < offset) k++;
+  if(k > 0)
+  {
+    dt_mipmap_pack_extent_t *prev = &g_array_index(pack->holes, dt_mipmap_pack_extent_t, k - 1);
+    if(prev->offset + prev->size == offset)
+    {
+      offset = prev->offset;
+      size += prev->size;
+      pack->dead_bytes -= prev->size;
+      g_array_remove_index(pack->holes, --k);
+    }
+  }
+  if(k < pack->holes->len)
+  {
+    dt_mipmap_pack_extent_t *next = &g_array_index(pack->holes, dt_mipmap_pack_extent_t, k);
+    if(offset + size == next->offset)
+    {
+      size += next->size;
+      pack->dead_bytes -= next->size;
+      g_array_remove_index(pack->holes, k);
+    }
+  }
+  if(offset + size >= pack->data_end)
+  {
+    // the file keeps its size until the next open, appending just overwrites the tail
+    pack->data_end = offset;
+    return;
+  }
+  const dt_mipmap_pack_extent_t hole = { offset, size, 0 };
+  g_array_insert_val(pack->holes, k, hole);
+  pack->dead_bytes += size;
+}
+
+static gint _pack_extent_cmp(gconstpointer a, gconstpointer b)
+{
+  const dt_mipmap_pack_extent_t *e1 = (const dt_mipmap_pack_extent_t *)a;
+  const dt_mipmap_pack_extent_t *e2 = (const dt_mipmap_pack_extent_t *)b;
+  return e1->offset < e2->offset ? -1 : e1->offset > e2->offset;
+}
+
+// move all records to the front of the pack, in their current order. the pack is only a cache: should we
+// crash in the middle, some records are damaged, which dt_mipmap_pack_read() notices.
+static int _pack_compact(dt_mipmap_pack_t *pack, GArray *records)
+{
+  uint64_t end = sizeof(dt_mipmap_pack_header);
+  uint8_t *buf = NULL;
+  size_t buf_size = 0;
+  for(guint k = 0; k < records->len; k++)
+  {
+    const dt_mipmap_pack_extent_t *rec = &g_array_index(records, dt_mipmap_pack_extent_t, k);
+    if(rec->offset != end)
+    {
+      // records only ever move towards the front, so nothing not yet moved gets overwritten. a record may
+      // overlap its own new place though, copy it out of the mapping first.
+      if(rec->size > buf_size)
+      {
+        free(buf);
+        buf_size = rec->size;
+        buf = (uint8_t *)malloc(buf_size);
+        if(!buf) return 1;
+      }
+      memcpy(buf, pack->data + rec->offset, rec->size);
+      if(_pack_pwrite(pack->data_fd, buf, rec->size, end))
+      {
+        free(buf);
+        return 1;
+      }
+      pack->index[rec->imgid] = end;
+    }
+    end += rec->size;
+  }
+  free(buf);
+  pack->data_end = end;
+  g_array_set_size(pack->holes, 0);
+  pack->dead_bytes = 0;
+  return 0;
+}
+
+// find the holes between the records the index points to, and drop index entries to broken records. this
+// also catches up on holes from earlier sessions, and compacts the pack when too much of it is unused.
+static int _pack_scan(dt_mipmap_pack_t *pack, const char *base)
+{
+  GArray *records = g_array_new(FALSE, FALSE, sizeof(dt_mipmap_pack_extent_t));
+  for(size_t imgid = 0; imgid < pack->slots; imgid++)
+  {
+    if(!pack->index[imgid]) continue;
+    const size_t size = _pack_record_size(pack, pack->index[imgid], imgid);
+    if(!size)
+    {
+      pack->index[imgid] = 0;
+      continue;
+    }
+    const dt_mipmap_pack_extent_t rec = { pack->index[imgid], size, imgid };
+    g_array_append_val(records, rec);
+  }
+  g_array_sort(records, _pack_extent_cmp);
+
+  uint64_t end = sizeof(dt_mipmap_pack_header);
+  for(guint k = 0; k < records->len; k++)
+  {
+    const dt_mipmap_pack_extent_t *rec = &g_array_index(records, dt_mipmap_pack_extent_t, k);
+    if(rec->offset < end)
+    {
+      // overlaps the one before, can't both be right
+      pack->index[rec->imgid] = 0;
+      g_array_remove_index(records, k--);
+      continue;
+    }
+    if(rec->offset > end)
+    {
+      const dt_mipmap_pack_extent_t hole = { end, rec->offset - end, 0 };
+      g_array_append_val(pack->holes, hole);
+      pack->dead_bytes += hole.size;
+    }
+    end = rec->offset + rec->size;
+  }
+  const size_t file_size = pack->data_end;
+  pack->data_end = end;
+
+  int res = 0;
+  if(pack->dead_bytes > DT_MIPMAP_PACK_COMPACT_MIN
+     && pack->dead_bytes > DT_MIPMAP_PACK_COMPACT_RATIO * pack->data_end)
+  {
+    dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compacting `%s', %zu of %zu bytes unused\n", base, pack->dead_bytes,
+             pack->data_end);
+    res = _pack_compact(pack, records);
+  }
+  g_array_free(records, TRUE);
+
+  // drop what's behind the last record
+  if(!res && pack->data_end < file_size)
+    res = ftruncate(pack->data_fd, pack->data_end) || _pack_map_data(pack);
+  return res;
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *base)
+{
+  char filename[PATH_MAX] = { 0 };
+  dt_mipmap_pack_t *pack = (dt_mipmap_pack_t *)calloc(1, sizeof(dt_mipmap_pack_t));
+  pack->data_fd = pack->index_fd = -1;
+  pack->holes = g_array_new(FALSE, FALSE, sizeof(dt_mipmap_pack_extent_t));
+
+  snprintf(filename, sizeof(filename), "%s.pack", base);
+  pack->data_fd = open(filename, O_RDWR | O_CREAT, 0640);
+  snprintf(filename, sizeof(filename), "%s.idx", base);
+  pack->index_fd = open(filename, O_RDWR | O_CREAT, 0640);
+  if(pack->data_fd < 0 || pack->index_fd < 0) goto error;
+
+  struct stat st;
+  char header[sizeof(dt_mipmap_pack_header)] = { 0 };
+  if(fstat(pack->data_fd, &st)) goto error;
+  if(st.st_size < (off_t)sizeof(header) || pread(pack->data_fd, header, sizeof(header), 0) != sizeof(header)
+     || memcmp(header, dt_mipmap_pack_header, sizeof(header)))
+  {
+    // new or broken pack: start from scratch, an old index would point to garbage.
+    if(ftruncate(pack->data_fd, 0) || ftruncate(pack->index_fd, 0)
+       || _pack_pwrite(pack->data_fd, dt_mipmap_pack_header, sizeof(dt_mipmap_pack_header), 0))
+      goto error;
+    st.st_size = sizeof(dt_mipmap_pack_header);
+  }
+  pack->data_end = st.st_size;
+  if(_pack_map_data(pack)) goto error;
+
+  if(fstat(pack->index_fd, &st)) goto error;
+  if(_pack_map_index(pack, st.st_size / sizeof(uint64_t))) goto error;
+  if(_pack_scan(pack, base)) goto error;
+
+  dt_pthread_mutex_init(&pack->mutex, NULL);
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] opened `%s', %zu bytes, %zu of them unused, %zu index slots\n", base,
+           pack->data_end, pack->dead_bytes, pack->slots);
+  return pack;
+
+error:
+  fprintf(stderr, "[mipmap_pack] could not open thumbnail pack `%s': %s\n", base, strerror(errno));
+  if(pack->data) munmap((void *)pack->data, pack->data_mapped);
+  if(pack->index) munmap(pack->index, pack->slots * sizeof(uint64_t));
+  if(pack->data_fd >= 0) close(pack->data_fd);
+  if(pack->index_fd >= 0) close(pack->index_fd);
+  g_array_free(pack->holes, TRUE);
+  free(pack);
+  return NULL;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+  if(pack->index)
+  {
+    msync(pack->index, pack->slots * sizeof(uint64_t), MS_SYNC);
+    munmap(pack->index, pack->slots * sizeof(uint64_t));
+  }
+  if(pack->data) munmap((void *)pack->data, pack->data_mapped);
+  close(pack->data_fd);
+  close(pack->index_fd);
+  g_array_free(pack->holes, TRUE);
+  dt_pthread_mutex_destroy(&pack->mutex);
+  free(pack);
+}
+
+int dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, uint8_t *buf, const uint32_t max_width,
+                        const uint32_t max_height, uint32_t *width, uint32_t *height, int32_t *color_space)
+{
+  int res = 1;
+  dt_pthread_mutex_lock(&pack->mutex);
+  const uint64_t offset = imgid < pack->slots ? pack->index[imgid] : 0;
+  if(!offset) goto end;
+
+  // appended after we last mapped the pack?
+  if(offset + sizeof(dt_mipmap_pack_record_t) > pack->data_mapped && _pack_map_data(pack)) goto end;
+  if(offset + sizeof(dt_mipmap_pack_record_t) > pack->data_mapped) goto broken;
+
+  dt_mipmap_pack_record_t rec;
+  memcpy(&rec, pack->data + offset, sizeof(rec));
+  if(rec.magic != DT_MIPMAP_PACK_RECORD_MAGIC || rec.imgid != imgid || rec.width > max_width
+     || rec.height > max_height || rec.size != (size_t)rec.width * rec.height * 4
+     || offset + sizeof(rec) + rec.size > pack->data_mapped)
+    goto broken;
+
+  memcpy(buf, pack->data + offset + sizeof(rec), rec.size);
+  *width = rec.width;
+  *height = rec.height;
+  *color_space = rec.color_space;
+  res = 0;
+  goto end;
+
+broken:
+  fprintf(stderr, "[mipmap_pack] broken thumbnail for image %u\n", imgid);
+  pack->index[imgid] = 0;
+end:
+  dt_pthread_mutex_unlock(&pack->mutex);
+  return res;
+}
+
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *buf, const uint32_t width,
+                         const uint32_t height, const int32_t color_space)
+{
+  const dt_mipmap_pack_record_t rec = { DT_MIPMAP_PACK_RECORD_MAGIC, imgid, width, height, color_space,
+                                        width * height * 4 };
+  const size_t size = sizeof(rec) + rec.size;
+  int res = 1;
+  dt_pthread_mutex_lock(&pack->mutex);
+  // reuse a hole if there's one big enough, append otherwise
+  const uint64_t offset = _pack_alloc(pack, size);
+  const int append = (offset == pack->data_end);
+  // the data goes first, the index entry is only updated when it's complete
+  if(_pack_pwrite(pack->data_fd, &rec, sizeof(rec), offset)
+     || _pack_pwrite(pack->data_fd, buf, rec.size, offset + sizeof(rec)) || _pack_grow_index(pack, imgid))
+  {
+    // don't leave half a record behind
+    if(append)
+    {
+      if(ftruncate(pack->data_fd, offset)) {}
+    }
+    else
+      _pack_free(pack, offset, size);
+    goto end;
+  }
+  if(append) pack->data_end = offset + size;
+
+  // the record we replace becomes a hole
+  const uint64_t old_offset = pack->index[imgid];
+  pack->index[imgid] = offset;
+  if(old_offset)
+  {
+    const size_t old_size = _pack_record_size(pack, old_offset, imgid);
+    if(old_size) _pack_free(pack, old_offset, old_size);
+  }
+  res = 0;
+end:
+  dt_pthread_mutex_unlock(&pack->mutex);
+  return res;
+}
+
+int dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&pack->mutex);
+  const int res = imgid < pack->slots && pack->index[imgid];
+  dt_pthread_mutex_unlock(&pack->mutex);
+  return res;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&pack->mutex);
+  const uint64_t offset = imgid < pack->slots ? pack->index[imgid] : 0;
+  if(offset)
+  {
+    pack->index[imgid] = 0;
+    const size_t size = _pack_record_size(pack, offset, imgid);
+    if(size) _pack_free(pack, offset, size);
+  }
+  dt_pthread_mutex_unlock(&pack->mutex);
+}
+
+#else // __WIN32__
+
+// no mmap(), always fall back to the jpg files.
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *base)
+{
+  return NULL;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+}
+
+int dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, uint8_t *buf, const uint32_t max_width,
+                        const uint32_t max_height, uint32_t *width, uint32_t *height, int32_t *color_space)
+{
+  return 1;
+}
+
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *buf, const uint32_t width,
+                         const uint32_t height, const int32_t color_space)
+{
+  return 1;
+}
+
+int dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  return 0;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+}
+
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
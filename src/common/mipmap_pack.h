@@ -0,0 +1,49 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <inttypes.h>
+
+/**
+ * single-file backing store for the thumbnails of one mip level, as an alternative to one jpg per image.
+ *
+ * <base>.pack holds uncompressed 8-bit buffers, one after the other, and is memory mapped for reading.
+ * <base>.idx is a memory mapped table of offsets into the pack, indexed by image id.
+ * replaced or removed thumbnails leave holes in the pack which new ones are written to when they fit. the holes
+ * are found again on open, and the pack gets compacted then when too much of it is unused.
+ */
+typedef struct dt_mipmap_pack_t dt_mipmap_pack_t;
+
+/** open or create the pack <base>.pack/<base>.idx, returns NULL if that's not possible. */
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *base);
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+/** copy the 8-bit rgba thumbnail of imgid into buf, which has to hold max_width*max_height*4 bytes.
+ * returns 0 on success. */
+int dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, uint8_t *buf, const uint32_t max_width,
+                        const uint32_t max_height, uint32_t *width, uint32_t *height, int32_t *color_space);
+/** store the thumbnail of imgid, replacing an older one. returns 0 on success. */
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *buf, const uint32_t width,
+                         const uint32_t height, const int32_t color_space);
+int dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid);
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
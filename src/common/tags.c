@@ -191,6 +191,21 @@ gboolean dt_tag_exists(const char *name, guint *tagid)
   return FALSE;
 }
 
+/* the tags of imgid, or of the selected images if imgid <= 0, changed */
+static void _tag_update_collection(gint imgid)
+{
+  if(imgid > 0)
+  {
+    dt_collection_update_image(darktable.collection, imgid, DT_COLLECTION_SORT_NONE);
+  }
+  else
+  {
+    GList *imgids = dt_collection_get_selected(darktable.collection, -1);
+    dt_collection_update_images(darktable.collection, imgids, DT_COLLECTION_SORT_NONE);
+    g_list_free(imgids);
+  }
+}
+
 void dt_tag_attach(guint tagid, gint imgid)
 {
   sqlite3_stmt *stmt;
@@ -218,7 +233,7 @@ void dt_tag_attach(guint tagid, gint imgid)
 
   dt_tag_update_used_tags();
 
-  dt_collection_update_query(darktable.collection);
+  _tag_update_collection(imgid);
 }
 
 void dt_tag_attach_list(GList *tags, gint imgid)
@@ -283,7 +298,7 @@ void dt_tag_detach(guint tagid, gint imgid)
 
   dt_tag_update_used_tags();
 
-  dt_collection_update_query(darktable.collection);
+  _tag_update_collection(imgid);
 }
 
 void dt_tag_detach_by_string(const char *name, gint imgid)
@@ -300,7 +315,7 @@ void dt_tag_detach_by_string(const char *name, gint imgid)
 
   dt_tag_update_used_tags();
 
-  dt_collection_update_query(darktable.collection);
+  _tag_update_collection(imgid);
 }
 
 
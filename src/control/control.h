@@ -183,14 +183,15 @@ typedef struct dt_control_t
   // job management
   int32_t running;
   gboolean export_scheduled;
-  dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
+  dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex; // queue_mutex guards fg_jobs
   pthread_cond_t cond;
   int32_t num_threads;
   pthread_t *thread, kick_on_workers_thread;
-  dt_job_t **job;
+  GHashTable *fg_jobs; // system fg jobs which are queued or running, for deduping
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  // every worker has its own set of queues, idle workers steal from the others
+  struct dt_control_worker_queue_t *worker_queues;
+  uint32_t next_worker_queue; // round robin for jobs added from outside the workers
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
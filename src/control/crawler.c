@@ -64,8 +64,9 @@ GList *dt_control_crawler_run()
   sqlite3_prepare_v2(dt_database_get(darktable.db), "UPDATE main.images SET flags = ?1 WHERE id = ?2", -1,
                      &inner_stmt, NULL);
 
-  // let's wrap this into a transaction, it might make it a little faster.
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  // let's wrap this into a savepoint, it might make it a little faster. it nests in an import batch that
+  // may be open on the same connection.
+  sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT crawler", NULL, NULL, NULL);
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -170,7 +171,7 @@ GList *dt_control_crawler_run()
     g_free(extra_path);
   }
 
-  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  sqlite3_exec(dt_database_get(darktable.db), "RELEASE crawler", NULL, NULL, NULL);
 
   sqlite3_finalize(stmt);
   sqlite3_finalize(inner_stmt);
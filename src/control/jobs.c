@@ -36,6 +36,26 @@ typedef struct worker_thread_parameters_t
   int32_t threadid;
 } worker_thread_parameters_t;
 
+/* the queues owned by one worker thread. jobs get added to the queues of the worker adding them (or round
+   robin when added from other threads), and workers without anything to do steal from the others. this keeps
+   the workers from serializing on one global lock when hundreds of jobs are added at once. */
+typedef struct dt_control_worker_queue_t
+{
+  dt_pthread_mutex_t mutex;
+  GList *queues[DT_JOB_QUEUE_MAX];
+  size_t queue_length[DT_JOB_QUEUE_MAX];
+
+  // statistics, only written by the owning worker:
+  uint64_t jobs;                      // number of jobs run by this worker
+  uint64_t steals;                    // how many of them were taken from other workers' queues
+  double wait_time[DT_JOB_QUEUE_MAX]; // accumulated time jobs spent in the queue before being run
+  uint64_t waited[DT_JOB_QUEUE_MAX];  // number of jobs accounted in wait_time
+} dt_control_worker_queue_t;
+
+static __thread int threadid = -1;
+// index into control->worker_queues, only set for the (non reserved) worker threads
+static __thread int worker_queue = -1;
+
 typedef struct _dt_job_t
 {
   dt_job_execute_callback execute;
@@ -50,6 +70,8 @@ typedef struct _dt_job_t
   dt_job_state_t state;
   unsigned char priority;
   dt_job_queue_t queue;
+  int32_t worker;     // index of the worker queue the job got added to
+  double queued_time; // wall time the job got added to its queue
 
   dt_job_state_change_callback state_changed_cb;
 
@@ -74,6 +96,22 @@ static inline int dt_control_job_equal(_dt_job_t *j1, _dt_job_t *j2)
           && (g_strcmp0(j1->description, j2->description) == 0));
 }
 
+/** hash and equality for control->fg_jobs, consistent with dt_control_job_equal(). */
+static guint _control_job_hash(gconstpointer key)
+{
+  const _dt_job_t *job = (const _dt_job_t *)key;
+  guint hash = g_direct_hash(job->execute) ^ g_direct_hash(job->state_changed_cb) ^ job->queue;
+  if(job->params_size == 0) return hash ^ g_str_hash(job->description);
+  for(size_t k = 0; k < job->params_size; k++) hash = hash * 31 + ((const unsigned char *)job->params)[k];
+  return hash;
+}
+
+static gboolean _control_job_key_equal(gconstpointer a, gconstpointer b)
+{
+  const _dt_job_t *j1 = (const _dt_job_t *)a, *j2 = (const _dt_job_t *)b;
+  return j1->params_size == j2->params_size && dt_control_job_equal((_dt_job_t *)j1, (_dt_job_t *)j2);
+}
+
 static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
 {
   if(!job) return;
@@ -222,7 +260,10 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
   return 0;
 }
 
-static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+/* the job at the head of one worker's queues which would be run next, and the queue it's in. expects
+   wq->mutex to be held. */
+static _dt_job_t *_control_worker_queue_best(dt_control_worker_queue_t *wq, const int skip_export,
+                                             int *winner_queue)
 {
   /*
    * job scheduling works like this:
@@ -234,53 +275,120 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
    *   * system background
    * - the jobs that didn't get picked this round get their priority incremented
    */
-
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  // find the job
   _dt_job_t *job = NULL;
-  int winner_queue = DT_JOB_QUEUE_MAX;
   int max_priority = -1;
+  *winner_queue = DT_JOB_QUEUE_MAX;
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(control->queues[i] == NULL) continue;
-    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
+    if(wq->queues[i] == NULL) continue;
+    if(skip_export && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+    _dt_job_t *_job = (_dt_job_t *)wq->queues[i]->data;
     if(_job->priority > max_priority)
     {
       max_priority = _job->priority;
       job = _job;
-      winner_queue = i;
+      *winner_queue = i;
     }
   }
+  return job;
+}
+
+/* pick the job to run next from one worker's queues. expects wq->mutex to be held. */
+static _dt_job_t *_control_worker_queue_pick(dt_control_t *control, dt_control_worker_queue_t *wq)
+{
+  int skip_export = control->export_scheduled;
 
-  if(!job)
+  // find the job
+  _dt_job_t *job = NULL;
+  int winner_queue = DT_JOB_QUEUE_MAX;
+  while(1)
   {
-    dt_pthread_mutex_unlock(&control->queue_mutex);
-    return NULL;
+    job = _control_worker_queue_best(wq, skip_export, &winner_queue);
+
+    if(!job) return NULL;
+
+    // only one export job may run at a time, no matter which worker's queue it's in
+    if(winner_queue == DT_JOB_QUEUE_USER_EXPORT
+       && !__sync_bool_compare_and_swap(&control->export_scheduled, FALSE, TRUE))
+    {
+      skip_export = TRUE;
+      continue;
+    }
+    break;
   }
 
-  // the order of the queues in control->queues matches our priority, and we only update job when the priority
+  // the order of the queues in wq->queues matches our priority, and we only update job when the priority
   // is strictly bigger
   // invariant -> job is the one we are looking for
 
   // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
+  GList **queue = &wq->queues[winner_queue];
   *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
-  if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
-
-  // and place it in scheduled job array (for job deduping)
-  control->job[dt_control_get_threadid()] = job;
+  wq->queue_length[winner_queue]--;
 
   // increment the priorities of the others
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
+    if(i == winner_queue || wq->queues[i] == NULL) continue;
+    ((_dt_job_t *)wq->queues[i]->data)->priority++;
+  }
+
+  return job;
+}
+
+static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
+{
+  const int32_t id = dt_control_get_threadid();
+  dt_control_worker_queue_t *own = &control->worker_queues[id];
+
+  // find the worker holding the most important job, with the same rules as within one worker's queues. we
+  // start with our own queues and only switch on something strictly better, so we only steal when a peer has
+  // a higher class job than we have, or when we are out of work.
+  const int skip_export = control->export_scheduled;
+  int victim = id, best_priority = -1, best_queue = DT_JOB_QUEUE_MAX;
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    const int w = (id + k) % control->num_threads;
+    dt_control_worker_queue_t *wq = &control->worker_queues[w];
+    int queue = DT_JOB_QUEUE_MAX;
+    dt_pthread_mutex_lock(&wq->mutex);
+    const _dt_job_t *head = _control_worker_queue_best(wq, skip_export, &queue);
+    const int priority = head ? head->priority : -1;
+    dt_pthread_mutex_unlock(&wq->mutex);
+    if(priority > best_priority || (head && priority == best_priority && queue < best_queue))
+    {
+      victim = w;
+      best_priority = priority;
+      best_queue = queue;
+    }
+  }
+
+  dt_control_worker_queue_t *wq = &control->worker_queues[victim];
+  dt_pthread_mutex_lock(&wq->mutex);
+  _dt_job_t *job = _control_worker_queue_pick(control, wq);
+  dt_pthread_mutex_unlock(&wq->mutex);
+
+  // the queues changed in between? take anything, starting with our own queues and then our neighbour
+  for(int k = 0; !job && k < control->num_threads; k++)
+  {
+    victim = (id + k) % control->num_threads;
+    wq = &control->worker_queues[victim];
+    dt_pthread_mutex_lock(&wq->mutex);
+    job = _control_worker_queue_pick(control, wq);
+    dt_pthread_mutex_unlock(&wq->mutex);
   }
 
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  if(!job) return NULL;
+
+  const double wait = dt_get_wtime() - job->queued_time;
+  own->jobs++;
+  own->wait_time[job->queue] += wait;
+  own->waited[job->queue]++;
+  if(victim != id) own->steals++;
+
+  dt_print(DT_DEBUG_CONTROL, "[schedule_job] %02d took job from queue of %02d after %.3fs: ", id, victim, wait);
+  dt_control_job_print(job);
+  dt_print(DT_DEBUG_CONTROL, "\n");
 
   return job;
 }
@@ -318,11 +426,14 @@ static int32_t dt_control_run_job(dt_control_t *control)
 
   dt_pthread_mutex_unlock(&job->wait_mutex);
 
-  // remove the job from scheduled job array (for job deduping)
-  dt_pthread_mutex_lock(&control->queue_mutex);
-  control->job[dt_control_get_threadid()] = NULL;
-  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
-  dt_pthread_mutex_unlock(&control->queue_mutex);
+  // a copy of the job may be added again from now on
+  if(job->queue == DT_JOB_QUEUE_SYSTEM_FG)
+  {
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    g_hash_table_remove(control->fg_jobs, job);
+    dt_pthread_mutex_unlock(&control->queue_mutex);
+  }
+  if(job->queue == DT_JOB_QUEUE_USER_EXPORT) __sync_bool_compare_and_swap(&control->export_scheduled, TRUE, FALSE);
 
   // and free it
   dt_control_job_dispose(job);
@@ -385,15 +496,17 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   }
 
   job->queue = queue_id;
+  job->queued_time = dt_get_wtime();
 
   _dt_job_t *job_for_disposal = NULL;
 
-  dt_pthread_mutex_lock(&control->queue_mutex);
-
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
+  // workers keep the jobs they create for themselves, everyone else hands them out round robin
+  const uint32_t target = worker_queue >= 0
+                              ? worker_queue
+                              : __sync_fetch_and_add(&control->next_worker_queue, 1) % control->num_threads;
+  dt_control_worker_queue_t *wq = &control->worker_queues[target];
 
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %u:%zu | ", target, wq->queue_length[queue_id]);
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -402,60 +515,63 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     // this is a stack with limited size and bubble up and all that stuff
     job->priority = DT_CONTROL_FG_PRIORITY;
 
-    // check if we have already scheduled the job
-    for(int k = 0; k < control->num_threads; k++)
+    // all system fg jobs which are queued or running are in control->fg_jobs, so looking up a copy and adding
+    // the new job happen under the one lock and can't race with another thread adding the same job.
+    dt_pthread_mutex_lock(&control->queue_mutex);
+    _dt_job_t *other_job = (_dt_job_t *)g_hash_table_lookup(control->fg_jobs, job);
+    if(other_job)
     {
-      _dt_job_t *other_job = (_dt_job_t *)control->job[k];
-      if(dt_control_job_equal(job, other_job))
+      // if the job is still queued -> move it to the top of that queue
+      dt_control_worker_queue_t *other = &control->worker_queues[other_job->worker];
+      dt_pthread_mutex_lock(&other->mutex);
+      GList **queue = &other->queues[queue_id];
+      GList *iter = g_list_find(*queue, other_job);
+      if(iter)
       {
+        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue of %d: ", other_job->worker);
+        *queue = g_list_delete_link(*queue, iter);
+        *queue = g_list_prepend(*queue, other_job);
+      }
+      else
         dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in scheduled: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        dt_pthread_mutex_unlock(&control->queue_mutex);
+      dt_control_job_print(other_job);
+      dt_print(DT_DEBUG_CONTROL, "\n");
+      dt_pthread_mutex_unlock(&other->mutex);
+      dt_pthread_mutex_unlock(&control->queue_mutex);
 
+      if(!iter)
+      {
         dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
         dt_control_job_dispose(job);
-
         return 0; // there can't be any further copy
       }
+      job_for_disposal = job;
     }
-
-    // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    else
     {
-      _dt_job_t *other_job = (_dt_job_t *)iter->data;
-      if(dt_control_job_equal(job, other_job))
+      // now we can add the new job to the list
+      job->worker = target;
+      g_hash_table_add(control->fg_jobs, job);
+      dt_pthread_mutex_lock(&wq->mutex);
+      GList **queue = &wq->queues[queue_id];
+      *queue = g_list_prepend(*queue, job);
+      wq->queue_length[queue_id]++;
+
+      // and take care of the maximal queue size, shared between all workers
+      const size_t max_jobs = MAX(1, DT_CONTROL_MAX_JOBS / control->num_threads);
+      if(wq->queue_length[queue_id] > max_jobs)
       {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
-
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
-
-        job_for_disposal = job;
-
-        job = other_job;
-        break; // there can't be any further copy in the list
+        GList *last = g_list_last(*queue);
+        g_hash_table_remove(control->fg_jobs, last->data);
+        dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
+        dt_control_job_dispose((_dt_job_t *)last->data);
+        *queue = g_list_delete_link(*queue, last);
+        wq->queue_length[queue_id]--;
       }
+      dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+      dt_pthread_mutex_unlock(&wq->mutex);
+      dt_pthread_mutex_unlock(&control->queue_mutex);
     }
-
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
-
-    // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
-    {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
-    }
-
-    control->queue_length[queue_id] = length;
   }
   else
   {
@@ -466,11 +582,12 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    dt_pthread_mutex_lock(&wq->mutex);
+    wq->queues[queue_id] = g_list_append(wq->queues[queue_id], job);
+    wq->queue_length[queue_id]++;
+    dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+    dt_pthread_mutex_unlock(&wq->mutex);
   }
-  dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
-  dt_pthread_mutex_unlock(&control->queue_mutex);
 
   // notify workers
   dt_pthread_mutex_lock(&control->cond_mutex);
@@ -484,8 +601,6 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
   return 0;
 }
 
-static __thread int threadid = -1;
-
 int32_t dt_control_get_threadid()
 {
   if(threadid > -1) return threadid;
@@ -546,7 +661,7 @@ static void *dt_control_work(void *ptr)
 #endif
   worker_thread_parameters_t *params = (worker_thread_parameters_t *)ptr;
   dt_control_t *control = params->self;
-  threadid = params->threadid;
+  threadid = worker_queue = params->threadid;
   free(params);
   // int32_t threadid = dt_control_get_threadid();
   while(dt_control_running())
@@ -598,7 +713,11 @@ void dt_control_jobs_init(dt_control_t *control)
   // start threads
   control->num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
-  control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->fg_jobs = g_hash_table_new(_control_job_hash, _control_job_key_equal);
+  control->worker_queues
+      = (dt_control_worker_queue_t *)calloc(control->num_threads, sizeof(dt_control_worker_queue_t));
+  for(int k = 0; k < control->num_threads; k++) dt_pthread_mutex_init(&control->worker_queues[k].mutex, NULL);
+  control->next_worker_queue = 0;
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -628,7 +747,21 @@ void dt_control_jobs_init(dt_control_t *control)
 
 void dt_control_jobs_cleanup(dt_control_t *control)
 {
-  free(control->job);
+  static const char *queue_names[DT_JOB_QUEUE_MAX]
+      = { "user fg", "system fg", "user bg", "export", "system bg" };
+  for(int k = 0; k < control->num_threads; k++)
+  {
+    dt_control_worker_queue_t *wq = &control->worker_queues[k];
+    dt_print(DT_DEBUG_CONTROL, "[jobs] worker %02d ran %" PRIu64 " jobs, %" PRIu64 " of them stolen\n", k, wq->jobs,
+             wq->steals);
+    for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+      if(wq->waited[i])
+        dt_print(DT_DEBUG_CONTROL, "[jobs]   %-9s: %" PRIu64 " jobs, %.3fs average wait in queue\n",
+                 queue_names[i], wq->waited[i], wq->wait_time[i] / wq->waited[i]);
+    dt_pthread_mutex_destroy(&wq->mutex);
+  }
+  free(control->worker_queues);
+  g_hash_table_destroy(control->fg_jobs);
   free(control->thread);
 }
 
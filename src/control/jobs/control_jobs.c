@@ -33,6 +33,7 @@
 #include "common/tags.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/tiling.h"
 
 #include "gui/gtk.h"
 
@@ -67,6 +68,12 @@ typedef struct dt_control_export_t
   gboolean style_append;
 } dt_control_export_t;
 
+typedef struct dt_control_export_variants_t
+{
+  int count;
+  dt_control_export_t *variants; // size, format and storage of each, the rest is the same for all
+} dt_control_export_variants_t;
+
 typedef struct dt_control_image_enumerator_t
 {
   GList *index;
@@ -1147,9 +1154,171 @@ static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
   return 0;
 }
 
+/* rough number of full resolution float4 buffers a single export pipe keeps alive at once:
+ * the input image, the output of the current module, and the pixelpipe cache lines. */
+#define DT_CONTROL_EXPORT_MEMORY_FACTOR 4.0f
+
+/* state shared by all the pipes of one (possibly parallel) export job */
+typedef struct dt_control_export_shared_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GList *images;         // images not yet handed out, in export order
+  guint total, num;      // num: sequence number of the last image handed out
+  guint tagid, etagid;
+  int running;           // number of pipes currently inside store()
+  size_t memory_in_use;  // estimated host memory of the running pipes
+  double fraction;
+} dt_control_export_shared_t;
+
+typedef struct dt_control_export_worker_t
+{
+  dt_control_export_shared_t *shared;
+  dt_imageio_module_data_t *fdata; // each pipe has its own format data (one jpeg struct per thread etc)
+  int omp_threads;
+  pthread_t thread;
+} dt_control_export_worker_t;
+
+/* take the next image from the list. tags are changed while holding the lock, so they are written in the same
+ * order as the images are exported sequentially. returns 0 if there is nothing left to do. */
+static int _control_export_next(dt_control_export_shared_t *s, int *imgid, guint *num, size_t *memory)
+{
+  dt_pthread_mutex_lock(&s->mutex);
+  while(s->images && dt_control_job_get_state(s->job) != DT_JOB_STATE_CANCELLED)
+  {
+    const int id = GPOINTER_TO_INT(s->images->data);
+    s->images = g_list_delete_link(s->images, s->images);
+    const guint n = ++s->num;
+
+    // remove 'changed' tag from image
+    dt_tag_detach(s->tagid, id);
+    // make sure the 'exported' tag is set on the image
+    dt_tag_attach(s->etagid, id);
+    // check if image still exists:
+    char imgfilename[PATH_MAX] = { 0 };
+    size_t need = 0;
+    gboolean available = FALSE;
+    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)id, 'r');
+    if(image)
+    {
+      gboolean from_cache = TRUE;
+      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+      {
+        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
+      }
+      else
+      {
+        available = TRUE;
+        need = (size_t)(DT_CONTROL_EXPORT_MEMORY_FACTOR * image->width * image->height * 4 * sizeof(float));
+      }
+      dt_image_cache_read_release(darktable.image_cache, image);
+    }
+
+    if(!available)
+    {
+      s->fraction = MIN(1.0, s->fraction + 1.0 / s->total);
+      dt_control_job_set_progress(s->job, s->fraction);
+      continue;
+    }
+
+    // wait until this image fits into host memory next to the ones being exported right now.
+    // a single pipe is always allowed to run, it will fall back to tiling on its own.
+    while(s->running > 0 && dt_control_job_get_state(s->job) != DT_JOB_STATE_CANCELLED
+          && !dt_tiling_piece_fits_host_memory(need, 1, 1, 1.0f, s->memory_in_use))
+      dt_pthread_cond_wait(&s->cond, &s->mutex);
+    if(dt_control_job_get_state(s->job) == DT_JOB_STATE_CANCELLED) break;
+
+    s->running++;
+    s->memory_in_use += need;
+    dt_pthread_mutex_unlock(&s->mutex);
+
+    *imgid = id;
+    *num = n;
+    *memory = need;
+    return 1;
+  }
+  dt_pthread_mutex_unlock(&s->mutex);
+  return 0;
+}
+
+static void _control_export_done(dt_control_export_shared_t *s, const size_t memory, const int failed)
+{
+  dt_pthread_mutex_lock(&s->mutex);
+  s->running--;
+  s->memory_in_use -= memory;
+  s->fraction = MIN(1.0, s->fraction + 1.0 / s->total);
+  dt_control_job_set_progress(s->job, s->fraction);
+  if(failed) dt_control_job_cancel(s->job);
+  pthread_cond_broadcast(&s->cond);
+  dt_pthread_mutex_unlock(&s->mutex);
+}
+
+static void *_control_export_worker(void *data)
+{
+  dt_control_export_worker_t *w = (dt_control_export_worker_t *)data;
+  dt_control_export_shared_t *s = w->shared;
+  dt_control_export_t *settings = s->settings;
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(w->omp_threads);
+#endif
+
+  int imgid;
+  guint num;
+  size_t memory;
+  while(_control_export_next(s, &imgid, &num, &memory))
+  {
+    const int failed = s->mstorage->store(s->mstorage, s->sdata, imgid, s->mformat, w->fdata, num, s->total,
+                                          settings->high_quality, settings->upscale) != 0;
+    _control_export_done(s, memory, failed);
+  }
+  return NULL;
+}
+
+/* number of pipes to run concurrently for this export */
+static int _control_export_parallel_pipes(dt_imageio_module_storage_t *mstorage, dt_imageio_module_data_t *sdata,
+                                          const guint total)
+{
+  if(total < 2 || !mstorage->concurrent_store(mstorage, sdata)) return 1;
+  const int max_pipes = CLAMP(dt_conf_get_int("max_parallel_exports"), 1, 64);
+  return MIN(max_pipes, total);
+}
+
+/* set up the fdata struct: the requested size within what storage and format can take, and the style */
+static void _control_export_setup_format(const dt_control_export_t *settings, dt_imageio_module_format_t *mformat,
+                                         dt_imageio_module_data_t *fdata, dt_imageio_module_storage_t *mstorage)
+{
+  // Get max dimensions...
+  uint32_t w, h, fw, fh, sw, sh;
+  fw = fh = sw = sh = 0;
+  mstorage->dimension(mstorage, settings->sdata, &sw, &sh);
+  mformat->dimension(mformat, fdata, &fw, &fh);
+
+  if(sw == 0 || fw == 0)
+    w = sw > fw ? sw : fw;
+  else
+    w = sw < fw ? sw : fw;
+
+  if(sh == 0 || fh == 0)
+    h = sh > fh ? sh : fh;
+  else
+    h = sh < fh ? sh : fh;
+
+  fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
+  fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
+  g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
+  fdata->style_append = settings->style_append;
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
-  int imgid = -1;
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
   dt_control_export_t *settings = (dt_control_export_t *)params->data;
   GList *t = params->index;
@@ -1173,21 +1342,7 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     mstorage->set_params(mstorage, sdata, mstorage->params_size(mstorage));
   }
 
-  // Get max dimensions...
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  mstorage->dimension(mstorage, sdata, &sw, &sh);
-  mformat->dimension(mformat, fdata, &fw, &fh);
-
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
-
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
-  else
-    h = sh < fh ? sh : fh;
+  _control_export_setup_format(settings, mformat, fdata, mstorage);
 
   const guint total = g_list_length(t);
   dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
@@ -1197,61 +1352,64 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   // update the message. initialize_store() might have changed the number of images
   dt_control_job_set_progress_message(job, message);
 
-  double fraction = 0;
-
-  // set up the fdata struct
-  fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
-  fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
-  g_strlcpy(fdata->style, settings->style, sizeof(fdata->style));
-  fdata->style_append = settings->style_append;
-  guint num = 0;
+  dt_control_export_shared_t shared = { 0 };
+  shared.job = job;
+  shared.settings = settings;
+  shared.mformat = mformat;
+  shared.mstorage = mstorage;
+  shared.sdata = sdata;
+  shared.images = t;
+  shared.total = total;
+  dt_pthread_mutex_init(&shared.mutex, NULL);
+  pthread_cond_init(&shared.cond, NULL);
   // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
   // sensible assumption?
-  guint tagid = 0, etagid = 0;
-  dt_tag_new("darktable|changed", &tagid);
-  dt_tag_new("darktable|exported", &etagid);
-
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  dt_tag_new("darktable|changed", &shared.tagid);
+  dt_tag_new("darktable|exported", &shared.etagid);
+
+  // the job thread runs the first pipe itself, all others get a thread of their own.
+  const int pipes = _control_export_parallel_pipes(mstorage, sdata, total);
+  const int omp_threads = MAX(1, darktable.num_openmp_threads / pipes);
+  dt_control_export_worker_t *workers = calloc(pipes, sizeof(dt_control_export_worker_t));
+  const size_t fdata_size = mformat->params_size(mformat);
+  int started = 1;
+  workers[0].shared = &shared;
+  workers[0].fdata = fdata;
+  workers[0].omp_threads = omp_threads;
+  if(pipes > 1)
+    dt_print(DT_DEBUG_PERF, "[export_job] running %d pipes with %d openmp threads each\n", pipes, omp_threads);
+  for(int k = 1; k < pipes; k++)
   {
-    if(!t)
-      imgid = 0;
-    else
+    dt_control_export_worker_t *wk = &workers[started];
+    wk->shared = &shared;
+    wk->omp_threads = omp_threads;
+    wk->fdata = mformat->get_params(mformat);
+    if(!wk->fdata) break;
+    memcpy(wk->fdata, fdata, fdata_size);
+    if(dt_pthread_create(&wk->thread, _control_export_worker, wk))
     {
-      imgid = GPOINTER_TO_INT(t->data);
-      t = g_list_delete_link(t, t);
-      num = total - g_list_length(t);
+      mformat->free_params(mformat, wk->fdata);
+      break;
     }
+    started++;
+  }
 
-    // remove 'changed' tag from image
-    dt_tag_detach(tagid, imgid);
-    // make sure the 'exported' tag is set on the image
-    dt_tag_attach(etagid, imgid);
-    // check if image still exists:
-    char imgfilename[PATH_MAX] = { 0 };
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
-    {
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale) != 0)
-          dt_control_job_cancel(job);
-      }
-    }
+  _control_export_worker(&workers[0]);
 
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
+  for(int k = 1; k < started; k++)
+  {
+    pthread_join(workers[k].thread, NULL);
+    mformat->free_params(mformat, workers[k].fdata);
   }
+  free(workers);
+#ifdef _OPENMP
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+
+  g_list_free(shared.images);
+  pthread_cond_destroy(&shared.cond);
+  dt_pthread_mutex_destroy(&shared.mutex);
+  t = NULL;
   params->index = NULL;
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
@@ -1266,6 +1424,91 @@ end:
   return 0;
 }
 
+static int32_t dt_control_export_variants_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
+  dt_control_export_variants_t *settings = (dt_control_export_variants_t *)params->data;
+  GList *t = params->index;
+  const int count = settings->count;
+  dt_imageio_export_variant_t *variants = calloc(count, sizeof(dt_imageio_export_variant_t));
+  int ready = 0;
+
+  for(; ready < count; ready++)
+  {
+    dt_control_export_t *v = &settings->variants[ready];
+    dt_imageio_module_format_t *mformat = dt_imageio_get_format_by_index(v->format_index);
+    g_assert(mformat);
+    dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(v->storage_index);
+    g_assert(mstorage);
+    dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
+    if(!fdata) break;
+
+    if(mstorage->initialize_store)
+    {
+      if(mstorage->initialize_store(mstorage, v->sdata, &mformat, &fdata, &t, v->high_quality, v->upscale))
+      {
+        mformat->free_params(mformat, fdata);
+        break;
+      }
+      mformat->set_params(mformat, fdata, mformat->params_size(mformat));
+      mstorage->set_params(mstorage, v->sdata, mstorage->params_size(mstorage));
+    }
+
+    _control_export_setup_format(v, mformat, fdata, mstorage);
+    variants[ready] = (dt_imageio_export_variant_t){ mformat, fdata, mstorage, v->sdata };
+  }
+
+  const guint total = g_list_length(t);
+  if(ready == count)
+  {
+    dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
+    char message[512] = { 0 };
+    snprintf(message, sizeof(message),
+             ngettext("exporting %d image in %d variants", "exporting %d images in %d variants", total), total,
+             count);
+    dt_control_job_set_progress_message(job, message);
+
+    // one image after the other, its variants are exported side by side
+    dt_control_export_shared_t shared = { 0 };
+    shared.job = job;
+    shared.images = t;
+    shared.total = total;
+    dt_pthread_mutex_init(&shared.mutex, NULL);
+    pthread_cond_init(&shared.cond, NULL);
+    dt_tag_new("darktable|changed", &shared.tagid);
+    dt_tag_new("darktable|exported", &shared.etagid);
+
+    int imgid;
+    guint num;
+    size_t memory;
+    while(_control_export_next(&shared, &imgid, &num, &memory))
+    {
+      const int failed = dt_imageio_export_variants(imgid, variants, count, settings->variants[0].high_quality,
+                                                    settings->variants[0].upscale, num, total) != 0;
+      _control_export_done(&shared, memory, failed);
+    }
+
+    g_list_free(shared.images);
+    pthread_cond_destroy(&shared.cond);
+    dt_pthread_mutex_destroy(&shared.mutex);
+    t = NULL;
+    params->index = NULL;
+  }
+
+  for(int k = 0; k < ready; k++)
+  {
+    if(ready == count && variants[k].storage->finalize_store)
+      variants[k].storage->finalize_store(variants[k].storage, variants[k].storage_params);
+    variants[k].format->free_params(variants[k].format, variants[k].format_params);
+  }
+  free(variants);
+
+  // notify the user via the window manager
+  dt_ui_notify_user();
+
+  return 0;
+}
+
 static dt_control_image_enumerator_t *dt_control_gpx_apply_alloc()
 {
   dt_control_image_enumerator_t *params = dt_control_image_enumerator_alloc();
@@ -1626,6 +1869,85 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
   mstorage->export_dispatched(mstorage);
 }
 
+static void dt_control_export_variants_cleanup(void *p)
+{
+  dt_control_image_enumerator_t *params = p;
+
+  dt_control_export_variants_t *settings = (dt_control_export_variants_t *)params->data;
+  for(int k = 0; k < settings->count; k++)
+  {
+    dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(settings->variants[k].storage_index);
+    if(settings->variants[k].sdata) mstorage->free_params(mstorage, settings->variants[k].sdata);
+  }
+  free(settings->variants);
+  free(params->data);
+
+  dt_control_image_enumerator_cleanup(params);
+}
+
+void dt_control_export_variants(GList *imgid_list, const dt_control_export_variant_t *variants, int count,
+                                gboolean high_quality, gboolean upscale, char *style, gboolean style_append)
+{
+  dt_job_t *job = dt_control_job_create(&dt_control_export_variants_job_run, "export variants");
+  if(!job) return;
+  dt_control_image_enumerator_t *params = dt_control_image_enumerator_alloc();
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return;
+  }
+  dt_control_export_variants_t *data = calloc(1, sizeof(dt_control_export_variants_t));
+  if(data) data->variants = calloc(count, sizeof(dt_control_export_t));
+  if(!data || !data->variants)
+  {
+    free(data);
+    dt_control_image_enumerator_cleanup(params);
+    dt_control_job_dispose(job);
+    return;
+  }
+  params->data = data;
+  data->count = count;
+  dt_control_job_set_params(job, params, dt_control_export_variants_cleanup);
+
+  params->index = imgid_list;
+
+  for(int k = 0; k < count; k++)
+  {
+    dt_control_export_t *v = &data->variants[k];
+    v->max_width = variants[k].max_width;
+    v->max_height = variants[k].max_height;
+    v->format_index = variants[k].format_index;
+    v->storage_index = variants[k].storage_index;
+    dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(v->storage_index);
+    g_assert(mstorage);
+    // get shared storage param struct (global sequence counter, one picasa connection etc)
+    v->sdata = mstorage->get_params(mstorage);
+    if(v->sdata == NULL)
+    {
+      dt_control_log(_("failed to get parameters from storage module `%s', aborting export.."),
+                     mstorage->name(mstorage));
+      dt_control_job_dispose(job);
+      return;
+    }
+    if(variants[k].suffix[0] && mstorage->variant_suffix)
+      mstorage->variant_suffix(mstorage, v->sdata, variants[k].suffix);
+    v->high_quality = high_quality;
+    v->upscale = upscale;
+    g_strlcpy(v->style, style, sizeof(v->style));
+    v->style_append = style_append;
+  }
+
+  dt_control_job_add_progress(job, _("export images"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_EXPORT, job);
+
+  // tell the storages that we got their params for an export so they can reset themselves to a safe state
+  for(int k = 0; k < count; k++)
+  {
+    dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(variants[k].storage_index);
+    mstorage->export_dispatched(mstorage);
+  }
+}
+
 static int32_t dt_control_time_offset_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
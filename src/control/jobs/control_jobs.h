@@ -41,6 +41,15 @@ void dt_control_set_local_copy_images();
 void dt_control_reset_local_copy_images();
 void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
                        gboolean high_quality, gboolean upscale, char *style, gboolean style_append);
+/** one output of dt_control_export_variants() */
+typedef struct dt_control_export_variant_t
+{
+  int max_width, max_height, format_index, storage_index;
+  char suffix[32]; // appended to the file names by the storage, if not empty
+} dt_control_export_variant_t;
+/** export every image to all variants, running its pixelpipe only once */
+void dt_control_export_variants(GList *imgid_list, const dt_control_export_variant_t *variants, int count,
+                                gboolean high_quality, gboolean upscale, char *style, gboolean style_append);
 void dt_control_merge_hdr();
 
 void dt_control_seed_denoise();
@@ -18,8 +18,14 @@
 #include "control/jobs/film_jobs.h"
 #include "common/darktable.h"
 #include "common/film.h"
+#include "common/image.h"
 #include <stdlib.h>
 
+/* images written to the database in one transaction */
+#define DT_FILM_IMPORT_BATCH 256
+/* how far the workers preparing files may get ahead of the database writer */
+#define DT_FILM_IMPORT_WINDOW 512
+
 typedef struct dt_film_import1_t
 {
   dt_film_t *film;
@@ -120,6 +126,48 @@ static GList *_film_recursive_get_files(const gchar *path, gboolean recursive, G
   return *result;
 }
 
+/* the import runs as a pipeline: workers do the file system part of importing each file, the job thread
+   writes the prepared files to the database, in order. */
+typedef struct _film_import_queue_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  char **filenames;
+  dt_image_import_file_t *files;
+  uint8_t *ready;
+  int count;
+  int next;    // next file to prepare
+  int written; // files the writer is done with
+  int prepared;
+  double prepare_time;
+} _film_import_queue_t;
+
+static void *_film_import_worker(void *arg)
+{
+  _film_import_queue_t *q = (_film_import_queue_t *)arg;
+  dt_pthread_mutex_lock(&q->mutex);
+  for(;;)
+  {
+    while(q->next < q->count && q->next >= q->written + DT_FILM_IMPORT_WINDOW)
+      dt_pthread_cond_wait(&q->cond, &q->mutex);
+    if(q->next >= q->count) break;
+    const int k = q->next++;
+    dt_pthread_mutex_unlock(&q->mutex);
+
+    const double start = dt_get_wtime();
+    dt_image_import_prepare(q->files + k, q->filenames[k], FALSE);
+    const double took = dt_get_wtime() - start;
+
+    dt_pthread_mutex_lock(&q->mutex);
+    q->ready[k] = 1;
+    q->prepared++;
+    q->prepare_time += took;
+    pthread_cond_broadcast(&q->cond);
+  }
+  dt_pthread_mutex_unlock(&q->mutex);
+  return NULL;
+}
+
 /* compare used for sorting the list of files to import
    only sort on basename of full path eg. the actually filename.
 */
@@ -200,13 +248,49 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
   dt_control_job_set_progress_message(job, message);
 
 
-  /* loop thru the images and import to current film roll */
+  /* start the workers preparing the files */
+  _film_import_queue_t q = { 0 };
+  q.count = total;
+  q.filenames = (char **)calloc(total, sizeof(char *));
+  q.files = (dt_image_import_file_t *)calloc(total, sizeof(dt_image_import_file_t));
+  q.ready = (uint8_t *)calloc(total, sizeof(uint8_t));
+  int n = 0;
+  for(GList *image = images; image && q.filenames; image = g_list_next(image)) q.filenames[n++] = image->data;
+  dt_pthread_mutex_init(&q.mutex, NULL);
+  pthread_cond_init(&q.cond, NULL);
+
+  const int workers = (q.filenames && q.files && q.ready) ? CLAMP(dt_get_num_threads(), 1, total) : 0;
+  pthread_t *thread = (pthread_t *)calloc(MAX(workers, 1), sizeof(pthread_t));
+  int started = 0;
+  for(int k = 0; k < workers && thread; k++)
+    if(!dt_pthread_create(&thread[started], _film_import_worker, &q)) started++;
+
+  /* loop thru the images and import to current film roll, batching the database writes */
+  dt_image_import_batch_t *batch = dt_image_import_batch_begin();
+  const double start = dt_get_wtime();
+  double write_time = 0.0, wait_time = 0.0;
   dt_film_t *cfr = film;
   GList *image = g_list_first(images);
-  do
+  for(int k = 0; image; k++, image = g_list_next(image))
   {
     gchar *cdn = g_path_get_dirname((const gchar *)image->data);
 
+    /* wait for the file to be prepared, or prepare it here if there are no workers */
+    const double wait_start = dt_get_wtime();
+    dt_image_import_file_t single = { 0 };
+    dt_image_import_file_t *file = &single;
+    if(started)
+    {
+      dt_pthread_mutex_lock(&q.mutex);
+      while(!q.ready[k]) dt_pthread_cond_wait(&q.cond, &q.mutex);
+      dt_pthread_mutex_unlock(&q.mutex);
+      file = q.files + k;
+    }
+    else
+      dt_image_import_prepare(&single, (const gchar *)image->data, FALSE);
+    const double write_start = dt_get_wtime();
+    wait_time += write_start - wait_start;
+
     /* check if we need to initialize a new filmroll */
     if(!cfr || g_strcmp0(cfr->dirname, cdn) != 0)
     {
@@ -253,13 +337,49 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
     g_free(cdn);
 
     /* import image */
-    dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
+    dt_image_import_prepared(batch, cfr->id, file);
+    dt_image_import_file_cleanup(file);
+
+    if(started)
+    {
+      dt_pthread_mutex_lock(&q.mutex);
+      q.written = k + 1;
+      pthread_cond_broadcast(&q.cond);
+      dt_pthread_mutex_unlock(&q.mutex);
+    }
+
+    if((k + 1) % DT_FILM_IMPORT_BATCH == 0)
+    {
+      dt_image_import_batch_commit(batch);
+
+      /* tell how fast files are read and images are written */
+      dt_pthread_mutex_lock(&q.mutex);
+      const int prepared = started ? q.prepared : k + 1;
+      dt_pthread_mutex_unlock(&q.mutex);
+      const double elapsed = dt_get_wtime() - start;
+      g_snprintf(message, sizeof(message) - 1, _("importing %d/%d images, reading %.0f/s, writing %.0f/s"), k + 1,
+                 total, prepared / MAX(elapsed, 1e-3), (k + 1) / MAX(write_time, 1e-3));
+      dt_control_job_set_progress_message(job, message);
+    }
+    write_time += dt_get_wtime() - write_start;
 
     fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
+  }
+
+  dt_image_import_batch_end(batch);
 
+  for(int k = 0; k < started; k++) pthread_join(thread[k], NULL);
+  free(thread);
+  pthread_cond_destroy(&q.cond);
+  dt_pthread_mutex_destroy(&q.mutex);
 
-  } while((image = g_list_next(image)) != NULL);
+  dt_print(DT_DEBUG_PERF, "[film_import] %d images in %.3f secs: %d workers preparing %.3f secs, writing %.3f "
+                          "secs, waiting for files %.3f secs\n",
+           total, dt_get_wtime() - start, started, q.prepare_time, write_time, wait_time);
+  free(q.filenames);
+  free(q.files);
+  free(q.ready);
 
   g_list_free_full(images, g_free);
 
@@ -30,6 +30,9 @@ static int32_t dt_image_load_job_run(dt_job_t *job)
 {
   dt_image_load_t *params = dt_control_job_get_params(job);
 
+  // the view has moved on while we were waiting in the queue
+  if(!dt_mipmap_cache_prefetch_wanted(darktable.mipmap_cache, params->imgid, params->mip)) return 0;
+
   // hook back into mipmap_cache:
   dt_mipmap_buffer_t buf;
   dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
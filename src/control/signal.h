@@ -61,6 +61,12 @@ typedef enum dt_signal_t
     */
   DT_SIGNAL_COLLECTION_CHANGED,
 
+  /** \brief This signal is raised when tags, ratings or color labels of images changed and the collection
+      was updated in place instead of being queried again, see dt_collection_update_images()
+  no param, no returned value
+    */
+  DT_SIGNAL_COLLECTION_IMAGES_CHANGED,
+
   /** \brief This signal is raised when a tag is added/deleted/changed  */
   DT_SIGNAL_TAG_CHANGED,
 
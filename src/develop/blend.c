@@ -23,6 +23,12 @@
 #include "develop/masks.h"
 #include "develop/tiling.h"
 
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
 #define CLAMP_RANGE(x, y, z) (CLAMP(x, y, z))
 
 typedef struct _blend_buffer_desc_t
@@ -2426,10 +2432,592 @@ static void _blend_HSV_color(const _blend_buffer_desc_t *bd, const float *a, flo
   }
 }
 
+#if defined(__SSE2__)
+/* sse2 variants of the blend operators. four pixels are processed at a time: Lab and rgb pixels are
+ * transposed into one vector per channel so the formulas below read like their scalar counterparts, raw
+ * buffers have a single channel and are used as they are. whatever does not fill four pixels at the end
+ * of a row goes through the scalar code. the modes working in HSL, HSV or LCh have no sse2 variant. */
+
+static inline __m128 _sse_clamp(const __m128 x, const __m128 lo, const __m128 hi)
+{
+  return _mm_min_ps(_mm_max_ps(x, lo), hi);
+}
+
+static inline __m128 _sse_abs(const __m128 x)
+{
+  return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+// m ? x : y
+static inline __m128 _sse_select(const __m128 m, const __m128 x, const __m128 y)
+{
+  return _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+}
+
+// a * (1 - o) + b * o
+static inline __m128 _sse_mix(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _mm_add_ps(_mm_mul_ps(a, _mm_sub_ps(_mm_set1_ps(1.0f), o)), _mm_mul_ps(b, o));
+}
+
+/* the chroma channels of most Lab modes follow the change of lightness */
+static inline __m128 _sse_Lab_follow_L(const __m128 ta, const __m128 tb, const __m128 taL, const __m128 tbL,
+                                       const __m128 o, const float f)
+{
+  const __m128 den = _sse_select(_mm_cmpgt_ps(taL, _mm_set1_ps(0.01f)), taL, _mm_set1_ps(0.01f));
+  const __m128 sum = _mm_mul_ps(_mm_set1_ps(f), _mm_add_ps(ta, tb));
+  const __m128 v = _mm_add_ps(_mm_mul_ps(ta, _mm_sub_ps(_mm_set1_ps(1.0f), o)),
+                              _mm_mul_ps(_mm_div_ps(_mm_mul_ps(sum, tbL), den), o));
+  return _sse_clamp(v, _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f));
+}
+
+/* per mode: one function on the scaled Lab channels of four pixels, and one on a single channel with range
+ * 0..1, which is used for rgb and raw alike. */
+
+static inline void _blend_normal_bounded_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = _sse_clamp(_sse_mix(ta[0], tb[0], o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  for(int c = 1; c < 3; c++)
+    tb[c] = flag ? ta[c] : _sse_clamp(_sse_mix(ta[c], tb[c], o), _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blend_normal_bounded_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, b, o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_normal_unbounded_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o,
+                                                    const int flag)
+{
+  tb[0] = _sse_mix(ta[0], tb[0], o);
+  for(int c = 1; c < 3; c++) tb[c] = flag ? ta[c] : _sse_mix(ta[c], tb[c], o);
+}
+
+static inline __m128 _blend_normal_unbounded_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_mix(a, b, o);
+}
+
+static inline void _blend_lighten_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  const __m128 tbo = tb[0];
+  tb[0] = _sse_clamp(_sse_mix(ta[0], _mm_max_ps(ta[0], tb[0]), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  const __m128 d = _sse_abs(_mm_sub_ps(tbo, tb[0]));
+  for(int c = 1; c < 3; c++)
+    tb[c] = flag ? ta[c]
+                 : _sse_clamp(_sse_mix(ta[c], _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(ta[c], tb[c])), d),
+                              _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blend_lighten_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, _mm_max_ps(a, b), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_darken_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  const __m128 tbo = tb[0];
+  tb[0] = _sse_clamp(_sse_mix(ta[0], _mm_min_ps(ta[0], tb[0]), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  const __m128 d = _sse_abs(_mm_sub_ps(tbo, tb[0]));
+  for(int c = 1; c < 3; c++)
+    tb[c] = flag ? ta[c]
+                 : _sse_clamp(_sse_mix(ta[c], _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(ta[c], tb[c])), d),
+                              _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blend_darken_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, _mm_min_ps(a, b), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_multiply_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  const __m128 la = _sse_clamp(ta[0], _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  const __m128 lb = _sse_clamp(tb[0], _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  tb[0] = _sse_clamp(_sse_mix(la, _mm_mul_ps(la, lb), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  for(int c = 1; c < 3; c++) tb[c] = flag ? ta[c] : _sse_Lab_follow_L(ta[c], tb[c], ta[0], tb[0], o, 1.0f);
+}
+
+static inline __m128 _blend_multiply_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, _mm_mul_ps(a, b), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_average_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = _sse_clamp(_sse_mix(ta[0], _mm_div_ps(_mm_add_ps(ta[0], tb[0]), _mm_set1_ps(2.0f)), o),
+                     _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  for(int c = 1; c < 3; c++)
+    tb[c] = flag ? ta[c]
+                 : _sse_clamp(_sse_mix(ta[c], _mm_div_ps(_mm_add_ps(ta[c], tb[c]), _mm_set1_ps(2.0f)), o),
+                              _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blend_average_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, _mm_div_ps(_mm_add_ps(a, b), _mm_set1_ps(2.0f)), o), _mm_setzero_ps(),
+                    _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_add_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = _sse_clamp(_sse_mix(ta[0], _mm_add_ps(ta[0], tb[0]), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  for(int c = 1; c < 3; c++)
+    tb[c] = flag ? ta[c] : _sse_clamp(_sse_mix(ta[c], _mm_add_ps(ta[c], tb[c]), o), _mm_set1_ps(-1.0f),
+                                      _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blend_add_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, _mm_add_ps(a, b), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_substract_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = _sse_clamp(_sse_mix(ta[0], _mm_sub_ps(_mm_add_ps(tb[0], ta[0]), _mm_set1_ps(1.0f)), o),
+                     _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  for(int c = 1; c < 3; c++)
+    tb[c] = flag ? ta[c] : _sse_clamp(_sse_mix(ta[c], _mm_add_ps(tb[c], ta[c]), o), _mm_set1_ps(-1.0f),
+                                      _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blend_substract_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, _mm_sub_ps(_mm_add_ps(b, a), _mm_set1_ps(1.0f)), o), _mm_setzero_ps(),
+                    _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_difference_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  const __m128 la = _sse_clamp(ta[0], _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  const __m128 lb = _sse_clamp(tb[0], _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  tb[0] = _sse_clamp(_sse_mix(la, _sse_abs(_mm_sub_ps(la, lb)), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  for(int c = 1; c < 3; c++)
+  {
+    if(flag)
+    {
+      tb[c] = ta[c];
+      continue;
+    }
+    // shifted to 0..2
+    const __m128 ca = _sse_clamp(_mm_add_ps(ta[c], _mm_set1_ps(1.0f)), _mm_setzero_ps(), _mm_set1_ps(2.0f));
+    const __m128 cb = _sse_clamp(_mm_add_ps(tb[c], _mm_set1_ps(1.0f)), _mm_setzero_ps(), _mm_set1_ps(2.0f));
+    tb[c] = _mm_sub_ps(
+        _sse_clamp(_sse_mix(ca, _sse_abs(_mm_sub_ps(ca, cb)), o), _mm_setzero_ps(), _mm_set1_ps(2.0f)),
+        _mm_set1_ps(1.0f));
+  }
+}
+
+static inline __m128 _blend_difference_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return _sse_clamp(_sse_mix(a, _sse_abs(_mm_sub_ps(a, b)), o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+}
+
+static inline void _blend_difference2_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  const __m128 d0 = _sse_abs(_mm_sub_ps(ta[0], tb[0]));
+  const __m128 d1 = _mm_div_ps(_sse_abs(_mm_sub_ps(ta[1], tb[1])), _mm_set1_ps(2.0f));
+  const __m128 d2 = _mm_div_ps(_sse_abs(_mm_sub_ps(ta[2], tb[2])), _mm_set1_ps(2.0f));
+  const __m128 d = _mm_max_ps(d0, _mm_max_ps(d1, d2));
+  tb[0] = _sse_clamp(_sse_mix(ta[0], d, o), _mm_setzero_ps(), _mm_set1_ps(1.0f));
+  for(int c = 1; c < 3; c++) tb[c] = flag ? ta[c] : _mm_setzero_ps();
+}
+
+#define _blend_difference2_rgb_sse2 _blend_difference_rgb_sse2
+
+static inline __m128 _blend_screen_L_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 la = _sse_clamp(a, _mm_setzero_ps(), one);
+  const __m128 lb = _sse_clamp(b, _mm_setzero_ps(), one);
+  const __m128 s = _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(one, la), _mm_sub_ps(one, lb)));
+  return _sse_clamp(_sse_mix(la, s, o), _mm_setzero_ps(), one);
+}
+
+static inline void _blend_screen_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = _blend_screen_L_sse2(ta[0], tb[0], o);
+  for(int c = 1; c < 3; c++) tb[c] = flag ? ta[c] : _sse_Lab_follow_L(ta[c], tb[c], ta[0], tb[0], o, 0.5f);
+}
+
+#define _blend_screen_rgb_sse2 _blend_screen_L_sse2
+
+/* overlay, softlight, hardlight, vividlight, linearlight and pinlight only differ in how the clamped
+ * lightness (or channel) values are combined, and all of them weigh with the squared opacity. */
+static inline __m128 _blend_overlay_f_sse2(const __m128 la, const __m128 lb)
+{
+  const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), half = _mm_set1_ps(0.5f);
+  const __m128 hi = _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_sub_ps(la, half))),
+                                               _mm_sub_ps(one, lb)));
+  const __m128 lo = _mm_mul_ps(_mm_mul_ps(two, la), lb);
+  return _sse_select(_mm_cmpgt_ps(la, half), hi, lo);
+}
+
+static inline __m128 _blend_softlight_f_sse2(const __m128 la, const __m128 lb)
+{
+  const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+  const __m128 hi = _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(one, la), _mm_sub_ps(one, _mm_sub_ps(lb, half))));
+  const __m128 lo = _mm_mul_ps(la, _mm_add_ps(lb, half));
+  return _sse_select(_mm_cmpgt_ps(lb, half), hi, lo);
+}
+
+static inline __m128 _blend_hardlight_f_sse2(const __m128 la, const __m128 lb)
+{
+  const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), half = _mm_set1_ps(0.5f);
+  const __m128 hi = _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_sub_ps(la, half))),
+                                               _mm_sub_ps(one, lb)));
+  const __m128 lo = _mm_mul_ps(_mm_mul_ps(two, la), lb);
+  return _sse_select(_mm_cmpgt_ps(lb, half), hi, lo);
+}
+
+static inline __m128 _blend_vividlight_f_sse2(const __m128 la, const __m128 lb)
+{
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 hi = _sse_select(_mm_cmpge_ps(lb, one), one, _mm_div_ps(la, _mm_mul_ps(two, _mm_sub_ps(one, lb))));
+  const __m128 lo = _sse_select(_mm_cmple_ps(lb, zero), zero,
+                                _mm_sub_ps(one, _mm_div_ps(_mm_sub_ps(one, la), _mm_mul_ps(two, lb))));
+  return _sse_select(_mm_cmpgt_ps(lb, half), hi, lo);
+}
+
+static inline __m128 _blend_linearlight_f_sse2(const __m128 la, const __m128 lb)
+{
+  return _mm_sub_ps(_mm_add_ps(la, _mm_mul_ps(_mm_set1_ps(2.0f), lb)), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 _blend_pinlight_f_sse2(const __m128 la, const __m128 lb)
+{
+  const __m128 two = _mm_set1_ps(2.0f), half = _mm_set1_ps(0.5f);
+  const __m128 hi = _mm_max_ps(la, _mm_mul_ps(two, _mm_sub_ps(lb, half)));
+  const __m128 lo = _mm_min_ps(la, _mm_mul_ps(two, lb));
+  return _sse_select(_mm_cmpgt_ps(lb, half), hi, lo);
+}
+
+#define _BLEND_LIGHT_SSE2(name)                                                                              \
+  static inline __m128 _blend_##name##_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)              \
+  {                                                                                                          \
+    const __m128 one = _mm_set1_ps(1.0f);                                                                    \
+    const __m128 la = _sse_clamp(a, _mm_setzero_ps(), one);                                                  \
+    const __m128 lb = _sse_clamp(b, _mm_setzero_ps(), one);                                                  \
+    return _sse_clamp(_sse_mix(la, _blend_##name##_f_sse2(la, lb), _mm_mul_ps(o, o)), _mm_setzero_ps(), one); \
+  }                                                                                                          \
+                                                                                                             \
+  static inline void _blend_##name##_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)  \
+  {                                                                                                          \
+    tb[0] = _blend_##name##_rgb_sse2(ta[0], tb[0], o);                                                       \
+    for(int c = 1; c < 3; c++)                                                                               \
+      tb[c] = flag ? ta[c] : _sse_Lab_follow_L(ta[c], tb[c], ta[0], tb[0], _mm_mul_ps(o, o), 1.0f);          \
+  }
+
+_BLEND_LIGHT_SSE2(overlay)
+_BLEND_LIGHT_SSE2(softlight)
+_BLEND_LIGHT_SSE2(hardlight)
+_BLEND_LIGHT_SSE2(vividlight)
+_BLEND_LIGHT_SSE2(linearlight)
+
+#undef _BLEND_LIGHT_SSE2
+
+static inline __m128 _blend_pinlight_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 la = _sse_clamp(a, _mm_setzero_ps(), one);
+  const __m128 lb = _sse_clamp(b, _mm_setzero_ps(), one);
+  return _sse_clamp(_sse_mix(la, _blend_pinlight_f_sse2(la, lb), _mm_mul_ps(o, o)), _mm_setzero_ps(), one);
+}
+
+static inline void _blend_pinlight_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = _blend_pinlight_rgb_sse2(ta[0], tb[0], o);
+  for(int c = 1; c < 3; c++) tb[c] = _sse_clamp(ta[c], _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f));
+}
+
+#define _blend_inverse_Lab_sse2 _blend_normal_bounded_Lab_sse2
+#define _blend_inverse_rgb_sse2 _blend_normal_bounded_rgb_sse2
+
+static inline void _blend_Lab_lightness_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = _sse_mix(ta[0], tb[0], o);
+  tb[1] = ta[1];
+  tb[2] = ta[2];
+}
+
+static inline __m128 _blend_Lab_lightness_rgb_sse2(const __m128 a, const __m128 b, const __m128 o)
+{
+  return a; // noop for rgb and raw (unclamped)
+}
+
+static inline void _blend_Lab_color_Lab_sse2(const __m128 *ta, __m128 *tb, const __m128 o, const int flag)
+{
+  tb[0] = ta[0];
+  for(int c = 1; c < 3; c++) tb[c] = flag ? ta[c] : _sse_mix(ta[c], tb[c], o);
+}
+
+#define _blend_Lab_color_rgb_sse2 _blend_Lab_lightness_rgb_sse2
+
+/* the row function of a mode: Lab and rgb need four channels, raw one. anything else, and the pixels left
+ * over at the end of the row, take the scalar path. */
+#define _BLEND_ROW_SSE2(name)                                                                                \
+  static void _blend_##name##_sse2(const _blend_buffer_desc_t *bd, const float *a, float *b,                 \
+                                   const float *mask, int flag)                                              \
+  {                                                                                                          \
+    const size_t npixels = bd->stride / bd->ch;                                                              \
+    size_t i = 0;                                                                                            \
+                                                                                                             \
+    if(bd->cst == iop_cs_Lab && bd->ch == 4)                                                                 \
+    {                                                                                                        \
+      const __m128 scale[3] = { _mm_set1_ps(100.0f), _mm_set1_ps(128.0f), _mm_set1_ps(128.0f) };             \
+      for(; i + 4 <= npixels; i += 4)                                                                        \
+      {                                                                                                      \
+        __m128 a0 = _mm_loadu_ps(a + 4 * i), a1 = _mm_loadu_ps(a + 4 * i + 4);                               \
+        __m128 a2 = _mm_loadu_ps(a + 4 * i + 8), a3 = _mm_loadu_ps(a + 4 * i + 12);                          \
+        __m128 b0 = _mm_loadu_ps(b + 4 * i), b1 = _mm_loadu_ps(b + 4 * i + 4);                               \
+        __m128 b2 = _mm_loadu_ps(b + 4 * i + 8), b3 = _mm_loadu_ps(b + 4 * i + 12);                          \
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);                                                                   \
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);                                                                   \
+        const __m128 o = _mm_loadu_ps(mask + i);                                                             \
+        const __m128 ta[3] = { _mm_div_ps(a0, scale[0]), _mm_div_ps(a1, scale[1]), _mm_div_ps(a2, scale[2]) }; \
+        __m128 tb[3] = { _mm_div_ps(b0, scale[0]), _mm_div_ps(b1, scale[1]), _mm_div_ps(b2, scale[2]) };     \
+        _blend_##name##_Lab_sse2(ta, tb, o, flag);                                                           \
+        b0 = _mm_mul_ps(tb[0], scale[0]);                                                                    \
+        b1 = _mm_mul_ps(tb[1], scale[1]);                                                                    \
+        b2 = _mm_mul_ps(tb[2], scale[2]);                                                                    \
+        b3 = o;                                                                                              \
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);                                                                   \
+        _mm_storeu_ps(b + 4 * i, b0);                                                                        \
+        _mm_storeu_ps(b + 4 * i + 4, b1);                                                                    \
+        _mm_storeu_ps(b + 4 * i + 8, b2);                                                                    \
+        _mm_storeu_ps(b + 4 * i + 12, b3);                                                                   \
+      }                                                                                                      \
+    }                                                                                                        \
+    else if(bd->cst == iop_cs_rgb && bd->ch == 4)                                                            \
+    {                                                                                                        \
+      const __m128 alpha = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));                                     \
+      for(; i < npixels; i++)                                                                                \
+      {                                                                                                      \
+        const __m128 o = _mm_set1_ps(mask[i]);                                                               \
+        const __m128 v = _blend_##name##_rgb_sse2(_mm_loadu_ps(a + 4 * i), _mm_loadu_ps(b + 4 * i), o);      \
+        _mm_storeu_ps(b + 4 * i, _sse_select(alpha, o, v));                                                  \
+      }                                                                                                      \
+    }                                                                                                        \
+    else if(bd->cst == iop_cs_RAW && bd->ch == 1)                                                            \
+    {                                                                                                        \
+      for(; i + 4 <= npixels; i += 4)                                                                        \
+        _mm_storeu_ps(b + i, _blend_##name##_rgb_sse2(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i),              \
+                                                      _mm_loadu_ps(mask + i)));                              \
+    }                                                                                                        \
+                                                                                                             \
+    if(i < npixels)                                                                                          \
+    {                                                                                                        \
+      _blend_buffer_desc_t rest = *bd;                                                                       \
+      rest.stride = (npixels - i) * bd->ch;                                                                  \
+      _blend_##name(&rest, a + i * bd->ch, b + i * bd->ch, mask + i, flag);                                  \
+    }                                                                                                        \
+  }
+
+_BLEND_ROW_SSE2(normal_bounded)
+_BLEND_ROW_SSE2(normal_unbounded)
+_BLEND_ROW_SSE2(lighten)
+_BLEND_ROW_SSE2(darken)
+_BLEND_ROW_SSE2(multiply)
+_BLEND_ROW_SSE2(average)
+_BLEND_ROW_SSE2(add)
+_BLEND_ROW_SSE2(substract)
+_BLEND_ROW_SSE2(difference)
+_BLEND_ROW_SSE2(difference2)
+_BLEND_ROW_SSE2(screen)
+_BLEND_ROW_SSE2(overlay)
+_BLEND_ROW_SSE2(softlight)
+_BLEND_ROW_SSE2(hardlight)
+_BLEND_ROW_SSE2(vividlight)
+_BLEND_ROW_SSE2(linearlight)
+_BLEND_ROW_SSE2(pinlight)
+_BLEND_ROW_SSE2(inverse)
+_BLEND_ROW_SSE2(Lab_lightness)
+_BLEND_ROW_SSE2(Lab_color)
+
+#undef _BLEND_ROW_SSE2
+#undef _blend_difference2_rgb_sse2
+#undef _blend_screen_rgb_sse2
+#undef _blend_inverse_Lab_sse2
+#undef _blend_inverse_rgb_sse2
+#undef _blend_Lab_color_rgb_sse2
+
+/* one blendif channel of four pixels, see _blendif_factor() */
+static inline __m128 _blendif_factor_channel_sse2(const __m128 scaled, const float *const p, const int invert,
+                                                  const int incl)
+{
+  const __m128 p0 = _mm_set1_ps(p[0]), p1 = _mm_set1_ps(p[1]);
+  const __m128 p2 = _mm_set1_ps(p[2]), p3 = _mm_set1_ps(p[3]);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 up = _mm_div_ps(_mm_sub_ps(scaled, p0), _mm_set1_ps(fmax(0.01f, p[1] - p[0])));
+  const __m128 down = _mm_sub_ps(one, _mm_div_ps(_mm_sub_ps(scaled, p2), _mm_set1_ps(fmax(0.01f, p[3] - p[2]))));
+  const __m128 in_up = _mm_and_ps(_mm_cmpgt_ps(scaled, p0), _mm_cmplt_ps(scaled, p1));
+  const __m128 in_down = _mm_and_ps(_mm_cmpgt_ps(scaled, p2), _mm_cmplt_ps(scaled, p3));
+  const __m128 in_top = _mm_and_ps(_mm_cmpge_ps(scaled, p1), _mm_cmple_ps(scaled, p2));
+  __m128 factor = _mm_and_ps(in_down, down);
+  factor = _mm_or_ps(_mm_and_ps(in_up, up), _mm_andnot_ps(in_up, factor));
+  factor = _mm_or_ps(_mm_and_ps(in_top, one), _mm_andnot_ps(in_top, factor));
+  if(invert) factor = _mm_sub_ps(one, factor);
+  return incl ? _mm_sub_ps(one, factor) : factor;
+}
+
+/* sse2 version of _blend_make_mask(). it covers the blendif channels which only need scaling and
+ * clamping, rows which need LCh or HSL are left to the scalar code. */
+static void _blend_make_mask_sse2(const _blend_buffer_desc_t *bd, const unsigned int blendif,
+                                  const float *blendif_parameters, const unsigned int mask_mode,
+                                  const unsigned int mask_combine, const float gopacity, const float *a,
+                                  const float *b, float *mask)
+{
+  const size_t npixels = bd->stride / bd->ch;
+  const int incl = (mask_combine & DEVELOP_COMBINE_INCL) ? 1 : 0;
+  const int inv = (mask_combine & DEVELOP_COMBINE_INV) ? 1 : 0;
+  const unsigned int channel_mask
+      = bd->cst == iop_cs_Lab ? DEVELOP_BLENDIF_Lab_MASK : bd->cst == iop_cs_rgb ? DEVELOP_BLENDIF_RGB_MASK : 0;
+  size_t i = 0;
+
+  if(bd->ch == 4 && channel_mask && (mask_mode & DEVELOP_MASK_CONDITIONAL) && !(blendif & 0x7f00))
+  {
+    // channels with sliders spanning the whole range contribute a constant
+    float fixed = 1.0f;
+    for(int ch = 0; ch <= DEVELOP_BLENDIF_MAX; ch++)
+      if((channel_mask & (1 << ch)) && !(blendif & (1 << ch)))
+        fixed *= !(blendif & (1 << (ch + 16))) == !incl ? 1.0f : 0.0f;
+
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    for(; i + 4 <= npixels; i += 4)
+    {
+      __m128 in[4], out[4];
+      for(int k = 0; k < 4; k++)
+      {
+        in[k] = _mm_loadu_ps(a + 4 * (i + k));
+        out[k] = _mm_loadu_ps(b + 4 * (i + k));
+      }
+      _MM_TRANSPOSE4_PS(in[0], in[1], in[2], in[3]);
+      _MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);
+
+      __m128 scaled[8];
+      if(bd->cst == iop_cs_Lab)
+      {
+        const __m128 ab_off = _mm_set1_ps(128.0f), ab_range = _mm_set1_ps(256.0f);
+        for(int k = 0; k < 2; k++)
+        {
+          const __m128 *px = k ? out : in;
+          scaled[4 * k + 0] = _sse_clamp(_mm_div_ps(px[0], _mm_set1_ps(100.0f)), zero, one);
+          scaled[4 * k + 1] = _sse_clamp(_mm_div_ps(_mm_add_ps(px[1], ab_off), ab_range), zero, one);
+          scaled[4 * k + 2] = _sse_clamp(_mm_div_ps(_mm_add_ps(px[2], ab_off), ab_range), zero, one);
+          scaled[4 * k + 3] = zero;
+        }
+      }
+      else
+      {
+        for(int k = 0; k < 2; k++)
+        {
+          const __m128 *px = k ? out : in;
+          const __m128 gray = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.3f), px[0]),
+                                                    _mm_mul_ps(_mm_set1_ps(0.59f), px[1])),
+                                         _mm_mul_ps(_mm_set1_ps(0.11f), px[2]));
+          scaled[4 * k + 0] = _sse_clamp(gray, zero, one);
+          for(int c = 0; c < 3; c++) scaled[4 * k + 1 + c] = _sse_clamp(px[c], zero, one);
+        }
+      }
+
+      __m128 result = _mm_set1_ps(fixed);
+      for(int ch = 0; ch < 8; ch++)
+      {
+        if(!(channel_mask & (1 << ch)) || !(blendif & (1 << ch))) continue;
+        result = _mm_mul_ps(result, _blendif_factor_channel_sse2(scaled[ch], blendif_parameters + 4 * ch,
+                                                                 (blendif & (1 << (ch + 16))) != 0, incl));
+      }
+
+      const __m128 conditional = incl ? _mm_sub_ps(one, result) : result;
+      const __m128 form = _mm_loadu_ps(mask + i);
+      __m128 opacity = incl ? _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(one, form), _mm_sub_ps(one, conditional)))
+                            : _mm_mul_ps(form, conditional);
+      if(inv) opacity = _mm_sub_ps(one, opacity);
+      _mm_storeu_ps(mask + i, _mm_mul_ps(opacity, _mm_set1_ps(gopacity)));
+    }
+  }
+
+  if(i < npixels)
+  {
+    _blend_buffer_desc_t rest = *bd;
+    rest.stride = (npixels - i) * bd->ch;
+    _blend_make_mask(&rest, blendif, blendif_parameters, mask_mode, mask_combine, gopacity, a + i * bd->ch,
+                     b + i * bd->ch, mask + i);
+  }
+}
+
+static _blend_row_func *_blend_choose_func_sse2(const unsigned int blend_mode)
+{
+  switch(blend_mode)
+  {
+    case DEVELOP_BLEND_LIGHTEN:
+      return _blend_lighten_sse2;
+    case DEVELOP_BLEND_DARKEN:
+      return _blend_darken_sse2;
+    case DEVELOP_BLEND_MULTIPLY:
+      return _blend_multiply_sse2;
+    case DEVELOP_BLEND_AVERAGE:
+      return _blend_average_sse2;
+    case DEVELOP_BLEND_ADD:
+      return _blend_add_sse2;
+    case DEVELOP_BLEND_SUBSTRACT:
+      return _blend_substract_sse2;
+    case DEVELOP_BLEND_DIFFERENCE:
+      return _blend_difference_sse2;
+    case DEVELOP_BLEND_DIFFERENCE2:
+      return _blend_difference2_sse2;
+    case DEVELOP_BLEND_SCREEN:
+      return _blend_screen_sse2;
+    case DEVELOP_BLEND_OVERLAY:
+      return _blend_overlay_sse2;
+    case DEVELOP_BLEND_SOFTLIGHT:
+      return _blend_softlight_sse2;
+    case DEVELOP_BLEND_HARDLIGHT:
+      return _blend_hardlight_sse2;
+    case DEVELOP_BLEND_VIVIDLIGHT:
+      return _blend_vividlight_sse2;
+    case DEVELOP_BLEND_LINEARLIGHT:
+      return _blend_linearlight_sse2;
+    case DEVELOP_BLEND_PINLIGHT:
+      return _blend_pinlight_sse2;
+    case DEVELOP_BLEND_INVERSE:
+      return _blend_inverse_sse2;
+    case DEVELOP_BLEND_NORMAL:
+    case DEVELOP_BLEND_BOUNDED:
+      return _blend_normal_bounded_sse2;
+    case DEVELOP_BLEND_LAB_LIGHTNESS:
+      return _blend_Lab_lightness_sse2;
+    case DEVELOP_BLEND_LAB_COLOR:
+      return _blend_Lab_color_sse2;
+    case DEVELOP_BLEND_LIGHTNESS:
+    case DEVELOP_BLEND_CHROMA:
+    case DEVELOP_BLEND_HUE:
+    case DEVELOP_BLEND_COLOR:
+    case DEVELOP_BLEND_COLORADJUST:
+    case DEVELOP_BLEND_HSV_LIGHTNESS:
+    case DEVELOP_BLEND_HSV_COLOR:
+      return NULL;
+    case DEVELOP_BLEND_NORMAL2:
+    case DEVELOP_BLEND_UNBOUNDED:
+    default:
+      return _blend_normal_unbounded_sse2;
+  }
+}
+#endif
+
 _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
 {
   _blend_row_func *blend = NULL;
 
+#if defined(__SSE2__)
+  if(darktable.codepath.SSE2 && !darktable.codepath.OPENMP_SIMD)
+  {
+    blend = _blend_choose_func_sse2(blend_mode);
+    if(blend) return blend;
+  }
+#endif
+
   /* select the blend operator */
   switch(blend_mode)
   {
@@ -2524,6 +3112,144 @@ _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
   return blend;
 }
 
+/* rasterized drawn masks of the darkroom pipes. the raster only depends on the forms, on the roi and on
+ * the distortions of the modules before the one blending, so when the user tweaks a masked module or comes
+ * back to an earlier zoom level and position the previous raster is reused instead of rendering all
+ * brushes and paths again. */
+#define BLEND_MASK_CACHE_SIZE 8
+#define BLEND_MASK_CACHE_BYTES ((size_t)64 << 20)
+// the budget grows to hold this many masks of the size the full pipe renders at, a 4K view needs ~33MB each
+#define BLEND_MASK_CACHE_FULL_LINES 4
+
+typedef struct _blend_mask_cache_line_t
+{
+  uint64_t hash;
+  int width, height;
+  float *mask;
+  uint64_t used;
+} _blend_mask_cache_line_t;
+
+static struct
+{
+  GMutex lock;
+  _blend_mask_cache_line_t line[BLEND_MASK_CACHE_SIZE];
+  uint64_t clock;
+  size_t budget; // bytes, at least BLEND_MASK_CACHE_BYTES
+} _blend_mask_cache;
+
+static uint64_t _blend_mask_hash(struct dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
+                                 const struct dt_iop_roi_t *roi)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+
+  // everything up to this module, which covers all distortions applied to the forms, and the roi
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, g_list_index(pipe->nodes, piece));
+
+  const int length = dt_masks_group_get_hash_buffer_length(form);
+  char *str = malloc(length);
+  if(!str) return 0;
+  dt_masks_group_get_hash_buffer(form, str);
+  for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
+  free(str);
+
+  const float geometry[3] = { pipe->iwidth, pipe->iheight, pipe->iscale };
+  const char *g = (const char *)geometry;
+  for(size_t i = 0; i < sizeof(geometry); i++) hash = ((hash << 5) + hash) ^ g[i];
+  return hash;
+}
+
+static int _blend_mask_cache_get(const uint64_t hash, const int width, const int height, float *mask)
+{
+  int found = 0;
+  g_mutex_lock(&_blend_mask_cache.lock);
+  for(int k = 0; k < BLEND_MASK_CACHE_SIZE; k++)
+  {
+    _blend_mask_cache_line_t *l = _blend_mask_cache.line + k;
+    if(l->mask && l->hash == hash && l->width == width && l->height == height)
+    {
+      memcpy(mask, l->mask, sizeof(float) * width * height);
+      l->used = ++_blend_mask_cache.clock;
+      found = 1;
+      break;
+    }
+  }
+  g_mutex_unlock(&_blend_mask_cache.lock);
+  return found;
+}
+
+static void _blend_mask_cache_put(const uint64_t hash, const int width, const int height, const float *mask,
+                                  const int full)
+{
+  const size_t size = sizeof(float) * width * height;
+
+  g_mutex_lock(&_blend_mask_cache.lock);
+  // the roi of the full pipe is the darkroom view, size the cache after it so that its masks fit
+  if(full) _blend_mask_cache.budget = MAX(BLEND_MASK_CACHE_BYTES, BLEND_MASK_CACHE_FULL_LINES * size);
+  const size_t budget = MAX(BLEND_MASK_CACHE_BYTES, _blend_mask_cache.budget);
+  g_mutex_unlock(&_blend_mask_cache.lock);
+  if(size > budget / BLEND_MASK_CACHE_FULL_LINES) return;
+
+  float *copy = dt_alloc_align(64, size);
+  if(!copy) return;
+  memcpy(copy, mask, size);
+
+  g_mutex_lock(&_blend_mask_cache.lock);
+  // drop the least recently used lines until there is a free one and we are within budget
+  int slot;
+  for(;;)
+  {
+    size_t total = size;
+    int lru = -1;
+    slot = -1;
+    for(int k = 0; k < BLEND_MASK_CACHE_SIZE; k++)
+    {
+      const _blend_mask_cache_line_t *l = _blend_mask_cache.line + k;
+      if(!l->mask)
+      {
+        if(slot < 0) slot = k;
+        continue;
+      }
+      total += sizeof(float) * l->width * l->height;
+      if(lru < 0 || l->used < _blend_mask_cache.line[lru].used) lru = k;
+    }
+    if(slot >= 0 && total <= budget) break;
+    dt_free_align(_blend_mask_cache.line[lru].mask);
+    _blend_mask_cache.line[lru].mask = NULL;
+  }
+
+  _blend_mask_cache_line_t *l = _blend_mask_cache.line + slot;
+  l->hash = hash;
+  l->width = width;
+  l->height = height;
+  l->mask = copy;
+  l->used = ++_blend_mask_cache.clock;
+  g_mutex_unlock(&_blend_mask_cache.lock);
+}
+
+void dt_develop_blend_mask_cache_flush(void)
+{
+  g_mutex_lock(&_blend_mask_cache.lock);
+  for(int k = 0; k < BLEND_MASK_CACHE_SIZE; k++)
+  {
+    dt_free_align(_blend_mask_cache.line[k].mask);
+    _blend_mask_cache.line[k].mask = NULL;
+  }
+  g_mutex_unlock(&_blend_mask_cache.lock);
+}
+
+/* renders the drawn mask of the module into mask, going through the cache for the darkroom pipes */
+static void _blend_render_form(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                               dt_masks_form_t *form, const struct dt_iop_roi_t *roi, float *mask)
+{
+  const int cached = piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW);
+  const uint64_t hash = cached ? _blend_mask_hash(piece, form, roi) : 0;
+
+  if(hash && _blend_mask_cache_get(hash, roi->width, roi->height, mask)) return;
+
+  if(dt_masks_group_render_roi(self, piece, form, roi, mask) && hash)
+    _blend_mask_cache_put(hash, roi->width, roi->height, mask, piece->pipe->type & DT_DEV_PIXELPIPE_FULL);
+}
+
 void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               const void *const ivoid, void *const ovoid, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out)
@@ -2604,7 +3330,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 
     if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+      _blend_render_form(self, piece, form, roi_out, mask);
 
       if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
       {
@@ -2650,8 +3376,14 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
       float *in = (float *)ivoid + iindex;
       float *out = (float *)ovoid + oindex;
       float *m = (float *)mask + y * roi_out->width;
-      _blend_make_mask(&bd, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in,
-                       out, m);
+#if defined(__SSE2__)
+      if(darktable.codepath.SSE2 && !darktable.codepath.OPENMP_SIMD)
+        _blend_make_mask_sse2(&bd, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity,
+                              in, out, m);
+      else
+#endif
+        _blend_make_mask(&bd, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in,
+                         out, m);
     }
 
     const int maskblur = fabs(d->radius) <= 0.1f ? 0 : 1;
@@ -2840,7 +3572,7 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
     dt_masks_form_t *form = dt_masks_get_from_id(self->dev, d->mask_id);
     if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+      _blend_render_form(self, piece, form, roi_out, mask);
 
       if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
       {
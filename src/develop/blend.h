@@ -372,6 +372,9 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 /** get blend version */
 int dt_develop_blend_version(void);
 
+/** drop all cached drawn mask rasters */
+void dt_develop_blend_mask_cache_flush(void);
+
 /** check if content of params is all zero, indicating a non-initialized set of blend parameters which needs
  * special care. */
 gboolean dt_develop_blend_params_is_all_zero(const void *params, size_t length);
@@ -45,6 +45,8 @@
 #define DT_DEV_AVERAGE_DELAY_START 250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START 50
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+#define DT_DEV_PROGRESSIVE_MAX_BANDS 16
+#define DT_DEV_PROGRESSIVE_MIN_BAND_HEIGHT 128
 
 const gchar *dt_dev_histogram_type_names[DT_DEV_HISTOGRAM_N] = { "logarithmic", "linear", "waveform" };
 
@@ -74,6 +76,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->preview_input_changed = 0;
 
   dev->pipe = dev->preview_pipe = NULL;
+  memset(&dev->progressive, 0, sizeof(dev->progressive));
   dt_pthread_mutex_init(&dev->pipe_mutex, NULL);
   dt_pthread_mutex_init(&dev->preview_pipe_mutex, NULL);
   //   dt_pthread_mutex_init(&dev->histogram_waveform_mutex, NULL);
@@ -138,6 +141,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
     dt_dev_pixelpipe_cleanup(dev->preview_pipe);
     free(dev->preview_pipe);
   }
+  dt_free_align(dev->progressive.buf);
   while(dev->history)
   {
     dt_dev_free_history_item(((dt_dev_history_item_t *)dev->history->data));
@@ -287,6 +291,65 @@ restart:
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 }
 
+// process the full pipe in horizontal bands, starting in the middle of the view and working outwards,
+// so the center gets refined first while the preview is still shown around it. returns non-zero if
+// processing got interrupted, just like dt_dev_pixelpipe_process().
+static int _dev_process_image_progressive(dt_develop_t *dev, const int x, const int y, const int wd,
+                                          const int ht, const float scale)
+{
+  const int bands = CLAMP(ht / DT_DEV_PROGRESSIVE_MIN_BAND_HEIGHT, 2, DT_DEV_PROGRESSIVE_MAX_BANDS);
+  const int band_height = (ht + bands - 1) / bands;
+  const size_t size = (size_t)4 * wd * ht;
+
+  dt_pthread_mutex_lock(&dev->pipe->backbuf_mutex);
+  if(dev->progressive.size < size)
+  {
+    // the darkroom may still show the last composed image, don't leave it dangling
+    if(dev->pipe->backbuf == dev->progressive.buf) dev->pipe->backbuf = NULL;
+    dt_free_align(dev->progressive.buf);
+    dev->progressive.buf = (uint8_t *)dt_alloc_align(64, size);
+    dev->progressive.size = dev->progressive.buf ? size : 0;
+  }
+  dev->progressive.width = wd;
+  dev->progressive.height = ht;
+  dev->progressive.bands = bands;
+  dev->progressive.band_height = band_height;
+  dev->progressive.done = 0;
+  dt_pthread_mutex_unlock(&dev->pipe->backbuf_mutex);
+
+  if(!dev->progressive.buf) return dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale);
+
+  for(int k = 0; k < bands; k++)
+  {
+    // center band first, then alternate above and below it
+    const int band = bands / 2 + ((k & 1) ? -(k + 1) / 2 : (k + 1) / 2);
+    const int by = band * band_height;
+    const int bh = MIN(band_height, ht - by);
+    if(band < 0 || band >= bands || bh <= 0) continue;
+
+    if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y + by, wd, bh, scale)) return 1;
+    // the remaining bands are stale if history, zoom or pan changed in the meantime
+    if(dev->pipe->changed != DT_DEV_PIPE_UNCHANGED) return 1;
+
+    dt_pthread_mutex_lock(&dev->pipe->backbuf_mutex);
+    memcpy(dev->progressive.buf + (size_t)4 * wd * by, dev->pipe->backbuf, (size_t)4 * wd * bh);
+    dev->progressive.done |= (uint64_t)1 << band;
+    dt_pthread_mutex_unlock(&dev->pipe->backbuf_mutex);
+
+    if(dev->gui_attached) dt_control_queue_redraw_center();
+  }
+
+  // hand the composed image to the darkroom as if it came out of the pipe in one go
+  dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, wd, ht, scale };
+  dt_pthread_mutex_lock(&dev->pipe->backbuf_mutex);
+  dev->pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(dev->pipe->image.id, &roi, dev->pipe, 0);
+  dev->pipe->backbuf = dev->progressive.buf;
+  dev->pipe->backbuf_width = wd;
+  dev->pipe->backbuf_height = ht;
+  dt_pthread_mutex_unlock(&dev->pipe->backbuf_mutex);
+  return 0;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -385,8 +448,19 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  // render slow pipes progressively, so the center of the view shows up early and a new change
+  // does not have to wait for the full image to finish
+  const int progressive_delay = dt_conf_get_int("darkroom/ui/progressive_threshold");
+  const int progressive = dev->gui_attached && progressive_delay > 0
+                          && dev->average_delay > progressive_delay
+                          && ht >= 2 * DT_DEV_PROGRESSIVE_MIN_BAND_HEIGHT;
+  dt_pthread_mutex_lock(&dev->pipe->backbuf_mutex);
+  dev->progressive.done = 0;
+  dt_pthread_mutex_unlock(&dev->pipe->backbuf_mutex);
+
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
+  if(progressive ? _dev_process_image_progressive(dev, x, y, wd, ht, scale)
+                 : dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
@@ -939,8 +1013,9 @@ static void auto_apply_presets(dt_develop_t *dev)
         DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                     "UPDATE memory.history SET num=?1 WHERE rowid=?2", -1, &stmt, NULL);
 
-        // let's wrap this into a transaction, it might make it a little faster.
-        sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+        // let's wrap this into a savepoint, it might make it a little faster. not a transaction of its own,
+        // this runs while an import batch (see dt_image_import_batch_begin()) has one open.
+        sqlite3_exec(dt_database_get(darktable.db), "SAVEPOINT auto_apply_presets", NULL, NULL, NULL);
         do
         {
           DT_DEBUG_SQLITE3_CLEAR_BINDINGS(stmt);
@@ -954,7 +1029,7 @@ static void auto_apply_presets(dt_develop_t *dev)
           r = g_list_next(r);
         } while((sqlite3_step(stmt) == SQLITE_DONE) && r);
 
-        sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+        sqlite3_exec(dt_database_get(darktable.db), "RELEASE auto_apply_presets", NULL, NULL, NULL);
 
         g_list_free(rowids);
         sqlite3_finalize(stmt);
@@ -106,6 +106,17 @@ typedef struct dt_develop_t
   struct dt_iop_module_t *gui_module; // this module claims gui expose/event callbacks.
   float preview_downsampling;         // < 1.0: optionally downsample preview
 
+  // progressive rendering of slow full pipe runs: the view is split into horizontal bands which are
+  // processed center first and composed into buf. protected by pipe->backbuf_mutex.
+  struct
+  {
+    uint8_t *buf;
+    size_t size;
+    int32_t width, height;
+    int32_t bands, band_height;
+    uint64_t done; // bitmask of finished bands
+  } progressive;
+
   // width, height: dimensions of window
   int32_t width, height;
 
@@ -178,6 +178,10 @@ static void default_process(struct dt_iop_module_t *self, struct dt_dev_pixelpip
   if(darktable.codepath.OPENMP_SIMD && self->process_plain)
     self->process_plain(self, piece, i, o, roi_in, roi_out);
 #if defined(__SSE__)
+  else if(darktable.codepath.AVX512 && self->process_avx512)
+    self->process_avx512(self, piece, i, o, roi_in, roi_out);
+  else if(darktable.codepath.AVX2 && self->process_avx2)
+    self->process_avx2(self, piece, i, o, roi_in, roi_out);
   else if(darktable.codepath.SSE2 && self->process_sse2)
     self->process_sse2(self, piece, i, o, roi_in, roi_out);
 #endif
@@ -237,6 +241,7 @@ int dt_iop_load_module_so(dt_iop_module_so_t *module, const char *libname, const
     module->output_format = default_output_format;
   if(!g_module_symbol(module->module, "tiling_callback", (gpointer) & (module->tiling_callback)))
     module->tiling_callback = default_tiling_callback;
+  if(!g_module_symbol(module->module, "pointwise", (gpointer) & (module->pointwise))) module->pointwise = NULL;
   if(!g_module_symbol(module->module, "gui_reset", (gpointer) & (module->gui_reset)))
     module->gui_reset = NULL;
   if(!g_module_symbol(module->module, "gui_init", (gpointer) & (module->gui_init))) module->gui_init = NULL;
@@ -294,6 +299,10 @@ int dt_iop_load_module_so(dt_iop_module_so_t *module, const char *libname, const
 
   if(!g_module_symbol(module->module, "process_sse2", (gpointer) & (module->process_sse2)))
     module->process_sse2 = NULL;
+  if(!g_module_symbol(module->module, "process_avx2", (gpointer) & (module->process_avx2)))
+    module->process_avx2 = NULL;
+  if(!g_module_symbol(module->module, "process_avx512", (gpointer) & (module->process_avx512)))
+    module->process_avx512 = NULL;
 
   if(!g_module_symbol(module->module, "process", (gpointer) & (module->process_plain))) goto error;
 
@@ -388,6 +397,7 @@ static int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t
   module->input_format = so->input_format;
   module->output_format = so->output_format;
   module->tiling_callback = so->tiling_callback;
+  module->pointwise = so->pointwise;
   module->gui_update = so->gui_update;
   module->gui_reset = so->gui_reset;
   module->gui_init = so->gui_init;
@@ -413,6 +423,8 @@ static int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t
   module->process_tiling = so->process_tiling;
   module->process_plain = so->process_plain;
   module->process_sse2 = so->process_sse2;
+  module->process_avx2 = so->process_avx2;
+  module->process_avx512 = so->process_avx512;
   module->process_cl = so->process_cl;
   module->process_tiling_cl = so->process_tiling_cl;
   module->distort_transform = so->distort_transform;
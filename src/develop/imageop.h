@@ -167,6 +167,7 @@ typedef struct dt_iop_module_so_t
   void (*tiling_callback)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                           const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out,
                           struct dt_develop_tiling_t *tiling);
+  int (*pointwise)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
 
   void (*gui_reset)(struct dt_iop_module_t *self);
   void (*gui_update)(struct dt_iop_module_t *self);
@@ -219,6 +220,12 @@ typedef struct dt_iop_module_so_t
   void (*process_sse2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                        const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                        const struct dt_iop_roi_t *const roi_out);
+  void (*process_avx2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                       const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                       const struct dt_iop_roi_t *const roi_out);
+  void (*process_avx512)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                         const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                         const struct dt_iop_roi_t *const roi_out);
   int (*process_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
                     void *const o, const struct dt_iop_roi_t *const roi_in,
                     const struct dt_iop_roi_t *const roi_out);
@@ -350,6 +357,8 @@ typedef struct dt_iop_module_t
   void (*tiling_callback)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                           const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out,
                           struct dt_develop_tiling_t *tiling);
+  /** may process() of this piece be run on strips, fused with neighbouring point-wise modules? (optional) */
+  int (*pointwise)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
 
   /** callback methods for gui. */
   /** synch gtk interface with gui params, if necessary. */
@@ -420,6 +429,14 @@ typedef struct dt_iop_module_t
   void (*process_sse2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                        const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                        const struct dt_iop_roi_t *const roi_out);
+  /** a variant process(), that can contain AVX2 and FMA intrinsics. */
+  void (*process_avx2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                       const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                       const struct dt_iop_roi_t *const roi_out);
+  /** a variant process(), that can contain AVX-512F intrinsics. */
+  void (*process_avx512)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                         const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                         const struct dt_iop_roi_t *const roi_out);
   /** the opencl equivalent of process(). */
   int (*process_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
                     void *const o, const struct dt_iop_roi_t *const roi_in,
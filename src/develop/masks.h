@@ -315,6 +315,13 @@ int dt_masks_form_duplicate(dt_develop_t *dev, int formid);
 /** utils functions */
 int dt_masks_point_in_form_exact(float x, float y, float *points, int points_start, int points_count);
 int dt_masks_point_in_form_near(float x, float y, float *points, int points_start, int points_count, float distance, int *near);
+/** rows per band when rasterizing forms band by band in parallel */
+int dt_masks_band_height(int height);
+/** bins count segments spanning rows ymin[k]..ymax[k] into bands of band_height rows. the segments
+ * touching band b are (*index)[(*offsets)[b]] .. (*index)[(*offsets)[b + 1] - 1], in their original order.
+ * returns the number of bands, 0 on failure. both arrays have to be freed by the caller. */
+int dt_masks_bin_segments(const int *ymin, const int *ymax, int count, int height, int band_height,
+                          int **offsets, int **index);
 
 
 /** code for dynamic handling of intermediate buffers */
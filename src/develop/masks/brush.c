@@ -2625,49 +2625,6 @@ static int dt_brush_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pi
   return 1;
 }
 
-/** we write a falloff segment respecting limits of buffer */
-static inline void _brush_falloff_roi(float *buffer, int *p0, int *p1, int bw, int bh, float hardness,
-                                      float density)
-{
-  // segment length (increase by 1 to avoid division-by-zero special case handling)
-  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
-  const int solid = hardness * l;
-
-  const float lx = (float)(p1[0] - p0[0]) / (float)l;
-  const float ly = (float)(p1[1] - p0[1]) / (float)l;
-
-  const int dx = lx <= 0 ? -1 : 1;
-  const int dy = ly <= 0 ? -1 : 1;
-  const int dpx = dx;
-  const int dpy = dy * bw;
-
-  float fx = p0[0];
-  float fy = p0[1];
-
-  float op = density;
-  float dop = density / (float)(l - solid);
-
-  for(int i = 0; i < l; i++)
-  {
-    const int x = fx;
-    const int y = fy;
-
-    fx += lx;
-    fy += ly;
-    if(i > solid) op -= dop;
-
-    if(x < 0 || x >= bw || y < 0 || y >= bh) continue;
-
-    float *buf = buffer + (size_t)y * bw + x;
-
-    *buf = fmaxf(*buf, op);
-    if(x + dx >= 0 && x + dx < bw)
-      buf[dpx] = fmaxf(buf[dpx], op); // this one is to avoid gaps due to int rounding
-    if(y + dy >= 0 && y + dy < bh)
-      buf[dpy] = fmaxf(buf[dpy], op); // this one is to avoid gaps due to int rounding
-  }
-}
-
 static int dt_brush_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
                                  dt_masks_form_t *form, const dt_iop_roi_t *roi, float *buffer)
 {
@@ -2760,26 +2717,49 @@ static int dt_brush_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t
     return 1;
   }
 
-  // now we fill the falloff
-  int p0[2], p1[2];
-  for(int i = nb_corner * 3; i < border_count; i++)
+  // now we fill the falloff, in bands of rows drawn in parallel
+  const int first = nb_corner * 3;
+  const int nseg = MAX(border_count - first, 0);
+  int *seg = malloc(sizeof(int) * 4 * MAX(nseg, 1));
+  float *segpayload = malloc(sizeof(float) * 2 * MAX(nseg, 1));
+  if(!seg || !segpayload)
   {
-    p0[0] = points[i * 2];
-    p0[1] = points[i * 2 + 1];
-    p1[0] = border[i * 2];
-    p1[1] = border[i * 2 + 1];
+    free(seg);
+    free(segpayload);
+    free(points);
+    free(border);
+    free(payload);
+    return 0;
+  }
 
-    if(MAX(p0[0], p1[0]) < 0 || MIN(p0[0], p1[0]) >= width || MAX(p0[1], p1[1]) < 0
-       || MIN(p0[1], p1[1]) >= height)
+  int count = 0;
+  for(int i = first; i < border_count; i++)
+  {
+    int *s = seg + 4 * count;
+    s[0] = points[i * 2];
+    s[1] = points[i * 2 + 1];
+    s[2] = border[i * 2];
+    s[3] = border[i * 2 + 1];
+
+    if(MAX(s[0], s[2]) < 0 || MIN(s[0], s[2]) >= width || MAX(s[1], s[3]) < 0 || MIN(s[1], s[3]) >= height)
       continue;
 
-    _brush_falloff_roi(buffer, p0, p1, width, height, payload[i * 2], payload[i * 2 + 1]);
+    segpayload[count * 2] = payload[i * 2];
+    segpayload[count * 2 + 1] = payload[i * 2 + 1];
+    count++;
   }
 
+  const int res = dt_masks_brush_falloff_bands(buffer, width, height, dt_masks_band_height(height), seg,
+                                               segpayload, count);
+
+  free(seg);
+  free(segpayload);
   free(points);
   free(border);
   free(payload);
 
+  if(!res) return 0;
+
   if(darktable.unmuted & DT_DEBUG_PERF)
     dt_print(DT_DEBUG_MASKS, "[masks %s] brush fill buffer took %0.04f sec\n", form->name,
              dt_get_wtime() - start);
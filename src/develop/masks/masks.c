@@ -27,6 +27,7 @@
 #pragma GCC diagnostic ignored "-Wshadow"
 
 // clang-format off
+#include "develop/masks/raster.c"
 #include "develop/masks/circle.c"
 #include "develop/masks/path.c"
 #include "develop/masks/brush.c"
@@ -2297,6 +2298,7 @@ int dt_masks_point_in_form_near(float x, float y, float *points, int points_star
   }
   return 0;
 }
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
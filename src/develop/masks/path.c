@@ -2443,34 +2443,6 @@ static int _path_crop_to_roi(float *path, const int point_count, float xmin, flo
   return 1;
 }
 
-/** we write a falloff segment respecting limits of buffer */
-static void _path_falloff_roi(float *buffer, int *p0, int *p1, int bw, int bh)
-{
-  // segment length
-  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
-
-  const float lx = p1[0] - p0[0];
-  const float ly = p1[1] - p0[1];
-
-  const int dx = lx < 0 ? -1 : 1;
-  const int dy = ly < 0 ? -1 : 1;
-  const int dpy = dy * bw;
-
-  for(int i = 0; i < l; i++)
-  {
-    // position
-    const int x = (int)((float)i * lx / (float)l) + p0[0];
-    const int y = (int)((float)i * ly / (float)l) + p0[1];
-    const float op = 1.0 - (float)i / (float)l;
-    float *buf = buffer + (size_t)y * bw + x;
-    if(x >= 0 && x < bw && y >= 0 && y < bh) buf[0] = fmaxf(buf[0], op);
-    if(x + dx >= 0 && x + dx < bw && y >= 0 && y < bh)
-      buf[dx] = fmaxf(buf[dx], op); // this one is to avoid gap due to int rounding
-    if(x >= 0 && x < bw && y + dy >= 0 && y + dy < bh)
-      buf[dpy] = fmaxf(buf[dpy], op); // this one is to avoid gap due to int rounding
-  }
-}
-
 static int dt_path_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                                 const dt_iop_roi_t *roi, float *buffer)
 {
@@ -2662,91 +2634,28 @@ static int dt_path_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t
     {
       // roi lies completely within path
       for(size_t k = 0; k < (size_t)width * height; k++) buffer[k] = 1.0f;
+      free(cpoints);
+      cpoints = NULL;
     }
-    else
-    {
-      // all other cases
-
-      // edge-flag polygon fill: we write all the point around the path into the buffer
-      float xlast = cpoints[(points_count - 1) * 2];
-      float ylast = cpoints[(points_count - 1) * 2 + 1];
-
-      for(int i = nb_corner * 3; i < points_count; i++)
-      {
-        float xstart = xlast;
-        float ystart = ylast;
-
-        float xend = xlast = cpoints[i * 2];
-        float yend = ylast = cpoints[i * 2 + 1];
-
-        if(ystart > yend)
-        {
-          float tmp;
-          tmp = ystart, ystart = yend, yend = tmp;
-          tmp = xstart, xstart = xend, xend = tmp;
-        }
-
-        const float m = (xstart - xend) / (ystart - yend); // we don't need special handling of ystart==yend
-                                                           // as following loop will take care
-
-        for(int yy = (int)ceilf(ystart); (float)yy < yend;
-            yy++) // this would normally never touch the last roi line => see comment further above
-        {
-          const float xcross = xstart + m * (yy - ystart);
-
-          int xx = floorf(xcross);
-          if((float)xx + 0.5f <= xcross) xx++;
-
-          if(xx < 0 || xx >= width || yy < 0 || yy >= height)
-            continue; // sanity check just to be on the safe side
-
-          size_t index = (size_t)yy * width + xx;
-
-          buffer[index] = 1.0f - buffer[index];
-        }
-      }
-
-      if(darktable.unmuted & DT_DEBUG_PERF)
-        dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill draw path took %0.04f sec\n", form->name,
-                 dt_get_wtime() - start2);
-      start2 = dt_get_wtime();
+  }
 
-      // we fill the inside plain
-      // we don't need to deal with parts of shape outside of roi
-      xmin = fmaxf(xmin, 0);
-      xmax = fminf(xmax, width - 1);
-      ymin = fmaxf(ymin, 0);
-      ymax = fminf(ymax, height - 1);
+  // the rest is drawn in bands of rows, in parallel. we record the falloff segments first.
+  const int first = nb_corner * 3;
+  const int nseg = path_encircles_roi ? 0 : MAX(border_count - first, 0);
+  int *seg = malloc(sizeof(int) * 4 * MAX(nseg, 1));
+  int res = 0;
 
-      for(int yy = ymin; yy <= ymax; yy++)
-      {
-        int state = 0;
-        for(int xx = xmin; xx <= xmax; xx++)
-        {
-          size_t index = (size_t)yy * width + xx;
-          float v = buffer[index];
-          if(v > 0.5f) state = !state;
-          if(state) buffer[index] = 1.0f;
-        }
-      }
+  if(!seg) goto end;
 
-      if(darktable.unmuted & DT_DEBUG_PERF)
-        dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill fill plain took %0.04f sec\n", form->name,
-                 dt_get_wtime() - start2);
-      start2 = dt_get_wtime();
-    }
-    free(cpoints);
-  }
-
-  // deal with feather if it does not lie outside of roi
-  if(!path_encircles_roi)
+  int count = 0;
+  if(nseg)
   {
     int p0[2], p1[2];
     float pf1[2];
     int last0[2] = { -100, -100 };
     int last1[2] = { -100, -100 };
     int next = 0;
-    for(int i = nb_corner * 3; i < border_count; i++)
+    for(int i = first; i < border_count; i++)
     {
       p0[0] = floorf(points[i * 2] + 0.5f);
       p0[1] = ceilf(points[i * 2 + 1]);
@@ -2773,20 +2682,48 @@ static int dt_path_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t
         p1[1] = pf1[1] = border[next * 2 + 1];
       }
 
-      // and we draw the falloff
+      // and we record the falloff
       if(last0[0] != p0[0] || last0[1] != p0[1] || last1[0] != p1[0] || last1[1] != p1[1])
       {
-        _path_falloff_roi(buffer, p0, p1, width, height);
+        int *s = seg + 4 * count;
+        s[0] = p0[0];
+        s[1] = p0[1];
+        s[2] = p1[0];
+        s[3] = p1[1];
+        count++;
         last0[0] = p0[0];
         last0[1] = p0[1];
         last1[0] = p1[0];
         last1[1] = p1[1];
       }
     }
+  }
 
-    if(darktable.unmuted & DT_DEBUG_PERF)
-      dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill fill falloff took %0.04f sec\n", form->name,
-               dt_get_wtime() - start2);
+  if(cpoints)
+  {
+    // we don't need to deal with parts of shape outside of roi
+    xmin = fmaxf(xmin, 0);
+    xmax = fminf(xmax, width - 1);
+    ymin = fmaxf(ymin, 0);
+    ymax = fminf(ymax, height - 1);
+  }
+
+  res = dt_masks_path_fill_bands(buffer, width, height, dt_masks_band_height(height), cpoints, first,
+                                 points_count, xmin, xmax, ymin, ymax, seg, count);
+
+  if(darktable.unmuted & DT_DEBUG_PERF)
+    dt_print(DT_DEBUG_MASKS, "[masks %s] path_fill fill path and falloff took %0.04f sec\n", form->name,
+             dt_get_wtime() - start2);
+
+end:
+  free(seg);
+  free(cpoints);
+
+  if(!res)
+  {
+    free(points);
+    free(border);
+    return 0;
   }
 
   free(points);
@@ -0,0 +1,340 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2011 henrik andersson.
+    copyright (c) 2012 aldric renaudin.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "common/darktable.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// rasterization of brush and path masks in bands of rows, drawn in parallel. nothing in here knows about
+// forms or the pixelpipe, so src/tests/masks.c can check it against the serial code.
+
+int dt_masks_band_height(int height)
+{
+  // a few bands per thread so that uneven bands still balance, but not so thin that long segments
+  // get walked over and over again. a single thread draws everything in one go.
+  const int threads = dt_get_num_threads();
+  if(threads <= 1) return MAX(height, 1);
+  return MAX(16, height / (4 * threads) + 1);
+}
+
+int dt_masks_bin_segments(const int *ymin, const int *ymax, int count, int height, int band_height,
+                          int **offsets, int **index)
+{
+  *offsets = NULL;
+  *index = NULL;
+  if(height <= 0 || band_height <= 0) return 0;
+
+  const int nbands = (height + band_height - 1) / band_height;
+  int *off = calloc(nbands + 1, sizeof(int));
+  if(off == NULL) return 0;
+
+  // first pass counts the segments of each band, second one fills the lists in segment order
+  for(int k = 0; k < count; k++)
+  {
+    if(ymax[k] < 0 || ymin[k] >= height) continue;
+    const int b0 = MAX(ymin[k], 0) / band_height;
+    const int b1 = MIN(ymax[k], height - 1) / band_height;
+    for(int b = b0; b <= b1; b++) off[b + 1]++;
+  }
+  for(int b = 0; b < nbands; b++) off[b + 1] += off[b];
+
+  int *idx = malloc(sizeof(int) * MAX(off[nbands], 1));
+  int *fill = malloc(sizeof(int) * nbands);
+  if(idx == NULL || fill == NULL)
+  {
+    free(off);
+    free(idx);
+    free(fill);
+    return 0;
+  }
+  memcpy(fill, off, sizeof(int) * nbands);
+  for(int k = 0; k < count; k++)
+  {
+    if(ymax[k] < 0 || ymin[k] >= height) continue;
+    const int b0 = MAX(ymin[k], 0) / band_height;
+    const int b1 = MIN(ymax[k], height - 1) / band_height;
+    for(int b = b0; b <= b1; b++) idx[fill[b]++] = k;
+  }
+  free(fill);
+
+  *offsets = off;
+  *index = idx;
+  return nbands;
+}
+
+/** we write a falloff segment respecting limits of buffer. only rows y0 .. y1-1 are written, the other ones
+ * belong to another band */
+static void _path_falloff_roi(float *buffer, const int *p0, const int *p1, int bw, int y0, int y1)
+{
+  // segment length
+  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
+
+  const float lx = p1[0] - p0[0];
+  const float ly = p1[1] - p0[1];
+
+  const int dx = lx < 0 ? -1 : 1;
+  const int dy = ly < 0 ? -1 : 1;
+  const int dpy = dy * bw;
+
+  for(int i = 0; i < l; i++)
+  {
+    // position
+    const int x = (int)((float)i * lx / (float)l) + p0[0];
+    const int y = (int)((float)i * ly / (float)l) + p0[1];
+    const float op = 1.0 - (float)i / (float)l;
+    float *buf = buffer + (size_t)y * bw + x;
+    if(x >= 0 && x < bw && y >= y0 && y < y1) buf[0] = fmaxf(buf[0], op);
+    if(x + dx >= 0 && x + dx < bw && y >= y0 && y < y1)
+      buf[dx] = fmaxf(buf[dx], op); // this one is to avoid gap due to int rounding
+    if(x >= 0 && x < bw && y + dy >= y0 && y + dy < y1)
+      buf[dpy] = fmaxf(buf[dpy], op); // this one is to avoid gap due to int rounding
+  }
+}
+
+/** edge-flag fill: we flip the pixels where the path edge from pstart to pend crosses rows y0 .. y1-1 */
+static void _path_fill_edge_roi(float *buffer, const float *pstart, const float *pend, int bw, int bh, int y0,
+                                int y1)
+{
+  float xstart = pstart[0];
+  float ystart = pstart[1];
+  float xend = pend[0];
+  float yend = pend[1];
+
+  if(ystart > yend)
+  {
+    float tmp;
+    tmp = ystart, ystart = yend, yend = tmp;
+    tmp = xstart, xstart = xend, xend = tmp;
+  }
+
+  const float m = (xstart - xend) / (ystart - yend); // we don't need special handling of ystart==yend
+                                                     // as following loop will take care
+
+  for(int yy = MAX((int)ceilf(ystart), y0); (float)yy < yend && yy < y1;
+      yy++) // this would normally never touch the last roi line => see comment in dt_path_get_mask_roi()
+  {
+    const float xcross = xstart + m * (yy - ystart);
+
+    int xx = floorf(xcross);
+    if((float)xx + 0.5f <= xcross) xx++;
+
+    if(xx < 0 || xx >= bw || yy < 0 || yy >= bh) continue; // sanity check just to be on the safe side
+
+    size_t index = (size_t)yy * bw + xx;
+
+    buffer[index] = 1.0f - buffer[index];
+  }
+}
+
+/** we write a falloff segment respecting limits of buffer. only rows y0 .. y1-1 are written, the other ones
+ * belong to another band */
+static inline void _brush_falloff_roi(float *buffer, const int *p0, const int *p1, int bw, int bh, int y0,
+                                      int y1, float hardness, float density)
+{
+  // segment length (increase by 1 to avoid division-by-zero special case handling)
+  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
+  const int solid = hardness * l;
+
+  const float lx = (float)(p1[0] - p0[0]) / (float)l;
+  const float ly = (float)(p1[1] - p0[1]) / (float)l;
+
+  const int dx = lx <= 0 ? -1 : 1;
+  const int dy = ly <= 0 ? -1 : 1;
+  const int dpx = dx;
+  const int dpy = dy * bw;
+
+  float fx = p0[0];
+  float fy = p0[1];
+
+  float op = density;
+  float dop = density / (float)(l - solid);
+
+  for(int i = 0; i < l; i++)
+  {
+    const int x = fx;
+    const int y = fy;
+
+    fx += lx;
+    fy += ly;
+    if(i > solid) op -= dop;
+
+    if(x < 0 || x >= bw || y < 0 || y >= bh) continue;
+
+    float *buf = buffer + (size_t)y * bw + x;
+
+    if(y >= y0 && y < y1)
+    {
+      *buf = fmaxf(*buf, op);
+      if(x + dx >= 0 && x + dx < bw)
+        buf[dpx] = fmaxf(buf[dpx], op); // this one is to avoid gaps due to int rounding
+    }
+    if(y + dy >= y0 && y + dy < y1)
+      buf[dpy] = fmaxf(buf[dpy], op); // this one is to avoid gaps due to int rounding
+  }
+}
+
+/** draws the falloff segments of a brush. segment k goes from (seg[4k], seg[4k+1]) to (seg[4k+2], seg[4k+3]),
+ * with hardness payload[2k] and density payload[2k+1]. all writes are fmaxf() so the result does not depend
+ * on the order in which segments are drawn. returns 0 on failure. */
+static int dt_masks_brush_falloff_bands(float *buffer, const int width, const int height, const int band_height,
+                                        const int *seg, const float *payload, const int count)
+{
+  int *segymin = malloc(sizeof(int) * MAX(count, 1));
+  int *segymax = malloc(sizeof(int) * MAX(count, 1));
+  int *band_offsets = NULL, *band_index = NULL;
+  int nbands = 0;
+  if(!segymin || !segymax) goto end;
+
+  for(int k = 0; k < count; k++)
+  {
+    // rows reached by the segment, including the neighbour written against gaps and rounding
+    const int *s = seg + 4 * k;
+    segymin[k] = MIN(s[1], s[3]) - 2;
+    segymax[k] = MAX(s[1], s[3]) + 2;
+  }
+
+  nbands = dt_masks_bin_segments(segymin, segymax, count, height, band_height, &band_offsets, &band_index);
+
+#ifdef _OPENMP
+#if !defined(__SUNOS__) && !defined(__NetBSD__)
+#pragma omp parallel for default(none) shared(buffer, seg, payload, band_offsets, band_index) schedule(dynamic)
+#else
+#pragma omp parallel for shared(buffer, seg, payload, band_offsets, band_index) schedule(dynamic)
+#endif
+#endif
+  for(int b = 0; b < nbands; b++)
+  {
+    const int y0 = b * band_height;
+    const int y1 = MIN(y0 + band_height, height);
+    for(int k = band_offsets[b]; k < band_offsets[b + 1]; k++)
+    {
+      const int n = band_index[k];
+      _brush_falloff_roi(buffer, seg + 4 * n, seg + 4 * n + 2, width, height, y0, y1, payload[n * 2],
+                         payload[n * 2 + 1]);
+    }
+  }
+
+end:
+  free(band_offsets);
+  free(band_index);
+  free(segymin);
+  free(segymax);
+  return nbands != 0;
+}
+
+/** fills a path and draws its falloff. the path consists of cpoints[first] .. cpoints[points_count-1], already
+ * cropped to the roi, and is filled inside xmin .. xmax, ymin .. ymax. cpoints may be NULL if there's nothing
+ * to fill. the falloff segments are given as for dt_masks_brush_falloff_bands(). flipping pixels and fmaxf()
+ * do not depend on the order in which edges and segments come, and a band is filled before its falloff is
+ * drawn, so the result is the same as drawing the whole roi in one go. returns 0 on failure. */
+static int dt_masks_path_fill_bands(float *buffer, const int width, const int height, const int band_height,
+                                    const float *cpoints, const int first, const int points_count,
+                                    const float xmin, const float xmax, const float ymin, const float ymax,
+                                    const int *seg, const int count)
+{
+  const int nedges = cpoints ? points_count - first : 0;
+  int *edgeymin = malloc(sizeof(int) * MAX(nedges, 1));
+  int *edgeymax = malloc(sizeof(int) * MAX(nedges, 1));
+  int *segymin = malloc(sizeof(int) * MAX(count, 1));
+  int *segymax = malloc(sizeof(int) * MAX(count, 1));
+  int *edge_offsets = NULL, *edge_index = NULL, *seg_offsets = NULL, *seg_index = NULL;
+  int nbands = 0;
+
+  if(!edgeymin || !edgeymax || !segymin || !segymax) goto end;
+
+  // edge k of the path goes from the point before to point first + k
+  for(int k = 0; k < nedges; k++)
+  {
+    const int i0 = k ? first + k - 1 : points_count - 1;
+    const int i1 = first + k;
+    edgeymin[k] = floorf(fminf(cpoints[i0 * 2 + 1], cpoints[i1 * 2 + 1]));
+    edgeymax[k] = ceilf(fmaxf(cpoints[i0 * 2 + 1], cpoints[i1 * 2 + 1]));
+  }
+  for(int k = 0; k < count; k++)
+  {
+    const int *s = seg + 4 * k;
+    segymin[k] = MIN(s[1], s[3]) - 1;
+    segymax[k] = MAX(s[1], s[3]) + 1;
+  }
+
+  nbands = dt_masks_bin_segments(edgeymin, edgeymax, nedges, height, band_height, &edge_offsets, &edge_index);
+  if(nbands && !dt_masks_bin_segments(segymin, segymax, count, height, band_height, &seg_offsets, &seg_index))
+    nbands = 0;
+
+#ifdef _OPENMP
+#if !defined(__SUNOS__) && !defined(__NetBSD__)
+#pragma omp parallel for default(none) shared(buffer, cpoints, seg, edge_offsets, edge_index, seg_offsets, \
+                                              seg_index, nbands) schedule(dynamic)
+#else
+#pragma omp parallel for shared(buffer, cpoints, seg, edge_offsets, edge_index, seg_offsets, seg_index, nbands) \
+    schedule(dynamic)
+#endif
+#endif
+  for(int b = 0; b < nbands; b++)
+  {
+    const int y0 = b * band_height;
+    const int y1 = MIN(y0 + band_height, height);
+
+    if(cpoints)
+    {
+      // edge-flag polygon fill: we write all the point around the path into the band
+      for(int e = edge_offsets[b]; e < edge_offsets[b + 1]; e++)
+      {
+        const int k = edge_index[e];
+        const int i0 = k ? first + k - 1 : points_count - 1;
+        _path_fill_edge_roi(buffer, cpoints + i0 * 2, cpoints + (first + k) * 2, width, height, y0, y1);
+      }
+
+      // we fill the inside plain
+      for(int yy = MAX((int)ymin, y0); yy <= ymax && yy < y1; yy++)
+      {
+        int state = 0;
+        for(int xx = xmin; xx <= xmax; xx++)
+        {
+          size_t index = (size_t)yy * width + xx;
+          float v = buffer[index];
+          if(v > 0.5f) state = !state;
+          if(state) buffer[index] = 1.0f;
+        }
+      }
+    }
+
+    // and we draw the falloff
+    for(int k = seg_offsets[b]; k < seg_offsets[b + 1]; k++)
+    {
+      const int *s = seg + 4 * seg_index[k];
+      _path_falloff_roi(buffer, s, s + 2, width, y0, y1);
+    }
+  }
+
+end:
+  free(edge_offsets);
+  free(edge_index);
+  free(seg_offsets);
+  free(seg_index);
+  free(edgeymin);
+  free(edgeymax);
+  free(segymin);
+  free(segymax);
+  return nbands != 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -20,6 +20,7 @@
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
+#include <math.h>
 #include <stdlib.h>
 
 
@@ -32,34 +33,90 @@
 //   ping, pong, and priority buffer (focused plugin)
 // - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
 
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
+#define DT_PIXELPIPE_CACHE_INVALID ((uint64_t)-1)
+
+typedef struct dt_dev_pixelpipe_cache_line_t
+{
+  uint64_t hash; // DT_PIXELPIPE_CACHE_INVALID if the contents are not valid
+  void *data;    // NULL if the line currently holds no buffer
+  size_t size;
+  dt_iop_buffer_dsc_t dsc;
+  int64_t used;  // clock of the last query hitting this line, weights push it into the future
+  float cost;    // seconds it took to compute the contents, including the input
+} dt_dev_pixelpipe_cache_line_t;
+
+static inline void _line_invalidate(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
+{
+  if(line->hash != DT_PIXELPIPE_CACHE_INVALID) g_hash_table_remove(cache->hashes, &line->hash);
+  line->hash = DT_PIXELPIPE_CACHE_INVALID;
+  line->cost = 0.0f;
+  if(line->data) ASAN_POISON_MEMORY_REGION(line->data, line->size);
+}
+
+static inline void _line_free_buffer(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line)
 {
-  cache->entries = entries;
-  cache->data = (void **)calloc(entries, sizeof(void *));
-  cache->size = (size_t *)calloc(entries, sizeof(size_t));
-  cache->dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
+  _line_invalidate(cache, line);
+  if(!line->data) return;
+  g_hash_table_remove(cache->buffers, line->data);
+  dt_free_align(line->data);
+  line->data = NULL;
+  cache->memory -= line->size;
+  cache->entries--;
+  line->size = 0;
+}
+
+static inline int _line_alloc_buffer(dt_dev_pixelpipe_cache_t *cache, dt_dev_pixelpipe_cache_line_t *line,
+                                     const size_t size)
+{
+  line->data = (void *)dt_alloc_align(16, size);
+  if(!line->data) return 1;
 #ifdef _DEBUG
-  memset(cache->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t) * entries);
+  memset(line->data, 0x5d, size);
 #endif
-  cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  line->size = size;
+  cache->memory += size;
+  cache->entries++;
+  g_hash_table_insert(cache->buffers, line->data, line);
+  ASAN_POISON_MEMORY_REGION(line->data, line->size);
+  return 0;
+}
+
+// the lines touched by the current and the previous query are the output and input of the module being
+// processed right now. these, and lines weighted into the future, must not be recycled.
+static inline int _line_protected(const dt_dev_pixelpipe_cache_t *cache, const dt_dev_pixelpipe_cache_line_t *line)
+{
+  return line->hash != DT_PIXELPIPE_CACHE_INVALID && cache->clock - line->used <= 1;
+}
+
+// the higher, the better suited for eviction: old lines which are cheap to recompute
+static inline float _line_score(const dt_dev_pixelpipe_cache_t *cache, const dt_dev_pixelpipe_cache_line_t *line)
+{
+  if(line->hash == DT_PIXELPIPE_CACHE_INVALID) return INFINITY;
+  return (float)(cache->clock - line->used) / (line->cost + 1e-3f);
+}
+
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memory_limit)
+{
+  cache->entries = 0;
+  cache->min_entries = entries;
+  cache->memory = 0;
+  cache->memory_limit = MAX(memory_limit, entries * size);
+  cache->clock = 0;
+  cache->lines = NULL;
+  cache->hashes = g_hash_table_new(g_int64_hash, g_int64_equal);
+  cache->buffers = g_hash_table_new(g_direct_hash, g_direct_equal);
+  cache->queries = cache->misses = 0;
   for(int k = 0; k < entries; k++)
   {
-    cache->size[k] = size;
-    if(size)
-    { // allow 0 initial buffer size (yet unknown dimensions)
-      cache->data[k] = (void *)dt_alloc_align(16, size);
-      if(!cache->data[k]) goto alloc_memory_fail;
+    dt_dev_pixelpipe_cache_line_t *line = g_slice_new0(dt_dev_pixelpipe_cache_line_t);
 #ifdef _DEBUG
-      memset(cache->data[k], 0x5d, size);
+    memset(&line->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t));
 #endif
-      ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
-    }
-    else cache->data[k] = 0;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
+    line->hash = DT_PIXELPIPE_CACHE_INVALID;
+    cache->lines = g_list_prepend(cache->lines, line);
+    // allow 0 initial buffer size (yet unknown dimensions)
+    if(size && _line_alloc_buffer(cache, line, size)) goto alloc_memory_fail;
   }
-  cache->queries = cache->misses = 0;
   return 1;
 
 alloc_memory_fail:
@@ -69,12 +126,18 @@ alloc_memory_fail:
 
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
-  free(cache->data);
-  free(cache->dsc);
-  free(cache->hash);
-  free(cache->used);
-  free(cache->size);
+  for(GList *l = cache->lines; l; l = g_list_next(l))
+  {
+    dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+    dt_free_align(line->data);
+    g_slice_free(dt_dev_pixelpipe_cache_line_t, line);
+  }
+  g_list_free(cache->lines);
+  cache->lines = NULL;
+  g_hash_table_destroy(cache->hashes);
+  g_hash_table_destroy(cache->buffers);
+  cache->entries = 0;
+  cache->memory = 0;
 }
 
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
@@ -114,16 +177,13 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
 
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
-  // search for hash in cache
-  for(int32_t k = 0; k < cache->entries; k++)
-    if(cache->hash[k] == hash) return 1;
-  return 0;
+  return g_hash_table_contains(cache->hashes, &hash);
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                          void **data, dt_iop_buffer_dsc_t **dsc)
 {
-  return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, -cache->entries);
+  return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, -MAX(cache->entries, cache->min_entries));
 }
 
 int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
@@ -132,107 +192,163 @@ int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t h
   return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, 0);
 }
 
-int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
-                                        void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+// find a cache line with a buffer of at least size bytes for new contents, freeing the buffers of other lines
+// if the memory budget demands it.
+static dt_dev_pixelpipe_cache_line_t *_cache_get_free_line(dt_dev_pixelpipe_cache_t *cache, const size_t size)
 {
-  cache->queries++;
-  *data = NULL;
-  int max_used = -1, max = 0;
-  size_t sz = 0;
-  for(int k = 0; k < cache->entries; k++)
+  dt_dev_pixelpipe_cache_line_t *empty = NULL;
+  while(1)
   {
-    // search for hash in cache
-    if(cache->used[k] > max_used)
+    // look for the best victim, preferring buffers which are large enough already
+    dt_dev_pixelpipe_cache_line_t *victim = NULL, *fitting = NULL;
+    float victim_score = -1.0f, fitting_score = -1.0f;
+    for(GList *l = cache->lines; l; l = g_list_next(l))
     {
-      max_used = cache->used[k];
-      max = k;
+      dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+      if(!line->data)
+      {
+        empty = line;
+        continue;
+      }
+      if(_line_protected(cache, line)) continue;
+      const float score = _line_score(cache, line);
+      if(score > victim_score)
+      {
+        victim_score = score;
+        victim = line;
+      }
+      if(line->size >= size && score > fitting_score)
+      {
+        fitting_score = score;
+        fitting = line;
+      }
     }
-    cache->used[k]++; // age all entries
-    if(cache->hash[k] == hash)
-    {
-      assert(cache->size[k] >= size);
 
-      *data = cache->data[k];
-      *dsc = &cache->dsc[k];
-      sz = cache->size[k];
-      cache->used[k] = weight; // this is the MRU entry
+    const int fits = cache->entries < cache->min_entries || cache->memory + size <= cache->memory_limit;
 
-      ASAN_POISON_MEMORY_REGION(*data, sz);
-      ASAN_UNPOISON_MEMORY_REGION(*data, size);
+    // invalid lines are free to take, and once we're over budget any line which is large enough will do.
+    if(fitting && (fitting->hash == DT_PIXELPIPE_CACHE_INVALID || !fits))
+    {
+      _line_invalidate(cache, fitting);
+      return fitting;
     }
-  }
 
-  if(!*data || sz < size)
-  {
-    // kill LRU entry
-    // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
-    // weight);
-    if(cache->size[max] < size)
+    if(fits || !victim)
     {
-      dt_free_align(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(16, size);
-      cache->size[max] = size;
+      // room for another buffer (or nothing left we could evict, so go over budget)
+      if(!empty)
+      {
+        empty = g_slice_new0(dt_dev_pixelpipe_cache_line_t);
+        empty->hash = DT_PIXELPIPE_CACHE_INVALID;
+        cache->lines = g_list_prepend(cache->lines, empty);
+      }
+      if(_line_alloc_buffer(cache, empty, size)) return NULL;
+      return empty;
     }
-    *data = cache->data[max];
-    sz = cache->size[max];
 
-    ASAN_POISON_MEMORY_REGION(*data, sz);
+    // over budget and no large enough line: drop the buffer of the victim and try again
+    _line_free_buffer(cache, victim);
+  }
+}
+
+int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
+                                        void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+{
+  cache->queries++;
+  cache->clock++;
+  *data = NULL;
+
+  // search for hash in cache
+  dt_dev_pixelpipe_cache_line_t *line
+      = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->hashes, &hash);
+  if(line && line->size >= size)
+  {
+    *data = line->data;
+    *dsc = &line->dsc;
+    line->used = cache->clock - weight; // this is the MRU entry
+
+    ASAN_POISON_MEMORY_REGION(*data, line->size);
     ASAN_UNPOISON_MEMORY_REGION(*data, size);
+    return 0;
+  }
 
-    // first, update our copy, then update the pointer to point at our copy
-    cache->dsc[max] = **dsc;
-    *dsc = &cache->dsc[max];
+  if(line)
+  {
+    // the line is too small for what's requested now, grow it in place
+    _line_free_buffer(cache, line);
+    if(_line_alloc_buffer(cache, line, size)) line = NULL;
+  }
+  else
+    line = _cache_get_free_line(cache, size);
 
-    cache->hash[max] = hash;
-    cache->used[max] = weight;
-    cache->misses++;
+  if(!line)
+  {
+    fprintf(stderr, "[pixelpipe_cache_get] failed to allocate %zu bytes\n", size);
     return 1;
   }
-  else
-    return 0;
+
+  *data = line->data;
+  ASAN_UNPOISON_MEMORY_REGION(*data, size);
+
+  // first, update our copy, then update the pointer to point at our copy
+  line->dsc = **dsc;
+  *dsc = &line->dsc;
+
+  line->hash = hash;
+  line->used = cache->clock - weight;
+  line->cost = 0.0f;
+  g_hash_table_insert(cache->hashes, &line->hash, line);
+  cache->misses++;
+  return 1;
 }
 
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++)
+  for(GList *l = cache->lines; l; l = g_list_next(l))
   {
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
-    ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+    dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
+    _line_invalidate(cache, line);
+    line->used = 0;
   }
 }
 
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
-  for(int k = 0; k < cache->entries; k++)
-  {
-    if(cache->data[k] == data)
-    {
-      cache->used[k] = -cache->entries;
-    }
-  }
+  dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  if(line) line->used = cache->clock + MAX(cache->entries, cache->min_entries);
 }
 
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
-  for(int k = 0; k < cache->entries; k++)
-  {
-    if(cache->data[k] == data)
-    {
-      cache->hash[k] = -1;
-      ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
-    }
-  }
+  dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  if(line) _line_invalidate(cache, line);
+}
+
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const float cost)
+{
+  dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  if(line) line->cost = cost;
+}
+
+float dt_dev_pixelpipe_cache_get_cost(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)g_hash_table_lookup(cache->buffers, data);
+  return line ? line->cost : 0.0f;
 }
 
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
-  for(int k = 0; k < cache->entries; k++)
+  int k = 0;
+  for(GList *l = cache->lines; l; l = g_list_next(l), k++)
   {
+    dt_dev_pixelpipe_cache_line_t *line = (dt_dev_pixelpipe_cache_line_t *)l->data;
     printf("pixelpipe cacheline %d ", k);
-    printf("used %d by %" PRIu64 "", cache->used[k], cache->hash[k]);
+    printf("used %" PRId64 " by %" PRIu64 " size %zu cost %.3fs", cache->clock - line->used, line->hash, line->size,
+           line->cost);
     printf("\n");
   }
+  printf("cache memory %.2f/%.2f MB in %d lines\n", cache->memory / (1024.0 * 1024.0),
+         cache->memory_limit / (1024.0 * 1024.0), cache->entries);
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
 }
 
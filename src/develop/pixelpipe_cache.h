@@ -18,38 +18,43 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
 
 /**
- * implements a simple pixel cache suitable for caching float images
+ * implements a pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ * cache lines are found through a hash table and may have different sizes. as many
+ * lines are kept as fit into a memory budget, and when room is needed the lines that
+ * are old and cheap to recompute (measured processing time of the module) go first.
  */
 
 typedef struct dt_dev_pixelpipe_cache_t
 {
-  int32_t entries;
-  void **data;
-  size_t *size;
-  struct dt_iop_buffer_dsc_t *dsc;
-  uint64_t *hash;
-  int32_t *used;
-#ifdef HAVE_OPENCL
-  void **gpu_mem;
-#endif
+  int32_t entries;     // number of cache lines currently holding a buffer
+  int32_t min_entries; // that many lines are always allowed, regardless of the memory budget
+  size_t memory;       // bytes allocated for all cache lines
+  size_t memory_limit; // budget for all cache lines
+  int64_t clock;       // counts the queries, used to age the cache lines
+  GList *lines;        // all dt_dev_pixelpipe_cache_line_t, with or without buffer
+  GHashTable *hashes;  // valid cache lines, by hash
+  GHashTable *buffers; // cache lines holding a buffer, by data pointer
   // profiling:
   uint64_t queries;
   uint64_t misses;
 } dt_dev_pixelpipe_cache_t;
 
-/** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
+/** constructs a new cache with given minimum cache line count (entries) and float buffer entry size in bytes.
+  these lines are allocated upfront, more lines will be added on demand as long as they fit into memory_limit
+  bytes (which is raised to entries * size if smaller).
   \param[out] returns 0 if fail to allocate mem cache.
 */
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memory_limit);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
@@ -57,7 +62,7 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi,
                                      struct dt_dev_pixelpipe_t *pipe, int module);
 
 /** returns the float data buffer for the given hash from the cache. if the hash does not match any
-  * cache line, the least recently used cache line will be cleared and an empty buffer is returned
+  * cache line, a new line is allocated or an old one is recycled, and an empty buffer is returned
   * together with a non-zero return value. */
 int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                void **data, struct dt_iop_buffer_dsc_t **dsc);
@@ -78,6 +83,11 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** remember how long it took (in seconds) to compute the given cache line, used for eviction. */
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const float cost);
+/** get the cost of the given cache line, 0 if it is not known to the cache. */
+float dt_dev_pixelpipe_cache_get_cost(dt_dev_pixelpipe_cache_t *cache, void *data);
+
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
@@ -22,12 +22,14 @@
 #include "common/histogram.h"
 #include "common/imageio.h"
 #include "common/opencl.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/format.h"
 #include "develop/imageop_math.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_profile.h"
 #include "develop/tiling.h"
 #include "gui/gtk.h"
 #include "libs/colorpicker.h"
@@ -91,7 +93,7 @@ static char *_pipe_type_to_str(int pipe_type)
 
 int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height, int levels)
 {
-  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_EXPORT;
   pipe->levels = levels;
   return res;
@@ -99,14 +101,14 @@ int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_
 
 int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
 
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 0);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 0, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
@@ -114,8 +116,7 @@ int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t
 int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(
-      pipe, 0, 5);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5, dt_conf_get_int64("pixelpipe_cache_memory"));
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
   return res;
 }
@@ -123,13 +124,12 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  int res = dt_dev_pixelpipe_init_cached(
-      pipe, 0, 5);
+  int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5, dt_conf_get_int64("pixelpipe_cache_memory"));
   pipe->type = DT_DEV_PIXELPIPE_FULL;
   return res;
 }
 
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries)
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memory_limit)
 {
   pipe->devid = -1;
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
@@ -137,11 +137,14 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size, memory_limit)) return 0;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
   pipe->processing = 0;
   pipe->shutdown = 0;
+  pipe->progress = NULL;
+  pipe->progress_data = NULL;
+  pipe->cancelled = 0;
   pipe->opencl_error = 0;
   pipe->tiling = 0;
   pipe->mask_display = 0;
@@ -559,6 +562,138 @@ error:
 #endif
 
 
+// bytes of intermediate strip buffer per thread when fusing point-wise modules, about the size of a l2 cache
+#define DT_DEV_PIXELPIPE_FUSED_STRIP_BYTES (256 * 1024)
+
+// can this piece be processed on strips, fused with its point-wise neighbours?
+static int _pointwise_fusable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                              dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  if(!module->pointwise || !module->pointwise(module, piece)) return 0;
+
+  // blending, histograms and color pickers need the full input and output buffers of the module
+  const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(bp && (bp->mask_mode & DEVELOP_MASK_ENABLED)) return 0;
+  if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
+     && (piece->request_histogram & DT_REQUEST_ON))
+    return 0;
+  // keep the input of the focused module in the cache, it is likely to change next
+  if(dev->gui_attached && module == dev->gui_module) return 0;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  if(roi_in.x != roi->x || roi_in.y != roi->y || roi_in.width != roi->width || roi_in.height != roi->height
+     || roi_in.scale != roi->scale)
+    return 0;
+
+  dt_iop_buffer_dsc_t dsc = pipe->dsc;
+  module->input_format(module, pipe, piece, &dsc);
+  if(dsc.channels != 4 || dsc.datatype != TYPE_FLOAT) return 0;
+  module->output_format(module, pipe, piece, &dsc);
+  if(dsc.channels != 4 || dsc.datatype != TYPE_FLOAT) return 0;
+
+  dt_develop_tiling_t tiling = { 0 };
+  module->tiling_callback(module, piece, roi, roi, &tiling);
+  return dt_tiling_piece_fits_host_memory(roi->width, roi->height, 4 * sizeof(float), tiling.factor,
+                                          tiling.overhead);
+}
+
+// find the run of fusable point-wise modules ending with the one in modules/pieces at pos. returns its
+// length and the pieces in pipe order in *run (to be freed by the caller). the list nodes and position to
+// continue the recursion with, to get the input of the run, are stored in *prev_modules etc.
+static int _pointwise_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                          GList *modules, GList *pieces, int pos, dt_dev_pixelpipe_iop_t ***run,
+                          GList **prev_modules, GList **prev_pieces, int *prev_pos)
+{
+  int len = 0;
+  *run = malloc(sizeof(dt_dev_pixelpipe_iop_t *) * (g_list_position(g_list_first(pieces), pieces) + 1));
+
+  while(modules)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    // skipped modules, as in dt_dev_pixelpipe_process_rec()
+    if(piece->enabled
+       && !(dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags()))
+    {
+      if(!_pointwise_fusable(pipe, dev, module, piece, roi)) break;
+      // if the output of this module is still cached, let the run start after it
+      if(len && dt_dev_pixelpipe_cache_available(&(pipe->cache),
+                                                 dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, pos)))
+        break;
+      (*run)[len++] = piece;
+    }
+    modules = g_list_previous(modules);
+    pieces = g_list_previous(pieces);
+    pos--;
+  }
+
+  for(int k = 0; k < len / 2; k++)
+  {
+    dt_dev_pixelpipe_iop_t *tmp = (*run)[k];
+    (*run)[k] = (*run)[len - 1 - k];
+    (*run)[len - 1 - k] = tmp;
+  }
+  *prev_modules = modules;
+  *prev_pieces = pieces;
+  *prev_pos = pos;
+  return len;
+}
+
+// run the modules of a point-wise run on horizontal strips, keeping the intermediate results in two
+// strip buffers small enough to stay in the caches, instead of a full pipe buffer per module.
+// expects busy_mutex to be locked.
+static int _pointwise_process(dt_dev_pixelpipe_t *pipe, const float *const input,
+                              const dt_iop_buffer_dsc_t *const input_format, float *const output,
+                              const dt_iop_roi_t *const roi, dt_dev_pixelpipe_iop_t **run, const int len)
+{
+  const size_t row_size = (size_t)4 * roi->width;
+  const int nthreads = dt_get_num_threads();
+  const int rows_per_thread = MAX(1, (int)(DT_DEV_PIXELPIPE_FUSED_STRIP_BYTES / (2 * sizeof(float) * row_size)));
+  const int strip_height = MIN(roi->height, nthreads * rows_per_thread);
+  float *strip[2] = { dt_alloc_align(64, sizeof(float) * row_size * strip_height),
+                      dt_alloc_align(64, sizeof(float) * row_size * strip_height) };
+  // pipe->dsc as handed to each module, so that side effects on it are only applied once
+  dt_iop_buffer_dsc_t *dsc = malloc(sizeof(dt_iop_buffer_dsc_t) * len);
+  int err = !strip[0] || !strip[1] || !dsc;
+
+  for(int y = 0; !err && y < roi->height; y += strip_height)
+  {
+    if(pipe->shutdown)
+    {
+      err = 1;
+      break;
+    }
+    dt_iop_roi_t roi_strip = *roi;
+    roi_strip.y += y;
+    roi_strip.height = MIN(strip_height, roi->height - y);
+
+    const float *in = input + row_size * y;
+    for(int k = 0; k < len; k++)
+    {
+      dt_dev_pixelpipe_iop_t *piece = run[k];
+      dt_iop_module_t *module = piece->module;
+      float *out = (k == len - 1) ? output + row_size * y : strip[k & 1];
+      if(y == 0)
+      {
+        piece->dsc_out = piece->dsc_in = k ? run[k - 1]->dsc_out : *input_format;
+        module->output_format(module, pipe, piece, &piece->dsc_out);
+        dsc[k] = piece->dsc_out;
+      }
+      pipe->dsc = dsc[k];
+      module->process(module, piece, in, out, &roi_strip, &roi_strip);
+      if(y == 0) piece->dsc_out = pipe->dsc;
+      in = out;
+    }
+  }
+  if(!err) pipe->dsc = run[len - 1]->dsc_out;
+
+  free(dsc);
+  dt_free_align(strip[0]);
+  dt_free_align(strip[1]);
+  return err;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -605,6 +740,16 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(!modules) return 0;
+    if(darktable.pipe_profile)
+    {
+      dt_times_t now;
+      dt_get_times(&now);
+      gchar *module_label = dt_history_item_get_name(module);
+      dt_dev_pixelpipe_profile_record(darktable.pipe_profile, pipe->profile_run, pipe->type, pipe->image.id,
+                                      module->op, module_label, &now, NULL, roi_out,
+                                      DT_DEV_PIXELPIPE_PROFILE_CACHE_HIT);
+      g_free(module_label);
+    }
     // go to post-collect directly:
     goto post_process_collect_info;
   }
@@ -675,11 +820,89 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 
     dt_show_times(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    if(darktable.pipe_profile)
+      dt_dev_pixelpipe_profile_record(darktable.pipe_profile, pipe->profile_run, pipe->type, pipe->image.id,
+                                      "input", _("input"), &start, NULL, roi_out, DT_DEV_PIXELPIPE_PROFILE_NONE);
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
   }
   else
   {
-    // 3b) recurse and obtain output array in &input
+    // 3b) a run of point-wise modules ending here is processed in one fused pass over strips of the image.
+    // that's cpu only, and debugging NaNs wants to see the output of every single module.
+    int fuse = !(darktable.unmuted & DT_DEBUG_NAN) && dt_conf_get_bool("pixelpipe/fuse_pointwise");
+#ifdef HAVE_OPENCL
+    if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) fuse = 0;
+#endif
+    if(fuse)
+    {
+      dt_dev_pixelpipe_iop_t **run = NULL;
+      GList *prev_modules = NULL, *prev_pieces = NULL;
+      int prev_pos = 0;
+
+      dt_pthread_mutex_lock(&pipe->busy_mutex);
+      if(pipe->shutdown)
+      {
+        dt_pthread_mutex_unlock(&pipe->busy_mutex);
+        return 1;
+      }
+      const int run_len
+          = _pointwise_run(pipe, dev, roi_out, modules, pieces, pos, &run, &prev_modules, &prev_pieces, &prev_pos);
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+      if(run_len > 1)
+      {
+        dt_iop_buffer_dsc_t _input_format = { 0 };
+        dt_iop_buffer_dsc_t *input_format = &_input_format;
+
+        if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out, prev_modules,
+                                        prev_pieces, prev_pos))
+        {
+          free(run);
+          return 1;
+        }
+
+        dt_pthread_mutex_lock(&pipe->busy_mutex);
+        if(pipe->shutdown)
+        {
+          dt_pthread_mutex_unlock(&pipe->busy_mutex);
+          free(run);
+          return 1;
+        }
+        (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+
+        dt_times_t start;
+        dt_get_times(&start);
+        if(_pointwise_process(pipe, (const float *)input, input_format, (float *)*output, roi_out, run, run_len))
+        {
+          dt_pthread_mutex_unlock(&pipe->busy_mutex);
+          free(run);
+          return 1;
+        }
+        **out_format = pipe->dsc;
+
+        gchar **labels = g_malloc0_n(run_len + 1, sizeof(gchar *));
+        for(int k = 0; k < run_len; k++) labels[k] = dt_history_item_get_name(run[k]->module);
+        gchar *module_label = g_strjoinv(" + ", labels);
+        g_strfreev(labels);
+        dt_show_times(&start, "[dev_pixelpipe]", "processed `%s' fused on CPU [%s]", module_label,
+                      _pipe_type_to_str(pipe->type));
+        if(darktable.pipe_profile)
+          dt_dev_pixelpipe_profile_record(darktable.pipe_profile, pipe->profile_run, pipe->type, pipe->image.id,
+                                          module->op, module_label, &start, roi_out, roi_out,
+                                          DT_DEV_PIXELPIPE_PROFILE_FUSED);
+        g_free(module_label);
+
+        const float input_cost = dt_dev_pixelpipe_cache_get_cost(&(pipe->cache), input);
+        dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, input_cost + dt_get_wtime() - start.clock);
+        dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+        free(run);
+        goto post_process_collect_info;
+      }
+      free(run);
+    }
+
+    // 3c) recurse and obtain output array in &input
 
     // get region of interest which is needed in input
     dt_pthread_mutex_lock(&pipe->busy_mutex);
@@ -1430,6 +1653,14 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
         }
 
+        if(pipe->cancelled)
+        {
+          // the module gave up half way, don't let anyone pick up its output
+          dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+          dt_pthread_mutex_unlock(&pipe->busy_mutex);
+          return 1;
+        }
+
         if(pipe->shutdown)
         {
           dt_pthread_mutex_unlock(&pipe->busy_mutex);
@@ -1672,9 +1903,20 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
             ? "GPU"
             : pixelpipe_flow & PIXELPIPE_FLOW_BLENDED_ON_CPU ? "CPU" : "",
         _pipe_type_to_str(pipe->type));
+    if(darktable.pipe_profile)
+      dt_dev_pixelpipe_profile_record(
+          darktable.pipe_profile, pipe->profile_run, pipe->type, pipe->image.id, module->op, module_label, &start,
+          &roi_in, roi_out,
+          (pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU ? DT_DEV_PIXELPIPE_PROFILE_GPU : 0)
+              | (pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING ? DT_DEV_PIXELPIPE_PROFILE_TILING : 0)
+              | (pixelpipe_flow & PIXELPIPE_FLOW_BLENDED_ON_GPU ? DT_DEV_PIXELPIPE_PROFILE_BLEND_GPU : 0));
     g_free(module_label);
     module_label = NULL;
 
+    // remember how expensive it would be to get this buffer again
+    const float input_cost = dt_dev_pixelpipe_cache_get_cost(&(pipe->cache), input);
+    dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, input_cost + dt_get_wtime() - start.clock);
+
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
 
@@ -2229,6 +2471,12 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
                              float scale)
 {
   pipe->processing = 1;
+  dt_times_t run_start = { 0 };
+  if(darktable.pipe_profile)
+  {
+    dt_get_times(&run_start);
+    pipe->profile_run = dt_dev_pixelpipe_profile_run_start(darktable.pipe_profile);
+  }
   pipe->opencl_enabled = dt_opencl_update_enabled(); // update enabled flag from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
                                        : -1; // try to get/lock opencl resource
@@ -2262,6 +2510,7 @@ restart:
 
   // mask display off as a starting point
   pipe->mask_display = 0;
+  pipe->cancelled = 0;
 
   void *buf = NULL;
   void *cl_mem_out = NULL;
@@ -2317,6 +2566,11 @@ restart:
     dt_opencl_unlock_device(pipe->devid);
     pipe->devid = -1;
   }
+  if(darktable.pipe_profile)
+    dt_dev_pixelpipe_profile_record(darktable.pipe_profile, pipe->profile_run, pipe->type, pipe->image.id, "pipe",
+                                    _pipe_type_to_str(pipe->type), &run_start, NULL, &roi,
+                                    err ? DT_DEV_PIXELPIPE_PROFILE_FAILED : DT_DEV_PIXELPIPE_PROFILE_NONE);
+
   // ... and in case of other errors ...
   if(err)
   {
@@ -2337,6 +2591,15 @@ restart:
   return 0;
 }
 
+int dt_dev_pixelpipe_progress(dt_dev_pixelpipe_t *pipe, struct dt_iop_module_t *module, float fraction)
+{
+  if(pipe->cancelled || pipe->shutdown) return 1;
+  if(dt_iop_breakpoint(module->dev, pipe)
+     || (pipe->progress && pipe->progress(pipe, module, fraction, pipe->progress_data)))
+    pipe->cancelled = 1;
+  return pipe->cancelled;
+}
+
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
@@ -69,6 +69,13 @@ typedef enum dt_dev_pixelpipe_change_t
   DT_DEV_PIPE_ZOOMED = 1 << 3 // zoom event, preview pipe does not need changes
 } dt_dev_pixelpipe_change_t;
 
+struct dt_dev_pixelpipe_t;
+
+/** progress report of a long running module, returns non-zero to cancel the run. may be called from several
+ * threads at once. */
+typedef int (*dt_dev_pixelpipe_progress_t)(struct dt_dev_pixelpipe_t *pipe, struct dt_iop_module_t *module,
+                                           float fraction, void *data);
+
 /**
  * this encapsulates the pixelpipe.
  * a develop module will need several of these:
@@ -108,6 +115,11 @@ typedef struct dt_dev_pixelpipe_t
   int processing;
   // shutting down?
   int shutdown;
+  // optional progress callback for long running modules, see dt_dev_pixelpipe_progress()
+  dt_dev_pixelpipe_progress_t progress;
+  void *progress_data;
+  // a module stopped early during this run, its output is dropped
+  int cancelled;
   // opencl enabled for this pixelpipe?
   int opencl_enabled;
   // opencl error detected?
@@ -123,6 +135,8 @@ typedef struct dt_dev_pixelpipe_t
   dt_imageio_levels_t levels;
   // opencl device that has been locked for this pipe.
   int devid;
+  // id of the current run in darktable.pipe_profile, if recording
+  int profile_run;
   // image struct as it was when the pixelpipe was initialized. copied to avoid race conditions.
   dt_image_t image;
 } dt_dev_pixelpipe_t;
@@ -141,8 +155,9 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 // inits all but the pixel caches, so you can't actually process an image (just get dimensions and
 // distortions)
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
-// inits the pixelpipe with given cacheline size and number of entries.
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// inits the pixelpipe with given cacheline size and number of entries. the cache may grow beyond that
+// number of entries as long as it stays below memory_limit bytes.
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memory_limit);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
@@ -176,6 +191,11 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev,
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y,
                                       int width, int height, float scale);
 
+// to be called now and then by long running process() implementations, with the fraction of their work
+// done. returns non-zero if the module should give up right away: the history changed under the pipe, or the
+// progress callback asked to cancel. the output of the module is then thrown away.
+int dt_dev_pixelpipe_progress(dt_dev_pixelpipe_t *pipe, struct dt_iop_module_t *module, float fraction);
+
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
 // disable given op and all that comes before it in the pipe:
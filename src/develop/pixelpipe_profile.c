@@ -0,0 +1,225 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "develop/pixelpipe_profile.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "develop/pixelpipe.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+// don't let a long session eat up all memory, one event is about 100 bytes
+#define DT_DEV_PIXELPIPE_PROFILE_MAX_EVENTS (1 << 20)
+
+typedef struct dt_dev_pixelpipe_profile_event_t
+{
+  char name[20];
+  gchar *label;
+  int run;
+  int pipe_type;
+  int32_t imgid;
+  int thread;
+  double start, duration, cpu; // in seconds, start relative to the begin of recording
+  dt_iop_roi_t roi_in, roi_out;
+  dt_dev_pixelpipe_profile_flags_t flags;
+} dt_dev_pixelpipe_profile_event_t;
+
+struct dt_dev_pixelpipe_profile_t
+{
+  dt_pthread_mutex_t mutex;
+  GArray *events;
+  size_t dropped;
+  int runs;
+  int threads;
+  double start;
+  char *filename;
+  dt_dev_pixelpipe_profile_format_t format;
+};
+
+// small per thread ids, for the lanes of the trace
+static __thread int _profile_thread = -1;
+
+dt_dev_pixelpipe_profile_t *dt_dev_pixelpipe_profile_init(const char *filename,
+                                                          dt_dev_pixelpipe_profile_format_t format)
+{
+  dt_dev_pixelpipe_profile_t *profile = (dt_dev_pixelpipe_profile_t *)calloc(1, sizeof(dt_dev_pixelpipe_profile_t));
+  dt_pthread_mutex_init(&profile->mutex, NULL);
+  profile->events = g_array_new(FALSE, FALSE, sizeof(dt_dev_pixelpipe_profile_event_t));
+  profile->start = dt_get_wtime();
+  profile->filename = g_strdup(filename);
+  profile->format = format;
+  return profile;
+}
+
+void dt_dev_pixelpipe_profile_cleanup(dt_dev_pixelpipe_profile_t *profile)
+{
+  if(!profile) return;
+  if(profile->filename)
+  {
+    if(dt_dev_pixelpipe_profile_write(profile, profile->filename, profile->format))
+      fprintf(stderr, "[pixelpipe_profile] could not write `%s'\n", profile->filename);
+    else
+      fprintf(stderr, "[pixelpipe_profile] wrote %u events of %d pipe runs to `%s'\n", profile->events->len,
+              profile->runs, profile->filename);
+  }
+  for(guint k = 0; k < profile->events->len; k++)
+    g_free(g_array_index(profile->events, dt_dev_pixelpipe_profile_event_t, k).label);
+  g_array_free(profile->events, TRUE);
+  g_free(profile->filename);
+  dt_pthread_mutex_destroy(&profile->mutex);
+  free(profile);
+}
+
+int dt_dev_pixelpipe_profile_run_start(dt_dev_pixelpipe_profile_t *profile)
+{
+  return __sync_fetch_and_add(&profile->runs, 1);
+}
+
+void dt_dev_pixelpipe_profile_record(dt_dev_pixelpipe_profile_t *profile, const int run, const int pipe_type,
+                                     const int32_t imgid, const char *name, const char *label,
+                                     const dt_times_t *start, const dt_iop_roi_t *roi_in,
+                                     const dt_iop_roi_t *roi_out, const dt_dev_pixelpipe_profile_flags_t flags)
+{
+  dt_times_t end;
+  dt_get_times(&end);
+
+  dt_dev_pixelpipe_profile_event_t ev = { { 0 } };
+  g_strlcpy(ev.name, name, sizeof(ev.name));
+  ev.run = run;
+  ev.pipe_type = pipe_type;
+  ev.imgid = imgid;
+  ev.start = start->clock - profile->start;
+  ev.duration = end.clock - start->clock;
+  // user time of the whole process, so this includes other threads running at the same time
+  ev.cpu = end.user - start->user;
+  if(roi_in) ev.roi_in = *roi_in;
+  if(roi_out) ev.roi_out = *roi_out;
+  ev.flags = flags;
+
+  dt_pthread_mutex_lock(&profile->mutex);
+  if(_profile_thread < 0) _profile_thread = profile->threads++;
+  ev.thread = _profile_thread;
+  if(profile->events->len < DT_DEV_PIXELPIPE_PROFILE_MAX_EVENTS)
+  {
+    ev.label = g_strdup(label ? label : name);
+    g_array_append_val(profile->events, ev);
+  }
+  else
+    profile->dropped++;
+  dt_pthread_mutex_unlock(&profile->mutex);
+}
+
+static const char *_profile_pipe_type(const int pipe_type)
+{
+  switch(pipe_type)
+  {
+    case DT_DEV_PIXELPIPE_PREVIEW:
+      return "preview";
+    case DT_DEV_PIXELPIPE_FULL:
+      return "full";
+    case DT_DEV_PIXELPIPE_THUMBNAIL:
+      return "thumbnail";
+    case DT_DEV_PIXELPIPE_EXPORT:
+      return "export";
+    default:
+      return "unknown";
+  }
+}
+
+// labels can contain anything the user typed as instance name
+static void _profile_write_string(FILE *f, const char *str)
+{
+  fputc('"', f);
+  for(const unsigned char *c = (const unsigned char *)str; *c; c++)
+  {
+    if(*c == '"' || *c == '\\')
+      fprintf(f, "\\%c", *c);
+    else if(*c < 0x20)
+      fprintf(f, "\\u%04x", *c);
+    else
+      fputc(*c, f);
+  }
+  fputc('"', f);
+}
+
+static void _profile_write_details(FILE *f, const dt_dev_pixelpipe_profile_event_t *ev)
+{
+  fprintf(f, "\"run\": %d, \"pipe\": \"%s\", \"imgid\": %d, \"module\": ", ev->run, _profile_pipe_type(ev->pipe_type),
+          ev->imgid);
+  _profile_write_string(f, ev->name);
+  fprintf(f, ", \"device\": \"%s\", \"tiling\": %s, \"blend_device\": \"%s\", \"cache\": \"%s\", \"failed\": %s, "
+             "\"fused\": %s, \"cpu_time\": %.6f, ",
+          ev->flags & DT_DEV_PIXELPIPE_PROFILE_GPU ? "gpu" : "cpu",
+          ev->flags & DT_DEV_PIXELPIPE_PROFILE_TILING ? "true" : "false",
+          ev->flags & DT_DEV_PIXELPIPE_PROFILE_BLEND_GPU ? "gpu" : "cpu",
+          ev->flags & DT_DEV_PIXELPIPE_PROFILE_CACHE_HIT ? "hit" : "miss",
+          ev->flags & DT_DEV_PIXELPIPE_PROFILE_FAILED ? "true" : "false",
+          ev->flags & DT_DEV_PIXELPIPE_PROFILE_FUSED ? "true" : "false", ev->cpu);
+  fprintf(f, "\"roi_in\": [%d, %d, %d, %d, %g], \"roi_out\": [%d, %d, %d, %d, %g]", ev->roi_in.x, ev->roi_in.y,
+          ev->roi_in.width, ev->roi_in.height, ev->roi_in.scale, ev->roi_out.x, ev->roi_out.y,
+          ev->roi_out.width, ev->roi_out.height, ev->roi_out.scale);
+}
+
+int dt_dev_pixelpipe_profile_write(dt_dev_pixelpipe_profile_t *profile, const char *filename,
+                                   dt_dev_pixelpipe_profile_format_t format)
+{
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return 1;
+
+  dt_pthread_mutex_lock(&profile->mutex);
+  if(format == DT_DEV_PIXELPIPE_PROFILE_TRACE)
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped\": %zu}, \"traceEvents\": [\n",
+            profile->dropped);
+  else
+    fprintf(f, "{\"runs\": %d, \"dropped\": %zu, \"events\": [\n", profile->runs, profile->dropped);
+
+  for(guint k = 0; k < profile->events->len; k++)
+  {
+    const dt_dev_pixelpipe_profile_event_t *ev
+        = &g_array_index(profile->events, dt_dev_pixelpipe_profile_event_t, k);
+    if(format == DT_DEV_PIXELPIPE_PROFILE_TRACE)
+    {
+      // complete events, times in microseconds
+      fprintf(f, "  {\"name\": ");
+      _profile_write_string(f, ev->label);
+      fprintf(f, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d, "
+                 "\"args\": {",
+              strcmp(ev->name, "pipe") ? "module" : "pipe", ev->start * 1e6, ev->duration * 1e6, ev->thread);
+      _profile_write_details(f, ev);
+      fprintf(f, "}}");
+    }
+    else
+    {
+      fprintf(f, "  {\"label\": ");
+      _profile_write_string(f, ev->label);
+      fprintf(f, ", \"start\": %.6f, \"wall_time\": %.6f, \"thread\": %d, ", ev->start, ev->duration, ev->thread);
+      _profile_write_details(f, ev);
+      fprintf(f, "}");
+    }
+    fprintf(f, k + 1 < profile->events->len ? ",\n" : "\n");
+  }
+  fprintf(f, "]}\n");
+  dt_pthread_mutex_unlock(&profile->mutex);
+
+  return fclose(f) != 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
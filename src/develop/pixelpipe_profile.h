@@ -0,0 +1,69 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "develop/imageop.h"
+
+/**
+ * structured timing of pixelpipe runs. when enabled (--pipe-profile or --pipe-trace on the command line of
+ * darktable and darktable-cli), every run of a pipe and every module processed or taken from the cache in it
+ * is recorded. the events are written when darktable shuts down, either as plain json or in the chrome
+ * trace event format (chrome://tracing, perfetto).
+ */
+
+typedef enum dt_dev_pixelpipe_profile_format_t
+{
+  DT_DEV_PIXELPIPE_PROFILE_JSON = 0,
+  DT_DEV_PIXELPIPE_PROFILE_TRACE = 1
+} dt_dev_pixelpipe_profile_format_t;
+
+typedef enum dt_dev_pixelpipe_profile_flags_t
+{
+  DT_DEV_PIXELPIPE_PROFILE_NONE = 0,
+  DT_DEV_PIXELPIPE_PROFILE_GPU = 1 << 0,        // processed with opencl
+  DT_DEV_PIXELPIPE_PROFILE_TILING = 1 << 1,     // processed in tiles
+  DT_DEV_PIXELPIPE_PROFILE_BLEND_GPU = 1 << 2,  // blended with opencl
+  DT_DEV_PIXELPIPE_PROFILE_CACHE_HIT = 1 << 3,  // output taken from the pixelpipe cache
+  DT_DEV_PIXELPIPE_PROFILE_FAILED = 1 << 4,     // pipe run was aborted or failed
+  DT_DEV_PIXELPIPE_PROFILE_FUSED = 1 << 5       // several point-wise modules processed in one pass
+} dt_dev_pixelpipe_profile_flags_t;
+
+typedef struct dt_dev_pixelpipe_profile_t dt_dev_pixelpipe_profile_t;
+
+/** start recording, the events are written to filename in the given format on cleanup. */
+dt_dev_pixelpipe_profile_t *dt_dev_pixelpipe_profile_init(const char *filename,
+                                                          dt_dev_pixelpipe_profile_format_t format);
+/** write the file and free everything. */
+void dt_dev_pixelpipe_profile_cleanup(dt_dev_pixelpipe_profile_t *profile);
+/** write all events recorded so far, returns 0 on success. */
+int dt_dev_pixelpipe_profile_write(dt_dev_pixelpipe_profile_t *profile, const char *filename,
+                                   dt_dev_pixelpipe_profile_format_t format);
+
+/** a new run of a pipe starts, returns the id the events of that run are tagged with. */
+int dt_dev_pixelpipe_profile_run_start(dt_dev_pixelpipe_profile_t *profile);
+/** record one event. name is the module op, label the name shown to the user (may be NULL). start holds
+ * the wall and cpu time taken when the work began. roi_in may be NULL. */
+void dt_dev_pixelpipe_profile_record(dt_dev_pixelpipe_profile_t *profile, const int run, const int pipe_type,
+                                     const int32_t imgid, const char *name, const char *label,
+                                     const dt_times_t *start, const dt_iop_roi_t *roi_in,
+                                     const dt_iop_roi_t *roi_out, const dt_dev_pixelpipe_profile_flags_t flags);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -18,6 +18,7 @@
 */
 
 #include <glib.h>    // for g_mkdir_with_parents, _
+#include <glib/gstdio.h> // for g_fopen, g_rename, g_unlink
 #include <gtk/gtk.h> // for gtk_init_check
 #include <libintl.h> // for bind_textdomain_codeset, etc
 #include <limits.h>  // for PATH_MAX
@@ -32,11 +33,131 @@
 #include "common/darktable.h"    // for darktable, darktable_t, dt_cleanup, etc
 #include "common/database.h"     // for dt_database_get
 #include "common/debug.h"        // for DT_DEBUG_SQLITE3_PREPARE_V2
+#include "common/dtpthread.h"    // for dt_pthread_create, etc
 #include "common/mipmap_cache.h" // for dt_mipmap_size_t, etc
 #include "config.h"              // for GETTEXT_PACKAGE, etc
 #include "control/conf.h"        // for dt_conf_get_bool
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+// shared state of all the threads generating thumbnails
+typedef struct dt_generate_cache_t
+{
+  dt_pthread_mutex_t mutex;
+  dt_mipmap_size_t min_mip, max_mip;
+  int32_t min_imgid, max_imgid;
+
+  int32_t *imgids;  // all images to work on, sorted by id
+  uint8_t *done;    // finished flag for every entry of imgids
+  size_t count;     // number of entries in imgids
+  size_t next;      // index of the next image to hand out
+  size_t finished;  // number of images done in this run
+  size_t watermark; // all images before this index are done
+
+  const char *checkpoint; // file to record the progress in, so an interrupted run can continue
+  double start, last_checkpoint;
+} dt_generate_cache_t;
+
+// the checkpoint stores the parameters of the run and the highest image id up to which everything is done.
+static int32_t _checkpoint_read(const dt_generate_cache_t *gc)
+{
+  FILE *f = g_fopen(gc->checkpoint, "rb");
+  if(!f) return -1;
+  int min_mip, max_mip, min_imgid, max_imgid, done_upto;
+  const int read = fscanf(f, "%d %d %d %d %d", &min_mip, &max_mip, &min_imgid, &max_imgid, &done_upto);
+  fclose(f);
+  if(read != 5 || min_mip != gc->min_mip || max_mip != gc->max_mip || min_imgid != gc->min_imgid
+     || max_imgid != gc->max_imgid)
+    return -1;
+  return done_upto;
+}
+
+static void _checkpoint_write(const dt_generate_cache_t *gc, const int32_t done_upto)
+{
+  gchar *tmp = g_strdup_printf("%s.tmp", gc->checkpoint);
+  FILE *f = g_fopen(tmp, "wb");
+  if(f)
+  {
+    fprintf(f, "%d %d %d %d %d\n", gc->min_mip, gc->max_mip, gc->min_imgid, gc->max_imgid, done_upto);
+    fclose(f);
+    // atomically replace the old one, so we never end up with a broken checkpoint
+    if(g_rename(tmp, gc->checkpoint)) g_unlink(tmp);
+  }
+  g_free(tmp);
+}
+
+static void _generate_thumbnails(const dt_generate_cache_t *gc, const int32_t imgid)
+{
+  uint32_t missing = 0;
+  for(int k = gc->max_mip; k >= gc->min_mip && k >= 0; k--)
+  {
+    // if the thumbnail is already on disc - do nothing
+    if(!dt_mipmap_cache_has_ondisk_thumbnail(darktable.mipmap_cache, imgid, k)) missing |= 1u << k;
+  }
+  if(!missing) return;
+
+  // get the biggest level first and keep it locked: all smaller ones are downsampled from it, so the raw is
+  // decoded and processed at most once. if it is on disc already, it's simply read from there.
+  dt_mipmap_buffer_t large;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &large, imgid, gc->max_mip, DT_MIPMAP_BLOCKING, 'r');
+
+  for(int k = gc->max_mip - 1; k >= gc->min_mip && k >= 0; k--)
+  {
+    if(!(missing & (1u << k))) continue;
+    // else, generate thumbnail and store in mipmap cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+
+  dt_mipmap_cache_release(darktable.mipmap_cache, &large);
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+}
+
+static void *_generate_worker(void *data)
+{
+  dt_generate_cache_t *gc = (dt_generate_cache_t *)data;
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+
+  while(1)
+  {
+    dt_pthread_mutex_lock(&gc->mutex);
+    if(gc->next >= gc->count)
+    {
+      dt_pthread_mutex_unlock(&gc->mutex);
+      break;
+    }
+    const size_t idx = gc->next++;
+    dt_pthread_mutex_unlock(&gc->mutex);
+
+    _generate_thumbnails(gc, gc->imgids[idx]);
+
+    dt_pthread_mutex_lock(&gc->mutex);
+    gc->done[idx] = 1;
+    gc->finished++;
+    while(gc->watermark < gc->count && gc->done[gc->watermark]) gc->watermark++;
+
+    const double now = dt_get_wtime();
+    const double rate = gc->finished / MAX(now - gc->start, 1e-3);
+    const int eta = (gc->count - gc->finished) / rate;
+    fprintf(stderr, "image %zu/%zu (%.02f%%), %.2f images/s, eta %d:%02d:%02d\n", gc->finished, gc->count,
+            100.0 * gc->finished / (float)gc->count, rate, eta / 3600, (eta / 60) % 60, eta % 60);
+
+    if(gc->watermark > 0 && now - gc->last_checkpoint > 10.0)
+    {
+      _checkpoint_write(gc, gc->imgids[gc->watermark - 1]);
+      gc->last_checkpoint = now;
+    }
+    dt_pthread_mutex_unlock(&gc->mutex);
+  }
+  return NULL;
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip,
+                                    const int32_t min_imgid, const int32_t max_imgid, const int threads,
+                                    const gboolean restart)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -52,12 +173,29 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
+  dt_generate_cache_t gc = { 0 };
+  gc.min_mip = min_mip;
+  gc.max_mip = max_mip;
+  gc.min_imgid = min_imgid;
+  gc.max_imgid = max_imgid;
+  gchar *checkpoint = g_strdup_printf("%s.d/generate-cache.checkpoint", darktable.mipmap_cache->cachedir);
+  gc.checkpoint = checkpoint;
+
+  // continue an interrupted run with the same parameters
+  int32_t first_imgid = min_imgid;
+  const int32_t done_upto = restart ? -1 : _checkpoint_read(&gc);
+  if(done_upto >= min_imgid)
+  {
+    fprintf(stderr, _("resuming after image id %d, use --restart to start from scratch\n"), done_upto);
+    first_imgid = done_upto + 1;
+  }
+
   // some progress counter
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
+  size_t image_count = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, first_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -66,6 +204,7 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
   }
   else
   {
+    g_free(checkpoint);
     return 1;
   }
 
@@ -78,37 +217,38 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // go through all images:
+  // fetch all ids upfront, the workers hand them out in order:
+  gc.imgids = (int32_t *)calloc(MAX(image_count, 1), sizeof(int32_t));
+  gc.done = (uint8_t *)calloc(MAX(image_count, 1), sizeof(uint8_t));
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
+                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2 ORDER BY id", -1, &stmt, 0);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, first_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const int32_t imgid = sqlite3_column_int(stmt, 0);
-
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+  while(sqlite3_step(stmt) == SQLITE_ROW && gc.count < image_count)
+    gc.imgids[gc.count++] = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
 
-      // if the thumbnail is already on disc - do nothing
-      if(!access(filename, R_OK)) continue;
+  dt_pthread_mutex_init(&gc.mutex, NULL);
+  gc.start = gc.last_checkpoint = dt_get_wtime();
 
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    }
+  // the calling thread is one of the workers, the openmp threads are split between all of them
+  const int workers = CLAMP(threads, 1, MAX(gc.count, 1));
+  darktable.num_openmp_threads = MAX(1, darktable.num_openmp_threads / workers);
+  pthread_t *thread = (pthread_t *)calloc(workers, sizeof(pthread_t));
+  int started = 0;
+  for(int k = 1; k < workers; k++)
+    if(!dt_pthread_create(&thread[started], _generate_worker, &gc)) started++;
+  _generate_worker(&gc);
+  for(int k = 0; k < started; k++) pthread_join(thread[k], NULL);
+  free(thread);
 
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+  dt_pthread_mutex_destroy(&gc.mutex);
+  free(gc.imgids);
+  free(gc.done);
 
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%)\n", counter, image_count, 100.0 * counter / (float)image_count);
-  }
-
-  sqlite3_finalize(stmt);
+  // all done, nothing to resume next time
+  g_unlink(checkpoint);
+  g_free(checkpoint);
   fprintf(stderr, "done\n");
 
   return 0;
@@ -121,13 +261,18 @@ static void usage(const char *progname)
       "usage: %s [-h, --help; --version]\n"
       "  [--min-mip <0-7> (default = 0)] [-m, --max-mip <0-7> (default = 2)]\n"
       "  [--min-imgid <N>] [--max-imgid <N>]\n"
+      "  [-j, --threads <N> (default = 1)] [--restart]\n"
       "  [--core <darktable options>]\n"
       "\n"
       "When multiple mipmap sizes are requested, the biggest one is computed\n"
       "while the rest are quickly downsampled.\n"
       "\n"
       "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-      "numbers to work on.\n",
+      "numbers to work on.\n"
+      "\n"
+      "With --threads several images are processed at the same time. The progress\n"
+      "is recorded in the cache directory, an interrupted run with the same\n"
+      "parameters continues where it stopped unless --restart is given.\n",
       progname);
 }
 
@@ -144,6 +289,8 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int threads = 1;
+  gboolean restart = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -178,6 +325,15 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--threads")) && argc > k + 1)
+    {
+      k++;
+      threads = MIN(MAX(atoi(arg[k]), 1), 64);
+    }
+    else if(!strcmp(arg[k], "--restart"))
+    {
+      restart = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -187,10 +343,14 @@ int main(int argc, char *arg[])
   }
 
   int m_argc = 0;
-  char **m_arg = malloc((3 + argc - k + 1) * sizeof(char *));
+  char **m_arg = malloc((5 + argc - k + 1) * sizeof(char *));
   m_arg[m_argc++] = "darktable-generate-cache";
   m_arg[m_argc++] = "--conf";
   m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  // make room in the full size buffer cache for all our threads:
+  gchar *worker_threads = g_strdup_printf("worker_threads=%d", threads);
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = worker_threads;
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
@@ -198,6 +358,7 @@ int main(int argc, char *arg[])
   if(dt_init(m_argc, m_arg, FALSE, TRUE, NULL))
   {
     free(m_arg);
+    g_free(worker_threads);
     exit(EXIT_FAILURE);
   }
 
@@ -209,6 +370,7 @@ int main(int argc, char *arg[])
               "for thumbnail cache\nno thumbnails to be generated, done."));
     dt_cleanup();
     free(m_arg);
+    g_free(worker_threads);
     exit(EXIT_FAILURE);
   }
 
@@ -216,20 +378,23 @@ int main(int argc, char *arg[])
   {
     fprintf(stderr, _("error: ensure that min_mip <= max_mip\n"));
     free(m_arg);
+    g_free(worker_threads);
     exit(EXIT_FAILURE);
   }
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, threads, restart))
   {
     free(m_arg);
+    g_free(worker_threads);
     exit(EXIT_FAILURE);
   }
 
   dt_cleanup();
 
   free(m_arg);
+  g_free(worker_threads);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
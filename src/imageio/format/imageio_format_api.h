@@ -76,6 +76,14 @@ int bpp(struct dt_imageio_module_data_t *data);
 /* write to file, with exif if not NULL, and icc profile if supported. */
 int write_image(struct dt_imageio_module_data_t *data, const char *filename, const void *in, void *exif,
                 int exif_len, int imgid, int num, int total);
+/* optional: write the image in bands of rows, top to bottom, for exports too large to be kept in memory.
+   begin is called with data->width and height set, band with rows in the layout write_image() gets,
+   end after a successful begin, with failed set if anything went wrong. return != 0 on fail. */
+int write_image_begin(struct dt_imageio_module_data_t *data, const char *filename, void *exif, int exif_len,
+                      int imgid, int num, int total);
+int write_image_band(struct dt_imageio_module_data_t *data, const void *in, int y, int height);
+int write_image_end(struct dt_imageio_module_data_t *data, const char *filename, void *exif, int exif_len,
+                    int failed);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 int levels(struct dt_imageio_module_data_t *data);
 
@@ -120,8 +120,8 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid, void *exif,
-                int exif_len, int imgid, int num, int total)
+int write_image_begin(dt_imageio_module_data_t *p_tmp, const char *filename, void *exif, int exif_len,
+                      int imgid, int num, int total)
 {
   dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
   const int width = p->width, height = p->height;
@@ -202,13 +202,31 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
    */
   png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
+  /* swap bytes of 16 bit files to most significant bit first */
+  if(p->bpp > 8) png_set_swap(png_ptr);
+
+  p->f = f;
+  p->png_ptr = png_ptr;
+  p->info_ptr = info_ptr;
+  return 0;
+}
+
+int write_image_band(dt_imageio_module_data_t *p_tmp, const void *ivoid, int y, int height)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  const int width = p->width;
+
   png_bytep *row_pointers = malloc((size_t)height * sizeof(png_bytep));
+  if(!row_pointers) return 1;
 
-  if(p->bpp > 8)
+  if(setjmp(png_jmpbuf(p->png_ptr)))
   {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
+    free(row_pointers);
+    return 1;
+  }
 
+  if(p->bpp > 8)
+  {
     for(unsigned i = 0; i < height; i++)
       row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
   }
@@ -217,16 +235,38 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
     for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
   }
 
-  png_write_image(png_ptr, row_pointers);
+  png_write_rows(p->png_ptr, row_pointers, height);
 
   free(row_pointers);
-
-  png_write_end(png_ptr, info_ptr);
-  png_destroy_write_struct(&png_ptr, &info_ptr);
-  fclose(f);
   return 0;
 }
 
+int write_image_end(dt_imageio_module_data_t *p_tmp, const char *filename, void *exif, int exif_len, int failed)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+
+  if(!failed)
+  {
+    if(setjmp(png_jmpbuf(p->png_ptr)))
+      failed = 1;
+    else
+      png_write_end(p->png_ptr, p->info_ptr);
+  }
+
+  png_destroy_write_struct(&p->png_ptr, &p->info_ptr);
+  fclose(p->f);
+  p->f = NULL;
+  return failed;
+}
+
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid, void *exif,
+                int exif_len, int imgid, int num, int total)
+{
+  if(write_image_begin(p_tmp, filename, exif, exif_len, imgid, num, total)) return 1;
+  const int failed = write_image_band(p_tmp, ivoid, 0, ((dt_imageio_png_t *)p_tmp)->height);
+  return write_image_end(p_tmp, filename, exif, exif_len, failed);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
@@ -51,20 +51,14 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
-int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void, void *exif,
-                int exif_len, int imgid, int num, int total)
+int write_image_begin(dt_imageio_module_data_t *d_tmp, const char *filename, void *exif, int exif_len,
+                      int imgid, int num, int total)
 {
-  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+  dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
 
   uint8_t *profile = NULL;
   uint32_t profile_len = 0;
 
-  TIFF *tif = NULL;
-
-  void *rowdata = NULL;
-
-  int rc = 1; // default to error
-
   if(imgid > 0)
   {
     cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid)->profile;
@@ -72,21 +66,17 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     if(profile_len > 0)
     {
       profile = malloc(profile_len);
-      if(!profile)
-      {
-        rc = 1;
-        goto exit;
-      }
+      if(!profile) return 1;
       cmsSaveProfileToMem(out_profile, profile, &profile_len);
     }
   }
 
   // Create little endian tiff image
-  tif = TIFFOpen(filename, "wl");
+  TIFF *tif = d->handle = TIFFOpen(filename, "wl");
   if(!tif)
   {
-    rc = 1;
-    goto exit;
+    free(profile);
+    return 1;
   }
 
   // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
@@ -125,7 +115,10 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   TIFFSetField(tif, TIFFTAG_FILLORDER, (uint16_t)FILLORDER_MSB2LSB);
   if(profile != NULL)
   {
+    // libtiff keeps its own copy
     TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, profile);
+    free(profile);
+    profile = NULL;
   }
   TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)3);
   TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
@@ -145,80 +138,70 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, (uint16_t)RESUNIT_INCH);
   }
 
+  return 0;
+}
+
+int write_image_band(dt_imageio_module_data_t *d_tmp, const void *in_void, int y, int height)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+
+  // one strip per row, so bands of rows can be written as they come
   const size_t rowsize = (d->width * 3) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
-  {
-    rc = 1;
-    goto exit;
-  }
+  void *rowdata = malloc(rowsize);
+  if(!rowdata) return 1;
 
-  if(d->bpp == 32)
+  int rc = 0;
+  for(int j = 0; j < height && !rc; j++)
   {
-    for(int y = 0; y < d->height; y++)
+    if(d->bpp == 32)
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->width;
+      const float *in = (const float *)in_void + (size_t)4 * j * d->width;
       float *out = (float *)rowdata;
 
       for(int x = 0; x < d->width; x++, in += 4, out += 3)
       {
         memcpy(out, in, 3 * sizeof(float));
       }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
     }
-  }
-  else if(d->bpp == 16)
-  {
-    for(int y = 0; y < d->height; y++)
+    else if(d->bpp == 16)
     {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->width;
+      const uint16_t *in = (const uint16_t *)in_void + (size_t)4 * j * d->width;
       uint16_t *out = (uint16_t *)rowdata;
 
       for(int x = 0; x < d->width; x++, in += 4, out += 3)
       {
         memcpy(out, in, 3 * sizeof(uint16_t));
       }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
     }
-  }
-  else
-  {
-    for(int y = 0; y < d->height; y++)
+    else
     {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->width;
+      const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * j * d->width;
       uint8_t *out = (uint8_t *)rowdata;
 
       for(int x = 0; x < d->width; x++, in += 4, out += 3)
       {
         memcpy(out, in, 3 * sizeof(uint8_t));
       }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
     }
+
+    if(TIFFWriteScanline(d->handle, rowdata, y + j, 0) == -1) rc = 1;
   }
 
-  // success
-  rc = 0;
+  free(rowdata);
+  return rc;
+}
+
+int write_image_end(dt_imageio_module_data_t *d_tmp, const char *filename, void *exif, int exif_len, int failed)
+{
+  dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+
+  int rc = failed;
 
-exit:
   // close the file before adding exif data
-  if(tif)
+  if(d->handle)
   {
-    TIFFClose(tif);
-    tif = NULL;
+    TIFFClose(d->handle);
+    d->handle = NULL;
   }
   if(!rc && exif)
   {
@@ -226,14 +209,18 @@ exit:
     // Until we get symbolic error status codes, if rc is 1, return 0
     rc = (rc == 1) ? 0 : 1;
   }
-  free(profile);
-  profile = NULL;
-  free(rowdata);
-  rowdata = NULL;
 
   return rc;
 }
 
+int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void, void *exif,
+                int exif_len, int imgid, int num, int total)
+{
+  if(write_image_begin(d_tmp, filename, exif, exif_len, imgid, num, total)) return 1;
+  const int failed = write_image_band(d_tmp, in_void, 0, ((dt_imageio_tiff_t *)d_tmp)->height);
+  return write_image_end(d_tmp, filename, exif, exif_len, failed);
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
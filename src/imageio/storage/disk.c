@@ -33,9 +33,13 @@
 #include "gui/gtkentry.h"
 #include "imageio/storage/imageio_storage_api.h"
 #include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 DT_MODULE(2)
 
@@ -52,6 +56,7 @@ typedef struct dt_imageio_disk_t
   char filename[DT_MAX_PATH_FOR_PARAMS];
   gboolean overwrite;
   dt_variables_params_t *vp;
+  char suffix[32]; // of the export variant, not part of the params
 } dt_imageio_disk_t;
 
 
@@ -186,6 +191,12 @@ void gui_reset(dt_imageio_module_storage_t *self)
   dt_bauhaus_combobox_set(d->overwrite, 0);
 }
 
+int concurrent_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata)
+{
+  // file name generation below is serialized, the export itself only touches its own file
+  return 1;
+}
+
 int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int imgid,
           dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata, const int num, const int total,
           const gboolean high_quality, const gboolean upscale)
@@ -196,7 +207,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   char dirname[PATH_MAX] = { 0 };
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, dirname, sizeof(dirname), &from_cache);
-  int fail = 0;
+  int fail = 0, reserved = 0;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
@@ -266,20 +277,31 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
     //     for(; c>filename && *c != '.' && *c != '/' ; c--);
     //     if(c <= filename || *c=='/') c = filename + strlen(filename);
 
-    sprintf(c, ".%s", ext);
+    sprintf(c, "%s.%s", d->suffix, ext);
 
   /* prevent overwrite of files */
   failed:
-    if(!d->overwrite)
+    if(!fail && !d->overwrite)
     {
+      // concurrent stores run outside of this lock while they write, so testing for existence isn't
+      // enough: create an empty placeholder with O_EXCL to reserve the name until the format writes it.
       int seq = 1;
-      if(!fail && g_file_test(filename, G_FILE_TEST_EXISTS))
+      int fd;
+      while((fd = g_open(filename, O_CREAT | O_EXCL | O_WRONLY, 0666)) == -1 && errno == EEXIST)
+      {
+        sprintf(c, "%s_%.2d.%s", d->suffix, seq, ext);
+        seq++;
+      }
+      if(fd == -1)
       {
-        do
-        {
-          sprintf(c, "_%.2d.%s", seq, ext);
-          seq++;
-        } while(g_file_test(filename, G_FILE_TEST_EXISTS));
+        fprintf(stderr, "[imageio_storage_disk] could not create file: `%s'!\n", filename);
+        dt_control_log(_("could not export to file `%s'!"), filename);
+        fail = 1;
+      }
+      else
+      {
+        close(fd);
+        reserved = 1;
       }
     }
   } // end of critical block
@@ -291,6 +313,8 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   {
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    // don't leave the empty placeholder behind
+    if(reserved) g_unlink(filename);
     return 1;
   }
 
@@ -304,7 +328,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
 
 size_t params_size(dt_imageio_module_storage_t *self)
 {
-  return sizeof(dt_imageio_disk_t) - sizeof(void *);
+  return offsetof(dt_imageio_disk_t, vp);
 }
 
 void init(dt_imageio_module_storage_t *self)
@@ -331,6 +355,12 @@ void *get_params(dt_imageio_module_storage_t *self)
   return d;
 }
 
+void variant_suffix(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data, const char *suffix)
+{
+  dt_imageio_disk_t *d = (dt_imageio_disk_t *)data;
+  g_strlcpy(d->suffix, suffix, sizeof(d->suffix));
+}
+
 void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *params)
 {
   if(!params) return;
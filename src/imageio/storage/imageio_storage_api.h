@@ -68,6 +68,12 @@ int store(struct dt_imageio_module_storage_t *self, struct dt_imageio_module_dat
           const int num, const int total, const gboolean high_quality, const gboolean upscale);
 /* called once at the end (after exporting all images), if implemented. */
 void finalize_store(struct dt_imageio_module_storage_t *self, struct dt_imageio_module_data_t *data);
+/* return non-zero if store() may be called from several threads at once for the same data. */
+int concurrent_store(struct dt_imageio_module_storage_t *self, struct dt_imageio_module_data_t *data);
+/* append suffix to the names of the files stored with data, if implemented. keeps export variants of the
+ * same format apart. */
+void variant_suffix(struct dt_imageio_module_storage_t *self, struct dt_imageio_module_data_t *data,
+                    const char *suffix);
 
 void *legacy_params(struct dt_imageio_module_storage_t *self, const void *const old_params,
                     const size_t old_params_size, const int old_version, const int new_version,
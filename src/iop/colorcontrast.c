@@ -136,6 +136,11 @@ void connect_key_accels(dt_iop_module_t *self)
 
 #endif
 
+int pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  return 1;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -34,6 +34,7 @@
 #include "common/imageio_png.h"
 #include "common/imageio_tiff.h"
 #include "develop/imageop_math.h"
+#include "iop/colorin_cmatrix.h"
 #include "iop/iop_api.h"
 
 #include "external/adobe_coeff.c"
@@ -448,21 +449,6 @@ error:
 }
 #endif
 
-static inline float _cbrtf(const float x)
-{
-  union convert {
-    float f;
-    int i;
-  } data, dataout;
-
-  data.f = x;
-
-  // approximate cbrtf(x):
-  dataout.i = (((int)(((float)(data.i)) / 3.0f)) + 709921077);
-
-  return dataout.f;
-}
-
 #if defined(__SSE2__)
 static inline __m128 _cbrtf_sse2(const __m128 x)
 {
@@ -472,24 +458,6 @@ static inline __m128 _cbrtf_sse2(const __m128 x)
 }
 #endif
 
-static inline float lab_f_m(const float x)
-{
-  const float epsilon = (216.0f / 24389.0f);
-  const float kappa = (24389.0f / 27.0f);
-
-  const float a = _cbrtf(x);
-  const float a3 = a * a * a;
-
-  // x > epsilon
-  const float res_big = (((a) * ((x + x) + a3)) / ((a3 + a3) + x));
-
-  // x <= epsilon
-  const float res_small = (((kappa * x) + (16.0f)) / (116.0f));
-
-  // blend results according to whether each component is > epsilon or not
-  return ((x > epsilon) ? res_big : res_small);
-}
-
 #if defined(__SSE2__)
 static inline __m128 lab_f_m_sse2(const __m128 x)
 {
@@ -513,37 +481,6 @@ static inline __m128 lab_f_m_sse2(const __m128 x)
 }
 #endif
 
-static inline void _dt_XYZ_to_Lab(const float *const XYZ, float *const Lab)
-{
-  const float d50_inv[4] = { 1.0f / 0.9642f, 1.0f, 1.0f / 0.8249f, 0.0f };
-  const float coef[4] = { 116.0f, 500.0f, 200.0f, 0.0f };
-
-  float _xyz[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-  for(int c = 0; c < 4; c++)
-  {
-    _xyz[c] = lab_f_m(d50_inv[c] * XYZ[c]);
-  }
-
-  // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
-
-  float sf1[4];
-  sf1[0] = _xyz[1];
-  sf1[1] = _xyz[0];
-  sf1[2] = _xyz[1];
-  sf1[3] = _xyz[3];
-
-  float sf2[4];
-  sf2[0] = _xyz[3];
-  sf2[1] = _xyz[1];
-  sf2[2] = _xyz[2];
-  sf2[3] = _xyz[3];
-
-  for(int c = 0; c < 4; c++)
-  {
-    Lab[c] = (sf1[c] - sf2[c]) * coef[c];
-  }
-}
-
 #if defined(__SSE2__)
 static inline __m128 dt_XYZ_to_Lab_sse2(const __m128 XYZ)
 {
@@ -671,21 +608,10 @@ static void process_cmatrix_fastpath_simple(struct dt_iop_module_t *self, dt_dev
 #endif
   for(int k = 0; k < (size_t)roi_out->width * roi_out->height; k++)
   {
-    float *in = (float *)ivoid + (size_t)ch * k;
+    const float *in = (const float *)ivoid + (size_t)ch * k;
     float *out = (float *)ovoid + (size_t)ch * k;
 
-    float _xyz[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-    for(int c = 0; c < 3; c++)
-    {
-      _xyz[c] = 0.0f;
-      for(int i = 0; i < 3; i++)
-      {
-        _xyz[c] += d->cmatrix[3 * c + i] * in[i];
-      }
-    }
-
-    _dt_XYZ_to_Lab(_xyz, out);
+    _cmatrix_to_Lab(d->cmatrix, in, out);
   }
 }
 
@@ -703,36 +629,10 @@ static void process_cmatrix_fastpath_clipping(struct dt_iop_module_t *self, dt_d
 #endif
   for(int k = 0; k < (size_t)roi_out->width * roi_out->height; k++)
   {
-    float *in = (float *)ivoid + (size_t)ch * k;
+    const float *in = (const float *)ivoid + (size_t)ch * k;
     float *out = (float *)ovoid + (size_t)ch * k;
 
-    float nRGB[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-    for(int c = 0; c < 3; c++)
-    {
-      nRGB[c] = 0.0f;
-      for(int i = 0; i < 3; i++)
-      {
-        nRGB[c] += d->nmatrix[3 * c + i] * in[i];
-      }
-    }
-
-    float cRGB[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-    for(int c = 0; c < 3; c++)
-    {
-      cRGB[c] = CLAMP(nRGB[c], 0.0f, 1.0f);
-    }
-
-    float XYZ[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-    for(int c = 0; c < 3; c++)
-    {
-      XYZ[c] = 0.0f;
-      for(int i = 0; i < 3; i++)
-      {
-        XYZ[c] += d->lmatrix[3 * c + i] * cRGB[i];
-      }
-    }
-
-    _dt_XYZ_to_Lab(XYZ, out);
+    _cmatrix_clipping_to_Lab(d->nmatrix, d->lmatrix, in, out);
   }
 }
 
@@ -952,6 +852,13 @@ static void process_lcms2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *
   }
 }
 
+int pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  // only the matrix path, lcms2 transforms are left alone
+  return d->type == DT_COLORSPACE_LAB || !isnan(d->cmatrix[0]);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -1356,6 +1263,55 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+#if defined(HAVE_AVX2_TARGET)
+void DT_TARGET_AVX2 process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                 const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
+                                 const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int blue_mapping = d->blue_mapping && piece->pipe->image.flags & DT_IMAGE_RAW;
+
+  // only the plain matrix case is worth it, luts and lcms2 stay on the sse2 code
+  if(d->type == DT_COLORSPACE_LAB || isnan(d->cmatrix[0]) || blue_mapping || d->nonlinearlut != 0)
+  {
+    process_sse2(self, piece, ivoid, ovoid, roi_in, roi_out);
+    return;
+  }
+
+  // without clipping, cmatrix goes to XYZ directly. with clipping, nmatrix goes to the clipping rgb space
+  // and lmatrix on to XYZ.
+  const int clipping = (d->nrgb != NULL);
+  _cmatrix_to_Lab_avx2(clipping ? d->nmatrix : d->cmatrix, d->lmatrix, clipping, (const float *)ivoid,
+                       (float *)ovoid, (size_t)roi_out->width * roi_out->height);
+
+  if(piece->pipe->mask_display) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+}
+#endif
+
+#if defined(HAVE_AVX512_TARGET)
+void DT_TARGET_AVX512 process_avx512(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                     const void *const ivoid, void *const ovoid,
+                                     const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+  const int blue_mapping = d->blue_mapping && piece->pipe->image.flags & DT_IMAGE_RAW;
+
+  if(d->type == DT_COLORSPACE_LAB || isnan(d->cmatrix[0]) || blue_mapping || d->nonlinearlut != 0)
+  {
+    process_sse2(self, piece, ivoid, ovoid, roi_in, roi_out);
+    return;
+  }
+
+  // without clipping, cmatrix goes to XYZ directly. with clipping, nmatrix goes to the clipping rgb space
+  // and lmatrix on to XYZ.
+  const int clipping = (d->nrgb != NULL);
+  _cmatrix_to_Lab_avx512(clipping ? d->nmatrix : d->cmatrix, d->lmatrix, clipping,
+                         (const float *)ivoid, (float *)ovoid, (size_t)roi_out->width * roi_out->height);
+
+  if(piece->pipe->mask_display) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+}
+#endif
+
 static void mat3mul(float *dst, const float *const m1, const float *const m2)
 {
   for(int k = 0; k < 3; k++)
@@ -0,0 +1,301 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2009--2011 johannes hanika.
+    copyright (c) 2011 henrik andersson
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// the color matrix kernels of colorin. they don't touch any pipe structs, so src/tests/colorin.c can run the
+// plain and the vectorized versions against each other.
+
+#include <glib.h>
+#include <math.h>
+#include <stddef.h>
+#if defined(HAVE_AVX2_TARGET)
+#include <immintrin.h>
+#endif
+
+static inline float _cbrtf(const float x)
+{
+  union convert {
+    float f;
+    int i;
+  } data, dataout;
+
+  data.f = x;
+
+  // approximate cbrtf(x):
+  dataout.i = (((int)(((float)(data.i)) / 3.0f)) + 709921077);
+
+  return dataout.f;
+}
+
+static inline float lab_f_m(const float x)
+{
+  const float epsilon = (216.0f / 24389.0f);
+  const float kappa = (24389.0f / 27.0f);
+
+  const float a = _cbrtf(x);
+  const float a3 = a * a * a;
+
+  // x > epsilon
+  const float res_big = (((a) * ((x + x) + a3)) / ((a3 + a3) + x));
+
+  // x <= epsilon
+  const float res_small = (((kappa * x) + (16.0f)) / (116.0f));
+
+  // blend results according to whether each component is > epsilon or not
+  return ((x > epsilon) ? res_big : res_small);
+}
+
+static inline void _dt_XYZ_to_Lab(const float *const XYZ, float *const Lab)
+{
+  const float d50_inv[4] = { 1.0f / 0.9642f, 1.0f, 1.0f / 0.8249f, 0.0f };
+  const float coef[4] = { 116.0f, 500.0f, 200.0f, 0.0f };
+
+  float _xyz[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for(int c = 0; c < 4; c++)
+  {
+    _xyz[c] = lab_f_m(d50_inv[c] * XYZ[c]);
+  }
+
+  // because d50_inv.z is 0.0f, lab_f(0) == 16/116, so Lab[0] = 116*f[0] - 16 equal to 116*(f[0]-f[3])
+
+  float sf1[4];
+  sf1[0] = _xyz[1];
+  sf1[1] = _xyz[0];
+  sf1[2] = _xyz[1];
+  sf1[3] = _xyz[3];
+
+  float sf2[4];
+  sf2[0] = _xyz[3];
+  sf2[1] = _xyz[1];
+  sf2[2] = _xyz[2];
+  sf2[3] = _xyz[3];
+
+  for(int c = 0; c < 4; c++)
+  {
+    Lab[c] = (sf1[c] - sf2[c]) * coef[c];
+  }
+}
+
+// only color matrix, cmatrix goes to XYZ directly
+static inline void _cmatrix_to_Lab(const float *const cmatrix, const float *const in, float *const out)
+{
+  float _xyz[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+  for(int c = 0; c < 3; c++)
+  {
+    _xyz[c] = 0.0f;
+    for(int i = 0; i < 3; i++)
+    {
+      _xyz[c] += cmatrix[3 * c + i] * in[i];
+    }
+  }
+
+  _dt_XYZ_to_Lab(_xyz, out);
+}
+
+// nmatrix goes to the clipping rgb space, lmatrix on to XYZ
+static inline void _cmatrix_clipping_to_Lab(const float *const nmatrix, const float *const lmatrix,
+                                            const float *const in, float *const out)
+{
+  float nRGB[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for(int c = 0; c < 3; c++)
+  {
+    nRGB[c] = 0.0f;
+    for(int i = 0; i < 3; i++)
+    {
+      nRGB[c] += nmatrix[3 * c + i] * in[i];
+    }
+  }
+
+  float cRGB[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for(int c = 0; c < 3; c++)
+  {
+    cRGB[c] = CLAMP(nRGB[c], 0.0f, 1.0f);
+  }
+
+  float XYZ[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for(int c = 0; c < 3; c++)
+  {
+    XYZ[c] = 0.0f;
+    for(int i = 0; i < 3; i++)
+    {
+      XYZ[c] += lmatrix[3 * c + i] * cRGB[i];
+    }
+  }
+
+  _dt_XYZ_to_Lab(XYZ, out);
+}
+
+#if defined(HAVE_AVX2_TARGET)
+// the avx2 variants work on two pixels at once, each 128-bit lane holds one of them.
+
+static inline __m256 DT_TARGET_AVX2 _cbrtf_avx2(const __m256 x)
+{
+  return (_mm256_castsi256_ps(
+      _mm256_add_epi32(_mm256_cvtps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)),
+                                                        _mm256_set1_ps(3.0f))),
+                       _mm256_set1_epi32(709921077))));
+}
+
+static inline __m256 DT_TARGET_AVX2 lab_f_m_avx2(const __m256 x)
+{
+  const __m256 epsilon = _mm256_set1_ps(216.0f / 24389.0f);
+  const __m256 kappa = _mm256_set1_ps(24389.0f / 27.0f);
+
+  const __m256 a = _cbrtf_avx2(x);
+  const __m256 a3 = _mm256_mul_ps(_mm256_mul_ps(a, a), a);
+  const __m256 res_big = _mm256_div_ps(_mm256_mul_ps(a, _mm256_add_ps(a3, _mm256_add_ps(x, x))),
+                                       _mm256_add_ps(_mm256_add_ps(a3, a3), x));
+  const __m256 res_small
+      = _mm256_div_ps(_mm256_fmadd_ps(kappa, x, _mm256_set1_ps(16.0f)), _mm256_set1_ps(116.0f));
+
+  return _mm256_blendv_ps(res_small, res_big, _mm256_cmp_ps(x, epsilon, _CMP_GT_OQ));
+}
+
+static inline __m256 DT_TARGET_AVX2 dt_XYZ_to_Lab_avx2(const __m256 XYZ)
+{
+  const __m256 d50_inv = _mm256_setr_ps(1.0f / 0.9642f, 1.0f, 1.0f / 0.8249f, 0.0f,
+                                        1.0f / 0.9642f, 1.0f, 1.0f / 0.8249f, 0.0f);
+  const __m256 coef = _mm256_setr_ps(116.0f, 500.0f, 200.0f, 0.0f, 116.0f, 500.0f, 200.0f, 0.0f);
+  const __m256 f = lab_f_m_avx2(_mm256_mul_ps(XYZ, d50_inv));
+  // same trick as in the sse2 version, the shuffles stay within each pixel's lane
+  return _mm256_mul_ps(coef, _mm256_sub_ps(_mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 1, 0, 1)),
+                                           _mm256_shuffle_ps(f, f, _MM_SHUFFLE(3, 2, 1, 3))));
+}
+
+static inline __m256 DT_TARGET_AVX2 _mat3_avx2(const __m256 m0, const __m256 m1, const __m256 m2,
+                                               const __m256 v)
+{
+  return _mm256_fmadd_ps(m2, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)),
+                         _mm256_fmadd_ps(m1, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)),
+                                         _mm256_mul_ps(m0, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)))));
+}
+
+#define MAT_COLUMN_AVX2(M, C) _mm256_setr_ps(M[C], M[C + 3], M[C + 6], 0.0f, M[C], M[C + 3], M[C + 6], 0.0f)
+
+static void DT_TARGET_AVX2 _cmatrix_to_Lab_avx2(const float *const m, const float *const lmat,
+                                               const int clipping, const float *const in, float *const out,
+                                               const size_t npixels)
+{
+  const __m256 m0 = MAT_COLUMN_AVX2(m, 0), m1 = MAT_COLUMN_AVX2(m, 1), m2 = MAT_COLUMN_AVX2(m, 2);
+  const __m256 lm0 = MAT_COLUMN_AVX2(lmat, 0), lm1 = MAT_COLUMN_AVX2(lmat, 1), lm2 = MAT_COLUMN_AVX2(lmat, 2);
+
+  // pipe buffers and fused strips are only guaranteed 16-byte alignment, so no aligned or streaming
+  // 256-bit accesses here
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+  for(size_t k = 0; k < npixels / 2; k++)
+  {
+    const __m256 input = _mm256_loadu_ps(in + 8 * k);
+    __m256 xyz = _mat3_avx2(m0, m1, m2, input);
+    if(clipping)
+      xyz = _mat3_avx2(lm0, lm1, lm2, _mm256_min_ps(_mm256_max_ps(xyz, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)));
+    _mm256_storeu_ps(out + 8 * k, dt_XYZ_to_Lab_avx2(xyz));
+  }
+
+  if(npixels & 1)
+  {
+    // odd pixel count: last one alone in the lower lane
+    const size_t k = npixels - 1;
+    const __m256 input = _mm256_castps128_ps256(_mm_load_ps(in + 4 * k));
+    __m256 xyz = _mat3_avx2(m0, m1, m2, input);
+    if(clipping)
+      xyz = _mat3_avx2(lm0, lm1, lm2, _mm256_min_ps(_mm256_max_ps(xyz, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)));
+    _mm_store_ps(out + 4 * k, _mm256_castps256_ps128(dt_XYZ_to_Lab_avx2(xyz)));
+  }
+}
+
+#undef MAT_COLUMN_AVX2
+#endif
+
+#if defined(HAVE_AVX512_TARGET)
+// the avx-512 variants work on four pixels at once, each 128-bit lane holds one of them.
+
+static inline __m512 DT_TARGET_AVX512 lab_f_m_avx512(const __m512 x)
+{
+  const __m512 epsilon = _mm512_set1_ps(216.0f / 24389.0f);
+  const __m512 kappa = _mm512_set1_ps(24389.0f / 27.0f);
+
+  // approximate cbrtf(x), see _cbrtf()
+  const __m512 a = _mm512_castsi512_ps(
+      _mm512_add_epi32(_mm512_cvtps_epi32(_mm512_div_ps(_mm512_cvtepi32_ps(_mm512_castps_si512(x)),
+                                                        _mm512_set1_ps(3.0f))),
+                       _mm512_set1_epi32(709921077)));
+  const __m512 a3 = _mm512_mul_ps(_mm512_mul_ps(a, a), a);
+  const __m512 res_big = _mm512_div_ps(_mm512_mul_ps(a, _mm512_add_ps(a3, _mm512_add_ps(x, x))),
+                                       _mm512_add_ps(_mm512_add_ps(a3, a3), x));
+  const __m512 res_small
+      = _mm512_div_ps(_mm512_fmadd_ps(kappa, x, _mm512_set1_ps(16.0f)), _mm512_set1_ps(116.0f));
+
+  return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, epsilon, _CMP_GT_OQ), res_small, res_big);
+}
+
+static inline __m512 DT_TARGET_AVX512 dt_XYZ_to_Lab_avx512(const __m512 XYZ)
+{
+  const __m512 d50_inv = _mm512_broadcast_f32x4(_mm_setr_ps(1.0f / 0.9642f, 1.0f, 1.0f / 0.8249f, 0.0f));
+  const __m512 coef = _mm512_broadcast_f32x4(_mm_setr_ps(116.0f, 500.0f, 200.0f, 0.0f));
+  const __m512 f = lab_f_m_avx512(_mm512_mul_ps(XYZ, d50_inv));
+  return _mm512_mul_ps(coef, _mm512_sub_ps(_mm512_shuffle_ps(f, f, _MM_SHUFFLE(3, 1, 0, 1)),
+                                           _mm512_shuffle_ps(f, f, _MM_SHUFFLE(3, 2, 1, 3))));
+}
+
+static inline __m512 DT_TARGET_AVX512 _mat3_avx512(const __m512 m0, const __m512 m1, const __m512 m2,
+                                                   const __m512 v)
+{
+  return _mm512_fmadd_ps(m2, _mm512_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)),
+                         _mm512_fmadd_ps(m1, _mm512_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)),
+                                         _mm512_mul_ps(m0, _mm512_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)))));
+}
+
+#define MAT_COLUMN_AVX512(M, C) _mm512_broadcast_f32x4(_mm_setr_ps(M[C], M[C + 3], M[C + 6], 0.0f))
+
+static void DT_TARGET_AVX512 _cmatrix_to_Lab_avx512(const float *const m, const float *const lmat,
+                                                   const int clipping, const float *const in,
+                                                   float *const out, const size_t npixels)
+{
+  const __m512 m0 = MAT_COLUMN_AVX512(m, 0), m1 = MAT_COLUMN_AVX512(m, 1), m2 = MAT_COLUMN_AVX512(m, 2);
+  const __m512 lm0 = MAT_COLUMN_AVX512(lmat, 0), lm1 = MAT_COLUMN_AVX512(lmat, 1),
+               lm2 = MAT_COLUMN_AVX512(lmat, 2);
+
+  // same as for avx2: only 16-byte alignment is guaranteed, use the unaligned forms
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+  for(size_t k = 0; k < (npixels + 3) / 4; k++)
+  {
+    // the last block may be partial, mask away the pixels beyond the end of the buffer
+    const size_t left = npixels - 4 * k;
+    const __mmask16 mask = left >= 4 ? 0xffff : (__mmask16)((1u << (4 * left)) - 1u);
+    const __m512 input = _mm512_maskz_loadu_ps(mask, in + 16 * k);
+    __m512 xyz = _mat3_avx512(m0, m1, m2, input);
+    if(clipping)
+      xyz = _mat3_avx512(lm0, lm1, lm2,
+                         _mm512_min_ps(_mm512_max_ps(xyz, _mm512_setzero_ps()), _mm512_set1_ps(1.0f)));
+    _mm512_mask_storeu_ps(out + 16 * k, mask, dt_XYZ_to_Lab_avx512(xyz));
+  }
+}
+
+#undef MAT_COLUMN_AVX512
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
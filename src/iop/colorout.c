@@ -403,6 +403,13 @@ static inline __m128 dt_Lab_to_XYZ_SSE(const __m128 Lab)
 }
 #endif
 
+int pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_colorout_data_t *const d = (dt_iop_colorout_data_t *)piece->data;
+  // only the matrix path, lcms2 transforms are left alone
+  return d->type == DT_COLORSPACE_LAB || !isnan(d->cmatrix[0]);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -207,7 +207,12 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
 
     const int max_filter_radius = (1 << max_scale); // 2 * 2^max_scale
 
-    tiling->factor = 3.5f + max_scale; // in + out + tmp + reducebuffer + scale buffers
+    // the cpu path folds every scale into the output right away and only keeps two coarse buffers,
+    // the opencl path still holds one detail buffer per scale.
+    if(piece->pipe->opencl_enabled && piece->pipe->devid >= 0)
+      tiling->factor = 3.5f + max_scale; // in + out + tmp + reducebuffer + scale buffers
+    else
+      tiling->factor = 2.5f + MIN(max_scale, 2); // in + out + reducebuffer + two coarse buffers
     tiling->maxbuf = 1.0f;
     tiling->overhead = 0;
     tiling->overlap = max_filter_radius;
@@ -388,14 +393,12 @@ static inline __m128 weight_sse(const __m128 *c1, const __m128 *c2, const float
 #define ROW_PROLOGUE                                                                                         \
   const float *px = ((float *)in) + (size_t)4 * j * width;                                                   \
   const float *px2;                                                                                          \
-  float *pdetail = detail + (size_t)4 * j * width;                                                           \
   float *pcoarse = out + (size_t)4 * j * width;
 
 #if defined(__SSE__)
 #define ROW_PROLOGUE_SSE                                                                                     \
   const __m128 *px = ((__m128 *)in) + (size_t)j * width;                                                     \
   const __m128 *px2;                                                                                         \
-  float *pdetail = detail + (size_t)4 * j * width;                                                           \
   float *pcoarse = out + (size_t)4 * j * width;
 #endif
 
@@ -412,28 +415,26 @@ static inline __m128 weight_sse(const __m128 *c1, const __m128 *c2, const float
 #define SUM_PIXEL_EPILOGUE                                                                                   \
   for(int c = 0; c < 4; c++) sum[c] /= wgt[c];                                                               \
                                                                                                              \
-  for(int c = 0; c < 4; c++) pdetail[c] = (px[c] - sum[c]);                                                  \
   for(int c = 0; c < 4; c++) pcoarse[c] = sum[c];                                                            \
   px += 4;                                                                                                   \
-  pdetail += 4;                                                                                              \
   pcoarse += 4;
 
 #if defined(__SSE__)
 #define SUM_PIXEL_EPILOGUE_SSE                                                                               \
   sum = _mm_div_ps(sum, wgt);                                                                                \
                                                                                                              \
-  _mm_stream_ps(pdetail, _mm_sub_ps(*px, sum));                                                              \
   _mm_stream_ps(pcoarse, sum);                                                                               \
   px++;                                                                                                      \
-  pdetail += 4;                                                                                              \
   pcoarse += 4;
 #endif
 
-typedef void((*eaw_decompose_t)(float *const out, const float *const in, float *const detail, const int scale,
-                                const float inv_sigma2, const int32_t width, const int32_t height));
+// the detail coefficients are not stored: they are in - out, and the caller
+// folds them into the output right away instead of keeping one buffer per scale.
+typedef void((*eaw_decompose_t)(float *const out, const float *const in, const int scale, const float inv_sigma2,
+                                const int32_t width, const int32_t height));
 
-static void eaw_decompose(float *const out, const float *const in, float *const detail, const int scale,
-                          const float inv_sigma2, const int32_t width, const int32_t height)
+static void eaw_decompose(float *const out, const float *const in, const int scale, const float inv_sigma2,
+                          const int32_t width, const int32_t height)
 {
   const int mult = 1 << scale;
   static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
@@ -547,8 +548,8 @@ static void eaw_decompose(float *const out, const float *const in, float *const
 #undef SUM_PIXEL_EPILOGUE
 
 #if defined(__SSE2__)
-static void eaw_decompose_sse(float *const out, const float *const in, float *const detail, const int scale,
-                              const float inv_sigma2, const int32_t width, const int32_t height)
+static void eaw_decompose_sse(float *const out, const float *const in, const int scale, const float inv_sigma2,
+                              const int32_t width, const int32_t height)
 {
   const int mult = 1 << scale;
   static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
@@ -664,11 +665,14 @@ static void eaw_decompose_sse(float *const out, const float *const in, float *co
 #undef SUM_PIXEL_EPILOGUE_SSE
 #endif
 
-typedef void((*eaw_synthesize_t)(float *const out, const float *const in, const float *const detail,
+// adds the shrunk detail of one scale to out and removes the raw detail (fine - coarse) from it.
+// out starts out as the finest scale, so after the last scale it holds the coarsest residual plus
+// all shrunk details. out may alias fine.
+typedef void((*eaw_synthesize_t)(float *const out, const float *const fine, const float *const coarse,
                                  const float *thrsf, const float *boostf, const int32_t width,
                                  const int32_t height));
 
-static void eaw_synthesize(float *const out, const float *const in, const float *const detail,
+static void eaw_synthesize(float *const out, const float *const fine, const float *const coarse,
                            const float *thrsf, const float *boostf, const int32_t width, const int32_t height)
 {
   const float threshold[4] = { thrsf[0], thrsf[1], thrsf[2], thrsf[3] };
@@ -681,15 +685,16 @@ static void eaw_synthesize(float *const out, const float *const in, const float
   {
     for(size_t c = 0; c < 4; c++)
     {
-      const float absamt = MAX(0.0f, (fabsf(detail[k + c]) - threshold[c]));
-      const float amount = copysignf(absamt, detail[k + c]);
-      out[k + c] = in[k + c] + (boost[c] * amount);
+      const float detail = fine[k + c] - coarse[k + c];
+      const float absamt = MAX(0.0f, (fabsf(detail) - threshold[c]));
+      const float amount = copysignf(absamt, detail);
+      out[k + c] += (boost[c] * amount) - detail;
     }
   }
 }
 
 #if defined(__SSE2__)
-static void eaw_synthesize_sse2(float *const out, const float *const in, const float *const detail,
+static void eaw_synthesize_sse2(float *const out, const float *const fine, const float *const coarse,
                                 const float *thrsf, const float *boostf, const int32_t width,
                                 const int32_t height)
 {
@@ -701,30 +706,47 @@ static void eaw_synthesize_sse2(float *const out, const float *const in, const f
 #endif
   for(int j = 0; j < height; j++)
   {
-    // TODO: prefetch? _mm_prefetch()
-    const __m128 *pin = (__m128 *)in + (size_t)j * width;
-    __m128 *pdetail = (__m128 *)detail + (size_t)j * width;
-    float *pout = out + (size_t)4 * j * width;
+    const __m128 *pfine = (__m128 *)fine + (size_t)j * width;
+    const __m128 *pcoarse = (__m128 *)coarse + (size_t)j * width;
+    __m128 *pout = (__m128 *)out + (size_t)j * width;
     for(int i = 0; i < width; i++)
     {
-#if 1
       const __m128i maski = _mm_set1_epi32(0x80000000u);
       const __m128 *mask = (__m128 *)&maski;
-      const __m128 absamt
-          = _mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(_mm_andnot_ps(*mask, *pdetail), threshold));
-      const __m128 amount = _mm_or_ps(_mm_and_ps(*pdetail, *mask), absamt);
-      _mm_stream_ps(pout, _mm_add_ps(*pin, _mm_mul_ps(boost, amount)));
-#endif
-      // _mm_stream_ps(pout, _mm_add_ps(*pin, *pdetail));
-      pdetail++;
-      pin++;
-      pout += 4;
+      const __m128 detail = _mm_sub_ps(*pfine, *pcoarse);
+      const __m128 absamt = _mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(_mm_andnot_ps(*mask, detail), threshold));
+      const __m128 amount = _mm_or_ps(_mm_and_ps(detail, *mask), absamt);
+      *pout = _mm_add_ps(*pout, _mm_sub_ps(_mm_mul_ps(boost, amount), detail));
+      pfine++;
+      pcoarse++;
+      pout++;
     }
   }
-  _mm_sfence();
 }
 #endif
 
+// sum of squared detail coefficients (fine - coarse) of one scale, for the bayesshrink threshold.
+static void eaw_detail_energy(const float *const fine, const float *const coarse, const size_t npixels,
+                              float sum_y2[3])
+{
+  double s0 = 0.0, s1 = 0.0, s2 = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) reduction(+ : s0, s1, s2) schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    const float d0 = fine[4 * k + 0] - coarse[4 * k + 0];
+    const float d1 = fine[4 * k + 1] - coarse[4 * k + 1];
+    const float d2 = fine[4 * k + 2] - coarse[4 * k + 2];
+    s0 += d0 * d0;
+    s1 += d1 * d1;
+    s2 += d2 * d2;
+  }
+  sum_y2[0] = s0;
+  sum_y2[1] = s1;
+  sum_y2[2] = s2;
+}
+
 // =====================================================================================
 
 static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
@@ -767,12 +789,20 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     return;
   }
 
-  float *buf[MAX_MAX_SCALE];
-  float *tmp = NULL;
-  float *buf1 = NULL, *buf2 = NULL;
-  for(int k = 0; k < max_scale; k++)
-    buf[k] = dt_alloc_align(64, (size_t)4 * sizeof(float) * npixels);
-  tmp = dt_alloc_align(64, (size_t)4 * sizeof(float) * npixels);
+  // two ping-pong buffers for the coarse scales. the details are never stored: each scale is shrunk
+  // and folded into ovoid as soon as it is known, so memory does not grow with the number of scales.
+  float *tmp[2] = { NULL, NULL };
+  for(int k = 0; k < MIN(max_scale, 2); k++)
+  {
+    tmp[k] = dt_alloc_align(64, (size_t)4 * sizeof(float) * npixels);
+    if(!tmp[k])
+    {
+      fprintf(stderr, "[denoiseprofile] failed to allocate wavelet buffers!\n");
+      dt_free_align(tmp[0]);
+      memcpy(ovoid, ivoid, npixels * 4 * sizeof(float));
+      return;
+    }
+  }
 
   const float wb[3] = { // twice as many samples in green channel:
                         2.0f * piece->pipe->dsc.processed_maximum[0] * d->strength * (in_scale * in_scale),
@@ -798,54 +828,22 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   }
 #endif
 
-  buf1 = (float *)ovoid;
-  buf2 = tmp;
+  // ovoid holds the finest scale and accumulates the result, buf1 is the current fine scale
+  const float *buf1 = (float *)ovoid;
 
   for(int scale = 0; scale < max_scale; scale++)
   {
-    const float sigma = 1.0f;
-    const float varf = sqrtf(2.0f + 2.0f * 4.0f * 4.0f + 6.0f * 6.0f) / 16.0f; // about 0.5
-    const float sigma_band = powf(varf, scale) * sigma;
-    decompose(buf2, buf1, buf[scale], scale, 1.0f / (sigma_band * sigma_band), width, height);
-// DEBUG: clean out temporary memory:
-// memset(buf1, 0, sizeof(float)*4*width*height);
-#if 0 // DEBUG: print wavelet scales:
-    if(piece->pipe->type != DT_DEV_PIXELPIPE_PREVIEW)
-    {
-      char filename[512];
-      snprintf(filename, sizeof(filename), "/tmp/coarse_%d.pfm", scale);
-      FILE *f = fopen(filename, "wb");
-      fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
-      for(size_t k = 0; k < npixels; k++)
-        fwrite(buf2+4*k, sizeof(float), 3, f);
-      fclose(f);
-      snprintf(filename, sizeof(filename), "/tmp/detail_%d.pfm", scale);
-      f = fopen(filename, "wb");
-      fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
-      for(size_t k = 0; k < npixels; k++)
-        fwrite(buf[scale]+4*k, sizeof(float), 3, f);
-      fclose(f);
-    }
-#endif
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
-  }
-
-  // now do everything backwards, so the result will end up in *ovoid
-  for(int scale = max_scale - 1; scale >= 0; scale--)
-  {
-#if 1
     // variance stabilizing transform maps sigma to unity.
     const float sigma = 1.0f;
     // it is then transformed by wavelet scales via the 5 tap a-trous filter:
     const float varf = sqrtf(2.0f + 2.0f * 4.0f * 4.0f + 6.0f * 6.0f) / 16.0f; // about 0.5
     const float sigma_band = powf(varf, scale) * sigma;
+    float *buf2 = tmp[scale & 1];
+    decompose(buf2, buf1, scale, 1.0f / (sigma_band * sigma_band), width, height);
+
     // determine thrs as bayesshrink
-    // TODO: parallelize!
-    float sum_y2[3] = { 0.0f };
-    for(size_t k = 0; k < npixels; k++)
-      for(int c = 0; c < 3; c++) sum_y2[c] += buf[scale][4 * k + c] * buf[scale][4 * k + c];
+    float sum_y2[3];
+    eaw_detail_energy(buf1, buf2, npixels, sum_y2);
 
     const float sb2 = sigma_band * sigma_band;
     const float var_y[3] = { sum_y2[0] / (npixels - 1.0f), sum_y2[1] / (npixels - 1.0f), sum_y2[2] / (npixels - 1.0f) };
@@ -854,26 +852,16 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     // add 8.0 here because it seemed a little weak
     const float adjt = 8.0f;
     const float thrs[4] = { adjt * sb2 / std_x[0], adjt * sb2 / std_x[1], adjt * sb2 / std_x[2], 0.0f };
-// const float std = (std_x[0] + std_x[1] + std_x[2])/3.0f;
-// const float thrs[4] = { adjt*sigma*sigma/std, adjt*sigma*sigma/std, adjt*sigma*sigma/std, 0.0f};
-// fprintf(stderr, "scale %d thrs %f %f %f = %f / %f %f %f \n", scale, thrs[0], thrs[1], thrs[2], sb2,
-// std_x[0], std_x[1], std_x[2]);
-#endif
     const float boost[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    // const float thrs[4] = { 0.0, 0.0, 0.0, 0.0 };
-    synthesize(buf2, buf1, buf[scale], thrs, boost, width, height);
-    // DEBUG: clean out temporary memory:
-    // memset(buf1, 0, sizeof(float)*4*width*height);
-
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
+    synthesize((float *)ovoid, buf1, buf2, thrs, boost, width, height);
+
+    buf1 = buf2;
   }
 
   backtransform((float *)ovoid, width, height, aa, bb);
 
-  for(int k = 0; k < max_scale; k++) dt_free_align(buf[k]);
-  dt_free_align(tmp);
+  dt_free_align(tmp[0]);
+  dt_free_align(tmp[1]);
 
   if(piece->pipe->mask_display) dt_iop_alpha_copy(ivoid, ovoid, width, height);
 
@@ -388,6 +388,13 @@ error:
 }
 #endif
 
+int pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_exposure_data_t *const d = (const dt_iop_exposure_data_t *const)piece->data;
+  // deflicker derives the exposure from the raw histogram on every call
+  return !d->deflicker;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const i, void *const o,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -87,6 +87,10 @@ void output_format(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_t *pipe
 void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                      const struct dt_iop_roi_t *roi_in, const struct dt_iop_roi_t *roi_out,
                      struct dt_develop_tiling_t *tiling);
+/** optional: return non-zero if process() with the params committed to piece is a pure per-pixel map from
+ * 4-channel float to 4-channel float, with no side effects besides pipe->dsc. the pixelpipe may then run it
+ * on horizontal strips, fused into one pass with adjacent point-wise modules. */
+int pointwise(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
 
 /** callback methods for gui. */
 /** synch gtk interface with gui params, if necessary. */
@@ -169,6 +173,22 @@ void process_sse2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
                   const struct dt_iop_roi_t *const roi_out);
 #endif
 
+#if defined(HAVE_AVX2_TARGET)
+/** a variant process(), that can contain AVX2 and FMA intrinsics. define it with DT_TARGET_AVX2. */
+/** can be provided by each IOP, is only called on cpus that support it. */
+void process_avx2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                  void *const o, const struct dt_iop_roi_t *const roi_in,
+                  const struct dt_iop_roi_t *const roi_out);
+#endif
+
+#if defined(HAVE_AVX512_TARGET)
+/** a variant process(), that can contain AVX-512F intrinsics. define it with DT_TARGET_AVX512. */
+/** can be provided by each IOP, is only called on cpus that support it. */
+void process_avx512(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                    void *const o, const struct dt_iop_roi_t *const roi_in,
+                    const struct dt_iop_roi_t *const roi_out);
+#endif
+
 #ifdef HAVE_OPENCL
 /** the opencl equivalent of process(). */
 int process_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in,
@@ -269,6 +269,13 @@ static void commit_params_late(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
   }
 }
 
+int pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_levels_data_t *const d = (dt_iop_levels_data_t *)piece->data;
+  // automatic mode computes its levels from the histogram of the whole input
+  return d->mode == LEVELS_MODE_MANUAL;
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
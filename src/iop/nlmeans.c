@@ -31,8 +31,12 @@
 #include <stdlib.h>
 
 #if defined(__SSE__)
+#include <emmintrin.h>
 #include <xmmintrin.h>
 #endif
+#if defined(HAVE_AVX2_TARGET)
+#include <immintrin.h>
+#endif
 
 
 #define BLOCKSIZE                                                                                            \
@@ -372,342 +376,346 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   return;
 }
 
-void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+/* The cpu version walks the output in tiles, small enough that the input, the distances and the weight sums
+ * of a tile stay in L2 while all shift vectors are run over it. For every shift the squared distances to the
+ * shifted image are summed over the patch with a box filter: vertically by sliding down the tile, then
+ * horizontally by sliding along each line. The patch window is clamped horizontally so it never leaves the
+ * image, and runs over zeros vertically, as it always did. */
+#define TILE_WIDTH 128
+#define TILE_HEIGHT 64
+
+/** d[i] = weighted squared distance of the colors of pixels a[i] and b[i] */
+typedef void (*nlmeans_dist_t)(float *const d, const float *const a, const float *const b, const int n,
+                               const float norm2[4]);
+/** adds the pixels in[i] with alpha 1, weighted by gh(dist[i]), to acc[i] */
+typedef void (*nlmeans_accu_t)(float *const acc, const float *const in, const float *const dist, const int n,
+                               const float sharpness);
+
+static void nlmeans_dist_plain(float *const d, const float *const a, const float *const b, const int n,
+                               const float norm2[4])
+{
+  for(int i = 0; i < n; i++)
+  {
+    float s = 0.0f;
+    for(int k = 0; k < 3; k++) s += (a[4 * i + k] - b[4 * i + k]) * (a[4 * i + k] - b[4 * i + k]) * norm2[k];
+    d[i] = s;
+  }
+}
+
+static void nlmeans_accu_plain(float *const acc, const float *const in, const float *const dist, const int n,
+                               const float sharpness)
 {
-  // this is called for preview and full pipe separately, each with its own pixelpipe piece.
-  // get our data struct:
-  const dt_iop_nlmeans_params_t *const d = (dt_iop_nlmeans_params_t *)piece->data;
+  for(int i = 0; i < n; i++)
+  {
+    const float w = gh(dist[i], sharpness);
+    for(int c = 0; c < 3; c++) acc[4 * i + c] += in[4 * i + c] * w;
+    acc[4 * i + 3] += w;
+  }
+}
 
-  const int ch = piece->colors;
+#if defined(__SSE__)
+static inline __m128 fast_mexp2f_sse(const __m128 x)
+{
+  const __m128 i1 = _mm_set1_ps((float)0x3f800000u); // 2^0
+  const __m128 i2 = _mm_set1_ps((float)0x3f000000u); // 2^-1
+  const __m128 k0 = _mm_add_ps(i1, _mm_mul_ps(x, _mm_sub_ps(i2, i1)));
+  const __m128 valid = _mm_cmpge_ps(k0, _mm_set1_ps((float)0x800000u));
+  return _mm_and_ps(_mm_castsi128_ps(_mm_cvttps_epi32(k0)), valid);
+}
 
-  // adjust to zoom size:
-  const int P = ceilf(d->radius * fmin(roi_in->scale, 2.0f) / fmax(piece->iscale, 1.0f)); // pixel filter size
-  const int K = ceilf(7 * fmin(roi_in->scale, 2.0f) / fmax(piece->iscale, 1.0f));         // nbhood
-  const float sharpness = 3000.0f / (1.0f + d->strength);
-  if(P < 1)
+static void nlmeans_dist_sse2(float *const d, const float *const a, const float *const b, const int n,
+                              const float norm2[4])
+{
+  const __m128 norm = _mm_set_ps(0.0f, norm2[2], norm2[1], norm2[0]);
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
   {
-    // nothing to do from this distance:
-    memcpy(ovoid, ivoid, (size_t)sizeof(float) * 4 * roi_out->width * roi_out->height);
-    return;
+    __m128 t[4];
+    for(int k = 0; k < 4; k++)
+    {
+      const __m128 diff = _mm_sub_ps(_mm_load_ps(a + 4 * (i + k)), _mm_load_ps(b + 4 * (i + k)));
+      t[k] = _mm_mul_ps(_mm_mul_ps(diff, diff), norm);
+    }
+    _MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+    _mm_storeu_ps(d + i, _mm_add_ps(_mm_add_ps(t[0], t[1]), _mm_add_ps(t[2], t[3])));
   }
+  nlmeans_dist_plain(d + i, a + 4 * i, b + 4 * i, n - i, norm2);
+}
 
-  // adjust to Lab, make L more important
-  // float max_L = 100.0f, max_C = 256.0f;
-  // float nL = 1.0f/(d->luma*max_L), nC = 1.0f/(d->chroma*max_C);
-  float max_L = 120.0f, max_C = 512.0f;
-  float nL = 1.0f / max_L, nC = 1.0f / max_C;
-  const float norm2[4] = { nL * nL, nC * nC, nC * nC, 1.0f };
+static void nlmeans_accu_sse2(float *const acc, const float *const in, const float *const dist, const int n,
+                              const float sharpness)
+{
+  const __m128 rgb = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  const __m128 alpha = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+  int i = 0;
+  for(; i + 4 <= n; i += 4)
+  {
+    const __m128 w = fast_mexp2f_sse(_mm_mul_ps(_mm_loadu_ps(dist + i), _mm_set1_ps(sharpness)));
+    const __m128 wk[4] = { _mm_shuffle_ps(w, w, _MM_SHUFFLE(0, 0, 0, 0)),
+                           _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 1, 1, 1)),
+                           _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 2, 2)),
+                           _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 3)) };
+    for(int k = 0; k < 4; k++)
+    {
+      const __m128 iv = _mm_or_ps(_mm_and_ps(_mm_load_ps(in + 4 * (i + k)), rgb), alpha);
+      _mm_store_ps(acc + 4 * (i + k), _mm_add_ps(_mm_load_ps(acc + 4 * (i + k)), _mm_mul_ps(iv, wk[k])));
+    }
+  }
+  nlmeans_accu_plain(acc + 4 * i, in + 4 * i, dist + i, n - i, sharpness);
+}
+#endif
 
-  float *Sa = dt_alloc_align(64, (size_t)sizeof(float) * roi_out->width * dt_get_num_threads());
-  // we want to sum up weights in col[3], so need to init to 0:
-  memset(ovoid, 0x0, (size_t)sizeof(float) * roi_out->width * roi_out->height * 4);
+#if defined(HAVE_AVX2_TARGET)
+static void DT_TARGET_AVX2 nlmeans_dist_avx2(float *const d, const float *const a, const float *const b,
+                                             const int n, const float norm2[4])
+{
+  const __m256 norm = _mm256_set_ps(0.0f, norm2[2], norm2[1], norm2[0], 0.0f, norm2[2], norm2[1], norm2[0]);
+  // the in-lane transpose leaves the pixels in order 0 2 4 6 1 3 5 7
+  const __m256i order = _mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0);
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+  {
+    __m256 t[4];
+    for(int k = 0; k < 4; k++)
+    {
+      const __m256 diff
+          = _mm256_sub_ps(_mm256_loadu_ps(a + 4 * (i + 2 * k)), _mm256_loadu_ps(b + 4 * (i + 2 * k)));
+      t[k] = _mm256_mul_ps(_mm256_mul_ps(diff, diff), norm);
+    }
+    const __m256 t01lo = _mm256_unpacklo_ps(t[0], t[1]);
+    const __m256 t01hi = _mm256_unpackhi_ps(t[0], t[1]);
+    const __m256 t23lo = _mm256_unpacklo_ps(t[2], t[3]);
+    const __m256 t23hi = _mm256_unpackhi_ps(t[2], t[3]);
+    const __m256 sum = _mm256_add_ps(
+        _mm256_add_ps(_mm256_shuffle_ps(t01lo, t23lo, _MM_SHUFFLE(1, 0, 1, 0)),
+                      _mm256_shuffle_ps(t01lo, t23lo, _MM_SHUFFLE(3, 2, 3, 2))),
+        _mm256_add_ps(_mm256_shuffle_ps(t01hi, t23hi, _MM_SHUFFLE(1, 0, 1, 0)),
+                      _mm256_shuffle_ps(t01hi, t23hi, _MM_SHUFFLE(3, 2, 3, 2))));
+    _mm256_storeu_ps(d + i, _mm256_permutevar8x32_ps(sum, order));
+  }
+  nlmeans_dist_plain(d + i, a + 4 * i, b + 4 * i, n - i, norm2);
+}
+
+static void DT_TARGET_AVX2 nlmeans_accu_avx2(float *const acc, const float *const in, const float *const dist,
+                                             const int n, const float sharpness)
+{
+  const __m256 i1 = _mm256_set1_ps((float)0x3f800000u); // 2^0
+  const __m256 i2 = _mm256_set1_ps((float)0x3f000000u); // 2^-1
+  const __m256 rgb = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+  const __m256 alpha = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  int i = 0;
+  for(; i + 8 <= n; i += 8)
+  {
+    // fast_mexp2f() on eight distances
+    const __m256 k0 = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_loadu_ps(dist + i), _mm256_set1_ps(sharpness)),
+                                      _mm256_sub_ps(i2, i1), i1);
+    const __m256 valid = _mm256_cmp_ps(k0, _mm256_set1_ps((float)0x800000u), _CMP_GE_OQ);
+    const __m256 w = _mm256_and_ps(_mm256_castsi256_ps(_mm256_cvttps_epi32(k0)), valid);
+    for(int k = 0; k < 4; k++)
+    {
+      // weights of pixels 2k and 2k+1, one per lane
+      const __m256 wk = _mm256_permutevar8x32_ps(
+          w, _mm256_set_epi32(2 * k + 1, 2 * k + 1, 2 * k + 1, 2 * k + 1, 2 * k, 2 * k, 2 * k, 2 * k));
+      const __m256 iv = _mm256_or_ps(_mm256_and_ps(_mm256_loadu_ps(in + 4 * (i + 2 * k)), rgb), alpha);
+      float *const a = acc + 4 * (i + 2 * k);
+      _mm256_storeu_ps(a, _mm256_fmadd_ps(iv, wk, _mm256_loadu_ps(a)));
+    }
+  }
+  nlmeans_accu_plain(acc + 4 * i, in + 4 * i, dist + i, n - i, sharpness);
+}
+#endif
+
+// per thread scratch memory of a tile, in floats: distances, vertical sums, one line of patch sums and the
+// weighted sums. each part starts on a cache line.
+static inline size_t nlmeans_dist_size(const int P)
+{
+  return ((size_t)(TILE_HEIGHT + 2 * P) * (TILE_WIDTH + 2 * P) + 15) & ~(size_t)15;
+}
+
+static inline size_t nlmeans_vert_size(const int P)
+{
+  return ((size_t)TILE_HEIGHT * (TILE_WIDTH + 2 * P) + 15) & ~(size_t)15;
+}
+
+static inline size_t nlmeans_scratch_size(const int P)
+{
+  return nlmeans_dist_size(P) + nlmeans_vert_size(P) + TILE_WIDTH + 4 * TILE_WIDTH * TILE_HEIGHT;
+}
+
+static void nlmeans_tile(const float *const in, float *const out, const int width, const int height,
+                         const int x0, const int y0, const int x1, const int y1, const int P, const int K,
+                         const float sharpness, const float norm2[4], const float weight[4],
+                         const float invert[4], float *const scratch, const nlmeans_dist_t dist,
+                         const nlmeans_accu_t accu)
+{
+  const int tw = x1 - x0;
+  const int th = y1 - y0;
+  // columns covered by the patches of the tile, with their centers clamped to the image
+  const int cx0 = CLAMPS(x0, P, width - 1 - P) - P;
+  const int cx1 = CLAMPS(x1 - 1, P, width - 1 - P) + P + 1;
+  const int dw = cx1 - cx0;
+  const int dh = th + 2 * P;
+
+  float *const D = scratch;                       // dh x dw squared distances
+  float *const V = D + nlmeans_dist_size(P);      // th x dw vertical sums
+  float *const B = V + nlmeans_vert_size(P);      // tw patch sums of one line
+  float *const acc = B + TILE_WIDTH;              // th x tw weighted sums
+  memset(acc, 0, sizeof(float) * 4 * tw * th);
 
-  // for each shift vector
   for(int kj = -K; kj <= K; kj++)
   {
+    // lines of the tile with a partner line in the image
+    const int ja = MAX(y0, -kj);
+    const int jb = MIN(y1, height - kj);
+    if(ja >= jb) continue;
+
     for(int ki = -K; ki <= K; ki++)
     {
-      int inited_slide = 0;
-// don't construct summed area tables but use sliding window! (applies to cpu version res < 1k only, or else
-// we will add up errors)
-// do this in parallel with a little threading overhead. could parallelize the outer loops with a bit more
-// memory
-#ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) firstprivate(inited_slide) shared(kj, ki, Sa)
-#endif
-      for(int j = 0; j < roi_out->height; j++)
+      const int xa = MAX(x0, -ki);
+      const int xb = MIN(x1, width - ki);
+      if(xa >= xb) continue;
+
+      // squared distances, zero where the pixel or its partner are outside the image
+      const int ia = MAX(cx0, -ki);
+      const int ib = MIN(cx1, width - ki);
+      for(int r = 0; r < dh; r++)
       {
-        if(j + kj < 0 || j + kj >= roi_out->height) continue;
-        float *S = Sa + (size_t)dt_get_thread_num() * roi_out->width;
-        const float *ins = ((float *)ivoid) + 4 * ((size_t)roi_in->width * (j + kj) + ki);
-        float *out = ((float *)ovoid) + 4 * (size_t)roi_out->width * j;
-
-        const int Pm = MIN(MIN(P, j + kj), j);
-        const int PM = MIN(MIN(P, roi_out->height - 1 - j - kj), roi_out->height - 1 - j);
-        // first line of every thread
-        // TODO: also every once in a while to assert numerical precision!
-        if(!inited_slide)
+        const int y = y0 - P + r;
+        float *const Dr = D + (size_t)r * dw;
+        if(y < 0 || y >= height || y + kj < 0 || y + kj >= height || ia >= ib)
         {
-          // sum up a line
-          memset(S, 0x0, sizeof(float) * roi_out->width);
-          for(int jj = -Pm; jj <= PM; jj++)
-          {
-            int i = MAX(0, -ki);
-            float *s = S + i;
-            const float *inp = ((float *)ivoid) + 4 * i + 4 * (size_t)roi_in->width * (j + jj);
-            const float *inps = ((float *)ivoid) + 4 * i + 4 * ((size_t)roi_in->width * (j + jj + kj) + ki);
-            const int last = roi_out->width + MIN(0, -ki);
-            for(; i < last; i++, inp += 4, inps += 4, s++)
-            {
-              for(int k = 0; k < 3; k++) s[0] += (inp[k] - inps[k]) * (inp[k] - inps[k]) * norm2[k];
-            }
-          }
-          // only reuse this if we had a full stripe
-          if(Pm == P && PM == P) inited_slide = 1;
+          memset(Dr, 0, sizeof(float) * dw);
+          continue;
         }
+        for(int i = cx0; i < ia; i++) Dr[i - cx0] = 0.0f;
+        dist(Dr + ia - cx0, in + 4 * ((size_t)width * y + ia), in + 4 * ((size_t)width * (y + kj) + ia + ki),
+             ib - ia, norm2);
+        for(int i = ib; i < cx1; i++) Dr[i - cx0] = 0.0f;
+      }
 
-        // sliding window for this line:
-        float *s = S;
-        float slide = 0.0f;
-        // sum up the first -P..P
-        for(int i = 0; i < 2 * P + 1; i++) slide += s[i];
-        for(int i = 0; i < roi_out->width; i++, s++, ins += 4, out += 4)
-        {
-          if(i - P > 0 && i + P < roi_out->width) slide += s[P] - s[-P - 1];
-          if(i + ki >= 0 && i + ki < roi_out->width)
-          {
-            const float iv[4] = { ins[0], ins[1], ins[2], 1.0f };
-#if defined(_OPENMP) && defined(OPENMP_SIMD_)
-#pragma omp SIMD()
-#endif
-            for(size_t c = 0; c < 4; c++)
-            {
-              out[c] += iv[c] * gh(slide, sharpness);
-            }
-          }
-        }
-        if(inited_slide && j + P + 1 + MAX(0, kj) < roi_out->height)
-        {
-          // sliding window in j direction:
-          int i = MAX(0, -ki);
-          s = S + i;
-          const float *inp = ((float *)ivoid) + 4 * i + 4 * (size_t)roi_in->width * (j + P + 1);
-          const float *inps = ((float *)ivoid) + 4 * i + 4 * ((size_t)roi_in->width * (j + P + 1 + kj) + ki);
-          const float *inm = ((float *)ivoid) + 4 * i + 4 * (size_t)roi_in->width * (j - P);
-          const float *inms = ((float *)ivoid) + 4 * i + 4 * ((size_t)roi_in->width * (j - P + kj) + ki);
-          const int last = roi_out->width + MIN(0, -ki);
-          for(; i < last; i++, inp += 4, inps += 4, inm += 4, inms += 4, s++)
-          {
-            float stmp = s[0];
-            for(int k = 0; k < 3; k++)
-              stmp += ((inp[k] - inps[k]) * (inp[k] - inps[k]) - (inm[k] - inms[k]) * (inm[k] - inms[k]))
-                      * norm2[k];
-            s[0] = stmp;
-          }
-        }
-        else
-          inited_slide = 0;
+      // vertical sums over the patch, sliding down the tile
+      for(int i = 0; i < dw; i++) V[i] = 0.0f;
+      for(int r = 0; r <= 2 * P; r++)
+        for(int i = 0; i < dw; i++) V[i] += D[(size_t)r * dw + i];
+      for(int j = 1; j < th; j++)
+      {
+        const float *const add = D + (size_t)(j + 2 * P) * dw;
+        const float *const sub = D + (size_t)(j - 1) * dw;
+        const float *const prev = V + (size_t)(j - 1) * dw;
+        float *const Vj = V + (size_t)j * dw;
+        for(int i = 0; i < dw; i++) Vj[i] = prev[i] + add[i] - sub[i];
+      }
+
+      // horizontal sums for all window centers, then the weighted pixels
+      const int ca = CLAMPS(xa, P, width - 1 - P);
+      const int cb = CLAMPS(xb - 1, P, width - 1 - P);
+      for(int j = ja; j < jb; j++)
+      {
+        const float *const Vj = V + (size_t)(j - y0) * dw - cx0;
+        for(int c = ca; c <= cb; c++) B[c - xa] = 0.0f;
+        for(int k = -P; k <= P; k++)
+          for(int c = ca; c <= cb; c++) B[c - xa] += Vj[c + k];
+        // pixels at the image border share the window of the first or last center
+        for(int i = xa; i < ca; i++) B[i - xa] = B[ca - xa];
+        for(int i = cb + 1; i < xb; i++) B[i - xa] = B[cb - xa];
+        accu(acc + 4 * ((size_t)(j - y0) * tw + xa - x0), in + 4 * ((size_t)width * (j + kj) + xa + ki), B,
+             xb - xa, sharpness);
       }
     }
   }
 
   // normalize and apply chroma/luma blending
-  const float weight[4] = { d->luma, d->chroma, d->chroma, 1.0f };
-  const float invert[4] = { 1.0f - d->luma, 1.0f - d->chroma, 1.0f - d->chroma, 0.0f };
-
-  const float *const in = ((const float *const)ivoid);
-  float *const out = ((float *const)ovoid);
-
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) schedule(static) collapse(2)
-#endif
-  for(size_t k = 0; k < (size_t)ch * roi_out->width * roi_out->height; k += ch)
-  {
-    for(size_t c = 0; c < 4; c++)
+  for(int j = 0; j < th; j++)
+    for(int i = 0; i < tw; i++)
     {
-      out[k + c] = (in[k + c] * invert[c]) + (out[k + c] * (weight[c] / out[k + 3]));
+      const float *const a = acc + 4 * ((size_t)j * tw + i);
+      const size_t k = 4 * ((size_t)width * (y0 + j) + x0 + i);
+      for(int c = 0; c < 4; c++) out[k + c] = in[k + c] * invert[c] + a[c] * (weight[c] / a[3]);
     }
-  }
-
-  // free shared tmp memory:
-  dt_free_align(Sa);
-
-  if(piece->pipe->mask_display) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
-#if defined(__SSE__)
-/** process, all real work is done here. */
-void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+static void nlmeans_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                            const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
+                            const dt_iop_roi_t *const roi_out, const nlmeans_dist_t dist,
+                            const nlmeans_accu_t accu)
 {
   // this is called for preview and full pipe separately, each with its own pixelpipe piece.
   // get our data struct:
-  dt_iop_nlmeans_params_t *d = (dt_iop_nlmeans_params_t *)piece->data;
+  const dt_iop_nlmeans_params_t *const d = (dt_iop_nlmeans_params_t *)piece->data;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
 
   // adjust to zoom size:
   const int P = ceilf(d->radius * fmin(roi_in->scale, 2.0f) / fmax(piece->iscale, 1.0f)); // pixel filter size
   const int K = ceilf(7 * fmin(roi_in->scale, 2.0f) / fmax(piece->iscale, 1.0f));         // nbhood
   const float sharpness = 3000.0f / (1.0f + d->strength);
-  if(P < 1)
+
+  const int tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+  const int tiles = tiles_x * ((height + TILE_HEIGHT - 1) / TILE_HEIGHT);
+  const size_t scratch_size = nlmeans_scratch_size(P);
+  // the patch has to fit into a line
+  float *const scratch = P < 1 || 2 * P >= width
+                             ? NULL
+                             : dt_alloc_align(64, sizeof(float) * scratch_size * dt_get_num_threads());
+  if(!scratch)
   {
     // nothing to do from this distance:
-    memcpy(ovoid, ivoid, (size_t)sizeof(float) * 4 * roi_out->width * roi_out->height);
+    memcpy(ovoid, ivoid, (size_t)sizeof(float) * 4 * width * height);
     return;
   }
 
   // adjust to Lab, make L more important
   // float max_L = 100.0f, max_C = 256.0f;
   // float nL = 1.0f/(d->luma*max_L), nC = 1.0f/(d->chroma*max_C);
-  float max_L = 120.0f, max_C = 512.0f;
-  float nL = 1.0f / max_L, nC = 1.0f / max_C;
+  const float max_L = 120.0f, max_C = 512.0f;
+  const float nL = 1.0f / max_L, nC = 1.0f / max_C;
   const float norm2[4] = { nL * nL, nC * nC, nC * nC, 1.0f };
+  const float weight[4] = { d->luma, d->chroma, d->chroma, 1.0f };
+  const float invert[4] = { 1.0f - d->luma, 1.0f - d->chroma, 1.0f - d->chroma, 0.0f };
 
-  float *Sa = dt_alloc_align(64, (size_t)sizeof(float) * roi_out->width * dt_get_num_threads());
-  // we want to sum up weights in col[3], so need to init to 0:
-  memset(ovoid, 0x0, (size_t)sizeof(float) * roi_out->width * roi_out->height * 4);
+  const float *const in = (const float *)ivoid;
+  float *const out = (float *)ovoid;
+  dt_dev_pixelpipe_t *const pipe = piece->pipe;
 
-  // for each shift vector
-  for(int kj = -K; kj <= K; kj++)
-  {
-    for(int ki = -K; ki <= K; ki++)
-    {
-      int inited_slide = 0;
-// don't construct summed area tables but use sliding window! (applies to cpu version res < 1k only, or else
-// we will add up errors)
-// do this in parallel with a little threading overhead. could parallelize the outer loops with a bit more
-// memory
 #ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) firstprivate(inited_slide) shared(kj, ki, Sa)
+#pragma omp parallel for default(none) shared(self) schedule(dynamic)
 #endif
-      for(int j = 0; j < roi_out->height; j++)
-      {
-        if(j + kj < 0 || j + kj >= roi_out->height) continue;
-        float *S = Sa + (size_t)dt_get_thread_num() * roi_out->width;
-        const float *ins = ((float *)ivoid) + 4 * ((size_t)roi_in->width * (j + kj) + ki);
-        float *out = ((float *)ovoid) + 4 * (size_t)roi_out->width * j;
-
-        const int Pm = MIN(MIN(P, j + kj), j);
-        const int PM = MIN(MIN(P, roi_out->height - 1 - j - kj), roi_out->height - 1 - j);
-        // first line of every thread
-        // TODO: also every once in a while to assert numerical precision!
-        if(!inited_slide)
-        {
-          // sum up a line
-          memset(S, 0x0, sizeof(float) * roi_out->width);
-          for(int jj = -Pm; jj <= PM; jj++)
-          {
-            int i = MAX(0, -ki);
-            float *s = S + i;
-            const float *inp = ((float *)ivoid) + 4 * i + 4 * (size_t)roi_in->width * (j + jj);
-            const float *inps = ((float *)ivoid) + 4 * i + 4 * ((size_t)roi_in->width * (j + jj + kj) + ki);
-            const int last = roi_out->width + MIN(0, -ki);
-            for(; i < last; i++, inp += 4, inps += 4, s++)
-            {
-              for(int k = 0; k < 3; k++) s[0] += (inp[k] - inps[k]) * (inp[k] - inps[k]) * norm2[k];
-            }
-          }
-          // only reuse this if we had a full stripe
-          if(Pm == P && PM == P) inited_slide = 1;
-        }
+  for(int t = 0; t < tiles; t++)
+  {
+    // check for cancellation between tiles, so a long run can be stopped quickly
+    if(dt_dev_pixelpipe_progress(pipe, self, (float)t / tiles)) continue;
 
-        // sliding window for this line:
-        float *s = S;
-        float slide = 0.0f;
-        // sum up the first -P..P
-        for(int i = 0; i < 2 * P + 1; i++) slide += s[i];
-        for(int i = 0; i < roi_out->width; i++)
-        {
-          if(i - P > 0 && i + P < roi_out->width) slide += s[P] - s[-P - 1];
-          if(i + ki >= 0 && i + ki < roi_out->width)
-          {
-            const __m128 iv = { ins[0], ins[1], ins[2], 1.0f };
-            _mm_store_ps(out, _mm_load_ps(out) + iv * _mm_set1_ps(gh(slide, sharpness)));
-          }
-          s++;
-          ins += 4;
-          out += 4;
-        }
-        if(inited_slide && j + P + 1 + MAX(0, kj) < roi_out->height)
-        {
-          // sliding window in j direction:
-          int i = MAX(0, -ki);
-          s = S + i;
-          const float *inp = ((float *)ivoid) + 4 * i + 4 * (size_t)roi_in->width * (j + P + 1);
-          const float *inps = ((float *)ivoid) + 4 * i + 4 * ((size_t)roi_in->width * (j + P + 1 + kj) + ki);
-          const float *inm = ((float *)ivoid) + 4 * i + 4 * (size_t)roi_in->width * (j - P);
-          const float *inms = ((float *)ivoid) + 4 * i + 4 * ((size_t)roi_in->width * (j - P + kj) + ki);
-          const int last = roi_out->width + MIN(0, -ki);
-          for(; ((intptr_t)s & 0xf) != 0 && i < last; i++, inp += 4, inps += 4, inm += 4, inms += 4, s++)
-          {
-            float stmp = s[0];
-            for(int k = 0; k < 3; k++)
-              stmp += ((inp[k] - inps[k]) * (inp[k] - inps[k]) - (inm[k] - inms[k]) * (inm[k] - inms[k]))
-                      * norm2[k];
-            s[0] = stmp;
-          }
-          /* Process most of the line 4 pixels at a time */
-          for(; i < last - 4; i += 4, inp += 16, inps += 16, inm += 16, inms += 16, s += 4)
-          {
-            __m128 sv = _mm_load_ps(s);
-            const __m128 inp1 = _mm_load_ps(inp) - _mm_load_ps(inps);
-            const __m128 inp2 = _mm_load_ps(inp + 4) - _mm_load_ps(inps + 4);
-            const __m128 inp3 = _mm_load_ps(inp + 8) - _mm_load_ps(inps + 8);
-            const __m128 inp4 = _mm_load_ps(inp + 12) - _mm_load_ps(inps + 12);
-
-            const __m128 inp12lo = _mm_unpacklo_ps(inp1, inp2);
-            const __m128 inp34lo = _mm_unpacklo_ps(inp3, inp4);
-            const __m128 inp12hi = _mm_unpackhi_ps(inp1, inp2);
-            const __m128 inp34hi = _mm_unpackhi_ps(inp3, inp4);
-
-            const __m128 inpv0 = _mm_movelh_ps(inp12lo, inp34lo);
-            sv += inpv0 * inpv0 * _mm_set1_ps(norm2[0]);
-
-            const __m128 inpv1 = _mm_movehl_ps(inp34lo, inp12lo);
-            sv += inpv1 * inpv1 * _mm_set1_ps(norm2[1]);
-
-            const __m128 inpv2 = _mm_movelh_ps(inp12hi, inp34hi);
-            sv += inpv2 * inpv2 * _mm_set1_ps(norm2[2]);
-
-            const __m128 inm1 = _mm_load_ps(inm) - _mm_load_ps(inms);
-            const __m128 inm2 = _mm_load_ps(inm + 4) - _mm_load_ps(inms + 4);
-            const __m128 inm3 = _mm_load_ps(inm + 8) - _mm_load_ps(inms + 8);
-            const __m128 inm4 = _mm_load_ps(inm + 12) - _mm_load_ps(inms + 12);
-
-            const __m128 inm12lo = _mm_unpacklo_ps(inm1, inm2);
-            const __m128 inm34lo = _mm_unpacklo_ps(inm3, inm4);
-            const __m128 inm12hi = _mm_unpackhi_ps(inm1, inm2);
-            const __m128 inm34hi = _mm_unpackhi_ps(inm3, inm4);
-
-            const __m128 inmv0 = _mm_movelh_ps(inm12lo, inm34lo);
-            sv -= inmv0 * inmv0 * _mm_set1_ps(norm2[0]);
-
-            const __m128 inmv1 = _mm_movehl_ps(inm34lo, inm12lo);
-            sv -= inmv1 * inmv1 * _mm_set1_ps(norm2[1]);
-
-            const __m128 inmv2 = _mm_movelh_ps(inm12hi, inm34hi);
-            sv -= inmv2 * inmv2 * _mm_set1_ps(norm2[2]);
-
-            _mm_store_ps(s, sv);
-          }
-          for(; i < last; i++, inp += 4, inps += 4, inm += 4, inms += 4, s++)
-          {
-            float stmp = s[0];
-            for(int k = 0; k < 3; k++)
-              stmp += ((inp[k] - inps[k]) * (inp[k] - inps[k]) - (inm[k] - inms[k]) * (inm[k] - inms[k]))
-                      * norm2[k];
-            s[0] = stmp;
-          }
-        }
-        else
-          inited_slide = 0;
-      }
-    }
+    const int x0 = (t % tiles_x) * TILE_WIDTH;
+    const int y0 = (t / tiles_x) * TILE_HEIGHT;
+    nlmeans_tile(in, out, width, height, x0, y0, MIN(x0 + TILE_WIDTH, width), MIN(y0 + TILE_HEIGHT, height), P,
+                 K, sharpness, norm2, weight, invert, scratch + scratch_size * dt_get_thread_num(), dist, accu);
   }
-  // normalize and apply chroma/luma blending
-  // bias a bit towards higher values for low input values:
-  // const __m128 weight = _mm_set_ps(1.0f, powf(d->chroma, 0.6), powf(d->chroma, 0.6), powf(d->luma, 0.6));
-  const __m128 weight = _mm_set_ps(1.0f, d->chroma, d->chroma, d->luma);
-  const __m128 invert = _mm_sub_ps(_mm_set1_ps(1.0f), weight);
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static) shared(d)
+
+  dt_free_align(scratch);
+
+  if(piece->pipe->mask_display) dt_iop_alpha_copy(ivoid, ovoid, width, height);
+}
+
+void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  nlmeans_process(self, piece, ivoid, ovoid, roi_in, roi_out, nlmeans_dist_plain, nlmeans_accu_plain);
+}
+
+#if defined(__SSE__)
+void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  nlmeans_process(self, piece, ivoid, ovoid, roi_in, roi_out, nlmeans_dist_sse2, nlmeans_accu_sse2);
+}
 #endif
-  for(int j = 0; j < roi_out->height; j++)
-  {
-    float *out = ((float *)ovoid) + 4 * (size_t)roi_out->width * j;
-    float *in = ((float *)ivoid) + 4 * (size_t)roi_out->width * j;
-    for(int i = 0; i < roi_out->width; i++)
-    {
-      _mm_store_ps(out, _mm_add_ps(_mm_mul_ps(_mm_load_ps(in), invert),
-                                   _mm_mul_ps(_mm_load_ps(out), _mm_div_ps(weight, _mm_set1_ps(out[3])))));
-      out += 4;
-      in += 4;
-    }
-  }
-  // free shared tmp memory:
-  dt_free_align(Sa);
 
-  if(piece->pipe->mask_display) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+#if defined(HAVE_AVX2_TARGET)
+void DT_TARGET_AVX2 process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                 const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
+                                 const dt_iop_roi_t *const roi_out)
+{
+  nlmeans_process(self, piece, ivoid, ovoid, roi_in, roi_out, nlmeans_dist_avx2, nlmeans_accu_avx2);
 }
 #endif
 
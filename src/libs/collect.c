@@ -1737,6 +1737,9 @@ void gui_init(dt_lib_module_t *self)
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED, G_CALLBACK(collection_updated),
                             self);
 
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_COLLECTION_IMAGES_CHANGED,
+                            G_CALLBACK(collection_updated), self);
+
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED, G_CALLBACK(filmrolls_updated),
                             self);
 
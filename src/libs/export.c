@@ -74,6 +74,68 @@ uint32_t container(dt_lib_module_t *self)
   return DT_UI_CONTAINER_PANEL_RIGHT_CENTER;
 }
 
+/** the export as set up in the module, followed by the ones from plugins/lighttable/export/variants.
+ *  variants sharing format and storage with an earlier one get their size appended to the file names.
+ *  returns NULL if one of those can't be understood, or would still be written to the same files as another. */
+static GArray *_parse_variants(const int max_width, const int max_height, const int format_index,
+                               const int storage_index)
+{
+  GArray *variants = g_array_new(FALSE, FALSE, sizeof(dt_control_export_variant_t));
+  const dt_control_export_variant_t first = { max_width, max_height, format_index, storage_index, "" };
+  g_array_append_val(variants, first);
+
+  gchar *conf = dt_conf_get_string("plugins/lighttable/export/variants");
+  gchar **entries = g_strsplit(conf ? conf : "", ";", -1);
+  g_free(conf);
+  for(gchar **entry = entries; *entry; entry++)
+  {
+    gchar *spec = g_strstrip(*entry);
+    if(!*spec) continue;
+
+    gchar **fields = g_strsplit(spec, ":", 3);
+    dt_control_export_variant_t v = { 0, 0, format_index, storage_index, "" };
+    gboolean valid = sscanf(fields[0], "%dx%d", &v.max_width, &v.max_height) == 2 && v.max_width >= 0
+                     && v.max_height >= 0;
+    if(valid && fields[1] && *fields[1])
+      valid = (v.format_index = dt_imageio_get_index_of_format(dt_imageio_get_format_by_name(fields[1]))) != -1;
+    if(valid && fields[1] && fields[2] && *fields[2])
+      valid = (v.storage_index = dt_imageio_get_index_of_storage(dt_imageio_get_storage_by_name(fields[2]))) != -1;
+    g_strfreev(fields);
+    if(valid)
+    {
+      dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(v.storage_index);
+      valid = mstorage->supported(mstorage, dt_imageio_get_format_by_index(v.format_index));
+    }
+    // all of them share the filename pattern, so another size of the same format and storage gets a suffix.
+    // only if the storage can't do that, or the size is the same too, the files would still collide.
+    for(guint k = 0; valid && k < variants->len; k++)
+    {
+      const dt_control_export_variant_t *o = &g_array_index(variants, dt_control_export_variant_t, k);
+      if(o->format_index != v.format_index || o->storage_index != v.storage_index) continue;
+      snprintf(v.suffix, sizeof(v.suffix), "_%dx%d", v.max_width, v.max_height);
+      if(!dt_imageio_get_storage_by_index(v.storage_index)->variant_suffix
+         || (o->max_width == v.max_width && o->max_height == v.max_height))
+      {
+        dt_control_log(_("export variant `%s' would overwrite another one"), spec);
+        g_strfreev(entries);
+        g_array_free(variants, TRUE);
+        return NULL;
+      }
+    }
+
+    if(!valid)
+    {
+      dt_control_log(_("invalid export variant `%s'"), spec);
+      g_strfreev(entries);
+      g_array_free(variants, TRUE);
+      return NULL;
+    }
+    g_array_append_val(variants, v);
+  }
+  g_strfreev(entries);
+  return variants;
+}
+
 static void export_button_clicked(GtkWidget *widget, gpointer user_data)
 {
   char style[128] = { 0 };
@@ -120,8 +182,21 @@ static void export_button_clicked(GtkWidget *widget, gpointer user_data)
   else
     list = dt_collection_get_selected(darktable.collection, -1);
 
-  dt_control_export(list, max_width, max_height, format_index, storage_index, high_quality, upscale,
-                    style, style_append);
+  // more sizes of the same images, all from one run of the pixelpipe
+  GArray *variants = _parse_variants(max_width, max_height, format_index, storage_index);
+  if(!variants)
+  {
+    g_list_free(list);
+    return;
+  }
+
+  if(variants->len > 1)
+    dt_control_export_variants(list, (dt_control_export_variant_t *)variants->data, variants->len, high_quality,
+                               upscale, style, style_append);
+  else
+    dt_control_export(list, max_width, max_height, format_index, storage_index, high_quality, upscale,
+                      style, style_append);
+  g_array_free(variants, TRUE);
 }
 
 static void width_changed(GtkSpinButton *spin, gpointer user_data)
@@ -329,6 +329,12 @@ static void gui_reset_wrapper(struct dt_imageio_module_storage_t *self)
       LUA_ASYNC_DONE);
 }
 
+static int concurrent_store_wrapper(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
+{
+  // the lua interpreter serializes all calls anyway
+  return 0;
+}
+
 static void gui_cleanup_wrapper(struct dt_imageio_module_storage_t *self)
 {
   self->widget = NULL;
@@ -350,6 +356,7 @@ static dt_imageio_module_storage_t ref_storage = {
   .recommended_dimension = default_dimension_wrapper,
   .store = store_wrapper,
   .finalize_store = finalize_store_wrapper,
+  .concurrent_store = concurrent_store_wrapper,
   .initialize_store = initialize_store_wrapper,
   .params_size = params_size_wrapper,
   .get_params = get_params_wrapper,
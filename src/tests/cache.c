@@ -16,13 +16,8 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-
-#define DT_UNIT_TEST
-// define dt alloc, so we don't need to include the rest of dt:
-#define dt_alloc_align(A, B) malloc(B)
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
-
-// unit test for the concurrent hopscotch hashmap and the LRU cache built on top of it.
+// unit test for the segmented LRU cache, plus a small benchmark of lock contention
+// with a growing number of threads and segments.
 #include "common/cache.h"
 #include "common/cache.c"
 
@@ -33,96 +28,146 @@
 #include <omp.h>
 #endif
 
-int32_t alloc_dummy(void *data, const uint32_t key, int32_t *cost, void **buf)
+// we don't link against the rest of dt:
+void *dt_alloc_align(size_t alignment, size_t size)
+{
+  void *ptr = NULL;
+  if(posix_memalign(&ptr, alignment, size)) return NULL;
+  return ptr;
+}
+#ifndef dt_free_align
+void dt_free_align(void *mem)
 {
-  *cost = 1; // also the default
-  *buf = (void *)(long int)key;
-  // request write lock for our buffer?
-  return 0;
+  free(mem);
 }
+#endif
 
-int main(int argc, char *arg[])
+static void alloc_dummy(void *data, dt_cache_entry_t *entry)
+{
+  uint32_t *buf = (uint32_t *)dt_alloc_align(16, sizeof(uint32_t));
+  *buf = entry->key;
+  entry->data = buf;
+  entry->data_size = sizeof(uint32_t);
+  entry->cost = 1; // also the default
+}
+
+static void cleanup_dummy(void *data, dt_cache_entry_t *entry)
+{
+  dt_free_align(entry->data);
+}
+
+static int lru_check_consistency(dt_cache_t *cache)
+{
+  int cnt = 0;
+  for(uint32_t k = 0; k < cache->num_segments; k++)
+  {
+    dt_cache_segment_t *segment = cache->segments + k;
+    const int lru_cnt = g_list_length(segment->lru);
+    assert(lru_cnt == (int)g_hash_table_size(segment->hashtable));
+    size_t cost = 0;
+    for(GList *l = segment->lru; l; l = g_list_next(l)) cost += ((dt_cache_entry_t *)l->data)->cost;
+    assert(cost == segment->cost);
+    cnt += lru_cnt;
+  }
+  return cnt;
+}
+
+static void test_concurrent_insert(const size_t quota, const uint32_t segments)
 {
   dt_cache_t cache;
-  // dt_cache_init(&cache, 110000, 16, 64, 100000);
-  // really hammer it, make quota insanely low:
-  dt_cache_init(&cache, 110000, 16, 64, 100);
+  dt_cache_init_segmented(&cache, 0, quota, segments);
   dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  dt_cache_set_cleanup_callback(&cache, cleanup_dummy, NULL);
 
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache, stderr) num_threads(16)
+#pragma omp parallel for default(none) schedule(guided) shared(cache) num_threads(16)
 #endif
-  for(int k = 0; k < 100000; k++)
+  for(int k = 1; k < 100000; k++)
   {
-    void *data = (void *)(long int)k;
-    const int size = 0; // dt_cache_size(&cache);
-    const int con1 = dt_cache_contains(&cache, k);
-    const int val1 = (int)(long int)dt_cache_read_get(&cache, k);
-    const int val2 = (int)(long int)dt_cache_read_get(&cache, k);
-    // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1, val2,
-    // con1, con2);
-    const int con2 = dt_cache_contains(&cache, k);
-    assert(con1 == 0);
-    assert(con2 == 1);
-    assert(val2 == k);
-    dt_cache_read_release(&cache, k);
-    dt_cache_read_release(&cache, k);
+    dt_cache_entry_t *entry = dt_cache_get(&cache, k, 'r');
+    const uint32_t val = *(uint32_t *)entry->data;
+    const int con = dt_cache_contains(&cache, k);
+    assert(val == k);
+    assert(con == 1);
+    (void)val;
+    (void)con;
+    dt_cache_release(&cache, entry);
   }
-  dt_cache_print_locked(&cache);
-  // fprintf(stderr, "\n");
-  fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
-
-  const int size = dt_cache_size(&cache);
-  const int lru_cnt = lru_check_consistency(&cache);
-  const int lru_cnt_r = lru_check_consistency_reverse(&cache);
-  // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-  assert(size == lru_cnt);
-  assert(lru_cnt_r == lru_cnt);
-  fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
 
+  const int cnt = lru_check_consistency(&cache);
+  fprintf(stderr, "[passed] inserting 100000 entries concurrently into %u segments, quota %zu, %d left\n",
+          cache.num_segments, quota, cnt);
   dt_cache_cleanup(&cache);
+}
 
+static void test_remove(void)
+{
+  dt_cache_t cache;
+  dt_cache_init_segmented(&cache, 0, 1000, 8);
+  dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  dt_cache_set_cleanup_callback(&cache, cleanup_dummy, NULL);
+  for(int k = 1; k <= 500; k++) dt_cache_release(&cache, dt_cache_get(&cache, k, 'w'));
+  for(int k = 1; k <= 500; k += 2) assert(dt_cache_remove(&cache, k) == 0);
+  for(int k = 1; k <= 500; k++) assert(dt_cache_contains(&cache, k) == !(k & 1));
+  assert(dt_cache_remove(&cache, 1) == 1);
+  assert(lru_check_consistency(&cache) == 250);
+  assert(dt_cache_get_cost(&cache) == 250);
+  dt_cache_gc(&cache, 0.0f);
+  assert(lru_check_consistency(&cache) == 0);
+  fprintf(stderr, "[passed] removing entries and garbage collection\n");
+  dt_cache_cleanup(&cache);
+}
 
+// the lighttable case: a working set which fits the cache, many threads asking for it in random order.
+static void bench_contention(const uint32_t segments, const int threads)
+{
+  const int working_set = 20000;
+  const int lookups = 2000000;
+  dt_cache_t cache;
+  dt_cache_init_segmented(&cache, 0, 2 * working_set, segments);
+  dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  dt_cache_set_cleanup_callback(&cache, cleanup_dummy, NULL);
 
-  {
-    // now a harder case: a cache with only one entry and a lot of threads fighting over it:
-    dt_cache_t cache2;
-    // really hammer it, make quota insanely low:
-    // capacity 1 num threads 1 cache line size 64 ignored, quota 2 (80% => 1)
-    dt_cache_init(&cache2, 1, 1, 64, 2);
-    dt_cache_set_allocate_callback(&cache2, alloc_dummy, NULL);
-
+  const double start = dt_get_wtime();
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache2, stderr) num_threads(16)
+#pragma omp parallel for default(none) schedule(static) shared(cache) num_threads(threads)
 #endif
-    for(int k = 0; k < 100000; k++)
-    {
-      void *data = (void *)(long int)k;
-      const int size = 0; // dt_cache_size(&cache);
-      const int con1 = dt_cache_contains(&cache2, k);
-      const int val1 = (int)(long int)dt_cache_read_get(&cache2, k);
-      const int val2 = (int)(long int)dt_cache_read_get(&cache2, k);
-      // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1,
-      // val2, con1, con2);
-      const int con2 = dt_cache_contains(&cache2, k);
-      assert(con1 == 0);
-      assert(con2 == 1);
-      assert(val2 == k);
-      dt_cache_read_release(&cache2, k);
-      dt_cache_read_release(&cache2, k);
-    }
-    dt_cache_print_locked(&cache2);
-    // fprintf(stderr, "\n");
-    fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
-
-    const int size = dt_cache_size(&cache2);
-    const int lru_cnt = lru_check_consistency(&cache2);
-    const int lru_cnt_r = lru_check_consistency_reverse(&cache2);
-    // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-    assert(size == lru_cnt);
-    assert(lru_cnt_r == lru_cnt);
-    fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
-    dt_cache_cleanup(&cache2);
+  for(int k = 0; k < lookups; k++)
+  {
+    const uint32_t key = 1 + (((uint32_t)k * 2654435761u) >> 8) % working_set;
+    dt_cache_entry_t *entry = dt_cache_get(&cache, key, 'r');
+    assert(*(uint32_t *)entry->data == key);
+    dt_cache_release(&cache, entry);
+  }
+  const double end = dt_get_wtime();
+
+  uint64_t total = 0, contended = 0;
+  for(uint32_t k = 0; k < cache.num_segments; k++)
+  {
+    total += cache.segments[k].lookups;
+    contended += cache.segments[k].contended;
+  }
+  fprintf(stderr, "[bench] %2u segments %2d threads: %6.2f Mlookups/s, %5.2f%% contended\n", cache.num_segments,
+          threads, lookups / (end - start) * 1e-6, total ? 100.0 * contended / total : 0.0);
+  dt_cache_cleanup(&cache);
+}
+
+int main(int argc, char *arg[])
+{
+  // really hammer it, make quota insanely low:
+  test_concurrent_insert(100, 1);
+  test_concurrent_insert(100, 16);
+  // a cache with only one entry and a lot of threads fighting over it:
+  test_concurrent_insert(2, 1);
+  test_concurrent_insert(100000, 16);
+  test_remove();
+
+  if(argc > 1 && !strcmp(arg[1], "--bench"))
+  {
+    const uint32_t segments[] = { 1, 4, 16, 64 };
+    const int threads[] = { 1, 2, 4, 8, 16, 32 };
+    for(int s = 0; s < sizeof(segments) / sizeof(segments[0]); s++)
+      for(int t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) bench_contention(segments[s], threads[t]);
   }
 
   exit(0);
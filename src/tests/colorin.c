@@ -0,0 +1,129 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2011 johannes hanika.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for the colorin color matrix kernels: the avx2 and avx-512 versions have to give the same
+// result as the plain code, on buffers which are only 16-byte aligned like the ones the pixelpipe hands out.
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// we don't link against the rest of dt:
+#if defined(HAVE_AVX2_TARGET)
+#define DT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#if defined(HAVE_AVX512_TARGET)
+#define DT_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+#include "iop/colorin_cmatrix.h"
+
+// sRGB to XYZ D50, and a narrower clipping space with its way back
+static const float cmatrix[9] = { 0.4360747f, 0.3850649f, 0.1430804f, 0.2225045f, 0.7168786f,
+                                  0.0606169f, 0.0139322f, 0.0971045f, 0.7141733f };
+static const float nmatrix[9] = { 1.2f, -0.15f, -0.05f, -0.1f, 1.1f, 0.0f, 0.02f, -0.08f, 1.06f };
+static const float lmatrix[9] = { 0.36f, 0.32f, 0.12f, 0.18f, 0.6f, 0.05f, 0.01f, 0.08f, 0.6f };
+
+typedef void (*kernel_t)(const float *const m, const float *const lmat, const int clipping,
+                         const float *const in, float *const out, const size_t npixels);
+
+// 16 bytes off a 64-byte boundary, so neither 32 nor 64-byte aligned accesses would be legal
+static float *alloc_misaligned(const size_t floats, void **mem)
+{
+  if(posix_memalign(mem, 64, sizeof(float) * floats + 16)) return NULL;
+  return (float *)((char *)*mem + 16);
+}
+
+static void fill(float *const buf, const size_t npixels)
+{
+  uint32_t seed = 0x12345678u;
+  for(size_t k = 0; k < 4 * npixels; k++)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    // mostly [0, 1], some out of gamut values on both sides, some exact zeros
+    buf[k] = (k % 17 == 0) ? 0.0f : (seed >> 8) / (float)(1 << 24) * 1.4f - 0.2f;
+  }
+}
+
+static int test_kernel(const char *name, kernel_t kernel, const int clipping, const size_t npixels)
+{
+  void *in_mem, *plain_mem, *simd_mem;
+  float *in = alloc_misaligned(4 * npixels, &in_mem);
+  float *plain = alloc_misaligned(4 * npixels, &plain_mem);
+  // one pixel of canary past the end, masked stores must not touch it
+  float *simd = alloc_misaligned(4 * npixels + 4, &simd_mem);
+  fill(in, npixels);
+  for(size_t k = 0; k < 4 * npixels + 4; k++) simd[k] = -1234.0f;
+
+  for(size_t k = 0; k < npixels; k++)
+  {
+    if(clipping)
+      _cmatrix_clipping_to_Lab(nmatrix, lmatrix, in + 4 * k, plain + 4 * k);
+    else
+      _cmatrix_to_Lab(cmatrix, in + 4 * k, plain + 4 * k);
+  }
+  kernel(clipping ? nmatrix : cmatrix, lmatrix, clipping, in, simd, npixels);
+
+  // fma and the different evaluation order allow for some rounding, nothing more
+  float deviation = 0.0f;
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 3; c++) deviation = fmaxf(deviation, fabsf(simd[4 * k + c] - plain[4 * k + c]));
+  int canary = 1;
+  for(size_t k = 4 * npixels; k < 4 * npixels + 4; k++) canary &= simd[k] == -1234.0f;
+
+  const int ok = deviation < 1e-3f && canary;
+  fprintf(stderr, "[%s] %s, %s, %zu pixels: max deviation %g%s\n", ok ? "passed" : "FAILED", name,
+          clipping ? "clipping" : "simple", npixels, deviation, canary ? "" : ", wrote past the end");
+
+  free(in_mem);
+  free(plain_mem);
+  free(simd_mem);
+  return ok;
+}
+
+static int test_all(const char *name, kernel_t kernel)
+{
+  // odd counts hit the avx2 single pixel tail, anything not a multiple of 4 the avx-512 masked block
+  const size_t sizes[] = { 1, 2, 3, 4, 5, 7, 8, 1001, 4096 };
+  int ok = 1;
+  for(int clipping = 0; clipping < 2; clipping++)
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) ok &= test_kernel(name, kernel, clipping, sizes[s]);
+  return ok;
+}
+
+int main(int argc, char *arg[])
+{
+  int ok = 1;
+  __builtin_cpu_init();
+#if defined(HAVE_AVX2_TARGET)
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    ok &= test_all("avx2", _cmatrix_to_Lab_avx2);
+  else
+    fprintf(stderr, "[skipped] avx2, not supported by this cpu\n");
+#endif
+#if defined(HAVE_AVX512_TARGET)
+  if(__builtin_cpu_supports("avx512f"))
+    ok &= test_all("avx512", _cmatrix_to_Lab_avx512);
+  else
+    fprintf(stderr, "[skipped] avx512, not supported by this cpu\n");
+#endif
+  exit(ok ? 0 : 1);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
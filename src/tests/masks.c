@@ -0,0 +1,404 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2011 johannes hanika.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// unit test for the banded rasterization of brush and path masks: binning segments into bands, and the
+// banded brush falloff and path fill checked to be bit identical to drawing the whole roi in one go, the way
+// it was done before there were bands.
+#include "develop/masks/raster.c"
+
+#include <assert.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t seed = 0x2545f491u;
+static int rnd(const int lo, const int hi) // [lo, hi]
+{
+  seed = seed * 1664525u + 1013904223u;
+  return lo + (int)((seed >> 8) % (uint32_t)(hi - lo + 1));
+}
+
+// ---- the serial code as it was before the bands, the reference ----
+
+static void ref_brush_falloff_roi(float *buffer, const int *p0, const int *p1, int bw, int bh, float hardness,
+                                  float density)
+{
+  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
+  const int solid = hardness * l;
+
+  const float lx = (float)(p1[0] - p0[0]) / (float)l;
+  const float ly = (float)(p1[1] - p0[1]) / (float)l;
+
+  const int dx = lx <= 0 ? -1 : 1;
+  const int dy = ly <= 0 ? -1 : 1;
+  const int dpx = dx;
+  const int dpy = dy * bw;
+
+  float fx = p0[0];
+  float fy = p0[1];
+
+  float op = density;
+  float dop = density / (float)(l - solid);
+
+  for(int i = 0; i < l; i++)
+  {
+    const int x = fx;
+    const int y = fy;
+
+    fx += lx;
+    fy += ly;
+    if(i > solid) op -= dop;
+
+    if(x < 0 || x >= bw || y < 0 || y >= bh) continue;
+
+    float *buf = buffer + (size_t)y * bw + x;
+
+    *buf = fmaxf(*buf, op);
+    if(x + dx >= 0 && x + dx < bw) buf[dpx] = fmaxf(buf[dpx], op);
+    if(y + dy >= 0 && y + dy < bh) buf[dpy] = fmaxf(buf[dpy], op);
+  }
+}
+
+static void ref_path_falloff_roi(float *buffer, const int *p0, const int *p1, int bw, int bh)
+{
+  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
+
+  const float lx = p1[0] - p0[0];
+  const float ly = p1[1] - p0[1];
+
+  const int dx = lx < 0 ? -1 : 1;
+  const int dy = ly < 0 ? -1 : 1;
+  const int dpy = dy * bw;
+
+  for(int i = 0; i < l; i++)
+  {
+    const int x = (int)((float)i * lx / (float)l) + p0[0];
+    const int y = (int)((float)i * ly / (float)l) + p0[1];
+    const float op = 1.0 - (float)i / (float)l;
+    float *buf = buffer + (size_t)y * bw + x;
+    if(x >= 0 && x < bw && y >= 0 && y < bh) buf[0] = fmaxf(buf[0], op);
+    if(x + dx >= 0 && x + dx < bw && y >= 0 && y < bh) buf[dx] = fmaxf(buf[dx], op);
+    if(x >= 0 && x < bw && y + dy >= 0 && y + dy < bh) buf[dpy] = fmaxf(buf[dpy], op);
+  }
+}
+
+static void ref_path_fill(float *buffer, const int width, const int height, const float *cpoints,
+                          const int first, const int points_count, float xmin, float xmax, float ymin,
+                          float ymax, const int *seg, const int count)
+{
+  if(cpoints)
+  {
+    float xlast = cpoints[(points_count - 1) * 2];
+    float ylast = cpoints[(points_count - 1) * 2 + 1];
+
+    for(int i = first; i < points_count; i++)
+    {
+      float xstart = xlast;
+      float ystart = ylast;
+
+      float xend = xlast = cpoints[i * 2];
+      float yend = ylast = cpoints[i * 2 + 1];
+
+      if(ystart > yend)
+      {
+        float tmp;
+        tmp = ystart, ystart = yend, yend = tmp;
+        tmp = xstart, xstart = xend, xend = tmp;
+      }
+
+      const float m = (xstart - xend) / (ystart - yend);
+
+      for(int yy = (int)ceilf(ystart); (float)yy < yend; yy++)
+      {
+        const float xcross = xstart + m * (yy - ystart);
+
+        int xx = floorf(xcross);
+        if((float)xx + 0.5f <= xcross) xx++;
+
+        if(xx < 0 || xx >= width || yy < 0 || yy >= height) continue;
+
+        size_t index = (size_t)yy * width + xx;
+
+        buffer[index] = 1.0f - buffer[index];
+      }
+    }
+
+    for(int yy = ymin; yy <= ymax; yy++)
+    {
+      int state = 0;
+      for(int xx = xmin; xx <= xmax; xx++)
+      {
+        size_t index = (size_t)yy * width + xx;
+        float v = buffer[index];
+        if(v > 0.5f) state = !state;
+        if(state) buffer[index] = 1.0f;
+      }
+    }
+  }
+
+  for(int k = 0; k < count; k++) ref_path_falloff_roi(buffer, seg + 4 * k, seg + 4 * k + 2, width, height);
+}
+
+// ---- binning ----
+
+static void check_bins(const int *ymin, const int *ymax, const int count, const int height, const int band_height)
+{
+  int *offsets, *index;
+  const int nbands = dt_masks_bin_segments(ymin, ymax, count, height, band_height, &offsets, &index);
+  assert(nbands == (height + band_height - 1) / band_height);
+  assert(offsets[0] == 0);
+  for(int b = 0; b < nbands; b++)
+  {
+    const int y0 = b * band_height;
+    const int y1 = MIN(y0 + band_height, height) - 1;
+    // exactly the segments reaching into rows y0 .. y1, in their original order
+    int e = offsets[b];
+    for(int k = 0; k < count; k++)
+      if(ymin[k] <= y1 && ymax[k] >= y0)
+      {
+        assert(e < offsets[b + 1]);
+        assert(index[e] == k);
+        e++;
+      }
+    assert(e == offsets[b + 1]);
+  }
+  free(offsets);
+  free(index);
+}
+
+static void test_bin_segments(void)
+{
+  int *offsets, *index;
+
+  // nothing to bin into
+  assert(dt_masks_bin_segments(NULL, NULL, 0, 0, 10, &offsets, &index) == 0);
+  assert(!offsets && !index);
+  assert(dt_masks_bin_segments(NULL, NULL, 0, 100, 0, &offsets, &index) == 0);
+
+  // no segments: all bands there, all empty
+  assert(dt_masks_bin_segments(NULL, NULL, 0, 100, 10, &offsets, &index) == 10);
+  for(int b = 0; b <= 10; b++) assert(offsets[b] == 0);
+  free(offsets);
+  free(index);
+
+  // segments ending and starting right on the band edges, the last band only partly used (height 95)
+  {
+    const int ymin[] = { 9, 10, 9, 0, 94, 90, 19, 20 };
+    const int ymax[] = { 9, 10, 10, 0, 94, 94, 19, 29 };
+    check_bins(ymin, ymax, 8, 95, 10);
+    assert(dt_masks_bin_segments(ymin, ymax, 8, 95, 10, &offsets, &index) == 10);
+    // band 0: 9..9, 9..10, 0..0, band 1: 10..10, 9..10, 19..19
+    assert(offsets[1] == 3 && index[0] == 0 && index[1] == 2 && index[2] == 3);
+    assert(offsets[2] - offsets[1] == 3 && index[3] == 1 && index[4] == 2 && index[5] == 6);
+    // band 2 only has 20..29, band 3..8 are empty, band 9 has the last two
+    assert(offsets[3] - offsets[2] == 1 && index[6] == 7);
+    for(int b = 3; b < 9; b++) assert(offsets[b + 1] == offsets[b]);
+    assert(offsets[10] - offsets[9] == 2);
+    free(offsets);
+    free(index);
+  }
+
+  // outside of the roi, or spanning it completely
+  {
+    const int ymin[] = { -20, 100, -5, -1, 99, -1000 };
+    const int ymax[] = { -1, 120, 200, 0, 99, 1000 };
+    check_bins(ymin, ymax, 6, 100, 16);
+    assert(dt_masks_bin_segments(ymin, ymax, 6, 100, 16, &offsets, &index) == 7);
+    for(int b = 0; b < 7; b++)
+      for(int e = offsets[b]; e < offsets[b + 1]; e++) assert(index[e] != 0 && index[e] != 1);
+    free(offsets);
+    free(index);
+  }
+
+  // one band, as for a single thread, and bands of one row
+  for(int run = 0; run < 200; run++)
+  {
+    const int height = rnd(1, 300);
+    const int count = rnd(0, 64);
+    int ymin[64], ymax[64];
+    for(int k = 0; k < count; k++)
+    {
+      ymin[k] = rnd(-50, height + 50);
+      ymax[k] = ymin[k] + rnd(0, 80);
+    }
+    check_bins(ymin, ymax, count, height, height);
+    check_bins(ymin, ymax, count, height, height + rnd(1, 100));
+    check_bins(ymin, ymax, count, height, 1);
+    check_bins(ymin, ymax, count, height, rnd(1, height));
+  }
+
+  fprintf(stderr, "[passed] binning segments into bands\n");
+}
+
+// ---- banded against serial rasterization ----
+
+static int band_heights(const int height, int *bh)
+{
+  int n = 0;
+  const int candidates[] = { 1, 2, 3, 7, 16, 33, height - 1, height, height + 5, dt_masks_band_height(height) };
+  for(int k = 0; k < (int)(sizeof(candidates) / sizeof(candidates[0])); k++)
+    if(candidates[k] > 0) bh[n++] = candidates[k];
+  return n;
+}
+
+// a brush stroke: a random walk, the border on both sides of it at a random radius, partly outside the roi
+static int make_brush(const int width, const int height, int *seg, float *payload, const int max)
+{
+  const int count = rnd(1, max / 2) * 2;
+  float x = rnd(-width / 4, width + width / 4), y = rnd(-height / 4, height + height / 4);
+  float dx = rnd(-3, 3), dy = rnd(-3, 3);
+  const float hardness = rnd(0, 100) / 100.0f, density = rnd(1, 100) / 100.0f;
+  for(int k = 0; k < count; k += 2)
+  {
+    dx = CLAMP(dx + rnd(-1, 1), -4, 4);
+    dy = CLAMP(dy + rnd(-1, 1), -4, 4);
+    x += dx;
+    y += dy;
+    const float r = rnd(1, 40);
+    const float n = sqrtf(dx * dx + dy * dy) + 1e-3f;
+    for(int side = 0; side < 2; side++)
+    {
+      int *s = seg + 4 * (k + side);
+      const float sign = side ? -1.0f : 1.0f;
+      s[0] = x;
+      s[1] = y;
+      s[2] = x - sign * r * dy / n;
+      s[3] = y + sign * r * dx / n;
+      payload[2 * (k + side)] = hardness;
+      payload[2 * (k + side) + 1] = density;
+    }
+  }
+  return count;
+}
+
+static void test_brush(const int runs)
+{
+  const int max = 512;
+  int *seg = malloc(sizeof(int) * 4 * max);
+  float *payload = malloc(sizeof(float) * 2 * max);
+  for(int run = 0; run < runs; run++)
+  {
+    const int width = rnd(1, 320), height = rnd(1, 240);
+    const int count = make_brush(width, height, seg, payload, max);
+    float *ref = calloc((size_t)width * height, sizeof(float));
+    float *out = malloc(sizeof(float) * width * height);
+    for(int k = 0; k < count; k++)
+      ref_brush_falloff_roi(ref, seg + 4 * k, seg + 4 * k + 2, width, height, payload[2 * k], payload[2 * k + 1]);
+
+    int bh[16];
+    const int n = band_heights(height, bh);
+    for(int b = 0; b < n; b++)
+    {
+      memset(out, 0, sizeof(float) * width * height);
+      assert(dt_masks_brush_falloff_bands(out, width, height, bh[b], seg, payload, count));
+      if(memcmp(out, ref, sizeof(float) * width * height))
+      {
+        fprintf(stderr, "[FAILED] brush %d, %dx%d, %d segments, bands of %d rows\n", run, width, height, count,
+                bh[b]);
+        exit(1);
+      }
+    }
+    free(ref);
+    free(out);
+  }
+  free(seg);
+  free(payload);
+  fprintf(stderr, "[passed] %d brush strokes drawn in bands match the serial ones\n", runs);
+}
+
+// a closed path around a center, cropped to the roi like _path_crop_to_roi() leaves it (the last row is
+// allowed one beyond), with a falloff from every point outwards
+static void test_path(const int runs)
+{
+  const int max = 400;
+  float *cpoints = malloc(sizeof(float) * 2 * max);
+  int *seg = malloc(sizeof(int) * 4 * max);
+  for(int run = 0; run < runs; run++)
+  {
+    const int width = rnd(2, 320), height = rnd(2, 240);
+    const int first = 3 * rnd(0, 4); // the corners of the form come first and aren't part of the path
+    const int points_count = first + rnd(3, max - first - 1);
+    const float cx = rnd(-width / 4, width + width / 4), cy = rnd(-height / 4, height + height / 4);
+    const float radius = rnd(2, MAX(width, height));
+    float xmin = FLT_MAX, xmax = -FLT_MAX, ymin = FLT_MAX, ymax = -FLT_MAX;
+    int count = 0;
+    for(int i = first; i < points_count; i++)
+    {
+      const float a = 6.2831853f * (i - first) / (points_count - first);
+      const float r = radius * (0.5f + rnd(0, 100) / 200.0f);
+      const float x = cx + r * cosf(a), y = cy + r * sinf(a);
+      cpoints[2 * i] = CLAMP(x, 0, width - 1);
+      cpoints[2 * i + 1] = CLAMP(y, 0, height) + (rnd(0, 1) ? 0.5f : 0.0f) * (y > 0 && y < height - 1);
+      xmin = fminf(xmin, x);
+      xmax = fmaxf(xmax, x);
+      ymin = fminf(ymin, y);
+      ymax = fmaxf(ymax, y);
+      // the falloff, as recorded by dt_path_get_mask_roi()
+      const float f = rnd(0, 30);
+      int *s = seg + 4 * count++;
+      s[0] = floorf(x + 0.5f);
+      s[1] = ceilf(y);
+      s[2] = x + f * cosf(a);
+      s[3] = y + f * sinf(a);
+    }
+    xmin = fmaxf(xmin, 0);
+    xmax = fminf(xmax, width - 1);
+    ymin = fmaxf(ymin, 0);
+    ymax = fminf(ymax, height - 1);
+    // sometimes the roi lies completely within the path, then there's nothing to fill and no falloff
+    const int encircles = rnd(0, 9) == 0;
+    const float *fill = encircles ? NULL : cpoints;
+    if(encircles) count = 0;
+
+    float *ref = calloc((size_t)width * height, sizeof(float));
+    float *out = malloc(sizeof(float) * width * height);
+    ref_path_fill(ref, width, height, fill, first, points_count, xmin, xmax, ymin, ymax, seg, count);
+
+    int bh[16];
+    const int n = band_heights(height, bh);
+    for(int b = 0; b < n; b++)
+    {
+      memset(out, 0, sizeof(float) * width * height);
+      assert(dt_masks_path_fill_bands(out, width, height, bh[b], fill, first, points_count, xmin, xmax, ymin,
+                                      ymax, seg, count));
+      if(memcmp(out, ref, sizeof(float) * width * height))
+      {
+        fprintf(stderr, "[FAILED] path %d, %dx%d, %d points, bands of %d rows\n", run, width, height,
+                points_count - first, bh[b]);
+        exit(1);
+      }
+    }
+    free(ref);
+    free(out);
+  }
+  free(cpoints);
+  free(seg);
+  fprintf(stderr, "[passed] %d paths drawn in bands match the serial ones\n", runs);
+}
+
+int main(int argc, char *arg[])
+{
+  test_bin_segments();
+  test_brush(600);
+  test_path(600);
+  exit(0);
+}
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -245,6 +245,37 @@ void expose(
     dt_pthread_mutex_unlock(mutex);
     image_surface_imgid = dev->image_storage.id;
   }
+  if(dev->image_status == DT_DEV_PIXELPIPE_RUNNING && dev->progressive.done
+     && dev->pipe->input_timestamp >= dev->preview_pipe->input_timestamp)
+  {
+    // the full pipe renders progressively: draw the bands it finished so far on top of the preview
+    mutex = &dev->pipe->backbuf_mutex;
+    dt_pthread_mutex_lock(mutex);
+    float wd = dev->progressive.width;
+    float ht = dev->progressive.height;
+    const float band_ht = dev->progressive.band_height / darktable.gui->ppd;
+    stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
+    surface = dt_cairo_image_surface_create_for_data(dev->progressive.buf, CAIRO_FORMAT_RGB24, wd, ht, stride);
+    wd /= darktable.gui->ppd;
+    ht /= darktable.gui->ppd;
+    cairo_save(cr);
+    cairo_translate(cr, .5f * (width - wd), .5f * (height - ht));
+    if(closeup)
+    {
+      cairo_scale(cr, 2.0, 2.0);
+      cairo_translate(cr, -.25f * wd, -.25f * ht);
+    }
+    for(int band = 0; band < dev->progressive.bands; band++)
+      if(dev->progressive.done & ((uint64_t)1 << band))
+        cairo_rectangle(cr, 0, band * band_ht, wd, MIN(band_ht, ht - band * band_ht));
+    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+    cairo_fill(cr);
+    cairo_restore(cr);
+    cairo_surface_destroy(surface);
+    dt_pthread_mutex_unlock(mutex);
+    image_surface_imgid = dev->image_storage.id;
+  }
   cairo_restore(cri);
 
   if(image_surface_imgid == dev->image_storage.id)
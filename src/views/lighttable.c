@@ -97,6 +97,11 @@ typedef struct dt_library_t
   int images_in_row;
   int max_rows;
 
+  /* scroll speed in thumbnails per second, and where and when we last prefetched */
+  float scroll_speed;
+  int32_t prefetch_offset;
+  double prefetch_time;
+
   uint8_t *full_res_thumb;
   int32_t full_res_thumb_id, full_res_thumb_wd, full_res_thumb_ht;
   dt_image_orientation_t full_res_thumb_orientation;
@@ -273,11 +278,39 @@ static void _view_lighttable_collection_listener_callback(gpointer instance, gpo
   _update_collected_images(self);
 }
 
+/* returns the collected image at *rowid. if that one left the collection it's the next one, or the last one when
+ * there is none after it, and *rowid is set to where it was found. -1 if the collection is empty. */
+static int _collected_image_at(int32_t *rowid)
+{
+  int imgid = -1;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT imgid, rowid FROM memory.collected_images WHERE rowid >= ?1 "
+                              "ORDER BY rowid LIMIT 1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, *rowid);
+  if(sqlite3_step(stmt) != SQLITE_ROW)
+  {
+    sqlite3_finalize(stmt);
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT imgid, rowid FROM memory.collected_images ORDER BY rowid DESC LIMIT 1", -1,
+                                &stmt, NULL);
+    if(sqlite3_step(stmt) != SQLITE_ROW)
+    {
+      sqlite3_finalize(stmt);
+      return -1;
+    }
+  }
+  imgid = sqlite3_column_int(stmt, 0);
+  *rowid = sqlite3_column_int(stmt, 1);
+  sqlite3_finalize(stmt);
+  return imgid;
+}
+
 static void _update_collected_images(dt_view_t *self)
 {
   dt_library_t *lib = (dt_library_t *)self->data;
   sqlite3_stmt *stmt;
-  int32_t min_before = 0, min_after = 0;
+  int32_t position = 0;
 
   /* check if we can get a query from collection */
   gchar *query = g_strdup(dt_collection_get_query(darktable.collection));
@@ -286,14 +319,16 @@ static void _update_collected_images(dt_view_t *self)
   // we have a new query for the collection of images to display. For speed reason we collect all images into
   // a temporary (in-memory) table (collected_images).
   //
-  // 0. get current lower rowid
+  // 0. get the position of the full preview image. the rowids have gaps where images left the collection
+  // since the last rebuild, see dt_collection_update_images()
   if (lib->full_preview_id != -1)
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT MIN(rowid) FROM memory.collected_images",
-                                -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT COUNT(*) FROM memory.collected_images WHERE rowid < ?1", -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, lib->full_preview_rowid);
     if(sqlite3_step(stmt) == SQLITE_ROW)
     {
-      min_before = sqlite3_column_int(stmt, 0);
+      position = sqlite3_column_int(stmt, 0);
     }
     sqlite3_finalize(stmt);
   }
@@ -320,31 +355,20 @@ static void _update_collected_images(dt_view_t *self)
   g_free(query);
   g_free(ins_query);
 
-  // 3. get new low-bound, then update the full preview rowid accordingly
+  // 3. show the image at the same position in full preview
   if (lib->full_preview_id != -1)
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT MIN(rowid) FROM memory.collected_images",
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT imgid, rowid FROM memory.collected_images ORDER BY rowid LIMIT 1 OFFSET ?1",
                                 -1, &stmt, NULL);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      min_after = sqlite3_column_int(stmt, 0);
-    }
-    sqlite3_finalize(stmt);
-
-    // note that this adjustement is needed as for a memory table the rowid doesn't start to 1 after the DELETE
-    // above,
-    // but rowid is incremented each time we INSERT.
-    lib->full_preview_rowid += (min_after - min_before);
-
-    char col_query[128] = { 0 };
-    snprintf(col_query, sizeof(col_query), "SELECT imgid FROM memory.collected_images WHERE rowid=%d", lib->full_preview_rowid);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), col_query, -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, position);
     if(sqlite3_step(stmt) == SQLITE_ROW)
     {
       int nid = sqlite3_column_int(stmt, 0);
+      lib->full_preview_rowid = sqlite3_column_int(stmt, 1);
       if (nid != lib->full_preview_id)
       {
-        lib->full_preview_id = sqlite3_column_int(stmt, 0);
+        lib->full_preview_id = nid;
         dt_control_set_mouse_over_id(lib->full_preview_id);
       }
     }
@@ -901,31 +925,62 @@ after_drawing:
   /* check if offset was changed and we need to prefetch thumbs */
   if(offset_changed)
   {
+    /* follow the scroll speed, smoothed over the last few offset changes */
+    const double now = dt_get_wtime();
+    const double elapsed = now - lib->prefetch_time;
+    if(elapsed > 0.0 && elapsed < 1.0)
+      lib->scroll_speed = .5f * lib->scroll_speed + .5f * (offset - lib->prefetch_offset) / elapsed;
+    else
+      lib->scroll_speed = 0.0f;
+    lib->prefetch_time = now;
+    lib->prefetch_offset = offset;
+
+    /* look ahead as far as we will scroll in about a second, at least one page and at most four, and keep
+     * half a page behind us in case of turning back */
+    const int page = max_rows * iir;
+    const int ahead = page * CLAMP(1 + (int)(fabsf(lib->scroll_speed) / page), 1, 4);
+    const int behind = (max_rows / 2 + 1) * iir;
+    const gboolean backwards = lib->scroll_speed < 0.0f;
+    const int32_t first = MAX(0, offset - (backwards ? ahead : behind));
+    const int32_t last = offset + page + (backwards ? behind : ahead);
+
     int32_t imgids_num = 0;
-    const int prefetchrows = .5 * max_rows + 1;
-    int32_t *imgids = malloc(prefetchrows * iir * sizeof(int32_t));
+    int32_t *imgids = malloc((last - first) * sizeof(int32_t));
+    int32_t *prefetch = malloc((last - first) * sizeof(int32_t));
 
     /* clear and reset main query */
     DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
     DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
 
     /* setup offest and row for prefetch */
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, offset + max_rows * iir);
-    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, prefetchrows * iir);
+    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 1, first);
+    DT_DEBUG_SQLITE3_BIND_INT(lib->statements.main_query, 2, last - first);
 
-    // prefetch jobs in inverse order: supersede previous jobs: most important last
-    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < prefetchrows * iir)
+    while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW && imgids_num < last - first)
       imgids[imgids_num++] = sqlite3_column_int(lib->statements.main_query, 0);
 
+    /* rank by distance from the viewport: visible thumbnails, then the way we are heading, then behind us */
+    int prefetch_num = 0;
+    const int end = first + imgids_num;
+    const int visible_begin = MIN(offset, end), visible_end = MIN(offset + page, end);
+    for(int k = visible_begin; k < visible_end; k++) prefetch[prefetch_num++] = imgids[k - first];
+    if(backwards)
+    {
+      for(int k = visible_begin - 1; k >= first; k--) prefetch[prefetch_num++] = imgids[k - first];
+      for(int k = visible_end; k < end; k++) prefetch[prefetch_num++] = imgids[k - first];
+    }
+    else
+    {
+      for(int k = visible_end; k < end; k++) prefetch[prefetch_num++] = imgids[k - first];
+      for(int k = visible_begin - 1; k >= first; k--) prefetch[prefetch_num++] = imgids[k - first];
+    }
+
     float imgwd = iir == 1 ? 0.97 : 0.8;
     dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, imgwd * wd,
                                                              imgwd * (iir == 1 ? height : ht));
-    while(imgids_num > 0)
-    {
-      imgids_num--;
-      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgids[imgids_num], mip, DT_MIPMAP_PREFETCH, 'r');
-    }
+    dt_mipmap_cache_prefetch(darktable.mipmap_cache, prefetch, prefetch_num, mip);
 
+    free(prefetch);
     free(imgids);
   }
 
@@ -1251,7 +1306,7 @@ static int expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int3
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), stmt_string, -1, &stmt, NULL);
 
     /* Walk through the "next" images, activate preload and find out where to go if moving */
-    int *preload_stack = malloc(preload_num * sizeof(int));
+    int32_t *preload_stack = malloc(preload_num * sizeof(int32_t));
     for(int i = 0; i < preload_num; ++i)
     {
       preload_stack[i] = -1;
@@ -1278,13 +1333,9 @@ static int expose_full_preview(dt_view_t *self, cairo_t *cr, int32_t width, int3
     if(preload)
     {
       dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, width, height);
-      /* Preload these images.
-      * The job queue is not a queue, but a stack, so we have to do it backwards.
-      * Simply swapping DESC and ASC in the SQL won't help because we rely on the LIMIT clause, and
-      * that LIMIT has to work with the "correct" sort order. One could use a subquery, but I don't
-      * think that would be terribly elegant, either. */
-      while(--count >= 0 && preload_stack[count] != -1)
-        dt_mipmap_cache_get(darktable.mipmap_cache, NULL, preload_stack[count], mip, DT_MIPMAP_PREFETCH, 'r');
+      /* Preload these images, the next one first. This also drops whatever we asked for on our way here
+       * and didn't get loaded yet. */
+      dt_mipmap_cache_prefetch(darktable.mipmap_cache, preload_stack, count, mip);
     }
 
     free(preload_stack);
@@ -1537,7 +1588,7 @@ static gboolean star_key_accel_callback(GtkAccelGroup *accel_group, GObject *acc
   dt_view_t *self = darktable.view_manager->proxy.lighttable.view;
   int num = GPOINTER_TO_INT(data);
   int32_t mouse_over_id;
-  int next_image_rowid = -1;
+  int32_t next_image_rowid = -1;
 
   dt_library_t *lib = (dt_library_t *)self->data;
   if(lib->using_arrows)
@@ -1576,29 +1627,32 @@ static gboolean star_key_accel_callback(GtkAccelGroup *accel_group, GObject *acc
     dt_ratings_apply_to_selection(num);
   else
     dt_ratings_apply_to_image(mouse_over_id, num);
-  _update_collected_images(self);
+  dt_control_queue_redraw_center();
 
-  dt_collection_update_query(darktable.collection); // update the counter
+  // the rating updated the collected images and the counter for the images it touched
   if(lib->collection_count != dt_collection_get_count(darktable.collection))
   {
     // some images disappeared from collection. Selection is now invisible.
     // lib->collection_count  --> before the rating
     // dt_collection_get_count(darktable.collection)  --> after the rating
     dt_selection_clear(darktable.selection);
-    if(lib->using_arrows)
+    if(lib->using_arrows && next_image_rowid != -1)
     {
       // Jump where stored before
-      sqlite3_stmt *stmt;
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                  "SELECT imgid FROM memory.collected_images WHERE rowid=?1 OR rowid=?1 - 1 "
-                                  "ORDER BY rowid DESC LIMIT 1", -1, &stmt,
-                                  NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, next_image_rowid);
-      if(sqlite3_step(stmt) == SQLITE_ROW)
-        mouse_over_id = sqlite3_column_int(stmt, 0);
-      sqlite3_finalize(stmt);
+      const int imgid = _collected_image_at(&next_image_rowid);
+      if(imgid > 0) mouse_over_id = imgid;
       dt_control_set_mouse_over_id(mouse_over_id);
     }
+    if(lib->full_preview_id != -1)
+    {
+      // the image in full preview may have left the collection, go on with the one which took its place
+      const int imgid = _collected_image_at(&lib->full_preview_rowid);
+      if(imgid > 0 && imgid != lib->full_preview_id)
+      {
+        lib->full_preview_id = imgid;
+        dt_control_set_mouse_over_id(lib->full_preview_id);
+      }
+    }
   }
   return TRUE;
 }
@@ -1876,7 +1930,8 @@ int button_pressed(dt_view_t *self, double x, double y, double pressure, int whi
         }
         else
           dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
-        _update_collected_images(self);
+        dt_collection_update_image(darktable.collection, mouse_over_id, DT_COLLECTION_SORT_RATING);
+        dt_control_queue_redraw_center();
         break;
       }
       case DT_VIEW_GROUP:
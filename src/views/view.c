@@ -1608,18 +1608,20 @@ void dt_view_filmstrip_prefetch()
     offset = dt_collection_image_offset(imgid);
   }
 
+  // only get one more image, the one we will most likely step to next
+  const gboolean backwards = offset < darktable.view_manager->filmstrip_prefetch_offset && offset > 0;
+  darktable.view_manager->filmstrip_prefetch_offset = offset;
+
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-  // only get one more image:
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + 1);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset + 2);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const uint32_t prefetchid = sqlite3_column_int(stmt, 0);
-    // dt_control_log("prefetching image %u", prefetchid);
-    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
-  }
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, backwards ? offset - 1 : offset + 1);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
+  int32_t prefetchid = 0;
+  if(sqlite3_step(stmt) == SQLITE_ROW) prefetchid = sqlite3_column_int(stmt, 0);
   sqlite3_finalize(stmt);
+
+  // also drops the full size image of a neighbour we have already skipped past, if it is still queued
+  dt_mipmap_cache_prefetch(darktable.mipmap_cache, &prefetchid, prefetchid > 0 ? 1 : 0, DT_MIPMAP_FULL);
 }
 
 void dt_view_manager_view_toolbox_add(dt_view_manager_t *vm, GtkWidget *tool, dt_view_type_flags_t views)
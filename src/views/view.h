@@ -189,6 +189,9 @@ typedef struct dt_view_manager_t
     sqlite3_stmt *get_grouped;
   } statements;
 
+  /* offset of the image the filmstrip last prefetched around, tells which way we are going */
+  int32_t filmstrip_prefetch_offset;
+
 
   /*
    * Proxy